@@ -0,0 +1,1106 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+/* load generator for dealers and bots
+
+   plays many connections at once from a single poll loop, each with a
+   simple policy and a think time before each action, and reports
+   throughput, latency percentiles, and error counts.  It can
+
+   - play the seats of dealers started elsewhere (players)
+   - start its own dealers, and play every seat of each (dealers)
+   - be the dealer itself, for any number of copies of a bot, playing
+     every other seat with the same policy (fake_dealer), so a bot can
+     be loaded on its own
+
+   as a player, the latency of an action is the time from sending it
+   until the dealer's next message, which is the dealer's turnaround
+   since it passes on every action at once.  As a fake dealer, it is
+   the time from sending a bot a state where it has to act until its
+   action arrives.  A hand counts once for each connection which plays
+   it, except that with dealers only seat 0 counts, so hands are the
+   dealers' hands. */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "game.h"
+#include "rng.h"
+#include "net.h"
+#include "histogram.h"
+
+
+#define DEFAULT_DEALER "./dealer"
+#define DEFAULT_TIMEOUT_MILLIS 10000
+#define DEALER_START_MICROS 10000000
+#define LOADGEN_HOST "localhost"
+
+
+enum Policy { policy_random, policy_call, policy_raise };
+
+enum ThinkType { think_none, think_fixed, think_uniform, think_exp };
+
+typedef struct {
+  enum ThinkType type;
+  double a; /* fixed time, uniform low end, or exponential mean */
+  double b; /* uniform high end */
+} ThinkTime;
+
+typedef struct {
+  ReadBuf *buf; /* NULL once the connection is closed */
+  int isDealer; /* we are the dealer, and a bot is on the other side */
+  int started; /* fake dealer has the bot's version string */
+  int countHands;
+  uint32_t handsLeft; /* fake dealer only */
+  MatchState state;
+  Action action; /* next action, waiting on its think time */
+  int64_t actAt; /* when action is due, or -1 if there is none */
+  int64_t sentAt; /* when we started waiting on the other side, or -1 */
+  int len;
+  char line[ MAX_LINE_LEN ]; /* response to send as a player, or the
+				last state sent as a fake dealer */
+} LoadConn;
+
+typedef struct {
+  Game *game;
+  enum Policy policy;
+  ThinkTime think;
+  int64_t timeoutMicros;
+  rng_state_t rng;
+
+  int numConns;
+  int maxConns;
+  int numOpen;
+  LoadConn *conns;
+
+  /* counts since the start */
+  uint64_t hands;
+  uint64_t actions;
+  uint64_t connectErrors;
+  uint64_t protocolErrors;
+  uint64_t timeouts;
+  uint64_t disconnects;
+  Histogram latency; /* microseconds */
+} LoadGen;
+
+
+static void printUsage( FILE *file )
+{
+  fprintf( file, "usage: acpc_loadgen [options] players game host port ...\n" );
+  fprintf( file, "       acpc_loadgen [options] dealers game #matches #hands\n" );
+  fprintf( file, "       acpc_loadgen [options] fake_dealer game #bots #hands [bot_exe]\n" );
+  fprintf( file, "  players connects to each port and plays that seat\n" );
+  fprintf( file, "  dealers starts the matches and plays every seat\n" );
+  fprintf( file, "  fake_dealer deals #hands to each of #bots connections, starting\n" );
+  fprintf( file, "    them as \"bot_exe host port\" if bot_exe is given\n" );
+  fprintf( file, "options:\n" );
+  fprintf( file, "  --policy [random|call|raise] how to pick actions [default random]\n" );
+  fprintf( file, "  --think [spec] time before each action, in microseconds, as\n" );
+  fprintf( file, "    0, fixed:T, uniform:LOW:HIGH, or exp:MEAN [default 0]\n" );
+  fprintf( file, "  --seconds [n] stop after n seconds [default run until done]\n" );
+  fprintf( file, "  --report [n] also report every n seconds\n" );
+  fprintf( file, "  --timeout [milliseconds] longest wait on the other side [default %d]\n",
+	   DEFAULT_TIMEOUT_MILLIS );
+  fprintf( file, "  --seed [n] seed for policies, think times, cards, and dealers\n" );
+  fprintf( file, "  --port [n] fake_dealer listens on port n [default random]\n" );
+  fprintf( file, "  --dealer [path] dealer for dealers [default %s]\n",
+	   DEFAULT_DEALER );
+}
+
+/* parse a think time specification
+   returns 0 on success, -1 on failure */
+static int parseThink( const char *spec, ThinkTime *think )
+{
+  int c;
+
+  c = -1;
+  if( !strcmp( spec, "0" ) ) {
+
+    think->type = think_none;
+    return 0;
+  } else if( sscanf( spec, "fixed:%lf%n", &think->a, &c ) >= 1 ) {
+
+    think->type = think_fixed;
+  } else if( sscanf( spec, "uniform:%lf:%lf%n",
+		     &think->a, &think->b, &c ) >= 2 ) {
+
+    think->type = think_uniform;
+    if( think->b < think->a ) {
+
+      return -1;
+    }
+  } else if( sscanf( spec, "exp:%lf%n", &think->a, &c ) >= 1 ) {
+
+    think->type = think_exp;
+  }
+
+  if( c < 0 || spec[ c ] != 0 || think->a < 0.0 ) {
+
+    return -1;
+  }
+  return 0;
+}
+
+/* draw a think time in microseconds */
+static int64_t thinkMicros( const ThinkTime *think, rng_state_t *rng )
+{
+  switch( think->type ) {
+  case think_fixed:
+
+    return (int64_t)think->a;
+
+  case think_uniform:
+
+    return (int64_t)( think->a
+		      + ( think->b - think->a ) * genrand_real1( rng ) );
+
+  case think_exp:
+
+    return (int64_t)( -think->a * log( genrand_real3( rng ) ) );
+
+  default:
+
+    return 0;
+  }
+}
+
+/* pick a valid action for the player acting in state */
+static void chooseAction( const Game *game, const State *state,
+			  const enum Policy policy, rng_state_t *rng,
+			  Action *action )
+{
+  int32_t min, max;
+  uint32_t r;
+
+  r = policy == policy_random ? genrand_int32( rng ) % 16
+    : policy == policy_raise ? 1 : 15;
+  action->size = 0;
+  action->type = a_fold;
+  if( r == 0 && isValidAction( game, state, 0, action ) ) {
+
+    return;
+  }
+  if( r < 6 && raiseIsValid( game, state, &min, &max ) ) {
+
+    action->type = a_raise;
+    if( game->bettingType == noLimitBetting ) {
+
+      action->size = policy == policy_raise ? min
+	: min + genrand_int32( rng ) % ( max - min + 1 );
+    }
+    return;
+  }
+  action->type = a_call;
+}
+
+/* add a connection on fd
+   returns the connection, or NULL on failure */
+static LoadConn *addConn( LoadGen *lg, const int fd, const int isDealer )
+{
+  int v;
+  LoadConn *conn;
+
+  if( lg->numConns == lg->maxConns ) {
+
+    lg->maxConns = lg->maxConns ? lg->maxConns * 2 : 64;
+    lg->conns = (LoadConn *)realloc( lg->conns,
+				     lg->maxConns * sizeof( LoadConn ) );
+    if( lg->conns == NULL ) {
+
+      fprintf( stderr, "ERROR: could not allocate connections\n" );
+      exit( EXIT_FAILURE );
+    }
+  }
+
+  v = 1;
+  setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, (char *)&v, sizeof( int ) );
+
+  conn = &lg->conns[ lg->numConns ];
+  memset( conn, 0, sizeof( *conn ) );
+  conn->buf = createReadBuf( fd );
+  if( conn->buf == NULL ) {
+
+    fprintf( stderr, "ERROR: could not create socket buffer\n" );
+    close( fd );
+    return NULL;
+  }
+  conn->isDealer = isDealer;
+  conn->countHands = 1;
+  conn->actAt = -1;
+  conn->sentAt = -1;
+  ++lg->numConns;
+  ++lg->numOpen;
+  return conn;
+}
+
+static void closeConn( LoadGen *lg, LoadConn *conn )
+{
+  if( conn->buf != NULL ) {
+
+    destroyReadBuf( conn->buf );
+    conn->buf = NULL;
+    --lg->numOpen;
+  }
+}
+
+/* connect to a dealer's port, and send our version string
+   returns 0 on success, -1 on failure */
+static int connectPlayer( LoadGen *lg, char *host, const char *portString,
+			  const int countHands )
+{
+  int sock, len;
+  uint16_t port;
+  LoadConn *conn;
+  char version[ MAX_LINE_LEN ];
+
+  port = 0;
+  if( !isUnixEndpoint( host )
+      && sscanf( portString, "%"SCNu16, &port ) < 1 ) {
+
+    fprintf( stderr, "ERROR: invalid port %s\n", portString );
+    exit( EXIT_FAILURE );
+  }
+  sock = connectTo( host, port );
+  if( sock < 0 ) {
+
+    ++lg->connectErrors;
+    return -1;
+  }
+  conn = addConn( lg, sock, 0 );
+  if( conn == NULL ) {
+
+    ++lg->connectErrors;
+    return -1;
+  }
+  conn->countHands = countHands;
+
+  len = snprintf( version, MAX_LINE_LEN,
+		  "VERSION:%"PRIu32".%"PRIu32".%"PRIu32"\n",
+		  VERSION_MAJOR, VERSION_MINOR, VERSION_REVISION );
+  if( putLine( conn->buf, version, len ) != len ) {
+
+    ++lg->connectErrors;
+    closeConn( lg, conn );
+    return -1;
+  }
+  return 0;
+}
+
+/* handle a line from the dealer as a player */
+static void playerLine( LoadGen *lg, LoadConn *conn, char *line,
+			const int64_t now )
+{
+  int len, r;
+
+  /* ignore comments */
+  if( line[ 0 ] == '#' || line[ 0 ] == ';' ) {
+    return;
+  }
+
+  if( conn->sentAt >= 0 ) {
+
+    histogramRecord( &lg->latency, now - conn->sentAt );
+    conn->sentAt = -1;
+  }
+
+  len = readMatchState( line, lg->game, &conn->state );
+  if( len < 0 ) {
+
+    fprintf( stderr, "ERROR: could not read state %s", line );
+    ++lg->protocolErrors;
+    closeConn( lg, conn );
+    return;
+  }
+
+  if( stateFinished( &conn->state.state ) ) {
+
+    if( conn->countHands ) {
+
+      ++lg->hands;
+    }
+    return;
+  }
+  if( currentPlayer( lg->game, &conn->state.state )
+      != conn->state.viewingPlayer ) {
+    return;
+  }
+
+  /* response is the state, a colon, and the action */
+  chooseAction( lg->game, &conn->state.state, lg->policy, &lg->rng,
+		&conn->action );
+  if( len + 3 >= MAX_LINE_LEN ) {
+
+    ++lg->protocolErrors;
+    closeConn( lg, conn );
+    return;
+  }
+  memcpy( conn->line, line, len );
+  conn->line[ len ] = ':';
+  ++len;
+  r = printAction( lg->game, &conn->action, MAX_LINE_LEN - len - 2,
+		   &conn->line[ len ] );
+  if( r < 0 ) {
+
+    ++lg->protocolErrors;
+    closeConn( lg, conn );
+    return;
+  }
+  len += r;
+  conn->line[ len ] = '\r';
+  ++len;
+  conn->line[ len ] = '\n';
+  ++len;
+  conn->len = len;
+  conn->actAt = now + thinkMicros( &lg->think, &lg->rng );
+}
+
+/* send the fake dealer's current state to the bot */
+static void sendState( LoadGen *lg, LoadConn *conn )
+{
+  int len;
+
+  len = printMatchState( lg->game, &conn->state, MAX_LINE_LEN - 2,
+			 conn->line );
+  if( len < 0 ) {
+
+    ++lg->protocolErrors;
+    closeConn( lg, conn );
+    return;
+  }
+  conn->len = len;
+  conn->line[ len ] = '\r';
+  conn->line[ len + 1 ] = '\n';
+  if( putLine( conn->buf, conn->line, len + 2 ) != len + 2 ) {
+
+    ++lg->disconnects;
+    closeConn( lg, conn );
+  }
+}
+
+/* play the fake dealer's seats, and start new hands, until the bot
+   has to act, an action is waiting on its think time, or the bot has
+   played all its hands */
+static void advanceFakeDealer( LoadGen *lg, LoadConn *conn,
+			       const int64_t now )
+{
+  uint32_t handId;
+
+  while( conn->buf != NULL ) {
+
+    if( stateFinished( &conn->state.state ) ) {
+
+      ++lg->hands;
+      --conn->handsLeft;
+      if( conn->handsLeft == 0 ) {
+	/* the bot sees the end of the match when we hang up */
+
+	closeConn( lg, conn );
+	return;
+      }
+
+      /* next hand, with the bot moving round the table */
+      handId = conn->state.state.handId + 1;
+      initState( lg->game, handId, &conn->state.state );
+      dealCards( lg->game, &lg->rng, &conn->state.state );
+      conn->state.viewingPlayer = handId % lg->game->numPlayers;
+      sendState( lg, conn );
+      continue;
+    }
+
+    if( currentPlayer( lg->game, &conn->state.state )
+	== conn->state.viewingPlayer ) {
+
+      conn->sentAt = now;
+      return;
+    }
+
+    if( conn->actAt < 0 ) {
+
+      chooseAction( lg->game, &conn->state.state, lg->policy, &lg->rng,
+		    &conn->action );
+      conn->actAt = now + thinkMicros( &lg->think, &lg->rng );
+    }
+    if( conn->actAt > now ) {
+      return;
+    }
+    conn->actAt = -1;
+    doAction( lg->game, &conn->action, &conn->state.state );
+    sendState( lg, conn );
+  }
+}
+
+/* handle a line from a bot as the fake dealer */
+static void fakeDealerLine( LoadGen *lg, LoadConn *conn, char *line,
+			    const int64_t now )
+{
+  int c;
+  Action action;
+
+  if( !conn->started ) {
+    /* any version will do, and a bot asking for binary frames gets
+       text like from any other dealer which can't do them */
+
+    if( strncmp( line, "VERSION:", 8 ) ) {
+
+      fprintf( stderr, "ERROR: expected a version string, got %s", line );
+      ++lg->protocolErrors;
+      closeConn( lg, conn );
+      return;
+    }
+    conn->started = 1;
+
+    initState( lg->game, 0, &conn->state.state );
+    dealCards( lg->game, &lg->rng, &conn->state.state );
+    conn->state.viewingPlayer = 0;
+    sendState( lg, conn );
+    advanceFakeDealer( lg, conn, now );
+    return;
+  }
+
+  /* ignore comments */
+  if( line[ 0 ] == '#' || line[ 0 ] == ';' ) {
+    return;
+  }
+
+  if( conn->sentAt < 0 ) {
+    /* not the bot's turn */
+
+    fprintf( stderr, "ERROR: unexpected message %s", line );
+    ++lg->protocolErrors;
+    return;
+  }
+
+  /* the response must repeat the state we sent */
+  if( strncmp( line, conn->line, conn->len ) || line[ conn->len ] != ':' ) {
+
+    fprintf( stderr, "ERROR: response does not match state %s", line );
+    ++lg->protocolErrors;
+    closeConn( lg, conn );
+    return;
+  }
+  c = readAction( &line[ conn->len + 1 ], lg->game, &action );
+  if( c < 0 || !isValidAction( lg->game, &conn->state.state, 1, &action ) ) {
+
+    fprintf( stderr, "ERROR: bad action %s", line );
+    ++lg->protocolErrors;
+    action.type = a_call;
+    action.size = 0;
+  }
+
+  histogramRecord( &lg->latency, now - conn->sentAt );
+  conn->sentAt = -1;
+  ++lg->actions;
+
+  doAction( lg->game, &action, &conn->state.state );
+  sendState( lg, conn );
+  advanceFakeDealer( lg, conn, now );
+}
+
+/* read all the lines waiting on a connection */
+static void readConn( LoadGen *lg, LoadConn *conn, const int64_t now )
+{
+  ssize_t r;
+  char *line;
+
+  while( conn->buf != NULL ) {
+
+    /* a timeout leaves errno alone, so only a real socket error sets it,
+       and a partial line stays buffered until the rest arrives */
+    errno = 0;
+    r = getLineView( conn->buf, &line, 0 );
+    if( r < 0 ) {
+
+      if( errno != 0 ) {
+
+	++lg->disconnects;
+	closeConn( lg, conn );
+      }
+      return;
+    }
+    if( r == 0 ) {
+      /* the other side hung up, which is only expected between hands */
+
+      if( conn->isDealer || !stateFinished( &conn->state.state ) ) {
+
+	++lg->disconnects;
+      }
+      closeConn( lg, conn );
+      return;
+    }
+
+    if( conn->isDealer ) {
+
+      fakeDealerLine( lg, conn, line, now );
+    } else {
+
+      playerLine( lg, conn, line, now );
+    }
+  }
+}
+
+/* send due actions and check for timeouts */
+static void runTimers( LoadGen *lg, LoadConn *conn, const int64_t now )
+{
+  if( conn->buf == NULL ) {
+    return;
+  }
+
+  if( conn->sentAt >= 0 && lg->timeoutMicros > 0
+      && now - conn->sentAt > lg->timeoutMicros ) {
+
+    ++lg->timeouts;
+    closeConn( lg, conn );
+    return;
+  }
+
+  if( conn->actAt < 0 || conn->actAt > now ) {
+    return;
+  }
+  if( conn->isDealer ) {
+
+    advanceFakeDealer( lg, conn, now );
+    return;
+  }
+
+  conn->actAt = -1;
+  if( putLine( conn->buf, conn->line, conn->len ) != conn->len ) {
+
+    ++lg->disconnects;
+    closeConn( lg, conn );
+    return;
+  }
+  conn->sentAt = now;
+  ++lg->actions;
+}
+
+static void printReport( FILE *file, const LoadGen *lg,
+			 const int64_t elapsedMicros )
+{
+  double seconds;
+
+  seconds = elapsedMicros > 0 ? elapsedMicros / 1e6 : 1e-6;
+  fprintf( file, "%.3f s: %d connections open, %"PRIu64" hands %.1f/s,"
+	   " %"PRIu64" actions %.1f/s\n",
+	   seconds, lg->numOpen, lg->hands, lg->hands / seconds,
+	   lg->actions, lg->actions / seconds );
+  fprintf( file, "  latency us: p50 %"PRIu64" p90 %"PRIu64" p99 %"PRIu64
+	   " p99.9 %"PRIu64" max %"PRIu64" (%"PRIu64" samples)\n",
+	   histogramValueAtPercentile( &lg->latency, 50.0 ),
+	   histogramValueAtPercentile( &lg->latency, 90.0 ),
+	   histogramValueAtPercentile( &lg->latency, 99.0 ),
+	   histogramValueAtPercentile( &lg->latency, 99.9 ),
+	   lg->latency.count ? lg->latency.max : 0, lg->latency.count );
+  fprintf( file, "  errors: connect %"PRIu64" protocol %"PRIu64
+	   " timeout %"PRIu64" disconnect %"PRIu64"\n",
+	   lg->connectErrors, lg->protocolErrors, lg->timeouts,
+	   lg->disconnects );
+  fflush( file );
+}
+
+/* start a dealer for a match between numPlayers of our connections
+   returns the dealer's pid, and sets *fromDealer to read its output,
+   or returns -1 on failure */
+static pid_t startDealer( const char *dealerPath, const char *gameFile,
+			  const int numPlayers, const char *numHands,
+			  const uint32_t seed, const int match,
+			  ReadBuf **fromDealer )
+{
+  int p, fds[ 2 ];
+  pid_t pid;
+  char name[ 32 ], seedString[ 16 ];
+  char names[ MAX_PLAYERS ][ 16 ];
+  char *argv[ MAX_PLAYERS + 8 ];
+
+  snprintf( name, sizeof( name ), "loadgen.%d", match );
+  snprintf( seedString, sizeof( seedString ), "%"PRIu32, seed );
+  argv[ 0 ] = (char *)dealerPath;
+  argv[ 1 ] = name;
+  argv[ 2 ] = (char *)gameFile;
+  argv[ 3 ] = (char *)numHands;
+  argv[ 4 ] = seedString;
+  for( p = 0; p < numPlayers; ++p ) {
+
+    snprintf( names[ p ], sizeof( names[ p ] ), "p%d", p );
+    argv[ 5 + p ] = names[ p ];
+  }
+  argv[ 5 + p ] = "-l";
+  argv[ 6 + p ] = "-q";
+  argv[ 7 + p ] = NULL;
+
+  if( pipe( fds ) < 0 ) {
+
+    fprintf( stderr, "ERROR: could not create pipe for dealer\n" );
+    return -1;
+  }
+  pid = fork();
+  if( pid < 0 ) {
+
+    fprintf( stderr, "ERROR: fork() failed\n" );
+    close( fds[ 0 ] );
+    close( fds[ 1 ] );
+    return -1;
+  }
+  if( pid == 0 ) {
+    /* child runs the dealer, with its output going to us */
+
+    close( fds[ 0 ] );
+    dup2( fds[ 1 ], STDOUT_FILENO );
+    close( fds[ 1 ] );
+    execv( dealerPath, argv );
+    fprintf( stderr, "ERROR: could not run %s\n", dealerPath );
+    exit( EXIT_FAILURE );
+  }
+
+  close( fds[ 1 ] );
+  *fromDealer = createReadBuf( fds[ 0 ] );
+  if( *fromDealer == NULL ) {
+
+    fprintf( stderr, "ERROR: could not create dealer buffer\n" );
+    close( fds[ 0 ] );
+    return -1;
+  }
+  return pid;
+}
+
+/* start a bot on the fake dealer's port
+   returns the bot's pid, or -1 on failure */
+static pid_t startBot( const char *botExe, const uint16_t port )
+{
+  pid_t pid;
+  char portString[ 8 ];
+
+  snprintf( portString, sizeof( portString ), "%"PRIu16, port );
+  pid = fork();
+  if( pid < 0 ) {
+
+    fprintf( stderr, "ERROR: fork() failed\n" );
+    return -1;
+  }
+  if( pid == 0 ) {
+
+    execl( botExe, botExe, LOADGEN_HOST, portString, NULL );
+    fprintf( stderr, "ERROR: could not run %s\n", botExe );
+    exit( EXIT_FAILURE );
+  }
+  return pid;
+}
+
+int main( int argc, char **argv )
+{
+  int i, longOpt, listenSocket, numAccepts, numPolled, numChildren;
+  int numMatches, numBots, p, r;
+  int64_t now, start, stopAt, reportAt, reportMicros, next, due;
+  uint32_t seed, numHands;
+  uint16_t listenPort;
+  pid_t *children;
+  FILE *file;
+  LoadGen lg;
+  struct pollfd *fds;
+  int *fdConn;
+  struct timespec wait;
+  struct timeval tv;
+  ReadBuf *fromDealer;
+  char *dealerPath, *mode, *line, *port;
+  double seconds;
+  static struct option longOptions[] = {
+    { "policy", 1, 0, 0 },
+    { "think", 1, 0, 0 },
+    { "seconds", 1, 0, 0 },
+    { "report", 1, 0, 0 },
+    { "timeout", 1, 0, 0 },
+    { "seed", 1, 0, 0 },
+    { "port", 1, 0, 0 },
+    { "dealer", 1, 0, 0 },
+    { 0, 0, 0, 0 }
+  };
+
+  memset( &lg, 0, sizeof( lg ) );
+  lg.policy = policy_random;
+  lg.think.type = think_none;
+  lg.timeoutMicros = (int64_t)DEFAULT_TIMEOUT_MILLIS * 1000;
+  initHistogram( &lg.latency );
+  gettimeofday( &tv, NULL );
+  seed = tv.tv_usec;
+  seconds = 0.0;
+  reportMicros = 0;
+  listenPort = 0;
+  dealerPath = DEFAULT_DEALER;
+  while( ( i = getopt_long( argc, argv, "", longOptions, &longOpt ) ) >= 0 ) {
+
+    if( i != 0 ) {
+
+      printUsage( stderr );
+      exit( EXIT_FAILURE );
+    }
+    switch( longOpt ) {
+    case 0:
+
+      if( !strcmp( optarg, "random" ) ) {
+
+	lg.policy = policy_random;
+      } else if( !strcmp( optarg, "call" ) ) {
+
+	lg.policy = policy_call;
+      } else if( !strcmp( optarg, "raise" ) ) {
+
+	lg.policy = policy_raise;
+      } else {
+
+	fprintf( stderr, "ERROR: unknown policy %s\n", optarg );
+	exit( EXIT_FAILURE );
+      }
+      break;
+
+    case 1:
+
+      if( parseThink( optarg, &lg.think ) < 0 ) {
+
+	fprintf( stderr, "ERROR: bad think time %s\n", optarg );
+	exit( EXIT_FAILURE );
+      }
+      break;
+
+    case 2:
+
+      if( sscanf( optarg, "%lf", &seconds ) < 1 || seconds <= 0.0 ) {
+
+	fprintf( stderr, "ERROR: bad number of seconds %s\n", optarg );
+	exit( EXIT_FAILURE );
+      }
+      break;
+
+    case 3:
+
+      if( sscanf( optarg, "%d", &r ) < 1 || r < 1 ) {
+
+	fprintf( stderr, "ERROR: bad report interval %s\n", optarg );
+	exit( EXIT_FAILURE );
+      }
+      reportMicros = (int64_t)r * 1000000;
+      break;
+
+    case 4:
+
+      if( sscanf( optarg, "%d", &r ) < 1 || r < 0 ) {
+
+	fprintf( stderr, "ERROR: bad timeout %s\n", optarg );
+	exit( EXIT_FAILURE );
+      }
+      lg.timeoutMicros = (int64_t)r * 1000;
+      break;
+
+    case 5:
+
+      if( sscanf( optarg, "%"SCNu32, &seed ) < 1 ) {
+
+	fprintf( stderr, "ERROR: bad seed %s\n", optarg );
+	exit( EXIT_FAILURE );
+      }
+      break;
+
+    case 6:
+
+      if( sscanf( optarg, "%"SCNu16, &listenPort ) < 1 ) {
+
+	fprintf( stderr, "ERROR: bad port %s\n", optarg );
+	exit( EXIT_FAILURE );
+      }
+      break;
+
+    case 7:
+
+      dealerPath = optarg;
+      break;
+    }
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
+
+  if( argc < 5 ) {
+
+    printUsage( stderr );
+    exit( EXIT_FAILURE );
+  }
+  mode = argv[ 1 ];
+
+  /* get the game */
+  file = fopen( argv[ 2 ], "r" );
+  if( file == NULL ) {
+
+    fprintf( stderr, "ERROR: could not open game %s\n", argv[ 2 ] );
+    exit( EXIT_FAILURE );
+  }
+  lg.game = readGame( file );
+  if( lg.game == NULL ) {
+
+    fprintf( stderr, "ERROR: could not read game %s\n", argv[ 2 ] );
+    exit( EXIT_FAILURE );
+  }
+  fclose( file );
+
+  init_genrand( &lg.rng, seed );
+
+  /* a closed connection is an error to count, not a reason to die */
+  signal( SIGPIPE, SIG_IGN );
+
+  children = (pid_t *)malloc( sizeof( pid_t ) * argc );
+  numChildren = 0;
+  listenSocket = -1;
+  numAccepts = 0;
+  numHands = 0;
+  if( !strcmp( mode, "players" ) ) {
+
+    for( i = 4; i < argc; ++i ) {
+
+      connectPlayer( &lg, argv[ 3 ], argv[ i ], 1 );
+    }
+  } else if( !strcmp( mode, "dealers" ) ) {
+
+    if( sscanf( argv[ 3 ], "%d", &numMatches ) < 1 || numMatches < 1 ) {
+
+      fprintf( stderr, "ERROR: bad number of matches %s\n", argv[ 3 ] );
+      exit( EXIT_FAILURE );
+    }
+    free( children );
+    children = (pid_t *)malloc( sizeof( pid_t ) * numMatches );
+    if( children == NULL ) {
+
+      fprintf( stderr, "ERROR: could not allocate dealers\n" );
+      exit( EXIT_FAILURE );
+    }
+
+    for( i = 0; i < numMatches; ++i ) {
+
+      children[ numChildren ] = startDealer( dealerPath, argv[ 2 ],
+					     lg.game->numPlayers, argv[ 4 ],
+					     seed + i, i, &fromDealer );
+      if( children[ numChildren ] < 0 ) {
+
+	++lg.connectErrors;
+	continue;
+      }
+      ++numChildren;
+
+      /* the dealer's first line is its ports */
+      if( getLineView( fromDealer, &line, DEALER_START_MICROS ) <= 0 ) {
+
+	fprintf( stderr, "ERROR: could not get ports from dealer %d\n", i );
+	lg.connectErrors += lg.game->numPlayers;
+	destroyReadBuf( fromDealer );
+	continue;
+      }
+      p = 0;
+      for( port = strtok( line, " \t\r\n" ); port != NULL;
+	   port = strtok( NULL, " \t\r\n" ) ) {
+
+	connectPlayer( &lg, isUnixEndpoint( port ) ? port : LOADGEN_HOST,
+		       port, p == 0 );
+	++p;
+      }
+
+      /* the dealer still writes its score, which we have no use for */
+      destroyReadBuf( fromDealer );
+    }
+  } else if( !strcmp( mode, "fake_dealer" ) ) {
+
+    if( sscanf( argv[ 3 ], "%d", &numBots ) < 1 || numBots < 1 ) {
+
+      fprintf( stderr, "ERROR: bad number of bots %s\n", argv[ 3 ] );
+      exit( EXIT_FAILURE );
+    }
+    if( sscanf( argv[ 4 ], "%"SCNu32, &numHands ) < 1 || numHands < 1 ) {
+
+      fprintf( stderr, "ERROR: bad number of hands %s\n", argv[ 4 ] );
+      exit( EXIT_FAILURE );
+    }
+    listenSocket = getListenSocket( &listenPort );
+    if( listenSocket < 0 ) {
+
+      fprintf( stderr, "ERROR: could not create listen socket\n" );
+      exit( EXIT_FAILURE );
+    }
+    printf( "%"PRIu16"\n", listenPort );
+    fflush( stdout );
+    numAccepts = numBots;
+
+    if( argc > 5 ) {
+
+      free( children );
+      children = (pid_t *)malloc( sizeof( pid_t ) * numBots );
+      if( children == NULL ) {
+
+	fprintf( stderr, "ERROR: could not allocate bots\n" );
+	exit( EXIT_FAILURE );
+      }
+      for( i = 0; i < numBots; ++i ) {
+
+	children[ numChildren ] = startBot( argv[ 5 ], listenPort );
+	if( children[ numChildren ] >= 0 ) {
+
+	  ++numChildren;
+	}
+      }
+    }
+  } else {
+
+    fprintf( stderr, "ERROR: unknown mode %s\n", mode );
+    printUsage( stderr );
+    exit( EXIT_FAILURE );
+  }
+
+  /* play until every connection is done, or time is up */
+  fds = NULL;
+  fdConn = NULL;
+  start = monotonicMicros();
+  stopAt = seconds > 0.0 ? start + (int64_t)( seconds * 1e6 ) : -1;
+  reportAt = reportMicros ? start + reportMicros : -1;
+  while( lg.numOpen > 0 || numAccepts > 0 ) {
+
+    now = monotonicMicros();
+    if( stopAt >= 0 && now >= stopAt ) {
+      break;
+    }
+    if( reportAt >= 0 && now >= reportAt ) {
+
+      printReport( stdout, &lg, now - start );
+      reportAt += reportMicros;
+    }
+
+    /* wait for the next message, or until the next thing to do */
+    fds = (struct pollfd *)realloc( fds, sizeof( struct pollfd )
+				    * ( lg.numConns + 1 ) );
+    fdConn = (int *)realloc( fdConn, sizeof( int ) * ( lg.numConns + 1 ) );
+    if( fds == NULL || fdConn == NULL ) {
+
+      fprintf( stderr, "ERROR: could not allocate poll list\n" );
+      exit( EXIT_FAILURE );
+    }
+    next = stopAt;
+    if( reportAt >= 0 && ( next < 0 || reportAt < next ) ) {
+
+      next = reportAt;
+    }
+    numPolled = 0;
+    if( numAccepts > 0 ) {
+
+      fds[ numPolled ].fd = listenSocket;
+      fds[ numPolled ].events = POLLIN;
+      fdConn[ numPolled ] = -1;
+      ++numPolled;
+    }
+    for( i = 0; i < lg.numConns; ++i ) {
+
+      if( lg.conns[ i ].buf == NULL ) {
+	continue;
+      }
+      fds[ numPolled ].fd = lg.conns[ i ].buf->fd;
+      fds[ numPolled ].events = POLLIN;
+      fdConn[ numPolled ] = i;
+      ++numPolled;
+
+      if( lg.conns[ i ].actAt >= 0
+	  && ( next < 0 || lg.conns[ i ].actAt < next ) ) {
+
+	next = lg.conns[ i ].actAt;
+      }
+      if( lg.conns[ i ].sentAt >= 0 && lg.timeoutMicros > 0 ) {
+	/* timeouts are noticed just after they pass */
+
+	due = lg.conns[ i ].sentAt + lg.timeoutMicros + 1;
+	if( next < 0 || due < next ) {
+
+	  next = due;
+	}
+      }
+    }
+    if( next >= 0 ) {
+
+      next = next > now ? next - now : 0;
+      wait.tv_sec = next / 1000000;
+      wait.tv_nsec = ( next % 1000000 ) * 1000;
+    }
+    r = ppoll( fds, numPolled, next >= 0 ? &wait : NULL, NULL );
+    if( r < 0 ) {
+
+      fprintf( stderr, "ERROR: poll failed\n" );
+      exit( EXIT_FAILURE );
+    }
+
+    now = monotonicMicros();
+    for( i = 0; i < numPolled; ++i ) {
+
+      if( !fds[ i ].revents ) {
+	continue;
+      }
+
+      if( fdConn[ i ] < 0 ) {
+	/* a bot connecting to the fake dealer */
+
+	r = accept( listenSocket, NULL, NULL );
+	if( r < 0 ) {
+
+	  ++lg.connectErrors;
+	  continue;
+	}
+	if( addConn( &lg, r, 1 ) == NULL ) {
+
+	  ++lg.connectErrors;
+	} else {
+
+	  lg.conns[ lg.numConns - 1 ].handsLeft = numHands;
+	}
+	--numAccepts;
+	continue;
+      }
+
+      readConn( &lg, &lg.conns[ fdConn[ i ] ], now );
+    }
+
+    for( i = 0; i < lg.numConns; ++i ) {
+
+      runTimers( &lg, &lg.conns[ i ], now );
+    }
+  }
+
+  printReport( stdout, &lg, monotonicMicros() - start );
+
+  /* hang up, and clean up after any dealers or bots we started */
+  for( i = 0; i < lg.numConns; ++i ) {
+
+    closeConn( &lg, &lg.conns[ i ] );
+  }
+  if( listenSocket >= 0 ) {
+
+    close( listenSocket );
+  }
+  for( i = 0; i < numChildren; ++i ) {
+
+    if( stopAt >= 0 ) {
+
+      kill( children[ i ], SIGTERM );
+    }
+    waitpid( children[ i ], NULL, 0 );
+  }
+
+  free( fds );
+  free( fdConn );
+  free( children );
+  free( lg.conns );
+  free( lg.game );
+  return lg.connectErrors || lg.protocolErrors || lg.timeouts
+    || lg.disconnects ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -16,6 +16,7 @@ Copyright (C) 2014 by the Computer Poker Research Group, University of Alberta
 #include <getopt.h>
 #include "game.h"
 #include "net.h"
+#include "match_log.h"
 
 
 void getUsedCards( const Game *game,
@@ -47,8 +48,9 @@ void getUsedCards( const Game *game,
 
 int main( int argc, char **argv )
 {
-  int stateEnd, r, i, p, deckSize, numBoards;
+  int stateEnd, r, i, p, deckSize, numBoards, part, numParts;
   FILE *file;
+  LogReader *log;
   Game *game;
   State state;
   uint8_t deck[ MAX_SUITS * MAX_RANKS ];
@@ -56,9 +58,27 @@ int main( int argc, char **argv )
   double value[ MAX_PLAYERS ];
   char line[ 4096 ];
 
+  part = 0;
+  numParts = 1;
+  while( ( r = getopt( argc, argv, "p:" ) ) != -1 ) {
+
+    if( r != 'p' || sscanf( optarg, "%d/%d", &part, &numParts ) < 2
+	|| numParts < 1 || part < 0 || part >= numParts ) {
+
+      argc = 0;
+      break;
+    }
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
+
   if( argc < 3 ) {
 
-    fprintf( stderr, "USAGE: %s game_def log_file\n", argv[ 0 ] );
+    fprintf( stderr, "USAGE: %s [-p part/parts] game_def log_file\n", argv[ 0 ] );
+    fprintf( stderr, "  the log may be plain or compressed (see match_log.h)\n" );
+    fprintf( stderr, "  -p only does part (from 0) of parts equal shares of the blocks\n" );
+    fprintf( stderr, "     of a compressed log, so parts can run at once and their\n" );
+    fprintf( stderr, "     output be joined in order.  A plain log is a single block\n" );
     exit( EXIT_FAILURE );
   }
 
@@ -78,15 +98,23 @@ int main( int argc, char **argv )
   fclose( file );
 
   /* get the log file */
-  file = fopen( argv[ 2 ], "r" );
-  if( file == NULL ) {
+  log = openLogReader( argv[ 2 ] );
+  if( log == NULL ) {
 
     fprintf( stderr, "ERROR: could not open log file %s\n", argv[ 2 ] );
     exit( EXIT_FAILURE );
   }
+  if( setLogBlockRange( log,
+			(uint64_t)log->numBlocks * part / numParts,
+			(uint64_t)log->numBlocks * ( part + 1 ) / numParts )
+      < 0 ) {
+
+    fprintf( stderr, "ERROR: could not find part %d of %s\n", part, argv[ 2 ] );
+    exit( EXIT_FAILURE );
+  }
 
   /* read every line and process all hands */
-  while( fgets( line, 4096, file ) ) {
+  while( readLogLine( log, line, 4096 ) ) {
 
     stateEnd = readState( line, game, &state );
     if( stateEnd < 0 ) {
@@ -214,6 +242,6 @@ int main( int argc, char **argv )
     }
   }
 
-  fclose( file );
+  closeLogReader( log );
   exit( EXIT_SUCCESS );
 }
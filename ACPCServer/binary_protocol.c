@@ -0,0 +1,358 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "binary_protocol.h"
+
+
+#define RESPONSE_FRAME_LEN 13
+
+
+static void put32( uint8_t *bytes, const uint32_t value )
+{
+  bytes[ 0 ] = value;
+  bytes[ 1 ] = value >> 8;
+  bytes[ 2 ] = value >> 16;
+  bytes[ 3 ] = value >> 24;
+}
+
+static uint32_t get32( const uint8_t *bytes )
+{
+  return (uint32_t)bytes[ 0 ] | (uint32_t)bytes[ 1 ] << 8
+    | (uint32_t)bytes[ 2 ] << 16 | (uint32_t)bytes[ 3 ] << 24;
+}
+
+/* returns non-zero if the hand was finished by a showdown */
+static int wentToShowdown( const Game *game, const State *state )
+{
+  return stateFinished( state )
+    && numFolded( game, state ) + 1 < game->numPlayers;
+}
+
+/* returns non-zero if viewingPlayer gets to see player's hole cards
+   at a showdown, as in the text protocol */
+static int showsCards( const State *state, const uint8_t viewingPlayer,
+		       const uint8_t player )
+{
+  return player != viewingPlayer && !state->playerFolded[ player ];
+}
+
+int makeStateFrame( const Game *game, const MatchState *state,
+		    uint8_t frame[ BINARY_MAX_FRAME_LEN ] )
+{
+  int c, i, lastRound;
+  uint8_t p;
+  const State *s = &state->state;
+
+  /* find the round of the last action, if there was one */
+  for( lastRound = s->round; lastRound >= 0; --lastRound ) {
+
+    if( s->numActions[ lastRound ] ) {
+
+      break;
+    }
+  }
+
+  if( lastRound < 0 ) {
+    /* nothing has happened yet, so this is a new hand */
+
+    frame[ 1 ] = binary_hand_start;
+    put32( &frame[ 2 ], s->handId );
+    frame[ 6 ] = state->viewingPlayer;
+    c = 7;
+    for( i = 0; i < game->numHoleCards; ++i ) {
+
+      frame[ c ] = s->holeCards[ state->viewingPlayer ][ i ];
+      ++c;
+    }
+  } else {
+
+    frame[ 1 ] = binary_action;
+    i = s->numActions[ lastRound ] - 1;
+    frame[ 2 ] = s->action[ lastRound ][ i ].type;
+    put32( &frame[ 3 ], s->action[ lastRound ][ i ].size );
+    c = 7;
+
+    /* board cards which the action revealed */
+    for( i = sumBoardCards( game, lastRound );
+	 i < sumBoardCards( game, s->round ); ++i ) {
+
+      frame[ c ] = s->boardCards[ i ];
+      ++c;
+    }
+
+    /* cards shown at a showdown, which the text protocol prints */
+    if( wentToShowdown( game, s ) ) {
+
+      for( p = 0; p < game->numPlayers; ++p ) {
+
+	if( !showsCards( s, state->viewingPlayer, p ) ) {
+	  continue;
+	}
+
+	for( i = 0; i < game->numHoleCards; ++i ) {
+
+	  frame[ c ] = s->holeCards[ p ][ i ];
+	  ++c;
+	}
+      }
+    }
+  }
+
+  if( c > BINARY_MAX_FRAME_LEN ) {
+
+    return -1;
+  }
+  frame[ 0 ] = c - 1;
+  return c;
+}
+
+int readResponseFrame( const Game *game, const uint8_t *frame,
+		       const int len, const MatchState *state,
+		       Action *action )
+{
+  if( len != RESPONSE_FRAME_LEN || frame[ 1 ] != binary_response
+      || frame[ 8 ] >= a_invalid ) {
+
+    return -1;
+  }
+
+  if( get32( &frame[ 2 ] ) != state->state.handId
+      || frame[ 6 ] != state->state.round
+      || frame[ 7 ] != state->state.numActions[ state->state.round ] ) {
+
+    return 0;
+  }
+
+  action->type = (enum ActionType)frame[ 8 ];
+  action->size = (int32_t)get32( &frame[ 9 ] );
+  return 1;
+}
+
+int requestBinaryProtocol( ReadBuf *readBuf )
+{
+  int len;
+  char version[ MAX_LINE_LEN ];
+
+  len = snprintf( version, MAX_LINE_LEN,
+		  "VERSION:%"PRIu32".%"PRIu32".%"PRIu32 BINARY_VERSION_SUFFIX
+		  "\r\n", VERSION_MAJOR, VERSION_MINOR, VERSION_REVISION );
+  return putLine( readBuf, version, len ) == len ? 0 : -1;
+}
+
+int binaryProtocolAnswer( const char *line )
+{
+  /* a dealer agreeing sends back a version line with the suffix, and
+     any other dealer just starts sending states */
+  return !strncmp( line, "VERSION:", 8 )
+    && strstr( line, BINARY_VERSION_SUFFIX ) != NULL;
+}
+
+int startBinaryProtocol( ReadBuf *readBuf, char *line, const size_t maxLen )
+{
+  if( requestBinaryProtocol( readBuf ) < 0 ) {
+
+    return -1;
+  }
+
+  if( getLine( readBuf, maxLen, line, -1 ) <= 0 ) {
+
+    return -1;
+  }
+
+  return binaryProtocolAnswer( line );
+}
+
+int applyStateFrame( const Game *game, const uint8_t *frame,
+		     const int len, MatchState *state )
+{
+  int c, i, prevRound;
+  uint8_t p;
+  Action action;
+  State *s = &state->state;
+
+  if( len < 2 || frame[ 0 ] != len - 1 ) {
+
+    return -1;
+  }
+
+  if( frame[ 1 ] == binary_hand_start ) {
+
+    if( len != 7 + game->numHoleCards || frame[ 6 ] >= game->numPlayers ) {
+
+      return -1;
+    }
+
+    initState( game, get32( &frame[ 2 ] ), s );
+    state->viewingPlayer = frame[ 6 ];
+    for( i = 0; i < game->numHoleCards; ++i ) {
+
+      s->holeCards[ state->viewingPlayer ][ i ] = frame[ 7 + i ];
+    }
+    return 0;
+  }
+
+  if( frame[ 1 ] != binary_action || len < 7 || frame[ 2 ] >= a_invalid
+      || stateFinished( s ) ) {
+
+    return -1;
+  }
+
+  /* the dealer only sends actions it has already checked, so anything
+     invalid means we are out of step */
+  action.type = (enum ActionType)frame[ 2 ];
+  action.size = (int32_t)get32( &frame[ 3 ] );
+  if( !isValidAction( game, s, 0, &action ) ) {
+
+    return -1;
+  }
+  prevRound = s->round;
+  doAction( game, &action, s );
+
+  /* work out which cards follow from the new state, as the dealer did */
+  c = 7;
+  i = sumBoardCards( game, s->round ) - sumBoardCards( game, prevRound );
+  if( wentToShowdown( game, s ) ) {
+
+    for( p = 0; p < game->numPlayers; ++p ) {
+
+      if( showsCards( s, state->viewingPlayer, p ) ) {
+
+	i += game->numHoleCards;
+      }
+    }
+  }
+  if( len != c + i ) {
+
+    return -1;
+  }
+
+  for( i = sumBoardCards( game, prevRound );
+       i < sumBoardCards( game, s->round ); ++i ) {
+
+    s->boardCards[ i ] = frame[ c ];
+    ++c;
+  }
+
+  if( wentToShowdown( game, s ) ) {
+
+    for( p = 0; p < game->numPlayers; ++p ) {
+
+      if( !showsCards( s, state->viewingPlayer, p ) ) {
+	continue;
+      }
+
+      for( i = 0; i < game->numHoleCards; ++i ) {
+
+	s->holeCards[ p ][ i ] = frame[ c ];
+	++c;
+      }
+    }
+  }
+
+  return 0;
+}
+
+int makeResponseFrame( const MatchState *state, const Action *action,
+		       uint8_t frame[ BINARY_MAX_FRAME_LEN ] )
+{
+  frame[ 0 ] = RESPONSE_FRAME_LEN - 1;
+  frame[ 1 ] = binary_response;
+  put32( &frame[ 2 ], state->state.handId );
+  frame[ 6 ] = state->state.round;
+  frame[ 7 ] = state->state.numActions[ state->state.round ];
+  frame[ 8 ] = action->type;
+  put32( &frame[ 9 ], action->size );
+  return RESPONSE_FRAME_LEN;
+}
+
+ssize_t getFrameDeadline( ReadBuf *readBuf,
+			  uint8_t frame[ BINARY_MAX_FRAME_LEN ],
+			  int64_t deadlineMicros )
+{
+  ssize_t r;
+
+  r = getBytesDeadline( readBuf, 1, frame, deadlineMicros );
+  if( r <= 0 ) {
+
+    return r;
+  }
+
+  if( frame[ 0 ] == 0
+      || getBytesDeadline( readBuf, frame[ 0 ], &frame[ 1 ],
+			   deadlineMicros ) != frame[ 0 ] ) {
+
+    return -1;
+  }
+
+  return frame[ 0 ] + 1;
+}
+
+int getBinaryState( ReadBuf *readBuf, const Game *game, MatchState *state,
+		    int64_t deadlineMicros )
+{
+  ssize_t len;
+  uint8_t frame[ BINARY_MAX_FRAME_LEN ];
+
+  len = getFrameDeadline( readBuf, frame, deadlineMicros );
+  if( len <= 0 ) {
+
+    return len;
+  }
+
+  return applyStateFrame( game, frame, len, state ) < 0 ? -1 : 1;
+}
+
+int getBinaryStateNow( ReadBuf *readBuf, const Game *game,
+		       MatchState *state )
+{
+  ssize_t r;
+  uint8_t frame[ BINARY_MAX_FRAME_LEN ];
+
+  /* the length byte, then the rest of the frame it gives */
+  r = bufferBytes( readBuf, 1 );
+  if( r == BUFFER_EOF ) {
+
+    return 0;
+  }
+  if( r < 0 ) {
+
+    return -1;
+  }
+  if( r == 0 ) {
+    /* woken with nothing to read, but the connection is still open */
+
+    return BINARY_INCOMPLETE;
+  }
+  r = bufferBytes( readBuf,
+		   1 + (uint8_t)readBuf->buf[ readBuf->bufStart ] );
+  if( r < 0 ) {
+
+    return -1;
+  }
+  if( r < 1 + (uint8_t)readBuf->buf[ readBuf->bufStart ] ) {
+
+    return BINARY_INCOMPLETE;
+  }
+
+  /* it's all buffered, so this doesn't wait */
+  r = getFrameDeadline( readBuf, frame, -1 );
+  if( r <= 0 ) {
+
+    return -1;
+  }
+  return applyStateFrame( game, frame, r, state ) < 0 ? -1 : 1;
+}
+
+int putBinaryAction( ReadBuf *readBuf, const MatchState *state,
+		     const Action *action )
+{
+  int len;
+  uint8_t frame[ BINARY_MAX_FRAME_LEN ];
+
+  len = makeResponseFrame( state, action, frame );
+  return putLine( readBuf, (const char *)frame, len ) == len ? 0 : -1;
+}
@@ -0,0 +1,124 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#ifndef _BINARY_PROTOCOL_H
+#define _BINARY_PROTOCOL_H
+
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include "game.h"
+#include "net.h"
+
+
+/* optional binary framing of the dealer/player protocol
+
+   a player asks for it by adding BINARY_VERSION_SUFFIX to its version
+   line, as in VERSION:2.0.0:BINARY, and a dealer which understands it
+   sends the same line back before the match starts.  Older dealers
+   ignore the suffix and carry on with text, so text stays the default.
+
+   in place of each MATCHSTATE line, the dealer then sends a frame of
+     length of the rest of the frame (1 byte), kind (1 byte), contents
+   where the contents only describe what changed since the last frame
+     binary_hand_start: handId (4 bytes), viewing player (1 byte),
+       the viewing player's hole cards
+     binary_action: action type (1 byte), size (4 bytes), then the
+       board cards for any rounds the action moved on to, then if the
+       hand ended in a showdown, the hole cards of each other player
+       who did not fold, in player order
+   so a player which applies each action to its own state with
+   doAction always knows how many cards follow.  In place of its
+   response line, a player sends
+     binary_response: handId (4 bytes), round (1 byte), number of
+       actions so far in the round (1 byte), action type (1 byte),
+       size (4 bytes)
+   where the handId, round, and number of actions identify the state
+   being answered, like the state repeated in a text response.
+
+   all multi-byte numbers are little endian, and cards use the same
+   numbering as makeCard in game.h */
+
+#define BINARY_VERSION_SUFFIX ":BINARY"
+#define BINARY_MAX_FRAME_LEN 256
+#define BINARY_INCOMPLETE 2 /* from getBinaryStateNow */
+
+enum BinaryFrameKind { binary_hand_start = 1, binary_action = 2,
+		       binary_response = 3 };
+
+
+/* dealer side */
+
+/* make the frame which takes a player from the previous state sent to
+   it to state, where state->viewingPlayer is the receiving player
+   returns the length of the frame, or -1 on failure */
+int makeStateFrame( const Game *game, const MatchState *state,
+		    uint8_t frame[ BINARY_MAX_FRAME_LEN ] );
+
+/* read the action out of a response frame of length len, checking
+   the frame answers state
+   returns 1 if action was set, 0 if the frame answers some other
+   state, or -1 if the frame is not a valid response */
+int readResponseFrame( const Game *game, const uint8_t *frame,
+		       const int len, const MatchState *state,
+		       Action *action );
+
+
+/* player side */
+
+/* send the version line asking for the binary protocol, and read the
+   dealer's answer, which is a line of up to maxLen characters
+   returns 1 if the dealer agreed, 0 if it did not, in which case line
+   holds the first text message from the dealer, or -1 on failure */
+int startBinaryProtocol( ReadBuf *readBuf, char *line, const size_t maxLen );
+
+/* the two halves of startBinaryProtocol, for players which can't wait
+   on the answer: send the version line asking for the binary protocol,
+   returning 0 on success or -1 on failure, and then check the first
+   line from the dealer, returning 1 if it agreed, or 0 if line is the
+   first text message */
+int requestBinaryProtocol( ReadBuf *readBuf );
+int binaryProtocolAnswer( const char *line );
+
+/* apply a frame of length len from the dealer to state
+   returns 0 on success, -1 if the frame is invalid for state */
+int applyStateFrame( const Game *game, const uint8_t *frame,
+		     const int len, MatchState *state );
+
+/* make the frame answering state with action
+   returns the length of the frame */
+int makeResponseFrame( const MatchState *state, const Action *action,
+		       uint8_t frame[ BINARY_MAX_FRAME_LEN ] );
+
+/* get the next frame from the dealer and apply it to state, giving up
+   when monotonicMicros() reaches deadlineMicros unless it is negative
+   returns 1 on success, 0 on end of file, -1 on error or timeout */
+int getBinaryState( ReadBuf *readBuf, const Game *game, MatchState *state,
+		    int64_t deadlineMicros );
+
+/* getBinaryState without waiting, for callers watching many
+   connections, where a frame which has only partly arrived is left in
+   readBuf for the next call
+   returns 1 on success, 0 on end of file, -1 on error, or
+   BINARY_INCOMPLETE if the whole frame isn't there yet */
+int getBinaryStateNow( ReadBuf *readBuf, const Game *game,
+		       MatchState *state );
+
+/* send action as the response to state
+   returns 0 on success, -1 on failure */
+int putBinaryAction( ReadBuf *readBuf, const MatchState *state,
+		     const Action *action );
+
+
+/* either side */
+
+/* read a whole frame, including the length byte, into frame
+   gives up when monotonicMicros() reaches deadlineMicros unless it is
+   negative
+   returns the length of the frame, 0 on end of file,
+   or -1 on error or timeout */
+ssize_t getFrameDeadline( ReadBuf *readBuf,
+			  uint8_t frame[ BINARY_MAX_FRAME_LEN ],
+			  int64_t deadlineMicros );
+
+#endif
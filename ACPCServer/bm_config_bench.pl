@@ -0,0 +1,38 @@
+#!/usr/bin/perl
+
+# Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+
+# write a bm_server config with a large number of bots and users, and time
+# how long bm_server takes to read it
+
+$#ARGV <= 1 or die "usage: bm_config_bench.pl [#lines [configFile]]";
+$numLines = $#ARGV >= 0 ? $ARGV[ 0 ] : 100000;
+$configFile = $#ARGV >= 1 ? $ARGV[ 1 ] : "/tmp/bm_config_bench.$$.config";
+
+@games = ( 'holdem.limit.2p.reverse_blinds.game',
+	   'holdem.nolimit.2p.reverse_blinds.game',
+	   'holdem.limit.3p.game',
+	   'holdem.nolimit.3p.game' );
+
+# a quarter of the lines are users, and the rest are bots split between games
+$numUsers = int( $numLines / 4 );
+$botsPerGame = int( ( $numLines - $numUsers ) / @games ) - 2;
+
+open CONFIG, '>', $configFile or die "couldn't open $configFile";
+print CONFIG "port 54000\n";
+foreach $game ( @games ) {
+
+    print CONFIG "game $game {\n";
+    for( $b = 0; $b < $botsPerGame; ++$b ) {
+	print CONFIG "  bot bot$b example_player.limit.2p.sh\n";
+    }
+    print CONFIG "}\n";
+}
+for( $u = 0; $u < $numUsers; ++$u ) {
+    print CONFIG "user user$u passwd$u\n";
+}
+close CONFIG;
+
+system( './bm_server', '--check', $configFile );
+unlink $configFile if $#ARGV < 1;
+exit( $? >> 8 );
@@ -11,12 +11,59 @@
 #include <netinet/tcp.h>
 #include <sys/wait.h>
 #include <errno.h>
+#include <math.h>
 #include "net.h"
+#include "rng.h"
 
 #define ARG_SERVERNAME 1
 #define ARG_SERVERPORT 2
+#define ARG_USERNAME 3
+#define ARG_PASSWORD 4
+#define ARG_COMMAND 5
+#define ARG_GAME 6
 #define ARG_BOT_COMMAND 7
 #define ARG_MIN_ARGS 6
+#define ARG_SEQ_RUNS 8
+#define ARG_SEQ_TAG 9
+#define ARG_SEQ_SEED 10
+#define ARG_SEQ_PLAYERS 11
+
+#define MAX_PLAYERS 10
+#define SEQ_MIN_BLOCKS 2
+
+
+/* sequential testing settings and state, for seqrun */
+typedef struct {
+  char *game;
+  int maxRuns;
+  char *tag;
+  int numPlayers;
+  char *players[ MAX_PLAYERS ]; /* as given to bm_server */
+  char *evalName; /* name of the first player in VALUES lines */
+  double margin; /* stop once the interval is this narrow, if > 0 */
+  int useThreshold;
+  double threshold; /* or once the interval is all to one side of this */
+  double confidence;
+  int parallel; /* blocks to have queued at once */
+  int duplicate; /* blocks of every seat rotation, instead of single runs */
+  int runsPerBlock;
+
+  int numBlocks; /* blocks submitted */
+  int blocksRunning;
+  int blocksDone; /* blocks finished with all their values */
+  int stopped;
+  uint32_t *seeds;
+  int *runsLeft; /* in each block */
+  int *runsValued; /* runs of each block which reported values */
+  int *failed;
+  uint64_t *blockHands;
+  double *blockTotal;
+  double *blockSquared;
+
+  uint64_t hands; /* over finished blocks */
+  double total;
+  double squared;
+} SeqState;
 
 static void printUsage( FILE *file )
 {
@@ -40,6 +87,12 @@ static void printUsage( FILE *file )
 	   "rerun 2pl <local script> <match index> <tag> <seed> <player1> "
 	   "<player2> (<player3>)\n" );
   fprintf( file, "    Rerun a match that failed\n" );
+  fprintf( file, "  bm_run_matches <bm_hostname> <bm_port> <username> <pw> "
+	   "seqrun <game> <local script> <max runs> <tag> <seed> <player1> "
+	   "<player2> ... [--margin m] [--threshold t] [--confidence c] "
+	   "[--parallel n] [--duplicate]\n" );
+  fprintf( file, "    Run matches on bm_server until the value per hand of "
+	   "<player1> is known well enough\n" );
   fprintf( file, "\n" );
   fprintf( file, "<username> is your benchmark server username assigned to "
 	   "you by the competition chair\n" );
@@ -64,12 +117,489 @@ static void printUsage( FILE *file )
 	   "For example, if you tried to run twenty matches with seed 0 and "
 	   "the last match failed, you could use the \"rerun\" command with "
 	   "seed 0 and match index 19.\n" );
+  fprintf( file, "\n" );
+  fprintf( file, "seqrun keeps up to n (default 1) blocks of runs queued, "
+	   "with a new seed for each block.  With --duplicate a block is one "
+	   "run for every rotation of the seats, all with the same cards, and "
+	   "otherwise it is a single run.  After each block, it works out a "
+	   "c (default 0.95) confidence interval on the mean value per hand "
+	   "of <player1> from the values the dealer reports, and stops "
+	   "queueing runs once the interval is no wider than +-m, or once it "
+	   "lies all above or below t, after at least %d blocks.  A block "
+	   "only counts if every run in it reported values.  The k-th "
+	   "interval checked allows an error of (1-c)*6/(pi^2 k^2), which add "
+	   "up to at most 1-c over any number of checks, so stopping early "
+	   "keeps the c confidence.  Hands are treated as independent, which "
+	   "makes the interval wider than it need be for duplicate blocks\n",
+	   SEQ_MIN_BLOCKS );
+}
+
+/* run `command machine port` in a new process */
+static void startLocalAgent( const char *command, const char *machine,
+			     const char *port )
+{
+  pid_t childPID;
+
+  childPID = fork();
+  if( childPID < 0 ) {
+
+    fprintf( stderr, "ERROR: fork() failed\n" );
+    exit( EXIT_FAILURE );
+  }
+  if( childPID == 0 ) {
+    /* child runs the command */
+
+    execl( command, command, machine, port, NULL );
+    fprintf( stderr, "ERROR: could not run %s\n", command );
+    exit( EXIT_FAILURE );
+  }
+}
+
+/* z such that a standard normal is within +-z with probability p */
+static double normalQuantile( const double p )
+{
+  int i;
+  double low, high, mid;
+
+  low = 0.0;
+  high = 40.0;
+  for( i = 0; i < 100; ++i ) {
+
+    mid = ( low + high ) / 2.0;
+    if( erf( mid / sqrt( 2.0 ) ) < p ) {
+
+      low = mid;
+    } else {
+
+      high = mid;
+    }
+  }
+  return ( low + high ) / 2.0;
+}
+
+/* read the seqrun arguments and options
+   returns 0 on success, -1 on failure */
+static int parseSeqArgs( const int argc, char **argv, SeqState *seq )
+{
+  int i;
+  rng_state_t rng;
+  uint32_t seed;
+
+  memset( seq, 0, sizeof( *seq ) );
+  seq->confidence = 0.95;
+  seq->parallel = 1;
+  if( argc <= ARG_SEQ_PLAYERS + 1 ) {
+
+    return -1;
+  }
+  seq->game = argv[ ARG_GAME ];
+  seq->tag = argv[ ARG_SEQ_TAG ];
+  if( sscanf( argv[ ARG_SEQ_RUNS ], "%d", &seq->maxRuns ) < 1
+      || seq->maxRuns < 1
+      || sscanf( argv[ ARG_SEQ_SEED ], "%"SCNu32, &seed ) < 1 ) {
+
+    return -1;
+  }
+
+  /* players, with "local" meaning the agent run here */
+  for( i = ARG_SEQ_PLAYERS; i < argc && strncmp( argv[ i ], "--", 2 ); ++i ) {
+
+    if( seq->numPlayers == MAX_PLAYERS ) {
+
+      return -1;
+    }
+    if( !strcasecmp( argv[ i ], "local" ) ) {
+
+      seq->players[ seq->numPlayers ] = "LOCAL";
+    } else {
+
+      seq->players[ seq->numPlayers ] = argv[ i ];
+    }
+    ++seq->numPlayers;
+  }
+  if( seq->numPlayers < 2 ) {
+
+    return -1;
+  }
+  seq->evalName = strcmp( seq->players[ 0 ], "LOCAL" )
+    ? seq->players[ 0 ] : argv[ ARG_USERNAME ];
+
+  for( ; i < argc; ++i ) {
+
+    if( !strcmp( argv[ i ], "--duplicate" ) ) {
+
+      seq->duplicate = 1;
+      continue;
+    }
+    if( i + 1 == argc ) {
+
+      return -1;
+    }
+    if( !strcmp( argv[ i ], "--margin" ) ) {
+
+      if( sscanf( argv[ i + 1 ], "%lf", &seq->margin ) < 1
+	  || seq->margin <= 0.0 ) {
+
+	return -1;
+      }
+    } else if( !strcmp( argv[ i ], "--threshold" ) ) {
+
+      if( sscanf( argv[ i + 1 ], "%lf", &seq->threshold ) < 1 ) {
+
+	return -1;
+      }
+      seq->useThreshold = 1;
+    } else if( !strcmp( argv[ i ], "--confidence" ) ) {
+
+      if( sscanf( argv[ i + 1 ], "%lf", &seq->confidence ) < 1
+	  || seq->confidence <= 0.0 || seq->confidence >= 1.0 ) {
+
+	return -1;
+      }
+    } else if( !strcmp( argv[ i ], "--parallel" ) ) {
+
+      if( sscanf( argv[ i + 1 ], "%d", &seq->parallel ) < 1
+	  || seq->parallel < 1 ) {
+
+	return -1;
+      }
+    } else {
+
+      return -1;
+    }
+    ++i;
+  }
+  if( seq->margin <= 0.0 && !seq->useThreshold ) {
+
+    fprintf( stderr, "ERROR: seqrun needs --margin or --threshold\n" );
+    return -1;
+  }
+  seq->runsPerBlock = seq->duplicate ? seq->numPlayers : 1;
+
+  /* every block gets a seed of its own, which is never 0 as bm_server
+     would pick a different seed for each run of the block */
+  i = seq->maxRuns / seq->runsPerBlock;
+  if( i < 1 ) {
+
+    fprintf( stderr, "ERROR: a block needs %d runs\n", seq->runsPerBlock );
+    return -1;
+  }
+  seq->seeds = (uint32_t *)malloc( sizeof( uint32_t ) * i );
+  seq->runsLeft = (int *)calloc( i, sizeof( int ) );
+  seq->runsValued = (int *)calloc( i, sizeof( int ) );
+  seq->failed = (int *)calloc( i, sizeof( int ) );
+  seq->blockHands = (uint64_t *)calloc( i, sizeof( uint64_t ) );
+  seq->blockTotal = (double *)calloc( i, sizeof( double ) );
+  seq->blockSquared = (double *)calloc( i, sizeof( double ) );
+  assert( seq->seeds != 0 && seq->runsLeft != 0 && seq->runsValued != 0
+	  && seq->failed != 0
+	  && seq->blockHands != 0 && seq->blockTotal != 0
+	  && seq->blockSquared != 0 );
+  init_genrand( &rng, seed );
+  while( i > 0 ) {
+
+    --i;
+    do {
+
+      seq->seeds[ i ] = genrand_int32( &rng );
+    } while( seq->seeds[ i ] == 0 );
+  }
+
+  return 0;
+}
+
+/* queue the next block of runs */
+static void submitBlock( const int sock, SeqState *seq )
+{
+  int run, p, len, b = seq->numBlocks;
+  char line[ READBUF_LEN ];
+
+  for( run = 0; run < seq->runsPerBlock; ++run ) {
+
+    len = snprintf( line, sizeof( line ),
+		    "RUNMATCHES %s 1 %s.%d.%d %"PRIu32, seq->game, seq->tag,
+		    b, run, seq->seeds[ b ] );
+    for( p = 0; p < seq->numPlayers; ++p ) {
+
+      len += snprintf( &line[ len ], sizeof( line ) - len, " %s",
+		       seq->players[ ( p + run ) % seq->numPlayers ] );
+    }
+    len += snprintf( &line[ len ], sizeof( line ) - len, "\n" );
+    if( write( sock, line, len ) < len ) {
+
+      fprintf( stderr, "ERROR: failed while sending to server\n" );
+      exit( EXIT_FAILURE );
+    }
+  }
+
+  seq->runsLeft[ b ] = seq->runsPerBlock;
+  ++seq->numBlocks;
+  ++seq->blocksRunning;
+}
+
+/* the block of a job tag from bm_server, which is user.tag.block.run,
+   or -1 if it is not one of ours */
+static int tagBlock( const SeqState *seq, const char *user, const char *tag )
+{
+  int block, run, len;
+
+  len = strlen( user );
+  if( strncmp( tag, user, len ) || tag[ len ] != '.' ) {
+
+    return -1;
+  }
+  tag += len + 1;
+  len = strlen( seq->tag );
+  if( strncmp( tag, seq->tag, len ) || tag[ len ] != '.'
+      || sscanf( &tag[ len + 1 ], "%d.%d", &block, &run ) < 2
+      || block < 0 || block >= seq->numBlocks ) {
+
+    return -1;
+  }
+
+  return block;
+}
+
+/* add the values of the evaluated player in a VALUES line to block
+   returns 0 on success, -1 on failure */
+static int addRunValues( SeqState *seq, const int block, const char *values )
+{
+  int p, t, pos, evalSeat;
+  uint64_t hands;
+  double total[ MAX_PLAYERS ], squared[ MAX_PLAYERS ];
+  char name[ READBUF_LEN ];
+
+  if( sscanf( values, "VALUES:%"SCNu64"%n", &hands, &pos ) < 1 ) {
+
+    return -1;
+  }
+  for( p = 0; p < seq->numPlayers; ++p ) {
+
+    if( sscanf( &values[ pos ], p ? "|%lf%n" : ":%lf%n",
+		&total[ p ], &t ) < 1 ) {
+
+      return -1;
+    }
+    pos += t;
+  }
+  for( p = 0; p < seq->numPlayers; ++p ) {
+
+    if( sscanf( &values[ pos ], p ? "|%lf%n" : ":%lf%n",
+		&squared[ p ], &t ) < 1 ) {
+
+      return -1;
+    }
+    pos += t;
+  }
+
+  /* the first seat with the evaluated player's name */
+  evalSeat = -1;
+  for( p = 0; p < seq->numPlayers && evalSeat < 0; ++p ) {
+
+    if( sscanf( &values[ pos ], p ? "|%[^|\n]%n" : ":%[^|\n]%n",
+		name, &t ) < 1 ) {
+
+      return -1;
+    }
+    pos += t;
+    if( !strcmp( name, seq->evalName ) ) {
+
+      evalSeat = p;
+    }
+  }
+  if( evalSeat < 0 ) {
+
+    return -1;
+  }
+
+  seq->blockHands[ block ] += hands;
+  seq->blockTotal[ block ] += total[ evalSeat ];
+  seq->blockSquared[ block ] += squared[ evalSeat ];
+  ++seq->runsValued[ block ];
+  return 0;
+}
+
+/* mean value per hand so far, and the half width of its interval
+   the interval is checked after every block, so each check spends part
+   of the allowed error: the k-th check, counting from SEQ_MIN_BLOCKS
+   blocks, allows (1 - confidence) * 6 / ( pi^2 k^2 ), and since those
+   add up to 1 - confidence, the chance that any interval misses the
+   true mean stays within it however many blocks are run */
+static void seqInterval( const SeqState *seq, double *mean, double *half )
+{
+  int k;
+  double var, error;
+
+  *mean = seq->total / seq->hands;
+  var = seq->hands > 1
+    ? ( seq->squared - seq->total * *mean ) / ( seq->hands - 1 ) : 0.0;
+  k = seq->blocksDone - SEQ_MIN_BLOCKS + 1;
+  if( k < 1 ) {
+
+    k = 1;
+  }
+  error = ( 1.0 - seq->confidence ) * 6.0 / ( M_PI * M_PI * k * k );
+  *half = normalQuantile( 1.0 - error ) * sqrt( var > 0.0 ? var : 0.0 )
+    / sqrt( seq->hands );
+}
+
+/* count a run of block as finished, and stop queueing more runs once
+   the interval is settled */
+static void finishRun( SeqState *seq, const int block )
+{
+  double mean, half;
+
+  --seq->runsLeft[ block ];
+  if( seq->runsLeft[ block ] ) {
+
+    return;
+  }
+  --seq->blocksRunning;
+
+  /* duplicate blocks are only fair with every rotation, so a block
+     where any run failed to report values is left out entirely */
+  if( seq->runsValued[ block ] != seq->runsPerBlock ) {
+
+    seq->failed[ block ] = 1;
+  }
+  if( seq->failed[ block ] ) {
+
+    printf( "block %d failed, leaving it out\n", block );
+    fflush( stdout );
+    return;
+  }
+
+  seq->hands += seq->blockHands[ block ];
+  seq->total += seq->blockTotal[ block ];
+  seq->squared += seq->blockSquared[ block ];
+  ++seq->blocksDone;
+  if( seq->hands == 0 ) {
+
+    return;
+  }
+
+  seqInterval( seq, &mean, &half );
+  printf( "after %d blocks (%"PRIu64" hands): %s %.3f +- %.3f per hand\n",
+	  seq->blocksDone, seq->hands, seq->evalName, mean, half );
+  fflush( stdout );
+  if( seq->blocksDone >= SEQ_MIN_BLOCKS
+      && ( ( seq->margin > 0.0 && half <= seq->margin )
+	   || ( seq->useThreshold && ( mean - half > seq->threshold
+				       || mean + half < seq->threshold ) ) ) ) {
+
+    seq->stopped = 1;
+  }
+}
+
+/* log in to bm_server and run blocks of matches until the value of the
+   first player is settled or the runs are used up */
+static void runSequential( const int sock, ReadBuf *fromServer,
+			   const int argc, char **argv )
+{
+  int r, block, pos, len;
+  fd_set readfds;
+  double mean, half;
+  SeqState seq;
+  char tag[ READBUF_LEN ];
+  char line[ READBUF_LEN ];
+
+  if( parseSeqArgs( argc, argv, &seq ) < 0 ) {
+
+    printUsage( stderr );
+    exit( EXIT_FAILURE );
+  }
+
+  len = snprintf( line, sizeof( line ), "%s %s\n", argv[ ARG_USERNAME ],
+		  argv[ ARG_PASSWORD ] );
+  if( write( sock, line, len ) < len ) {
+
+    fprintf( stderr, "ERROR: failed while sending to server\n" );
+    exit( EXIT_FAILURE );
+  }
+
+  while( 1 ) {
+
+    /* keep blocks queued until the answer is known */
+    while( !seq.stopped && seq.blocksRunning < seq.parallel
+	   && ( seq.numBlocks + 1 ) * seq.runsPerBlock <= seq.maxRuns ) {
+
+      submitBlock( sock, &seq );
+    }
+    if( seq.blocksRunning == 0 ) {
+      break;
+    }
+
+    /* clean up any children */
+    while( waitpid( -1, NULL, WNOHANG ) > 0 );
+
+    FD_ZERO( &readfds );
+    FD_SET( sock, &readfds );
+    if( select( sock + 1, &readfds, NULL, NULL, NULL ) < 0 ) {
+
+      fprintf( stderr, "ERROR: select failed\n" );
+      exit( EXIT_FAILURE );
+    }
+
+    while( ( r = getLine( fromServer, READBUF_LEN, line, 0 ) ) >= 0 ) {
+
+      if( r == 0 ) {
+
+	fprintf( stderr, "ERROR: server closed connection\n" );
+	exit( EXIT_FAILURE );
+      }
+
+      if( sscanf( line, "RUN %s %n", tag, &pos ) == 1 ) {
+	/* tag holds the machine here */
+
+	line[ strcspn( line, "\r\n" ) ] = 0;
+	printf( "starting match %s:%s\n", tag, &line[ pos ] );
+	fflush( stdout );
+	startLocalAgent( argv[ ARG_BOT_COMMAND ], tag, &line[ pos ] );
+      } else if( sscanf( line, "# VALUES %s %n", tag, &pos ) == 1 ) {
+
+	block = tagBlock( &seq, argv[ ARG_USERNAME ], tag );
+	if( block >= 0 && addRunValues( &seq, block, &line[ pos ] ) < 0 ) {
+
+	  fprintf( stderr, "ERROR: bad values for %s\n", tag );
+	  seq.failed[ block ] = 1;
+	}
+      } else if( sscanf( line, "# FINISHED %s", tag ) == 1 ) {
+
+	block = tagBlock( &seq, argv[ ARG_USERNAME ], tag );
+	if( block >= 0 ) {
+
+	  finishRun( &seq, block );
+	}
+      } else if( !strncmp( line, "BAD", 3 ) ) {
+
+	fprintf( stderr, "ERROR: server said %s", line );
+	exit( EXIT_FAILURE );
+      } else if( !strncmp( line, "# RUNNING", 9 ) ) {
+
+	fputs( line, stdout );
+	fflush( stdout );
+      }
+    }
+  }
+
+  while( waitpid( -1, NULL, WNOHANG ) > 0 );
+  if( seq.hands == 0 ) {
+
+    fprintf( stderr, "ERROR: no runs finished\n" );
+    exit( EXIT_FAILURE );
+  }
+  seqInterval( &seq, &mean, &half );
+  printf( "%s after %d of %d runs: %s %.3f +- %.3f per hand over %"PRIu64
+	  " hands (%.0f%% confidence)\n",
+	  seq.stopped ? "stopped" : "finished",
+	  seq.numBlocks * seq.runsPerBlock, seq.maxRuns,
+	  seq.evalName, mean, half, seq.hands, seq.confidence * 100.0 );
+  exit( EXIT_SUCCESS );
 }
 
 int main( int argc, char **argv )
 {
   int sock, i;
-  pid_t childPID;
   uint16_t port;
   ReadBuf *fromServer;
   fd_set readfds;
@@ -130,6 +660,12 @@ int main( int argc, char **argv )
   /* set up read buffers */
   fromServer = createReadBuf( sock );
 
+  /* seqrun talks to bm_server for the whole evaluation */
+  if( !strcmp( argv[ ARG_COMMAND ], "seqrun" ) ) {
+
+    runSequential( sock, fromServer, argc, argv );
+  }
+
   /* write to server */
   line[0] = 0;
   for( i = 3; i < argc; ++i ) {
@@ -198,26 +734,7 @@ int main( int argc, char **argv )
 	  printf( "starting match %s:%s", &line[ 4 ], &line[ i + 1 ] );
 	  fflush( stdout );
 
-	  /* run `command machine port` */
-	  childPID = fork();
-	  if( childPID < 0 ) {
-
-	    fprintf( stderr, "ERROR: fork() failed\n" );
-	    exit( EXIT_FAILURE );
-	  }
-	  if( childPID == 0 ) {
-	    /* child runs the command */
-
-	    execl( argv[ ARG_BOT_COMMAND ],
-		   argv[ ARG_BOT_COMMAND ],
-		   &line[ 4 ],
-		   &line[ i + 1 ],
-		   NULL );
-	    fprintf( stderr,
-		     "ERROR: could not run %s\n",
-		     argv[ ARG_BOT_COMMAND ] );
-	    exit( EXIT_FAILURE );
-	  }
+	  startLocalAgent( argv[ ARG_BOT_COMMAND ], &line[ 4 ], &line[ i + 1 ] );
 	} else {
 	  /* just a message, print it out */
 
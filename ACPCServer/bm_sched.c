@@ -0,0 +1,370 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include "bm_sched.h"
+
+
+#define HEAP_START_SIZE 16
+
+
+static void initHeap( SchedHeap *heap,
+		      int (*before)( const void *a, const void *b ),
+		      void (*setIndex)( void *elt, const int index ) )
+{
+  heap->elts = NULL;
+  heap->num = 0;
+  heap->size = 0;
+  heap->before = before;
+  heap->setIndex = setIndex;
+}
+
+static void heapPlace( SchedHeap *heap, void *elt, const int index )
+{
+  heap->elts[ index ] = elt;
+  heap->setIndex( elt, index );
+}
+
+/* returns where the element ended up */
+static int heapSiftUp( SchedHeap *heap, int index )
+{
+  int parent;
+  void *elt;
+
+  elt = heap->elts[ index ];
+  while( index > 0 ) {
+
+    parent = ( index - 1 ) / 2;
+    if( !heap->before( elt, heap->elts[ parent ] ) ) {
+      break;
+    }
+
+    heapPlace( heap, heap->elts[ parent ], index );
+    index = parent;
+  }
+  heapPlace( heap, elt, index );
+  return index;
+}
+
+static void heapSiftDown( SchedHeap *heap, int index )
+{
+  int child;
+  void *elt;
+
+  elt = heap->elts[ index ];
+  while( 1 ) {
+
+    child = index * 2 + 1;
+    if( child >= heap->num ) {
+      break;
+    }
+    if( child + 1 < heap->num
+	&& heap->before( heap->elts[ child + 1 ], heap->elts[ child ] ) ) {
+
+      ++child;
+    }
+    if( !heap->before( heap->elts[ child ], elt ) ) {
+      break;
+    }
+
+    heapPlace( heap, heap->elts[ child ], index );
+    index = child;
+  }
+  heapPlace( heap, elt, index );
+}
+
+static void heapInsert( SchedHeap *heap, void *elt )
+{
+  if( heap->num == heap->size ) {
+
+    heap->size = heap->size ? heap->size * 2 : HEAP_START_SIZE;
+    heap->elts = realloc( heap->elts, sizeof( heap->elts[ 0 ] )
+			  * heap->size );
+    if( heap->elts == NULL ) {
+
+      fprintf( stderr, "ERROR: could not grow scheduler heap\n" );
+      exit( EXIT_FAILURE );
+    }
+  }
+
+  heap->elts[ heap->num ] = elt;
+  ++heap->num;
+  heapSiftUp( heap, heap->num - 1 );
+}
+
+/* element at index may have moved in either direction */
+static void heapFix( SchedHeap *heap, const int index )
+{
+  if( heapSiftUp( heap, index ) == index ) {
+
+    heapSiftDown( heap, index );
+  }
+}
+
+static void heapRemove( SchedHeap *heap, const int index )
+{
+  void *elt;
+
+  assert( index >= 0 && index < heap->num );
+  elt = heap->elts[ index ];
+  --heap->num;
+  if( index < heap->num ) {
+
+    heapPlace( heap, heap->elts[ heap->num ], index );
+    heapFix( heap, index );
+  }
+  heap->setIndex( elt, -1 );
+}
+
+static void *heapTop( const SchedHeap *heap )
+{
+  return heap->num ? heap->elts[ 0 ] : NULL;
+}
+
+
+/* items: earliest deadline, then oldest */
+static int itemBefore( const void *a, const void *b )
+{
+  const SchedItem *x = a, *y = b;
+
+  if( x->deadline != y->deadline ) {
+
+    if( x->deadline == 0 ) {
+
+      return 0;
+    }
+    if( y->deadline == 0 ) {
+
+      return 1;
+    }
+    return x->deadline < y->deadline;
+  }
+  return x->seq < y->seq;
+}
+
+static void itemSetIndex( void *elt, const int index )
+{
+  ( (SchedItem *)elt )->index = index;
+}
+
+/* queues: least virtual time, then by their first item */
+static int queueBefore( const void *a, const void *b )
+{
+  const SchedQueue *x = a, *y = b;
+
+  if( x->user->vtime != y->user->vtime ) {
+
+    return x->user->vtime < y->user->vtime;
+  }
+  return itemBefore( heapTop( &x->items ), heapTop( &y->items ) );
+}
+
+static void queueSetIndex( void *elt, const int index )
+{
+  ( (SchedQueue *)elt )->index = index;
+}
+
+/* games: by their first queue */
+static int gameBefore( const void *a, const void *b )
+{
+  const SchedGame *x = a, *y = b;
+
+  return queueBefore( heapTop( &x->queues ), heapTop( &y->queues ) );
+}
+
+static void gameSetIndex( void *elt, const int index )
+{
+  ( (SchedGame *)elt )->index = index;
+}
+
+
+/* put game where it belongs in the scheduler's heap, which only holds
+   games with something queued and room to start it */
+static void fixGame( Scheduler *sched, SchedGame *game )
+{
+  int runnable;
+
+  runnable = game->queues.num
+    && ( game->maxRunning == 0 || game->numRunning < game->maxRunning );
+  if( game->index < 0 ) {
+
+    if( runnable ) {
+
+      heapInsert( &sched->games, game );
+    }
+  } else if( runnable ) {
+
+    heapFix( &sched->games, game->index );
+  } else {
+
+    heapRemove( &sched->games, game->index );
+  }
+}
+
+/* put queue where it belongs in its game's heap, which only holds
+   queues with something in them */
+static void fixQueue( Scheduler *sched, SchedQueue *queue )
+{
+  SchedGame *game = queue->game;
+
+  if( queue->index < 0 ) {
+
+    if( queue->items.num ) {
+
+      heapInsert( &game->queues, queue );
+    }
+  } else if( queue->items.num ) {
+
+    heapFix( &game->queues, queue->index );
+  } else {
+
+    heapRemove( &game->queues, queue->index );
+  }
+  fixGame( sched, game );
+}
+
+static SchedQueue *getQueue( SchedUser *user, SchedGame *game )
+{
+  SchedQueue *queue;
+
+  for( queue = user->queues; queue != NULL; queue = queue->nextForUser ) {
+
+    if( queue->game == game ) {
+
+      return queue;
+    }
+  }
+
+  queue = malloc( sizeof( *queue ) );
+  if( queue == NULL ) {
+
+    fprintf( stderr, "ERROR: could not allocate scheduler queue\n" );
+    exit( EXIT_FAILURE );
+  }
+  queue->user = user;
+  queue->game = game;
+  queue->index = -1;
+  initHeap( &queue->items, itemBefore, itemSetIndex );
+  queue->nextForUser = user->queues;
+  user->queues = queue;
+  return queue;
+}
+
+
+void initScheduler( Scheduler *sched, const int totalCores )
+{
+  sched->totalCores = totalCores;
+  sched->usedCores = 0;
+  sched->vclock = 0.0;
+  sched->nextSeq = 0;
+  initHeap( &sched->games, gameBefore, gameSetIndex );
+}
+
+void initSchedUser( SchedUser *user, const double weight )
+{
+  user->weight = weight > 0.0 ? weight : 1.0;
+  user->vtime = 0.0;
+  user->numQueued = 0;
+  user->queues = NULL;
+}
+
+void initSchedGame( SchedGame *game, const int maxRunning )
+{
+  game->maxRunning = maxRunning;
+  game->numRunning = 0;
+  game->index = -1;
+  initHeap( &game->queues, queueBefore, queueSetIndex );
+}
+
+void schedAdd( Scheduler *sched, SchedItem *item,
+	       SchedUser *user, SchedGame *game )
+{
+  SchedQueue *queue;
+
+  /* a user coming back after a break starts level with everyone else */
+  if( user->numQueued == 0 && user->vtime < sched->vclock ) {
+
+    user->vtime = sched->vclock;
+  }
+  ++user->numQueued;
+
+  queue = getQueue( user, game );
+  item->queue = queue;
+  item->seq = sched->nextSeq;
+  ++sched->nextSeq;
+  heapInsert( &queue->items, item );
+  fixQueue( sched, queue );
+}
+
+void schedRemove( Scheduler *sched, SchedItem *item )
+{
+  SchedQueue *queue = item->queue;
+
+  assert( item->index >= 0 );
+  heapRemove( &queue->items, item->index );
+  --queue->user->numQueued;
+  fixQueue( sched, queue );
+}
+
+SchedItem *schedPeek( Scheduler *sched )
+{
+  SchedGame *game;
+  SchedItem *item;
+
+  game = heapTop( &sched->games );
+  if( game == NULL ) {
+
+    return NULL;
+  }
+  item = heapTop( &( (SchedQueue *)heapTop( &game->queues ) )->items );
+
+  /* always let something run, even if it wants more than all the cores */
+  if( sched->totalCores && sched->usedCores
+      && sched->usedCores + item->cores > sched->totalCores ) {
+
+    return NULL;
+  }
+
+  return item;
+}
+
+void schedStart( Scheduler *sched, SchedItem *item )
+{
+  SchedQueue *queue = item->queue, *q;
+  SchedUser *user = queue->user;
+  SchedGame *game = queue->game;
+
+  schedRemove( sched, item );
+  ++game->numRunning;
+  sched->usedCores += item->cores;
+
+  /* charge the user for what the item uses, counting items without
+     local bots as one core so they still take turns */
+  if( user->vtime > sched->vclock ) {
+
+    sched->vclock = user->vtime;
+  }
+  user->vtime += ( item->cores > 0 ? item->cores : 1 ) / user->weight;
+  for( q = user->queues; q != NULL; q = q->nextForUser ) {
+
+    if( q->index >= 0 ) {
+
+      heapFix( &q->game->queues, q->index );
+      fixGame( sched, q->game );
+    }
+  }
+  fixGame( sched, game );
+}
+
+void schedFinished( Scheduler *sched, SchedItem *item )
+{
+  SchedGame *game = item->queue->game;
+
+  assert( game->numRunning > 0 );
+  --game->numRunning;
+  sched->usedCores -= item->cores;
+  fixGame( sched, game );
+}
@@ -0,0 +1,109 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#ifndef _BM_SCHED_H
+#define _BM_SCHED_H
+
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+
+
+/* fair-share scheduler for the benchmark server's match queue
+
+   every user has a weight, and a virtual time which goes up by
+   cores/weight whenever one of its items starts, so over time users
+   get cores in proportion to their weights.  The user with the
+   smallest virtual time goes first, and within a user, items with
+   the earliest deadline go first, then the oldest.  A user which
+   starts queueing again after a break has its virtual time moved up
+   to the scheduler's, so it can't make up for time it was idle.
+
+   each item belongs to a game, which may limit how many of its items
+   run at once, and needs some number of cores, which must fit in the
+   scheduler's core budget.  When the best item doesn't fit, nothing
+   else starts until it does, so items needing many cores don't wait
+   forever behind smaller ones.
+
+   items are kept in a heap for each (user, game) pair, the pairs in a
+   heap for each game, and the games with room to run something in a
+   heap of their own, so finding, starting, adding, and removing an
+   item all take O(log n) time */
+
+typedef struct SchedQueue_struct SchedQueue;
+
+typedef struct {
+  void **elts;
+  int num;
+  int size;
+  int (*before)( const void *a, const void *b );
+  void (*setIndex)( void *elt, const int index );
+} SchedHeap;
+
+typedef struct {
+  double weight;
+  double vtime;
+  int numQueued;
+  SchedQueue *queues;
+} SchedUser;
+
+typedef struct {
+  int maxRunning; /* 0 for no limit */
+  int numRunning;
+  int index; /* position in the scheduler's heap, or -1 */
+  SchedHeap queues;
+} SchedGame;
+
+typedef struct {
+  /* set by the caller before adding the item */
+  int cores;
+  int64_t deadline; /* 0 for no deadline */
+  void *data;
+
+  /* used by the scheduler */
+  SchedQueue *queue;
+  uint64_t seq;
+  int index; /* position in the queue's heap, or -1 */
+} SchedItem;
+
+struct SchedQueue_struct {
+  SchedUser *user;
+  SchedGame *game;
+  SchedQueue *nextForUser;
+  int index; /* position in the game's heap, or -1 */
+  SchedHeap items;
+};
+
+typedef struct {
+  int totalCores; /* 0 for no limit */
+  int usedCores;
+  double vclock;
+  uint64_t nextSeq;
+  SchedHeap games;
+} Scheduler;
+
+
+void initScheduler( Scheduler *sched, const int totalCores );
+void initSchedUser( SchedUser *user, const double weight );
+void initSchedGame( SchedGame *game, const int maxRunning );
+
+/* queue item for user in game */
+void schedAdd( Scheduler *sched, SchedItem *item,
+	       SchedUser *user, SchedGame *game );
+
+/* take a queued item back out of the queue */
+void schedRemove( Scheduler *sched, SchedItem *item );
+
+/* returns the item which should start next, or NULL if nothing can
+   start until some running item finishes */
+SchedItem *schedPeek( Scheduler *sched );
+
+/* take item out of the queue and count it as running
+   item should have come from schedPeek */
+void schedStart( Scheduler *sched, SchedItem *item );
+
+/* a running item has finished, so its cores and game slot are free
+   the item may be added again with schedAdd */
+void schedFinished( Scheduler *sched, SchedItem *item );
+
+#endif
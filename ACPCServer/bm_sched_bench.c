@@ -0,0 +1,373 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+/* simulation benchmark for the bm_server match scheduler
+
+   queues a batch of single run matches from several users with
+   different weights, in several games with different limits on
+   running jobs, where some matches use bots which need many cores.
+   The matches are then run in simulated time, starting matches
+   whenever there is room, first with the scheduler in bm_sched.c and
+   then with a linear scan over all queued matches like the one
+   bm_server used to do.  Only the time spent picking matches is
+   measured. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "rng.h"
+#include "bm_sched.h"
+
+
+#define DEFAULT_MATCHES 10000
+#define DEFAULT_CORES 64
+#define NUM_USERS 8
+#define NUM_GAMES 4
+#define WIDE_CORES 16 /* a bot doing its own search on many cores */
+
+
+typedef struct {
+  int user;
+  int game;
+  int cores;
+  int64_t deadline;
+  int64_t duration;
+  uint64_t seq;
+  SchedItem item;
+} SimMatch;
+
+typedef struct {
+  SimMatch *match;
+  int64_t finish;
+} SimJob;
+
+typedef struct {
+  double coreTime[ NUM_USERS ]; /* core time used before any user ran out */
+  int64_t endTime;
+  int numLate;
+  int numDeadlines;
+  uint64_t pickNanos;
+  int numPicks;
+} SimResult;
+
+static const double userWeights[ NUM_USERS ] = { 1, 1, 1, 1, 2, 2, 4, 4 };
+static const int gameMaxRunning[ NUM_GAMES ] = { 0, 16, 8, 2 };
+
+
+static void printUsage( FILE *file )
+{
+  fprintf( file, "usage: bm_sched_bench [#matches [#cores]]\n" );
+}
+
+static uint64_t nowNanos()
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void makeMatches( SimMatch *matches, const int numMatches )
+{
+  int i;
+  rng_state_t rng;
+
+  init_genrand( &rng, 1 );
+  for( i = 0; i < numMatches; ++i ) {
+
+    matches[ i ].user = genrand_int32( &rng ) % NUM_USERS;
+    matches[ i ].game = genrand_int32( &rng ) % NUM_GAMES;
+    matches[ i ].cores = genrand_int32( &rng ) % 5 ? 2 : WIDE_CORES;
+    matches[ i ].duration = 50 + genrand_int32( &rng ) % 100;
+    matches[ i ].deadline = genrand_int32( &rng ) % 20
+      ? 0 : 1 + genrand_int32( &rng ) % ( numMatches * 4 );
+    matches[ i ].seq = i;
+  }
+}
+
+/* the job which finishes first */
+static int firstFinished( const SimJob *jobs, const int numJobs )
+{
+  int i, first;
+
+  first = 0;
+  for( i = 1; i < numJobs; ++i ) {
+
+    if( jobs[ i ].finish < jobs[ first ].finish ) {
+
+      first = i;
+    }
+  }
+  return first;
+}
+
+static void recordStart( SimResult *result, const SimMatch *match,
+			 const int64_t now, const int contended )
+{
+  if( contended ) {
+
+    result->coreTime[ match->user ]
+      += (double)match->cores * match->duration;
+  }
+  if( match->deadline ) {
+
+    ++result->numDeadlines;
+    if( now > match->deadline ) {
+
+      ++result->numLate;
+    }
+  }
+}
+
+static void runScheduler( SimMatch *matches, const int numMatches,
+			  const int cores, SimResult *result )
+{
+  int i, numJobs, contended;
+  int64_t now;
+  uint64_t start;
+  Scheduler sched;
+  SchedUser users[ NUM_USERS ];
+  SchedGame games[ NUM_GAMES ];
+  SchedItem *item;
+  SimJob *jobs;
+
+  memset( result, 0, sizeof( *result ) );
+  jobs = malloc( sizeof( *jobs ) * numMatches );
+  initScheduler( &sched, cores );
+  for( i = 0; i < NUM_USERS; ++i ) {
+
+    initSchedUser( &users[ i ], userWeights[ i ] );
+  }
+  for( i = 0; i < NUM_GAMES; ++i ) {
+
+    initSchedGame( &games[ i ], gameMaxRunning[ i ] );
+  }
+
+  start = nowNanos();
+  for( i = 0; i < numMatches; ++i ) {
+
+    matches[ i ].item.cores = matches[ i ].cores;
+    matches[ i ].item.deadline = matches[ i ].deadline;
+    matches[ i ].item.data = &matches[ i ];
+    schedAdd( &sched, &matches[ i ].item,
+	      &users[ matches[ i ].user ], &games[ matches[ i ].game ] );
+  }
+  result->pickNanos += nowNanos() - start;
+
+  now = 0;
+  numJobs = 0;
+  contended = 1;
+  while( 1 ) {
+
+    /* start everything there is room for */
+    while( 1 ) {
+
+      start = nowNanos();
+      item = schedPeek( &sched );
+      if( item != NULL ) {
+
+	schedStart( &sched, item );
+      }
+      result->pickNanos += nowNanos() - start;
+      if( item == NULL ) {
+	break;
+      }
+      ++result->numPicks;
+
+      jobs[ numJobs ].match = (SimMatch *)item->data;
+      jobs[ numJobs ].finish = now + jobs[ numJobs ].match->duration;
+      recordStart( result, jobs[ numJobs ].match, now, contended );
+      if( users[ jobs[ numJobs ].match->user ].numQueued == 0 ) {
+
+	contended = 0;
+      }
+      ++numJobs;
+    }
+
+    if( numJobs == 0 ) {
+      break;
+    }
+
+    /* move on to the next finished job */
+    i = firstFinished( jobs, numJobs );
+    now = jobs[ i ].finish;
+    start = nowNanos();
+    schedFinished( &sched, &jobs[ i ].match->item );
+    result->pickNanos += nowNanos() - start;
+    --numJobs;
+    jobs[ i ] = jobs[ numJobs ];
+  }
+
+  result->endTime = now;
+  free( jobs );
+}
+
+/* the scan bm_server used to do: the user who started a match longest
+   ago goes first, then the oldest match, skipping busy games */
+static void runLinearScan( SimMatch *matches, const int numMatches,
+			   const int cores, SimResult *result )
+{
+  int i, best, numQueued, numJobs, contended, usedCores;
+  int gameRunning[ NUM_GAMES ], userQueued[ NUM_USERS ];
+  int64_t now, userLastStart[ NUM_USERS ];
+  uint64_t start;
+  SimMatch **queue, *match;
+  SimJob *jobs;
+
+  memset( result, 0, sizeof( *result ) );
+  jobs = malloc( sizeof( *jobs ) * numMatches );
+  queue = malloc( sizeof( *queue ) * numMatches );
+  memset( gameRunning, 0, sizeof( gameRunning ) );
+  memset( userQueued, 0, sizeof( userQueued ) );
+  for( i = 0; i < NUM_USERS; ++i ) {
+
+    userLastStart[ i ] = -1;
+  }
+  for( i = 0; i < numMatches; ++i ) {
+
+    queue[ i ] = &matches[ i ];
+    ++userQueued[ matches[ i ].user ];
+  }
+  numQueued = numMatches;
+
+  now = 0;
+  numJobs = 0;
+  usedCores = 0;
+  contended = 1;
+  while( 1 ) {
+
+    while( 1 ) {
+
+      start = nowNanos();
+      best = -1;
+      for( i = 0; i < numQueued; ++i ) {
+
+	match = queue[ i ];
+	if( gameMaxRunning[ match->game ]
+	    && gameRunning[ match->game ] >= gameMaxRunning[ match->game ] ) {
+	  continue;
+	}
+
+	if( best < 0
+	    || userLastStart[ match->user ]
+	    < userLastStart[ queue[ best ]->user ]
+	    || ( userLastStart[ match->user ]
+		 == userLastStart[ queue[ best ]->user ]
+		 && match->seq < queue[ best ]->seq ) ) {
+
+	  best = i;
+	}
+      }
+      if( best >= 0 && cores && usedCores
+	  && usedCores + queue[ best ]->cores > cores ) {
+
+	best = -1;
+      }
+      if( best >= 0 ) {
+
+	match = queue[ best ];
+	--numQueued;
+	memmove( &queue[ best ], &queue[ best + 1 ],
+		 sizeof( *queue ) * ( numQueued - best ) );
+      }
+      result->pickNanos += nowNanos() - start;
+      if( best < 0 ) {
+	break;
+      }
+      ++result->numPicks;
+
+      ++gameRunning[ match->game ];
+      usedCores += match->cores;
+      userLastStart[ match->user ] = result->numPicks;
+      --userQueued[ match->user ];
+      jobs[ numJobs ].match = match;
+      jobs[ numJobs ].finish = now + match->duration;
+      recordStart( result, match, now, contended );
+      if( userQueued[ match->user ] == 0 ) {
+
+	contended = 0;
+      }
+      ++numJobs;
+    }
+
+    if( numJobs == 0 ) {
+      break;
+    }
+
+    i = firstFinished( jobs, numJobs );
+    now = jobs[ i ].finish;
+    --gameRunning[ jobs[ i ].match->game ];
+    usedCores -= jobs[ i ].match->cores;
+    --numJobs;
+    jobs[ i ] = jobs[ numJobs ];
+  }
+
+  result->endTime = now;
+  free( queue );
+  free( jobs );
+}
+
+static void printResult( const char *name, const SimResult *result )
+{
+  int u;
+  double total, totalWeight;
+
+  printf( "%s: %d matches in %"PRId64" time units, %.0f ns per match picked\n",
+	  name, result->numPicks, result->endTime,
+	  (double)result->pickNanos / result->numPicks );
+  printf( "  %d of %d matches with deadlines started late\n",
+	  result->numLate, result->numDeadlines );
+
+  total = 0.0;
+  totalWeight = 0.0;
+  for( u = 0; u < NUM_USERS; ++u ) {
+
+    total += result->coreTime[ u ];
+    totalWeight += userWeights[ u ];
+  }
+  printf( "  share of cores until a user ran out (weight share in brackets)\n" );
+  for( u = 0; u < NUM_USERS; ++u ) {
+
+    printf( "    user %d: %5.1f%% (%5.1f%%)\n", u,
+	    100.0 * result->coreTime[ u ] / total,
+	    100.0 * userWeights[ u ] / totalWeight );
+  }
+}
+
+int main( int argc, char **argv )
+{
+  int numMatches, cores;
+  SimMatch *matches;
+  SimResult result;
+
+  numMatches = DEFAULT_MATCHES;
+  cores = DEFAULT_CORES;
+  if( argc > 3
+      || ( argc > 1 && sscanf( argv[ 1 ], "%d", &numMatches ) < 1 )
+      || ( argc > 2 && sscanf( argv[ 2 ], "%d", &cores ) < 1 )
+      || numMatches < 1 || cores < 0 ) {
+
+    printUsage( stderr );
+    exit( EXIT_FAILURE );
+  }
+
+  matches = malloc( sizeof( *matches ) * numMatches );
+  if( matches == NULL ) {
+
+    fprintf( stderr, "ERROR: could not allocate %d matches\n", numMatches );
+    exit( EXIT_FAILURE );
+  }
+  printf( "%d queued matches, %d cores\n", numMatches, cores );
+
+  makeMatches( matches, numMatches );
+  runScheduler( matches, numMatches, cores, &result );
+  printResult( "fair share scheduler", &result );
+
+  runLinearScan( matches, numMatches, cores, &result );
+  printResult( "linear scan", &result );
+
+  free( matches );
+  return EXIT_SUCCESS;
+}
@@ -2,11 +2,14 @@
 Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
 */
 
+#define _GNU_SOURCE /* for sched_setaffinity and the CPU_* macros */
 #include <stdlib.h>
 #include <stdio.h>
+#include <stddef.h>
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
 #include <assert.h>
+#include <stdarg.h>
 #include <string.h>
 #include <strings.h>
 #include <ctype.h>
@@ -19,12 +22,20 @@ Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
 #include <netinet/tcp.h>
 #include <sys/wait.h>
 #include <sys/time.h>
+#include <sys/resource.h>
+#include <sched.h>
 #include <time.h>
+#include <math.h>
 #include <signal.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <sys/signalfd.h>
 #include "game.h"
 #include "net.h"
 #include "rng.h"
+#include "bm_sched.h"
 
 
 #define STATUS_CLOSED 0
@@ -34,7 +45,12 @@ Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
 #define BM_DEALER "dealer"
 #define BM_LOGDIR "logs"
 #define BM_DEALER_WAIT_SECS 5
-#define BM_MAX_IOWAIT_SECS 1
+#define BM_WORKER_MESSAGE_LEN 4096
+#define BM_MAX_EVENTS 64
+#define BM_INDEX_START_SLOTS 16
+#define BM_AGENT_HOST_LEN 256
+#define BM_AGENT_MAX_FIELDS ( MAX_PLAYERS * 2 + 68 )
+#define BM_JOURNAL_MIN_RECORDS 10000
 
 
 typedef struct LLPoolEntry_struct {
@@ -50,17 +66,30 @@ typedef struct {
   int numEntries;
 } LLPool;
 
+/* open addressing hash index over entries of an LLPool, keyed by a
+   string pointer at keyOffset in each item.  Entries are never moved
+   by an LLPool, so the index holds the entries themselves.  There is
+   no removal: the index is only used for configuration and results,
+   which are never taken out of the server */
+typedef struct {
+  LLPoolEntry **slots;
+  int numSlots; /* always a power of two */
+  int numEntries;
+  size_t keyOffset;
+} LLPoolIndex;
+
 /* structure giving the specification for a local bot */
 typedef struct {
   char *name;
   char *command;
+  int cores; /* cores the bot keeps busy while it runs */
 } BotSpec;
 
 /* structure giving the specification for a user */
 typedef struct {
   char *name;
   char *passwd;
-  struct timeval waitStart;
+  SchedUser sched; /* share of the server, from the user's weight */
 } UserSpec;
 
 typedef struct {
@@ -71,41 +100,65 @@ typedef struct {
   Game *game;
   char *gameFile;
   LLPool *bots;
+  LLPoolIndex botIndex; /* bots by name */
 
-  int curRunningJobs;
+  SchedGame sched; /* queued and running matches of this game */
 } GameConfig;
 
 typedef struct {
   uint16_t port;
   uint16_t maxRunningBots; /* maximum simultaneous bots at a time
 			      0 disables the check */
+  uint16_t maxRunningCores; /* maximum cores used by running bots at a time
+			       0 disables the check */
   uint16_t startupTimeoutSecs; /* maximum time to wait for clients to connect
 				  0 disables the timer */
   uint16_t responseTimeoutSecs; /* maximum time to wait for clients to respond 
                                    with an action */
   uint16_t handTimeoutSecs; /* maximum time to allowed per hand of play */
   uint16_t avgHandTimeSecs; /* average time per hand allowed for the match */
+  uint16_t traceMatches; /* non-zero to have dealers write binary message
+			    traces into the log directory */
+  uint16_t localBotSockets; /* non-zero to have bots connect to dealers over
+			       abstract Unix domain sockets instead of TCP */
+  uint16_t dealerWorkers; /* number of dealer --worker processes to start
+			     dealers from, 0 runs a new dealer for each job */
+  uint16_t pinCores; /* non-zero to give each job cores of its own, with
+			each bot pinned to as many as it uses */
+  char *queueJournal; /* file keeping the queue across restarts, or NULL */
 
   LLPool *games;
+  LLPoolIndex gameIndex; /* games by game file */
   LLPool *users;
+  LLPoolIndex userIndex; /* users by name */
 } Config;
 
 typedef struct {
   int status;
   UserSpec *user; /* NULL when status is STATUS_UNVALIDATED */
   ReadBuf *connBuf;
+  int isAgent; /* non-zero once the connection has sent AGENT */
+  int agentMaxJobs;
+  int agentRunningJobs;
+  char agentHost[ BM_AGENT_HOST_LEN ]; /* where network players connect
+					  to the agent's dealers */
 } Connection;
 
 typedef struct {
   GameConfig *gameConf;
   UserSpec *user;
   int numRuns;
-  rng_state_t rng;
+  rng_state_t *rng; /* NULL until the match first needs a seed */
   uint32_t rngSeed;
   int useRngForSeed; /* 0: use rngSeed as seed for each dealer run
 			1: use genrand_int32( match->rng ) */
+  uint32_t rngInit; /* what rng is initialised with */
+  uint32_t runsStarted;
+  uint32_t journalId; /* 0 if the match is not in the queue journal */
+  LLPoolEntry *submitter; /* connection which queued the match, which is
+			     told about each finished run, or NULL */
   char *tag;
-  struct timeval queueTime;
+  SchedItem sched; /* queued when numRuns > 0 and not isRunning */
   struct {
     int isNetworkPlayer;
     LLPoolEntry *entry; /* connection if network player, bot otherwise */
@@ -113,19 +166,106 @@ typedef struct {
   int isRunning;
 } Match;
 
+/* resources used by one process of a job, from wait4 */
+typedef struct {
+  int valid; /* zero until the process has been reaped */
+  int64_t userMicros;
+  int64_t sysMicros;
+  long maxRSSKB;
+} ProcessUsage;
+
 typedef struct {
   pid_t dealerPID;
+  uint64_t dealerStartTime; /* from processStartTime, 0 if unknown */
   pid_t botPID[ MAX_PLAYERS ];
+  ProcessUsage dealerUsage;
+  ProcessUsage botUsage[ MAX_PLAYERS ];
+  int pinned; /* non-zero if the job holds cores of its own */
+  cpu_set_t cores; /* all the job's cores, which the dealer runs on */
+  cpu_set_t botCores[ MAX_PLAYERS ]; /* each bot's share of cores */
   LLPoolEntry *matchEntry;
   char *tag; /* based on tag from the match for this job */
+  int stdoutFD; /* dealer's standard output when run here, or -1 */
   uint16_t ports[ MAX_PLAYERS ];
+  char endpoints[ MAX_PLAYERS ][ 64 ]; /* empty for TCP ports */
+  int worker; /* dealer worker running the dealer, or -1 */
+  LLPoolEntry *agent; /* connection of the agent running the job, or NULL */
+  uint32_t workerJobId; /* identifies the job to the worker or agent */
+  int waitingForPorts; /* non-zero until the worker's or agent's dealer
+			  is listening */
 } MatchJob;
 
+/* running totals of the value a player won, from which the mean and
+   variance of its value per hand follow */
+typedef struct {
+  uint32_t numRuns;
+  uint64_t numHands;
+  double total;
+  double totalSquared;
+} ValueTotals;
+
+/* values from every finished run of a match, by seat */
+typedef struct {
+  char *name; /* the tag of the match's jobs, user.tag */
+  int numPlayers;
+  char *playerName[ MAX_PLAYERS ];
+  ValueTotals seat[ MAX_PLAYERS ];
+} MatchResults;
+
+/* values of a player against one opponent in a game, over every match
+   they both played in */
+typedef struct {
+  char *name; /* game file, player, and opponent, separated by spaces */
+  ValueTotals totals;
+} PairResults;
+
+/* command line for a dealer, and the strings it points to */
+typedef struct {
+  char *argv[ MAX_PLAYERS + 64 ];
+  char matchName[ READBUF_LEN ];
+  char handsString[ 16 ];
+  char rngString[ 16 ];
+  char startupTimeoutString[ 16 ];
+  char responseTimeoutString[ 16 ];
+  char handTimeoutString[ 16 ];
+  char avgHandTimeString[ 16 ];
+  char listenString[ MAX_PLAYERS * 2 ];
+  char traceFile[ READBUF_LEN ];
+} DealerArgs;
+
+/* a dealer --worker process, with the games already loaded, which
+   forks a dealer for each job it is sent */
+typedef struct {
+  pid_t pid;
+  int fd; /* SOCK_SEQPACKET control socket */
+} DealerWorker;
+
 typedef struct {
   int listenSocket;
+  int epollFD; /* watches listenSocket, signalFD, workers, and all
+		  connections */
+  int signalFD; /* becomes readable when SIGCHLD is pending */
+  DealerWorker *workers;
+  int numWorkers;
+  int nextWorker;
+  uint32_t nextWorkerJobId;
+  int numAgents; /* connections which have sent AGENT */
   LLPool *conns;
   LLPool *matches;
   LLPool *jobs;
+  LLPool *matchResults;
+  LLPoolIndex matchResultsIndex; /* match results by name */
+  LLPool *pairResults;
+  LLPoolIndex pairResultsIndex; /* pair results by name */
+
+  Scheduler sched;
+  int runningBots;
+  cpu_set_t freeCores; /* cores no job is pinned to, if pinCores is set */
+  int numFreeCores;
+
+  FILE *journal; /* queue journal opened for appending, or NULL */
+  uint32_t nextJournalId;
+  int journalRecords; /* records in the journal since it was compacted */
 
   rng_state_t rng;
 
@@ -134,6 +274,39 @@ typedef struct {
   int devnullfd;
 } ServerState;
 
+/* a job an agent is running for the server */
+typedef struct {
+  uint32_t id; /* the server's id for the job */
+  int numPlayers;
+  pid_t dealerPID;
+  pid_t botPID[ MAX_PLAYERS ];
+  int dealerStatus;
+  int stdoutFD; /* dealer's standard output, which ends with the score */
+  char *logFile; /* the dealer's log, for the usage of the job */
+  char *playerNames[ MAX_PLAYERS ];
+  ProcessUsage dealerUsage;
+  ProcessUsage botUsage[ MAX_PLAYERS ];
+} AgentJob;
+
+/* a bm_server --agent process, which runs jobs for another server */
+typedef struct {
+  ReadBuf *serverBuf; /* connection to the server */
+  int signalFD; /* becomes readable when SIGCHLD is pending */
+  LLPool *jobs;
+  ServerState serv; /* only the hostname and devnullfd, for startBot */
+} AgentState;
+
+/* what the queue journal says about a match, while it is replayed */
+typedef struct {
+  uint32_t id;
+  int numRuns; /* runs left to start */
+  uint32_t runsStarted;
+  int isRunning;
+  pid_t dealerPID; /* dealer of the running run, 0 if unknown */
+  uint64_t dealerStartTime;
+  char *record; /* the MATCH record */
+} JournalMatch;
+
 
 LLPool *newLLPool( const int dataSize )
 {
@@ -148,23 +321,6 @@ LLPool *newLLPool( const int dataSize )
   return pool;
 }
 
-int entryInList( LLPoolEntry *list, LLPoolEntry *entry )
-{
-  while( list ) {
-
-    if( entry == list ) {
-
-      return 1;
-    }
-    if( list->next ) {
-
-      assert( list->next->prev == list );
-    }
-    list = list->next;
-  }
-  return 0;
-}
-
 /* add an object to the pool.  data must have a size of pool->dataSize */
 LLPoolEntry *LLPoolAddItem( LLPool *pool, void *item )
 {
@@ -180,7 +336,6 @@ LLPoolEntry *LLPoolAddItem( LLPool *pool, void *item )
     assert( entry != 0 );
   }
 
-assert( !entryInList( pool->head, entry ) );
   entry->next = pool->head;
   entry->prev = NULL;
   memcpy( entry->data, item, pool->dataSize );
@@ -216,7 +371,6 @@ assert( entry->next->prev == entry );
     entry->next->prev = entry->prev;
   }
 
-assert( !entryInList( pool->free, entry ) );
   if( pool->free ) {
 
     pool->free->prev = entry;
@@ -227,6 +381,91 @@ assert( !entryInList( pool->free, entry ) );
   --pool->numEntries;
 }
 
+uint32_t hashString( const char *s )
+{
+  uint32_t hash;
+
+  /* FNV-1a */
+  hash = 2166136261u;
+  while( *s ) {
+
+    hash = ( hash ^ (uint8_t)*s ) * 16777619u;
+    ++s;
+  }
+  return hash;
+}
+
+const char *indexKey( const LLPoolIndex *index,
+		      const LLPoolEntry *entry )
+{
+  return *(const char **)( entry->data + index->keyOffset );
+}
+
+void initLLPoolIndex( LLPoolIndex *index, const size_t keyOffset )
+{
+  index->slots = NULL;
+  index->numSlots = 0;
+  index->numEntries = 0;
+  index->keyOffset = keyOffset;
+}
+
+/* returns the slot holding key, or the empty slot where it would go */
+int LLPoolIndexSlot( const LLPoolIndex *index, const char *key )
+{
+  int slot;
+
+  slot = hashString( key ) & ( index->numSlots - 1 );
+  while( index->slots[ slot ]
+	 && strcmp( indexKey( index, index->slots[ slot ] ), key ) ) {
+
+    slot = ( slot + 1 ) & ( index->numSlots - 1 );
+  }
+  return slot;
+}
+
+/* returns entry with key on success, NULL on failure */
+LLPoolEntry *LLPoolIndexFind( const LLPoolIndex *index, const char *key )
+{
+  if( index->numEntries == 0 ) {
+
+    return NULL;
+  }
+  return index->slots[ LLPoolIndexSlot( index, key ) ];
+}
+
+/* entry's key must not already be in the index */
+void LLPoolIndexAdd( LLPoolIndex *index, LLPoolEntry *entry )
+{
+  int i, oldNumSlots;
+  LLPoolEntry **oldSlots;
+
+  /* keep the table at most half full */
+  if( ( index->numEntries + 1 ) * 2 > index->numSlots ) {
+
+    oldSlots = index->slots;
+    oldNumSlots = index->numSlots;
+    index->numSlots = oldNumSlots ? oldNumSlots * 2 : BM_INDEX_START_SLOTS;
+    index->slots = (LLPoolEntry **)calloc( index->numSlots,
+					   sizeof( LLPoolEntry * ) );
+    assert( index->slots != 0 );
+    for( i = 0; i < oldNumSlots; ++i ) {
+
+      if( oldSlots[ i ] ) {
+
+	index->slots[ LLPoolIndexSlot( index, indexKey( index,
+							oldSlots[ i ] ) ) ]
+	  = oldSlots[ i ];
+      }
+    }
+    free( oldSlots );
+  }
+
+  i = LLPoolIndexSlot( index, indexKey( index, entry ) );
+  assert( index->slots[ i ] == NULL );
+  index->slots[ i ] = entry;
+  ++index->numEntries;
+}
+
 /* LLPool iterator start */
 LLPoolEntry *LLPoolFirstEntry( LLPool *pool )
 {
@@ -252,7 +491,13 @@ void *LLPoolGetItem( LLPoolEntry *entry )
 
 void printUsage( FILE *file )
 {
-  fprintf( file, "usage: bm_server config_file\n" );
+  fprintf( file, "usage: bm_server [--check] config_file\n" );
+  fprintf( file, "       bm_server --agent server_host port user passwd [max_jobs [host]]\n" );
+  fprintf( file, "  --check: read the config, report how long it took, and exit\n" );
+  fprintf( file, "  --agent: run jobs for the server at server_host:port, with dealers\n" );
+  fprintf( file, "           and bots started in the current directory.  max_jobs\n" );
+  fprintf( file, "           defaults to the number of processors, and network players\n" );
+  fprintf( file, "           connect to host, or the agent's address as the server sees it\n" );
 }
 
 void setGameDefaults( GameConfig *gameConf )
@@ -263,37 +508,33 @@ void setGameDefaults( GameConfig *gameConf )
   gameConf->game = NULL;
   gameConf->gameFile = NULL;
   gameConf->bots = newLLPool( sizeof( BotSpec ) );
-
-  gameConf->curRunningJobs = 0;
+  initLLPoolIndex( &gameConf->botIndex, offsetof( BotSpec, name ) );
 }
 
 void setDefaults( Config *conf )
 {
   conf->port = 54000;
   conf->maxRunningBots = 0;
+  conf->maxRunningCores = 0;
   conf->startupTimeoutSecs = 60;
   conf->responseTimeoutSecs = 600; /* Value from 2011 ACPC */
   conf->handTimeoutSecs = 3000 * 7; /* Not enforced for 2011 ACPC */
   conf->avgHandTimeSecs = 7; /* Value from 2011 ACPC */
+  conf->traceMatches = 0;
+  conf->localBotSockets = 0;
+  conf->dealerWorkers = 0;
+  conf->pinCores = 0;
+  conf->queueJournal = NULL;
   conf->games = newLLPool( sizeof( GameConfig ) );
+  initLLPoolIndex( &conf->gameIndex, offsetof( GameConfig, gameFile ) );
   conf->users = newLLPool( sizeof( UserSpec ) );
+  initLLPoolIndex( &conf->userIndex, offsetof( UserSpec, name ) );
 }
 
 /* returns entry for bot on success, NULL on failure */
 LLPoolEntry *findBot( const GameConfig *game, const char *name )
 {
-  LLPoolEntry *cur;
-
-  for( cur = LLPoolFirstEntry( game->bots );
-       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
-
-    if( !strcmp( ( (BotSpec *)LLPoolGetItem( cur ) )->name, name ) ) {
-
-      return cur;
-    }
-  }
-
-  return NULL;
+  return LLPoolIndexFind( &game->botIndex, name );
 }
 
 void addBot( GameConfig *gameConf, const char *spec )
@@ -302,8 +543,10 @@ void addBot( GameConfig *gameConf, const char *spec )
   char name[ READBUF_LEN ];
   char command[ READBUF_LEN ];
 
-  /* split the line into name and command */
-  if( sscanf( spec, " %s %s", name, command ) < 2 ) {
+  /* split the line into name, command, and optional number of cores */
+  bot.cores = 1;
+  if( sscanf( spec, " %s %s %d", name, command, &bot.cores ) < 2
+      || bot.cores < 0 ) {
 
     fprintf( stderr, "BM_ERROR: could not get bot name and command from: %s",
 	     spec );
@@ -325,24 +568,13 @@ void addBot( GameConfig *gameConf, const char *spec )
   /* add the bot */
   bot.name = strdup( name );
   bot.command = strdup( command );
-  LLPoolAddItem( gameConf->bots, &bot );
+  LLPoolIndexAdd( &gameConf->botIndex, LLPoolAddItem( gameConf->bots, &bot ) );
 }
 
 /* returns entry for user on success, NULL on failure */
 LLPoolEntry *findUser( const Config *conf, const char *name )
 {
-  LLPoolEntry *cur;
-
-  for( cur = LLPoolFirstEntry( conf->users );
-       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
-
-    if( !strcmp( ( (UserSpec *)LLPoolGetItem( cur ) )->name, name ) ) {
-
-      return cur;
-    }
-  }
-
-  return NULL;
+  return LLPoolIndexFind( &conf->userIndex, name );
 }
 
 void addUser( Config *conf, const char *spec )
@@ -350,9 +582,12 @@ void addUser( Config *conf, const char *spec )
   UserSpec user;
   char name[ READBUF_LEN ];
   char passwd[ READBUF_LEN ];
+  double weight;
 
-  /* split the line into name and password */
-  if( sscanf( spec, " %s %s", name, passwd ) < 2 ) {
+  /* split the line into name, password, and optional weight */
+  weight = 1.0;
+  if( sscanf( spec, " %s %s %lf", name, passwd, &weight ) < 2
+      || weight <= 0.0 ) {
 
     fprintf( stderr, "BM_ERROR: could not get user name and password from: %s",
 	     spec );
@@ -369,32 +604,22 @@ void addUser( Config *conf, const char *spec )
   /* add the user */
   user.name = strdup( name );
   user.passwd = strdup( passwd );
-  gettimeofday( &user.waitStart, NULL );
-  LLPoolAddItem( conf->users, &user );
+  initSchedUser( &user.sched, weight );
+  LLPoolIndexAdd( &conf->userIndex, LLPoolAddItem( conf->users, &user ) );
 }
 
 /* returns entry for game on success, NULL on failure */
 LLPoolEntry *findGame( const Config *conf, const char *name )
 {
-  LLPoolEntry *cur;
-
-  for( cur = LLPoolFirstEntry( conf->games );
-       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
-
-    if( !strcmp( ( (GameConfig *)LLPoolGetItem( cur ) )->gameFile, name ) ) {
-
-      return cur;
-    }
-  }
-
-  return NULL;
+  return LLPoolIndexFind( &conf->gameIndex, name );
 }
 
 /* validate a logon request
    returns user on success, or NULL on failure */
 UserSpec *validateLogon( const Config *conf, const char *line )
 {
-  LLPoolEntry *cur;
+  LLPoolEntry *entry;
+  UserSpec *user;
   char name[ READBUF_LEN ];
   char passwd[ READBUF_LEN ];
 
@@ -403,21 +628,18 @@ UserSpec *validateLogon( const Config *conf, const char *line )
     return NULL;
   }
 
-  for( cur = LLPoolFirstEntry( conf->users );
-       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
-    UserSpec *user = (UserSpec *)LLPoolGetItem( cur );
-
-    if( !strcmp( user->name, name ) ) {
+  entry = findUser( conf, name );
+  if( entry == NULL ) {
 
-      if( !strcmp( user->passwd, passwd ) ) {
+    return NULL;
+  }
+  user = (UserSpec *)LLPoolGetItem( entry );
+  if( strcmp( user->passwd, passwd ) ) {
 
-	return user;
-      }
-      return NULL;
-    }
+    return NULL;
   }
 
-  return NULL;
+  return user;
 }
 
 void readConfig( const char *filename, Config *conf )
@@ -425,6 +647,7 @@ void readConfig( const char *filename, Config *conf )
   int start;
   FILE *file;
   GameConfig *gameConf;
+  LLPoolEntry *cur, *entry;
   char *line, lineBuf[ READBUF_LEN ];
 
   file = fopen( filename, "r" );
@@ -498,8 +721,9 @@ void readConfig( const char *filename, Config *conf )
 	fprintf( stderr, "BM_ERROR: could not read game %s", gc.gameFile );
 	exit( EXIT_FAILURE );
       }
-      gameConf
-	= (GameConfig *)LLPoolGetItem( LLPoolAddItem( conf->games, &gc ) );
+      entry = LLPoolAddItem( conf->games, &gc );
+      LLPoolIndexAdd( &conf->gameIndex, entry );
+      gameConf = (GameConfig *)LLPoolGetItem( entry );
     } else if( strncmp( line, "}", 1 ) == 0 ) {
       /* finished game definition */
 
@@ -516,6 +740,18 @@ void readConfig( const char *filename, Config *conf )
 	fprintf( stderr, "BM_ERROR: could not get maximum number of bots running from: %s", line );
 	exit( EXIT_FAILURE );
       }
+    } else if( strncasecmp( line, "maxRunningCores", 15 ) == 0 ) {
+
+      if( gameConf != NULL ) {
+
+	fprintf( stderr, "BM_ERROR: maxRunningCores must be defined outside of game blocks\n" );
+	exit( EXIT_FAILURE );
+      }
+      if( sscanf( &line[ 15 ], "%"SCNu16, &conf->maxRunningCores ) < 1 ) {
+
+	fprintf( stderr, "BM_ERROR: could not get maximum number of cores used from: %s", line );
+	exit( EXIT_FAILURE );
+      }
     } else if( strncasecmp( line, "startupTimeoutSecs", 18 ) == 0 ) {
 
       if( gameConf != NULL ) {
@@ -564,6 +800,68 @@ void readConfig( const char *filename, Config *conf )
 	fprintf( stderr, "BM_ERROR: could not get dealer average hand time: %s", line );
 	exit( EXIT_FAILURE );
       }
+    } else if( strncasecmp( line, "traceMatches", 12 ) == 0 ) {
+
+      if( gameConf != NULL ) {
+
+	fprintf( stderr, "BM_ERROR: traceMatches must be defined outside of game blocks\n" );
+	exit( EXIT_FAILURE );
+      }
+      if( sscanf( &line[ 12 ], "%"SCNu16, &conf->traceMatches ) < 1 ) {
+
+	fprintf( stderr, "BM_ERROR: could not get trace setting: %s", line );
+	exit( EXIT_FAILURE );
+      }
+    } else if( strncasecmp( line, "localBotSockets", 15 ) == 0 ) {
+
+      if( gameConf != NULL ) {
+
+	fprintf( stderr, "BM_ERROR: localBotSockets must be defined outside of game blocks\n" );
+	exit( EXIT_FAILURE );
+      }
+      if( sscanf( &line[ 15 ], "%"SCNu16, &conf->localBotSockets ) < 1 ) {
+
+	fprintf( stderr, "BM_ERROR: could not get local bot socket setting: %s", line );
+	exit( EXIT_FAILURE );
+      }
+    } else if( strncasecmp( line, "dealerWorkers", 13 ) == 0 ) {
+
+      if( gameConf != NULL ) {
+
+	fprintf( stderr, "BM_ERROR: dealerWorkers must be defined outside of game blocks\n" );
+	exit( EXIT_FAILURE );
+      }
+      if( sscanf( &line[ 13 ], "%"SCNu16, &conf->dealerWorkers ) < 1 ) {
+
+	fprintf( stderr, "BM_ERROR: could not get number of dealer workers: %s", line );
+	exit( EXIT_FAILURE );
+      }
+    } else if( strncasecmp( line, "pinCores", 8 ) == 0 ) {
+
+      if( gameConf != NULL ) {
+
+	fprintf( stderr, "BM_ERROR: pinCores must be defined outside of game blocks\n" );
+	exit( EXIT_FAILURE );
+      }
+      if( sscanf( &line[ 8 ], "%"SCNu16, &conf->pinCores ) < 1 ) {
+
+	fprintf( stderr, "BM_ERROR: could not get core pinning setting: %s", line );
+	exit( EXIT_FAILURE );
+      }
+    } else if( strncasecmp( line, "queueJournal", 12 ) == 0 ) {
+      char journal[ READBUF_LEN ];
+
+      if( gameConf != NULL ) {
+
+	fprintf( stderr, "BM_ERROR: queueJournal must be defined outside of game blocks\n" );
+	exit( EXIT_FAILURE );
+      }
+      if( sscanf( &line[ 12 ], " %s", journal ) < 1 ) {
+
+	fprintf( stderr, "BM_ERROR: could not get queue journal file: %s", line );
+	exit( EXIT_FAILURE );
+      }
+      conf->queueJournal = strdup( journal );
     } else if( strncasecmp( line, "maxMatchRuns", 12 ) == 0 ) {
 
       if( gameConf == NULL ) {
@@ -625,22 +923,48 @@ void readConfig( const char *filename, Config *conf )
   }
 
   fclose( file );
+
+  /* game limits are only known once their blocks have been read */
+  for( cur = LLPoolFirstEntry( conf->games );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+
+    gameConf = (GameConfig *)LLPoolGetItem( cur );
+    initSchedGame( &gameConf->sched, gameConf->maxRunningJobs );
+  }
+}
+
+/* ptr is handed back by epoll_wait when fd is readable */
+void watchFD( ServerState *serv, const int fd, void *ptr )
+{
+  struct epoll_event ev;
+
+  memset( &ev, 0, sizeof( ev ) );
+  ev.events = EPOLLIN;
+  ev.data.ptr = ptr;
+  if( epoll_ctl( serv->epollFD, EPOLL_CTL_ADD, fd, &ev ) < 0 ) {
+
+    fprintf( stderr, "BM_ERROR: could not add file descriptor to epoll\n" );
+    exit( EXIT_FAILURE );
+  }
 }
 
 void addConnection( ServerState *serv, const int sock )
 {
   Connection conn;
+  LLPoolEntry *entry;
 
   /* add the connection */
   conn.status = STATUS_UNVALIDATED;
   conn.user = NULL;
+  conn.isAgent = 0;
   conn.connBuf = createReadBuf( sock );
   if( conn.connBuf == 0 ) {
 
     fprintf( stderr, "BM_ERROR: could not create read buffer for socket\n" );
     exit( EXIT_FAILURE );
   }
-  LLPoolAddItem( serv->conns, &conn );
+  entry = LLPoolAddItem( serv->conns, &conn );
+  watchFD( serv, sock, entry );
 }
 
 int matchUsesConnection( const Match *match, const LLPoolEntry *connEntry )
@@ -659,22 +983,88 @@ int matchUsesConnection( const Match *match, const LLPoolEntry *connEntry )
   return 0;
 }
 
+/* pass on a line about a run of match to the connection which queued
+   the match, if it is still there */
+void tellSubmitter( const Match *match, const char *format, ... )
+{
+  int len;
+  va_list ap;
+  char line[ READBUF_LEN ];
+
+  if( match->submitter == NULL ) {
+
+    return;
+  }
+
+  va_start( ap, format );
+  len = vsnprintf( line, sizeof( line ), format, ap );
+  va_end( ap );
+  if( len >= sizeof( line ) ) {
+
+    len = sizeof( line ) - 1;
+    line[ len - 1 ] = '\n';
+  }
+  if( write( ( (Connection *)LLPoolGetItem( match->submitter ) )
+	     ->connBuf->fd, line, len ) < len ) {
+
+    fprintf( stderr, "BM_ERROR: short write to connection\n" );
+  }
+}
+
+/* match must not be queued or running */
+void removeMatch( ServerState *serv, LLPoolEntry *matchEntry )
+{
+  free( ( (Match *)LLPoolGetItem( matchEntry ) )->tag );
+  free( ( (Match *)LLPoolGetItem( matchEntry ) )->rng );
+  LLPoolRemoveEntry( serv->matches, matchEntry );
+}
+
+/* put match in the queue for its next run */
+void queueMatch( ServerState *serv, LLPoolEntry *matchEntry )
+{
+  Match *match = (Match *)LLPoolGetItem( matchEntry );
+
+  match->sched.data = matchEntry;
+  schedAdd( &serv->sched, &match->sched,
+	    &match->user->sched, &match->gameConf->sched );
+}
+
 void closeConnection( ServerState *serv, LLPoolEntry *connEntry )
 {
   Connection *conn = (Connection*)LLPoolGetItem( connEntry );
   LLPoolEntry *cur, *next;
 
+  /* forked children may still hold the socket open, so closing it is
+     not enough to stop epoll reporting it */
+  epoll_ctl( serv->epollFD, EPOLL_CTL_DEL, conn->connBuf->fd, NULL );
   destroyReadBuf( conn->connBuf );
   conn->status = STATUS_CLOSED;
 
-  /* remove any pending matches which relied on the connection */
+  /* the agent's jobs are finished off when the connection is cleaned
+     up, as nothing more will be heard about them */
+  if( conn->isAgent ) {
+
+    --serv->numAgents;
+  }
+
+  /* remove any pending matches which relied on the connection
+     running matches are removed when their job finishes */
   for( cur = LLPoolFirstEntry( serv->matches ); cur != NULL; cur = next ) {
     next = LLPoolNextEntry( cur );
     Match *match = (Match *)LLPoolGetItem( cur );
 
+    if( match->submitter == connEntry ) {
+
+      match->submitter = NULL;
+    }
     if( matchUsesConnection( match, connEntry ) ) {
 
       match->numRuns = 0;
+      if( !match->isRunning ) {
+
+	schedRemove( &serv->sched, &match->sched );
+	removeMatch( serv, cur );
+      }
     }
   }
 }
@@ -696,7 +1086,8 @@ void handleListenSocket( const Config *conf, ServerState *serv )
   addConnection( serv, sock );
 }
 
-/* -1 on failure, 0 on success */
+/* -1 on failure, 0 on success
+   match->sched is set up with the cores and deadline of the match */
 int parseMatchSpec( const Config *conf,
 		    ServerState *serv,
 		    const char *spec,
@@ -704,12 +1095,13 @@ int parseMatchSpec( const Config *conf,
 		    Match *match )
 {
   uint32_t rngSeed;
-  int pos, t, p;
+  int pos, t, p, deadlineSecs;
   LLPoolEntry *entry;
   char tag[ READBUF_LEN ];
   char name[ READBUF_LEN ];
 
   pos = 0;
+  match->sched.cores = 0;
 
   if( sscanf( &spec[ pos ], " %s%n", name, &t ) < 1 ) {
 
@@ -768,14 +1160,30 @@ int parseMatchSpec( const Config *conf,
 
 	return -1;
       }
+      match->sched.cores
+	+= ( (BotSpec *)LLPoolGetItem( match->players[ p ].entry ) )->cores;
+    }
+  }
+
+  /* optional number of seconds the runs should be started within */
+  match->sched.deadline = 0;
+  if( sscanf( &spec[ pos ], " %d", &deadlineSecs ) == 1 ) {
+
+    if( deadlineSecs <= 0 ) {
+
+      return -1;
     }
+    match->sched.deadline = (int64_t)time( NULL ) + deadlineSecs;
   }
 
   match->tag = strdup( tag );
   match->rngSeed = rngSeed;
+  match->runsStarted = 0;
+  match->journalId = 0;
+  match->submitter = connEntry;
   if( rngSeed ) {
 
-    init_genrand( &match->rng, rngSeed );
+    match->rngInit = rngSeed;
     if( match->numRuns == 1 ) {
 
       match->useRngForSeed = 0;
@@ -785,8 +1193,10 @@ int parseMatchSpec( const Config *conf,
     }
   } else {
 
-    init_genrand( &match->rng, genrand_int32( &serv->rng ) );
+    match->rngInit = genrand_int32( &serv->rng );
+    match->useRngForSeed = 1;
   }
+  match->rng = NULL;
 
   return 0;
 }
@@ -798,9 +1208,13 @@ void writeHelpMessage( int fd )
   r = write( fd, "HELP - this message\n", 20 );
   r = write( fd, "GAMES - list available games and players\n", 41 );
   r = write( fd, "QSTAT - show the current queue\n", 31 );
-  r = write( fd, "RUNMATCHES game #runs tag rngSeed player ... - submit match request\n", 68 );
+  r = write( fd, "RESULTS - show value per hand of each match and pair of players\n", 64 );
+  r = write( fd, "RUNMATCHES game #runs tag rngSeed player ... [deadlineSecs] - submit match request\n", 83 );
   r = write( fd, "  - Player order decides match seating\n", 39 );
+  r = write( fd, "  - Runs with a deadline go ahead of your other matches\n", 56 );
+  r = write( fd, "  - Finished runs are reported as # VALUES and # FINISHED lines\n", 64 );
   r = write( fd, "  - \"LOCAL\" player runs the bm_widget agent (bot_command)\n", 60 );
+  r = write( fd, "AGENT maxJobs [host] - run jobs as a worker agent (bm_server --agent)\n", 70 );
 }
 
 void writeGameList( const Config *conf, int fd )
@@ -855,239 +1269,361 @@ void writeQueueStatus( const Config *conf, const ServerState *serv, int fd )
   }
 }
 
-void handleConnection( Config *conf, ServerState *serv,
-		       LLPoolEntry *connEntry )
+/* how many bots will match start? */
+int botsInMatch( const Match *match )
 {
-  int r;
-  Connection *conn = (Connection *)LLPoolGetItem( connEntry );
-  char line[ READBUF_LEN ];
+  int p, num;
 
-  while( ( r = getLine( conn->connBuf, READBUF_LEN, line, 0 ) ) >= 0 ) {
+  num = 0;
+  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
 
-    if( r == 0 ) {
+    if( !match->players[ p ].isNetworkPlayer ) {
 
-      closeConnection( serv, connEntry );
-      return;
+      ++num;
     }
+  }
 
-    if( conn->status == STATUS_UNVALIDATED ) {
-      UserSpec *user;
-
-      user = validateLogon( conf, line );
-      if( user == NULL ) {
-	/* couldn't authenticate */
+  return num;
+}
 
-	r = write( conn->connBuf->fd, "BAD LOGON\n", 10 );
-	fprintf( stderr, "BM_ERROR: connection failed to log in\n" );
-	closeConnection( serv, connEntry );
-	return;
-      }
+/* the server blocks SIGCHLD to read it from a signalfd, and children
+   should start with it unblocked */
+void unblockChildSignal()
+{
+  sigset_t mask;
 
-      /* send an okay message */
-      r = write( conn->connBuf->fd, "LOGON OKAY - type help for commands\n", 36 );
+  sigemptyset( &mask );
+  sigaddset( &mask, SIGCHLD );
+  sigprocmask( SIG_UNBLOCK, &mask, NULL );
+}
 
-      /* connection status is now okay */
-      conn->user = user;
-      conn->status = STATUS_OKAY;
-      return;
-    }
+/* name of the player in seat p of match: the user's name for a network
+   player, or the bot's name */
+char *matchPlayerName( const Match *match, const int p )
+{
+  if( match->players[ p ].isNetworkPlayer ) {
 
-    if( !strncasecmp( line, "HELP", 4 ) ) {
+    return ( (Connection *)LLPoolGetItem( match->players[ p ].entry ) )
+      ->user->name;
+  }
+  return ( (BotSpec *)LLPoolGetItem( match->players[ p ].entry ) )->name;
+}
 
-      writeHelpMessage( conn->connBuf->fd );
-    } else if( !strncasecmp( line, "GAMES", 5 ) ) {
+/* fill in args with the command line for the dealer of job */
+void makeDealerArgs( const Config *conf,
+		     const Match *match,
+		     const MatchJob *job,
+		     const uint32_t rngSeed,
+		     DealerArgs *args )
+{
+  int p, arg;
 
-      writeGameList( conf, conn->connBuf->fd );
-    } else if( !strncasecmp( line, "QSTAT", 5 ) ) {
+  arg = 0;
 
-      writeQueueStatus( conf, serv, conn->connBuf->fd );
-    } else if( !strncasecmp( line, "RUNMATCHES", 10 ) ) {
-      Match match;
+  args->argv[ arg ] = BM_DEALER;
+  ++arg;
 
-      if( parseMatchSpec( conf, serv, &line[ 10 ], connEntry, &match ) < 0 ) {
+  snprintf( args->matchName, sizeof( args->matchName ), "%s/%s",
+	    BM_LOGDIR, job->tag );
+  args->argv[ arg ] = args->matchName;
+  ++arg;
 
-	fprintf( stderr, "BM_ERROR: bad RUNMATCHES command: %s", line );
-	r = write( conn->connBuf->fd, "BAD RUNMATCHES COMMAND\n", 23 );
-	return;
-      }
-      match.user = ( (Connection *)LLPoolGetItem( connEntry ) )->user;
-      match.isRunning = 0;
-      gettimeofday( &match.queueTime, NULL );
-      LLPoolAddItem( serv->matches, &match );
-      return;
-    } else {
+  args->argv[ arg ] = match->gameConf->gameFile;
+  ++arg;
 
-      r = write( conn->connBuf->fd, "UNKNOWN\n", 8 );
-      return;
-    }
+  snprintf( args->handsString,
+	    sizeof( args->handsString ),
+	    "%"PRIu32,
+	    match->gameConf->matchHands );
+  args->argv[ arg ] = args->handsString;
+  ++arg;
+
+  snprintf( args->rngString, sizeof( args->rngString ), "%"PRIu32, rngSeed );
+  args->argv[ arg ] = args->rngString;
+  ++arg;
+
+  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+
+    args->argv[ arg ] = matchPlayerName( match, p );
+    ++arg;
   }
-}
 
-int timeIsEarlier( struct timeval *a, struct timeval *b )
-{
-  if( a->tv_sec < b->tv_sec ) {
-    return 1;
-  } else if( a->tv_sec == b->tv_sec
-	     && a->tv_usec < b->tv_usec ) {
-    return 1;
+  if( conf->startupTimeoutSecs ) {
+
+    args->argv[ arg ] = "--start_timeout";
+    ++arg;
+
+    snprintf( args->startupTimeoutString,
+	      sizeof( args->startupTimeoutString ),
+	      "%d",
+	      (int)conf->startupTimeoutSecs * 1000 );
+    args->argv[ arg ] = args->startupTimeoutString;
+    ++arg;
   }
-  return 0;
-}
 
-/* how many bots will match start? */
-int botsInMatch( const Match *match )
-{
-  int p, num;
+  /* Add maximum per action timeout argument */
+  args->argv[ arg ] = "--t_response";
+  ++arg;
 
-  num = 0;
-  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+  snprintf( args->responseTimeoutString,
+	    sizeof( args->responseTimeoutString ),
+	    "%d",
+	    (int)conf->responseTimeoutSecs * 1000 );
+  args->argv[ arg ] = args->responseTimeoutString;
+  ++arg;
 
-    if( !match->players[ p ].isNetworkPlayer ) {
+  /* Add maximum per hand timeout argument */
+  args->argv[ arg ] = "--t_hand";
+  ++arg;
 
-      ++num;
+  snprintf( args->handTimeoutString,
+	    sizeof( args->handTimeoutString ),
+	    "%d",
+	    (int)conf->handTimeoutSecs * 1000 );
+  args->argv[ arg ] = args->handTimeoutString;
+  ++arg;
+
+  /* Add average per hand time argument */
+  args->argv[ arg ] = "--t_per_hand";
+  ++arg;
+
+  snprintf( args->avgHandTimeString,
+	    sizeof( args->avgHandTimeString ),
+	    "%d",
+	    (int)conf->avgHandTimeSecs * 1000 );
+  args->argv[ arg ] = args->avgHandTimeString;
+  ++arg;
+
+
+  args->argv[ arg ] = "-q";
+  ++arg;
+
+  /* the server keeps running results from every dealer's VALUES line */
+  args->argv[ arg ] = "--value_stats";
+  ++arg;
+
+  if( conf->localBotSockets ) {
+    /* bots run on this machine, so let the dealer pick abstract socket
+       names for them, and keep random TCP ports for network players */
+
+    for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+
+      args->listenString[ p * 2 ]
+	= match->players[ p ].isNetworkPlayer ? '0' : '@';
+      args->listenString[ p * 2 + 1 ] = ',';
     }
+    args->listenString[ p * 2 - 1 ] = 0;
+    args->argv[ arg ] = "-p";
+    ++arg;
+    args->argv[ arg ] = args->listenString;
+    ++arg;
   }
 
-  return num;
+  if( conf->traceMatches ) {
+    /* trace into the same directory as the log files, where the trace
+       is appended to along with them */
+
+    snprintf( args->traceFile, sizeof( args->traceFile ), "%s/%s.trace",
+	      BM_LOGDIR, job->tag );
+    args->argv[ arg ] = "--trace";
+    ++arg;
+    args->argv[ arg ] = args->traceFile;
+    ++arg;
+  }
+
+  /* Restore the appending behaviour so multiple matches get appended into
+   * the same log file */
+  args->argv[ arg ] = "-a";
+  ++arg;
+
+  args->argv[ arg ] = NULL;
 }
 
-void startDealer( const Config *conf,
-		  const Match *match,
-		  MatchJob *job,
-		  const uint32_t rngSeed )
+/* read the ports (or Unix domain endpoints) a dealer printed for a
+   match with numPlayers players
+   returns 0 on success, -1 on failure */
+int parsePortString( const int numPlayers,
+		     const char *portString,
+		     uint16_t ports[ MAX_PLAYERS ],
+		     char endpoints[ MAX_PLAYERS ][ 64 ] )
 {
-  int stdoutPipe[ 2 ], p, arg;
-  char handsString[ 16 ], rngString[ 16 ];
-  char startupTimeoutString[ 16 ], responseTimeoutString[ 16 ];
-  char handTimeoutString[ 16 ], avgHandTimeString[ 16 ];
-  char *argv[ MAX_PLAYERS + 64 ];
+  int p, pos, t;
+  char token[ 64 ];
 
-  if( pipe( stdoutPipe ) < 0 ) {
+  pos = 0;
+  for( p = 0; p < numPlayers; ++p ) {
 
-    fprintf( stderr, "BM_ERROR: could not create pipe for new dealer\n" );
-    exit( EXIT_FAILURE );
-  }
+    if( sscanf( &portString[ pos ], " %63s%n", token, &t ) < 1
+	|| ( !isUnixEndpoint( token )
+	     && sscanf( token, "%"SCNu16, &ports[ p ] ) < 1 ) ) {
 
-  job->dealerPID = fork();
-  if( job->dealerPID < 0 ) {
+      fprintf( stderr,
+	       "BM_ERROR: could not get port for player %d from dealer\n",
+	       p + 1 );
+      return -1;
+    }
+    pos += t;
 
-    fprintf( stderr, "BM_ERROR: fork() failed\n" );
-    exit( EXIT_FAILURE );
-  }
-  if( !job->dealerPID ) {
-    /* child runs the dealer command */
-    int stderrfd;
-    char tag[ READBUF_LEN ];
+    if( isUnixEndpoint( token ) ) {
 
-    snprintf( tag, sizeof( tag ), "%s/%s.stderr", BM_LOGDIR, job->tag );
-    stderrfd = open( tag, O_WRONLY | O_APPEND | O_CREAT, 0644 );
-    if( stderrfd < 0 ) {
+      strcpy( endpoints[ p ], token );
+      ports[ p ] = 0;
+    } else {
 
-      fprintf( stderr,
-	       "BM_ERROR: could not create error log %s\n",
-	       tag );
-      exit( EXIT_FAILURE );
+      endpoints[ p ][ 0 ] = 0;
     }
-    dup2( stderrfd, 2 );
+  }
 
-    /* change stdout to be the write end of the pipe */
-    close( stdoutPipe[ 0 ] );
-    dup2( stdoutPipe[ 1 ], 1 );
+  return 0;
+}
 
-    arg = 0;
+/* ask a dealer worker to start the dealer for job, which waits for
+   the ports to come back in handleWorkerMessage */
+void startWorkerDealer( ServerState *serv,
+			MatchJob *job,
+			const DealerArgs *args )
+{
+  int arg, len, r;
+  char message[ BM_WORKER_MESSAGE_LEN ];
 
-    argv[ arg ] = BM_DEALER;
-    ++arg;
+  job->worker = serv->nextWorker;
+  serv->nextWorker = ( serv->nextWorker + 1 ) % serv->numWorkers;
+  job->workerJobId = serv->nextWorkerJobId;
+  ++serv->nextWorkerJobId;
+  job->waitingForPorts = 1;
 
-    snprintf( tag, sizeof( tag ), "%s/%s", BM_LOGDIR, job->tag );
-    argv[ arg ] = tag;
-    ++arg;
+  len = snprintf( message, sizeof( message ), "RUN\t%"PRIu32"\t%s/%s.stderr",
+		  job->workerJobId, BM_LOGDIR, job->tag );
+  for( arg = 0; args->argv[ arg ] != NULL && len < sizeof( message ); ++arg ) {
 
-    argv[ arg ] = match->gameConf->gameFile;
-    ++arg;
+    len += snprintf( &message[ len ], sizeof( message ) - len,
+		     "\t%s", args->argv[ arg ] );
+  }
+  if( len >= sizeof( message ) ) {
 
-    snprintf( handsString, 
-	      sizeof( handsString ), 
-	      "%"PRIu32, 
-	      match->gameConf->matchHands );
-    argv[ arg ] = handsString;
-    ++arg;
+    fprintf( stderr, "BM_ERROR: dealer command too long for worker\n" );
+    exit( EXIT_FAILURE );
+  }
 
-    snprintf( rngString, sizeof( rngString ), "%"PRIu32, rngSeed );
-    argv[ arg ] = rngString;
-    ++arg;
+  r = write( serv->workers[ job->worker ].fd, message, len );
+  if( r != len ) {
 
-    for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+    fprintf( stderr, "BM_ERROR: could not send match to dealer worker\n" );
+    exit( EXIT_FAILURE );
+  }
+}
 
-      if( match->players[ p ].isNetworkPlayer ) {
+/* ask job's agent to run the dealer and bots for job, which waits for
+   the ports to come back in handleAgentMessage */
+void startAgentDealer( ServerState *serv,
+		       const Match *match,
+		       MatchJob *job,
+		       const DealerArgs *args )
+{
+  int p, arg, len;
+  Connection *agent = (Connection *)LLPoolGetItem( job->agent );
+  char message[ READBUF_LEN ];
+
+  job->workerJobId = serv->nextWorkerJobId;
+  ++serv->nextWorkerJobId;
+  job->waitingForPorts = 1;
+  ++agent->agentRunningJobs;
+
+  len = snprintf( message, sizeof( message ), "JOB\t%"PRIu32"\t%d\t%s/%s.stderr",
+		  job->workerJobId, match->gameConf->game->numPlayers,
+		  BM_LOGDIR, job->tag );
+  for( p = 0; p < match->gameConf->game->numPlayers
+	 && len < sizeof( message ); ++p ) {
+
+    len += snprintf( &message[ len ], sizeof( message ) - len, "\t%s",
+		     match->players[ p ].isNetworkPlayer ? "-"
+		     : ( (BotSpec *)LLPoolGetItem( match->players[ p ].entry ) )
+		     ->command );
+  }
+  for( arg = 0; args->argv[ arg ] != NULL && len < sizeof( message ); ++arg ) {
 
-	argv[ arg ]
-	  = ( (Connection *)LLPoolGetItem( match->players[ p ].entry ) )
-	  ->user->name;
-      } else {
+    len += snprintf( &message[ len ], sizeof( message ) - len,
+		     "\t%s", args->argv[ arg ] );
+  }
+  if( len < sizeof( message ) ) {
 
-	argv[ arg ]
-	  = ( (BotSpec *)LLPoolGetItem( match->players[ p ].entry ) )->name;
-      }
-      ++arg;
-    }
+    len += snprintf( &message[ len ], sizeof( message ) - len, "\n" );
+  }
+  if( len >= sizeof( message ) ) {
 
-    if( conf->startupTimeoutSecs ) {
+    fprintf( stderr, "BM_ERROR: dealer command too long for agent\n" );
+    exit( EXIT_FAILURE );
+  }
 
-      argv[ arg ] = "--start_timeout";
-      ++arg;
+  /* if the agent has gone, the job is finished off with the agent's
+     other jobs when its connection is cleaned up */
+  if( write( agent->connBuf->fd, message, len ) != len ) {
 
-      snprintf( startupTimeoutString,
-                sizeof( startupTimeoutString ),
-                "%d",
-                (int)conf->startupTimeoutSecs * 1000 );
-      argv[ arg ] = startupTimeoutString;
-      ++arg;
-    }
+    fprintf( stderr, "BM_ERROR: could not send job to agent %s\n",
+	     agent->agentHost );
+    closeConnection( serv, job->agent );
+  }
+}
 
-    /* Add maximum per action timeout argument */
-    argv[ arg ] = "--t_response";
-    ++arg;
+/* pin the calling process to cores before it runs a command
+   cores may be NULL to leave it wherever it was */
+void setChildCores( const cpu_set_t *cores )
+{
+  if( cores != NULL
+      && sched_setaffinity( 0, sizeof( *cores ), cores ) < 0 ) {
 
-    snprintf( responseTimeoutString, 
-             sizeof( responseTimeoutString ),
-             "%d",
-             (int)conf->responseTimeoutSecs * 1000 );
-    argv[ arg ] = responseTimeoutString;
-    ++arg;
+    fprintf( stderr, "BM_ERROR: could not pin process to its cores\n" );
+  }
+}
 
-    /* Add maximum per hand timeout argument */
-    argv[ arg ] = "--t_hand";
-    ++arg;
+/* run the dealer command in argv, with standard error appended to
+   stderrFile, and standard output going to a pipe whose read end is
+   put in stdoutFD, pinned to cores, or on any core if cores is NULL
+   returns the dealer's pid */
+pid_t forkDealer( char **argv,
+		  const char *stderrFile,
+		  const cpu_set_t *cores,
+		  int *stdoutFD )
+{
+  int stdoutPipe[ 2 ];
+  pid_t pid;
 
-    snprintf( handTimeoutString, 
-             sizeof( handTimeoutString ),
-             "%d",
-             (int)conf->handTimeoutSecs * 1000 );
-    argv[ arg ] = handTimeoutString;
-    ++arg;
+  if( pipe( stdoutPipe ) < 0 ) {
 
-    /* Add average per hand time argument */
-    argv[ arg ] = "--t_per_hand";
-    ++arg;
+    fprintf( stderr, "BM_ERROR: could not create pipe for new dealer\n" );
+    exit( EXIT_FAILURE );
+  }
 
-    snprintf( avgHandTimeString, 
-             sizeof( avgHandTimeString ),
-             "%d",
-             (int)conf->avgHandTimeSecs * 1000 );
-    argv[ arg ] = avgHandTimeString;
-    ++arg;
+  /* neither end should leak into dealers and bots started later */
+  fcntl( stdoutPipe[ 0 ], F_SETFD, FD_CLOEXEC );
+  fcntl( stdoutPipe[ 1 ], F_SETFD, FD_CLOEXEC );
 
+  pid = fork();
+  if( pid < 0 ) {
 
-    argv[ arg ] = "-q";
-    ++arg;
+    fprintf( stderr, "BM_ERROR: fork() failed\n" );
+    exit( EXIT_FAILURE );
+  }
+  if( !pid ) {
+    /* child runs the dealer command */
+    int stderrfd;
 
-    /* Restore the appending behaviour so multiple matches get appended into
-     * the same log file */
-    argv[ arg ] = "-a";
-    ++arg;
+    unblockChildSignal();
+
+    stderrfd = open( stderrFile, O_WRONLY | O_APPEND | O_CREAT, 0644 );
+    if( stderrfd < 0 ) {
+
+      fprintf( stderr,
+	       "BM_ERROR: could not create error log %s\n",
+	       stderrFile );
+      exit( EXIT_FAILURE );
+    }
+    dup2( stderrfd, 2 );
+
+    /* change stdout to be the write end of the pipe */
+    dup2( stdoutPipe[ 1 ], 1 );
 
-    argv[ arg ] = NULL;
+    setChildCores( cores );
 
     execv( BM_DEALER, argv );
 
@@ -1095,54 +1631,85 @@ void startDealer( const Config *conf,
     exit( EXIT_FAILURE );
   }
 
-  /* parent has to talk to child to get ports */
+  close( stdoutPipe[ 1 ] );
+  *stdoutFD = stdoutPipe[ 0 ];
+  return pid;
+}
+
+/* read the line of ports a dealer prints once it is listening
+   returns 0 on success, -1 on failure */
+int readPortString( const int stdoutFD, char portString[ READBUF_LEN ] )
+{
   ssize_t r;
-  int pos, t;
-  fd_set readfds;
-  struct timeval timeout;
-  char portString[ READBUF_LEN ];
 
-  close( stdoutPipe[ 1 ] );
-  timeout.tv_sec = BM_DEALER_WAIT_SECS;
-  timeout.tv_usec = 0;
-  FD_ZERO( &readfds );
-  FD_SET( stdoutPipe[ 0 ], &readfds );
-  if( select( stdoutPipe[ 0 ] + 1, &readfds, NULL, NULL, &timeout ) < 1 ) {
+  /* poll rather than select, as the pipe may be past FD_SETSIZE with
+     enough connections open */
+  if( waitReadable( stdoutFD, monotonicMicros()
+		    + (int64_t)BM_DEALER_WAIT_SECS * 1000000 ) < 0 ) {
 
     fprintf( stderr,
 	     "BM_ERROR: timed out waiting for port string from dealer\n" );
-    exit( EXIT_FAILURE );
+    return -1;
   }
-  r = read( stdoutPipe[ 0 ], portString, READBUF_LEN );
+  r = read( stdoutFD, portString, READBUF_LEN - 1 );
   if( r <= 0 || portString[ r - 1 ] != '\n' ) {
 
     fprintf( stderr, "BM_ERROR: could not read port string from dealer\n" );
-    exit( EXIT_FAILURE );
+    return -1;
   }
   portString[ r ] = 0;
 
-  /* parse the port string */
-  pos = 0;
-  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+  return 0;
+}
+
+void startDealer( const Config *conf,
+		  ServerState *serv,
+		  const Match *match,
+		  MatchJob *job,
+		  const uint32_t rngSeed )
+{
+  DealerArgs args;
+  char stderrFile[ READBUF_LEN ];
+  char portString[ READBUF_LEN ];
 
-    if( sscanf( &portString[ pos ],
-		" %"SCNu16"%n",
-		&job->ports[ p ],
-		&t ) < 1 ) {
+  makeDealerArgs( conf, match, job, rngSeed, &args );
 
-      fprintf( stderr,
-	       "BM_ERROR: could not get port for player %d from dealer\n",
-	       p + 1 );
-      exit( EXIT_FAILURE );
-    }
-    pos += t;
+  job->worker = -1;
+  job->waitingForPorts = 0;
+  if( job->agent != NULL ) {
+
+    startAgentDealer( serv, match, job, &args );
+    return;
+  }
+  if( serv->numWorkers ) {
+
+    startWorkerDealer( serv, job, &args );
+    return;
+  }
+
+  snprintf( stderrFile, sizeof( stderrFile ), "%s/%s.stderr",
+	    BM_LOGDIR, job->tag );
+  job->dealerPID = forkDealer( args.argv, stderrFile,
+			       job->pinned ? &job->cores : NULL,
+			       &job->stdoutFD );
+
+  /* parent has to talk to child to get ports */
+  if( readPortString( job->stdoutFD, portString ) < 0
+      || parsePortString( match->gameConf->game->numPlayers, portString,
+			  job->ports, job->endpoints ) < 0 ) {
+
+    exit( EXIT_FAILURE );
   }
 }
 
+/* endpoint replaces the server's hostname and port if it is not empty
+   cores may be NULL to run the bot on any core */
 pid_t startBot( const ServerState *serv,
 		const BotSpec *bot,
 		const uint16_t port,
-		const int botPosition )
+		const char *endpoint,
+		const int botPosition,
+		const cpu_set_t *cores )
 {
   pid_t pid;
 
@@ -1156,17 +1723,27 @@ pid_t startBot( const ServerState *serv,
     /* child runs the bot command */
     char portString[ 8 ];
     char posString[ 16 ];
+    const char *hostname = serv->hostname;
+
+    unblockChildSignal();
 
     snprintf( portString, sizeof( portString ), "%"PRIu16, port );
+    if( endpoint[ 0 ] ) {
+
+      hostname = endpoint;
+      strcpy( portString, "0" );
+    }
     snprintf( posString, sizeof( posString ), "%d", botPosition );
 
+    setChildCores( cores );
+
     /* throw away bot output */
     dup2( serv->devnullfd, 1 );
     dup2( serv->devnullfd, 2 );
 
     execl( bot->command,
 	   bot->command,
-	   serv->hostname,
+	   hostname,
 	   portString,
 	   posString,
 	   NULL );
@@ -1178,13 +1755,13 @@ pid_t startBot( const ServerState *serv,
   return pid;
 }
 
-int sendStartMessage( const ServerState *serv,
+int sendStartMessage( const char *hostname,
 		      const MatchJob *job,
 		      const Connection *conn,
 		      const uint16_t port )
 {
   int len;
-  char msg[ strlen( serv->hostname ) + 12 + READBUF_LEN ];
+  char msg[ strlen( hostname ) + 12 + READBUF_LEN ];
 
   len = snprintf( msg, sizeof( msg ), "# RUNNING %s\n", job->tag );
   assert( len > 0 );
@@ -1197,7 +1774,7 @@ int sendStartMessage( const ServerState *serv,
   len = snprintf( msg,
                   sizeof( msg ), 
                   "RUN %s %"PRIu16"\n", 
-                  serv->hostname, port );
+                  hostname, port );
   assert( len > 0 );
   if( write( conn->connBuf->fd, msg, len ) < len ) {
 
@@ -1208,33 +1785,55 @@ int sendStartMessage( const ServerState *serv,
   return 0;
 }
 
-MatchJob runMatchJob( const Config *conf,
-		      const ServerState *serv,
-		      LLPoolEntry *matchEntry,
-		      const uint32_t rngSeed )
+/* stop the dealer and any bots job has started */
+void abortJob( const MatchJob *job )
 {
-  int p, botPosition;
-  MatchJob job;
-  Match *match = (Match *)LLPoolGetItem( matchEntry );
-  char tag[ READBUF_LEN ];
+  int p, len;
+  char msg[ 32 ];
 
-  job.matchEntry = matchEntry;
+  fprintf( stderr, "BM_ERROR: aborting job\n" );
 
-  /* make the tag from the match tag */
-  snprintf( tag, sizeof( tag ), "%s.%s", match->user->name, match->tag );
-  job.tag = strdup( tag );
+  if( job->agent != NULL ) {
+    /* the agent knows what it started */
 
-  /* initialise all PIDs to 0 */
-  job.dealerPID = 0;
-  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+    len = snprintf( msg, sizeof( msg ), "KILL\t%"PRIu32"\n",
+		    job->workerJobId );
+    if( write( ( (Connection *)LLPoolGetItem( job->agent ) )->connBuf->fd,
+	       msg, len ) < len ) {
 
-    job.botPID[ p ] = 0;
+      fprintf( stderr, "BM_ERROR: short write to agent\n" );
+    }
+    return;
+  }
+
+  if( job->dealerPID ) {
+
+    kill( job->dealerPID, SIGTERM );
+  }
+  for( p = 0; p < MAX_PLAYERS; ++p ) {
+
+    if( job->botPID[ p ] ) {
+
+      kill( job->botPID[ p ], SIGTERM );
+    }
   }
+}
+
+/* start the bots for job, and tell network players where to connect,
+   once its dealer is listening.  An agent starts the bots for its own
+   jobs, and network players connect to the agent's host.
+   returns 0 on success, or -1 if the job had to be aborted */
+int startJobPlayers( const ServerState *serv, MatchJob *job )
+{
+  int p, botPosition;
+  const char *hostname = serv->hostname;
+  Match *match = (Match *)LLPoolGetItem( job->matchEntry );
+
+  if( job->agent != NULL ) {
 
-  /* start the dealer */
-  startDealer( conf, match, &job, rngSeed );
+    hostname = ( (Connection *)LLPoolGetItem( job->agent ) )->agentHost;
+  }
 
-  /* deal with all the players */
   botPosition = 0;
   for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
 
@@ -1242,280 +1841,2180 @@ MatchJob runMatchJob( const Config *conf,
       /* send message with port to network player to start up */
       Connection *conn = (Connection*)LLPoolGetItem( match->players[ p ].entry );
 
-      if( sendStartMessage( serv, &job, conn, job.ports[ p ] ) < 0 ) {
-	/* abort the job... */
-
-	fprintf( stderr, "BM_ERROR: aborting job\n" );
-
-	kill( job.dealerPID, SIGTERM );
-	while( p > 0 ) {
-	  --p;
-
-	  if( job.botPID[ p ] ) {
+      if( sendStartMessage( hostname, job, conn, job->ports[ p ] ) < 0 ) {
 
-	    kill( job.botPID[ p ], SIGTERM );
-	  }
-	}
-
-	return job;
+	abortJob( job );
+	return -1;
       }
-    } else {
+    } else if( job->agent == NULL ) {
       /* start up bot */
 
-      job.botPID[ p ]
+      job->botPID[ p ]
 	= startBot( serv,
 		    (BotSpec *)LLPoolGetItem( match->players[ p ].entry ),
-		    job.ports[ p ],
-		    botPosition );
+		    job->ports[ p ],
+		    job->endpoints[ p ],
+		    botPosition,
+		    job->pinned ? &job->botCores[ p ] : NULL );
       ++botPosition;
     }
   }
 
-  return job;
+  return 0;
 }
 
-int startMatchJob( const Config *conf, ServerState *serv )
+/* when pid started, in clock ticks since boot, or 0 if there is no
+   such process.  Together with the pid, this tells a process apart from
+   a later one which reused its pid */
+uint64_t processStartTime( const pid_t pid )
 {
-  int running;
-  LLPoolEntry *cur, *next, *best;
-  Match *curMatch, *bestMatch;
-  MatchJob job;
+  FILE *file;
+  char *s;
+  uint64_t startTime;
+  char line[ READBUF_LEN ];
 
-  /* automatically done adding things if we've got no more matches */
-  if( serv->matches->numEntries == 0 ) {
+  snprintf( line, sizeof( line ), "/proc/%d/stat", (int)pid );
+  file = fopen( line, "r" );
+  if( file == NULL ) {
 
     return 0;
   }
+  s = fgets( line, sizeof( line ), file );
+  fclose( file );
+  if( s == NULL ) {
 
-  /* how many bots are currently running */
-  running = 0;
-  for( cur = LLPoolFirstEntry( serv->jobs );
-       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
-    MatchJob *job = (MatchJob *)LLPoolGetItem( cur );
-
-    running += botsInMatch( (Match*)LLPoolGetItem( job->matchEntry ) );
+    return 0;
   }
 
-  /* pick the best match to start */
-  best = 0;
-  bestMatch = 0;
-  for( cur = LLPoolFirstEntry( serv->matches ); cur != NULL; cur = next ) {
-    next = LLPoolNextEntry( cur );
-    curMatch = (Match *)LLPoolGetItem( cur );
+  /* the command name may have spaces in it, so count fields from the
+     end of it.  The start time is the 20th field after it */
+  s = strrchr( line, ')' );
+  if( s == NULL
+      || sscanf( &s[ 1 ], "%*s %*s %*s %*s %*s %*s %*s %*s %*s %*s"
+		 " %*s %*s %*s %*s %*s %*s %*s %*s %*s %"SCNu64,
+		 &startTime ) < 1 ) {
 
-    if( curMatch->isRunning ) {
+    return 0;
+  }
+
+  return startTime;
+}
+
+/* the queue journal is an append-only file of records:
+     MATCH id runs runsStarted deadline useRngForSeed rngInit rngSeed
+       user game tag player ...
+   for a match which was queued, where runs have yet to start
+     START id
+   when a run starts,
+     DEALER id pid startTime
+   once the run's dealer is running here,
+     RETRY id
+   when a run has to be started again, and
+     END id
+   when the run is over.  Matches with network players are left out, as
+   their players can't come back after a restart */
+
+/* append a record to the queue journal, if there is one.  Records are
+   flushed straight away, so they survive the server crashing */
+void writeJournal( ServerState *serv, const char *format, ... )
+{
+  va_list ap;
+
+  if( serv->journal == NULL ) {
+
+    return;
+  }
+
+  va_start( ap, format );
+  vfprintf( serv->journal, format, ap );
+  va_end( ap );
+  fflush( serv->journal );
+  ++serv->journalRecords;
+}
+
+/* write the MATCH record for match, with any run under way counted as
+   not started yet */
+void writeJournalMatch( FILE *file, const Match *match )
+{
+  int p;
+
+  fprintf( file, "MATCH %"PRIu32" %d %"PRIu32" %"PRId64" %d %"PRIu32
+	   " %"PRIu32" %s %s %s", match->journalId,
+	   match->numRuns + match->isRunning,
+	   match->runsStarted - match->isRunning, match->sched.deadline,
+	   match->useRngForSeed, match->rngInit, match->rngSeed,
+	   match->user->name, match->gameConf->gameFile, match->tag );
+  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+
+    fprintf( file, " %s", matchPlayerName( match, p ) );
+  }
+  fprintf( file, "\n" );
+}
+
+/* add a newly queued match to the journal */
+void journalNewMatch( ServerState *serv, Match *match )
+{
+  int p;
+
+  if( serv->journal == NULL ) {
+
+    return;
+  }
+  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+
+    if( match->players[ p ].isNetworkPlayer ) {
+
+      return;
+    }
+  }
+
+  match->journalId = serv->nextJournalId;
+  ++serv->nextJournalId;
+  writeJournalMatch( serv->journal, match );
+  fflush( serv->journal );
+  ++serv->journalRecords;
+}
+
+/* note the dealer of job, which has just started running here, so it
+   can be stopped if the server restarts */
+void journalDealer( ServerState *serv, MatchJob *job )
+{
+  Match *match = (Match *)LLPoolGetItem( job->matchEntry );
+
+  if( serv->journal == NULL || !match->journalId ) {
+
+    return;
+  }
+
+  job->dealerStartTime = processStartTime( job->dealerPID );
+  writeJournal( serv, "DEALER %"PRIu32" %d %"PRIu64"\n", match->journalId,
+		(int)job->dealerPID, job->dealerStartTime );
+}
+
+/* replace the journal with one holding just enough records to get back
+   to the current queue, with matches in the order they were queued */
+void compactJournal( const Config *conf, ServerState *serv )
+{
+  int num, first, i, records;
+  FILE *file;
+  Match **matches;
+  LLPoolEntry *cur;
+  char tempFile[ READBUF_LEN ];
+
+  /* the newest match is at the head of the pool, and ids only go up,
+     so the pool is in reverse order of id */
+  matches = (Match **)malloc( sizeof( Match * )
+			      * ( serv->matches->numEntries + 1 ) );
+  assert( matches != 0 );
+  num = serv->matches->numEntries;
+  i = num;
+  for( cur = LLPoolFirstEntry( serv->matches );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    Match *match = (Match *)LLPoolGetItem( cur );
+
+    if( match->journalId ) {
+
+      --i;
+      matches[ i ] = match;
+    }
+  }
+  first = i;
+
+  snprintf( tempFile, sizeof( tempFile ), "%s.tmp", conf->queueJournal );
+  file = fopen( tempFile, "w" );
+  if( file == NULL ) {
+
+    fprintf( stderr, "BM_ERROR: could not create %s\n", tempFile );
+    exit( EXIT_FAILURE );
+  }
+
+  records = num - first;
+  for( i = first; i < num; ++i ) {
+
+    writeJournalMatch( file, matches[ i ] );
+  }
+  free( matches );
+
+  for( cur = LLPoolFirstEntry( serv->jobs );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    MatchJob *job = (MatchJob *)LLPoolGetItem( cur );
+    Match *match = (Match *)LLPoolGetItem( job->matchEntry );
+
+    if( !match->journalId ) {
+      continue;
+    }
+
+    fprintf( file, "START %"PRIu32"\n", match->journalId );
+    ++records;
+    if( job->dealerPID && job->dealerStartTime ) {
+
+      fprintf( file, "DEALER %"PRIu32" %d %"PRIu64"\n", match->journalId,
+	       (int)job->dealerPID, job->dealerStartTime );
+      ++records;
+    }
+  }
+
+  /* the new journal must be complete before it replaces the old one */
+  if( fflush( file ) || fsync( fileno( file ) ) < 0 || fclose( file )
+      || rename( tempFile, conf->queueJournal ) < 0 ) {
+
+    fprintf( stderr, "BM_ERROR: could not write queue journal %s\n",
+	     conf->queueJournal );
+    exit( EXIT_FAILURE );
+  }
+
+  if( serv->journal != NULL ) {
+
+    fclose( serv->journal );
+  }
+  serv->journal = fopen( conf->queueJournal, "a" );
+  if( serv->journal == NULL ) {
+
+    fprintf( stderr, "BM_ERROR: could not open queue journal %s\n",
+	     conf->queueJournal );
+    exit( EXIT_FAILURE );
+  }
+  serv->journalRecords = records;
+}
+
+/* compact the journal once most of it is about matches which are done */
+void checkJournal( const Config *conf, ServerState *serv )
+{
+  if( serv->journal != NULL
+      && serv->journalRecords >= BM_JOURNAL_MIN_RECORDS
+      && serv->journalRecords > 4 * serv->matches->numEntries ) {
+
+    compactJournal( conf, serv );
+  }
+}
+
+/* returns the match with id in the replayed journal, or NULL */
+JournalMatch *findJournalMatch( JournalMatch *matches,
+				const int numMatches,
+				const uint32_t id )
+{
+  int low, high, mid;
+
+  /* MATCH records come in order of id */
+  low = 0;
+  high = numMatches;
+  while( low < high ) {
+
+    mid = ( low + high ) / 2;
+    if( matches[ mid ].id < id ) {
+
+      low = mid + 1;
+    } else {
+
+      high = mid;
+    }
+  }
+
+  return low < numMatches && matches[ low ].id == id ? &matches[ low ] : NULL;
+}
+
+/* queue the match in a replayed MATCH record again
+   returns 0 on success, -1 if the match can no longer be run */
+int recoverJournalMatch( const Config *conf,
+			 ServerState *serv,
+			 const JournalMatch *jm )
+{
+  int pos, t, p;
+  LLPoolEntry *entry;
+  Match match;
+  char user[ READBUF_LEN ];
+  char game[ READBUF_LEN ];
+  char tag[ READBUF_LEN ];
+  char name[ READBUF_LEN ];
+
+  if( sscanf( jm->record, "MATCH %*u %*d %*u %"SCNd64" %d %"SCNu32
+	      " %"SCNu32" %s %s %s%n", &match.sched.deadline,
+	      &match.useRngForSeed, &match.rngInit, &match.rngSeed,
+	      user, game, tag, &pos ) < 7 ) {
+
+    return -1;
+  }
+
+  entry = findUser( conf, user );
+  if( entry == NULL ) {
+
+    return -1;
+  }
+  match.user = (UserSpec *)LLPoolGetItem( entry );
+  entry = findGame( conf, game );
+  if( entry == NULL ) {
+
+    return -1;
+  }
+  match.gameConf = (GameConfig *)LLPoolGetItem( entry );
+
+  match.sched.cores = 0;
+  for( p = 0; p < match.gameConf->game->numPlayers; ++p ) {
+
+    if( sscanf( &jm->record[ pos ], " %s%n", name, &t ) < 1 ) {
+
+      return -1;
+    }
+    pos += t;
+
+    match.players[ p ].isNetworkPlayer = 0;
+    match.players[ p ].entry = findBot( match.gameConf, name );
+    if( match.players[ p ].entry == NULL ) {
+
+      return -1;
+    }
+    match.sched.cores
+      += ( (BotSpec *)LLPoolGetItem( match.players[ p ].entry ) )->cores;
+  }
+
+  match.rng = NULL;
+  match.numRuns = jm->numRuns;
+  match.runsStarted = jm->runsStarted;
+  match.journalId = jm->id;
+  match.submitter = NULL;
+  match.tag = strdup( tag );
+  match.isRunning = 0;
+  queueMatch( serv, LLPoolAddItem( serv->matches, &match ) );
+
+  return 0;
+}
+
+/* replay the journal an earlier server left, and queue its matches
+   again.  Runs which were under way have their dealers stopped, as
+   their results would have gone back to the old server, and are run
+   again.  The journal is then compacted, and kept open for appending */
+void openJournal( const Config *conf, ServerState *serv )
+{
+  int numMatches, maxMatches, numQueued, numStopped, pos, i;
+  uint32_t id;
+  int64_t start;
+  FILE *file;
+  JournalMatch *jm, *matches;
+  char type[ 16 ];
+  char line[ READBUF_LEN ];
+
+  serv->journal = NULL;
+  serv->nextJournalId = 1;
+  serv->journalRecords = 0;
+  if( conf->queueJournal == NULL ) {
+
+    return;
+  }
+
+  start = monotonicMicros();
+  numMatches = 0;
+  maxMatches = 0;
+  matches = NULL;
+  file = fopen( conf->queueJournal, "r" );
+  while( file != NULL && fgets( line, sizeof( line ), file ) ) {
+
+    /* a crash can leave the last record half written */
+    if( line[ strlen( line ) - 1 ] != '\n' ) {
+
+      fprintf( stderr, "BM_ERROR: skipping half written journal record\n" );
+      continue;
+    }
+    if( sscanf( line, "%15s %"SCNu32" %n", type, &id, &pos ) < 2 ) {
+
+      fprintf( stderr, "BM_ERROR: skipping bad journal record %s", line );
+      continue;
+    }
+
+    if( !strcmp( type, "MATCH" ) ) {
+
+      if( numMatches && id <= matches[ numMatches - 1 ].id ) {
+
+	fprintf( stderr, "BM_ERROR: skipping out of order journal record %s",
+		 line );
+	continue;
+      }
+      if( numMatches == maxMatches ) {
+
+	maxMatches = maxMatches ? maxMatches * 2 : 1024;
+	matches = (JournalMatch *)realloc( matches, sizeof( JournalMatch )
+					   * maxMatches );
+	assert( matches != 0 );
+      }
+      jm = &matches[ numMatches ];
+      if( sscanf( &line[ pos ], "%d %"SCNu32, &jm->numRuns,
+		  &jm->runsStarted ) < 2 ) {
+
+	fprintf( stderr, "BM_ERROR: skipping bad journal record %s", line );
+	continue;
+      }
+      jm->id = id;
+      jm->isRunning = 0;
+      jm->dealerPID = 0;
+      jm->dealerStartTime = 0;
+      jm->record = strdup( line );
+      ++numMatches;
+      if( id >= serv->nextJournalId ) {
+
+	serv->nextJournalId = id + 1;
+      }
+      continue;
+    }
+
+    jm = findJournalMatch( matches, numMatches, id );
+    if( jm == NULL ) {
+
+      fprintf( stderr, "BM_ERROR: skipping journal record for unknown match %s",
+	       line );
+      continue;
+    }
+    if( !strcmp( type, "START" ) ) {
+
+      --jm->numRuns;
+      ++jm->runsStarted;
+      jm->isRunning = 1;
+    } else if( !strcmp( type, "DEALER" ) ) {
+
+      if( sscanf( &line[ pos ], "%d %"SCNu64, &jm->dealerPID,
+		  &jm->dealerStartTime ) < 2 ) {
+
+	jm->dealerPID = 0;
+      }
+    } else if( !strcmp( type, "RETRY" ) ) {
+
+      ++jm->numRuns;
+    } else if( !strcmp( type, "END" ) ) {
+
+      jm->isRunning = 0;
+      jm->dealerPID = 0;
+    } else {
+
+      fprintf( stderr, "BM_ERROR: skipping bad journal record %s", line );
+    }
+  }
+  if( file != NULL ) {
+
+    fclose( file );
+  }
+
+  numQueued = 0;
+  numStopped = 0;
+  for( i = 0; i < numMatches; ++i ) {
+
+    jm = &matches[ i ];
+    if( jm->isRunning ) {
+
+      /* only stop the dealer if its pid has not been reused */
+      if( jm->dealerPID && jm->dealerStartTime
+	  && processStartTime( jm->dealerPID ) == jm->dealerStartTime
+	  && kill( jm->dealerPID, SIGTERM ) == 0 ) {
+
+	++numStopped;
+      }
+      ++jm->numRuns;
+    }
+
+    if( jm->numRuns > 0 ) {
+
+      if( recoverJournalMatch( conf, serv, jm ) < 0 ) {
+
+	fprintf( stderr, "BM_ERROR: could not queue journalled match "
+		 "again: %s", jm->record );
+      } else {
+
+	++numQueued;
+      }
+    }
+    free( jm->record );
+  }
+  free( matches );
+
+  compactJournal( conf, serv );
+  if( numMatches ) {
+
+    printf( "recovered %d matches from %s in %.3f seconds,"
+	    " stopping %d dealers\n", numQueued, conf->queueJournal,
+	    ( monotonicMicros() - start ) / 1000000.0, numStopped );
+  }
+}
+
+/* seed for the next run of match.  The generator is only made the first
+   time it is needed, carrying on from any runs started before a restart,
+   as a queue of many matches would otherwise be mostly generator state */
+uint32_t nextRunSeed( Match *match )
+{
+  uint32_t i;
+
+  if( !match->useRngForSeed ) {
+
+    return match->rngSeed;
+  }
+
+  if( match->rng == NULL ) {
+
+    match->rng = (rng_state_t *)malloc( sizeof( rng_state_t ) );
+    assert( match->rng != 0 );
+    init_genrand( match->rng, match->rngInit );
+    for( i = 0; i < match->runsStarted; ++i ) {
+
+      genrand_int32( match->rng );
+    }
+  }
+  return genrand_int32( match->rng );
+}
+
+/* number of cores a pinned job for match needs, which is at least one
+   for the dealer */
+int matchCores( const Match *match )
+{
+  return match->sched.cores > 0 ? match->sched.cores : 1;
+}
+
+/* take the lowest numbered free cores for job, and split them between
+   its bots in seat order.  Bots which use no cores, and the dealer,
+   share all of the job's cores.  There must be enough free cores */
+void takeJobCores( ServerState *serv, const Match *match, MatchJob *job )
+{
+  int i, p, cpu, numCores;
+  const BotSpec *bot;
+
+  numCores = matchCores( match );
+  assert( numCores <= serv->numFreeCores );
+  CPU_ZERO( &job->cores );
+  cpu = 0;
+  for( i = 0; i < numCores; ++i ) {
+
+    while( !CPU_ISSET( cpu, &serv->freeCores ) ) {
+
+      ++cpu;
+    }
+    CPU_CLR( cpu, &serv->freeCores );
+    CPU_SET( cpu, &job->cores );
+  }
+  serv->numFreeCores -= numCores;
+
+  cpu = 0;
+  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+
+    CPU_ZERO( &job->botCores[ p ] );
+    if( match->players[ p ].isNetworkPlayer ) {
+      continue;
+    }
+
+    bot = (BotSpec *)LLPoolGetItem( match->players[ p ].entry );
+    if( bot->cores == 0 ) {
+
+      job->botCores[ p ] = job->cores;
+      continue;
+    }
+    for( i = 0; i < bot->cores; ++i ) {
+
+      while( !CPU_ISSET( cpu, &job->cores ) ) {
+
+	++cpu;
+      }
+      CPU_SET( cpu, &job->botCores[ p ] );
+      ++cpu;
+    }
+  }
+
+  job->pinned = 1;
+}
+
+/* give the cores of a finished job back */
+void returnJobCores( ServerState *serv, MatchJob *job )
+{
+  if( !job->pinned ) {
+
+    return;
+  }
+
+  CPU_OR( &serv->freeCores, &serv->freeCores, &job->cores );
+  serv->numFreeCores += CPU_COUNT( &job->cores );
+  job->pinned = 0;
+}
+
+/* agent is the connection of the agent to run the job on, or NULL to
+   run it on this machine.  A job run here with pin set is pinned to
+   cores of its own */
+MatchJob runMatchJob( const Config *conf,
+		      ServerState *serv,
+		      LLPoolEntry *matchEntry,
+		      LLPoolEntry *agent,
+		      const int pin,
+		      const uint32_t rngSeed )
+{
+  int p;
+  MatchJob job;
+  Match *match = (Match *)LLPoolGetItem( matchEntry );
+  char tag[ READBUF_LEN ];
+
+  job.matchEntry = matchEntry;
+  job.agent = agent;
+  job.stdoutFD = -1;
+  job.dealerStartTime = 0;
+  job.pinned = 0;
+  if( pin && agent == NULL ) {
+
+    takeJobCores( serv, match, &job );
+  }
+
+  /* make the tag from the match tag */
+  snprintf( tag, sizeof( tag ), "%s.%s", match->user->name, match->tag );
+  job.tag = strdup( tag );
+
+  /* initialise all PIDs to 0 */
+  job.dealerPID = 0;
+  job.dealerUsage.valid = 0;
+  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+
+    job.botPID[ p ] = 0;
+    job.botUsage[ p ].valid = 0;
+  }
+
+  /* start the dealer, and the players if it is already listening */
+  startDealer( conf, serv, match, &job, rngSeed );
+  if( !job.waitingForPorts ) {
+
+    startJobPlayers( serv, &job );
+  }
+
+  return job;
+}
+
+/* the agent with the most free job slots, or NULL if they are all full */
+LLPoolEntry *pickAgent( ServerState *serv )
+{
+  int slots, bestSlots;
+  LLPoolEntry *cur, *best;
+
+  best = NULL;
+  bestSlots = 0;
+  for( cur = LLPoolFirstEntry( serv->conns );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    Connection *conn = (Connection *)LLPoolGetItem( cur );
+
+    if( conn->status != STATUS_OKAY || !conn->isAgent ) {
+      continue;
+    }
+
+    slots = conn->agentMaxJobs - conn->agentRunningJobs;
+    if( slots > bestSlots ) {
+
+      best = cur;
+      bestSlots = slots;
+    }
+  }
+
+  return best;
+}
+
+/* the scheduler picks which match runs next, and it only
+   gets to start if there is room for its bots, and a free agent
+   to run it on if there are any agents */
+int startMatchJob( const Config *conf, ServerState *serv )
+{
+  int bots, pin;
+  SchedItem *item;
+  LLPoolEntry *matchEntry, *agent;
+  Match *match;
+  MatchJob job, *jobPtr;
+
+  item = schedPeek( &serv->sched );
+  if( item == NULL ) {
+
+    return 0;
+  }
+  matchEntry = (LLPoolEntry *)item->data;
+  match = (Match *)LLPoolGetItem( matchEntry );
+
+  /* check if we have the space to run the bots */
+  bots = botsInMatch( match );
+  if( conf->maxRunningBots && serv->runningBots
+      && bots + serv->runningBots > conf->maxRunningBots ) {
+
+    return 0;
+  }
+
+  agent = NULL;
+  if( serv->numAgents ) {
+
+    agent = pickAgent( serv );
+    if( agent == NULL ) {
+
+      return 0;
+    }
+  }
+
+  /* agents place their own jobs.  A job here waits for enough free
+     cores, unless nothing is running to free any up, when it runs
+     wherever it can rather than never running at all */
+  pin = conf->pinCores && agent == NULL;
+  if( pin && matchCores( match ) > serv->numFreeCores ) {
+
+    if( serv->jobs->numEntries ) {
+
+      return 0;
+    }
+    fprintf( stderr, "BM_ERROR: not enough cores to pin job, "
+	     "running it unpinned\n" );
+    pin = 0;
+  }
+
+  /* create the job */
+  job = runMatchJob( conf,
+		     serv,
+		     matchEntry,
+		     agent,
+		     pin,
+		     nextRunSeed( match ) );
+  assert( job.dealerPID || job.waitingForPorts );
+  jobPtr = (MatchJob *)LLPoolGetItem( LLPoolAddItem( serv->jobs, &job ) );
+
+  /* update status about running jobs */
+  schedStart( &serv->sched, item );
+  serv->runningBots += bots;
+  match->isRunning = 1;
+
+  /* update the match */
+  --match->numRuns;
+  ++match->runsStarted;
+  if( match->journalId ) {
+
+    writeJournal( serv, "START %"PRIu32"\n", match->journalId );
+    if( jobPtr->dealerPID ) {
+
+      journalDealer( serv, jobPtr );
+    }
+  }
+
+  return 1;
+}
+
+/* start the dealer workers, each with every configured game loaded */
+void startDealerWorkers( const Config *conf, ServerState *serv )
+{
+  int w, arg, sv[ 2 ], stderrfd;
+  LLPoolEntry *cur;
+  char **argv;
+  char stderrFile[ READBUF_LEN ];
+
+  argv = (char **)malloc( sizeof( char * )
+			  * ( conf->games->numEntries + 3 ) );
+  assert( argv != 0 );
+  arg = 0;
+  argv[ arg ] = BM_DEALER;
+  ++arg;
+  argv[ arg ] = "--worker";
+  ++arg;
+  for( cur = LLPoolFirstEntry( conf->games );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+
+    argv[ arg ] = ( (GameConfig *)LLPoolGetItem( cur ) )->gameFile;
+    ++arg;
+  }
+  argv[ arg ] = NULL;
+
+  serv->numWorkers = conf->dealerWorkers;
+  serv->nextWorker = 0;
+  serv->nextWorkerJobId = 0;
+  serv->workers = (DealerWorker *)malloc( sizeof( DealerWorker )
+					  * ( serv->numWorkers + 1 ) );
+  assert( serv->workers != 0 );
+  for( w = 0; w < serv->numWorkers; ++w ) {
+
+    if( socketpair( AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv ) < 0 ) {
+
+      fprintf( stderr, "BM_ERROR: could not create dealer worker socket\n" );
+      exit( EXIT_FAILURE );
+    }
+
+    serv->workers[ w ].pid = fork();
+    if( serv->workers[ w ].pid < 0 ) {
+
+      fprintf( stderr, "BM_ERROR: fork() failed\n" );
+      exit( EXIT_FAILURE );
+    }
+    if( !serv->workers[ w ].pid ) {
+      /* child becomes the worker, with the socket as standard input */
+
+      unblockChildSignal();
+
+      snprintf( stderrFile, sizeof( stderrFile ),
+		"%s/dealer_worker.%d.stderr", BM_LOGDIR, w );
+      stderrfd = open( stderrFile, O_WRONLY | O_APPEND | O_CREAT, 0644 );
+      if( stderrfd < 0 ) {
+
+	fprintf( stderr, "BM_ERROR: could not create error log %s\n",
+		 stderrFile );
+	exit( EXIT_FAILURE );
+      }
+      dup2( stderrfd, 2 );
+      dup2( sv[ 1 ], 0 );
+      dup2( serv->devnullfd, 1 );
+
+      execv( BM_DEALER, argv );
+
+      fprintf( stderr, "BM_ERROR: could not start dealer worker\n" );
+      exit( EXIT_FAILURE );
+    }
+
+    close( sv[ 1 ] );
+    serv->workers[ w ].fd = sv[ 0 ];
+    watchFD( serv, sv[ 0 ], &serv->workers[ w ] );
+  }
+
+  free( argv );
+}
+
+void initServerState( const Config *conf, ServerState *serv )
+{
+  struct addrinfo hints, *info;
+  uint16_t port;
+  int hnm, r;
+  char *hn;
+  sigset_t mask;
+  char ipstr[ INET6_ADDRSTRLEN ];
+
+  serv->conns = newLLPool( sizeof( Connection ) );
+  serv->matches = newLLPool( sizeof( Match ) );
+  serv->jobs = newLLPool( sizeof( MatchJob ) );
+  serv->matchResults = newLLPool( sizeof( MatchResults ) );
+  initLLPoolIndex( &serv->matchResultsIndex, offsetof( MatchResults, name ) );
+  serv->pairResults = newLLPool( sizeof( PairResults ) );
+  initLLPoolIndex( &serv->pairResultsIndex, offsetof( PairResults, name ) );
+  serv->numAgents = 0;
+  initScheduler( &serv->sched, conf->maxRunningCores );
+  serv->runningBots = 0;
+
+  /* jobs are pinned to the cores the server itself may run on */
+  CPU_ZERO( &serv->freeCores );
+  serv->numFreeCores = 0;
+  if( conf->pinCores ) {
+
+    if( sched_getaffinity( 0, sizeof( serv->freeCores ),
+			   &serv->freeCores ) < 0 ) {
+
+      fprintf( stderr, "BM_ERROR: could not get available cores\n" );
+      exit( EXIT_FAILURE );
+    }
+    serv->numFreeCores = CPU_COUNT( &serv->freeCores );
+  }
+
+  /* create the socket clients will connect to */
+  port = conf->port;
+  serv->listenSocket = getListenSocket( &port );
+  if( serv->listenSocket < 0 ) {
+
+    fprintf( stderr, "BM_ERROR: could not open socket for listening\n" );
+    exit( EXIT_FAILURE );
+  }
+  printf( "starting server on port %"PRIu16"\n", conf->port );
+
+  /* keep dealer workers, and anything else run by exec, from holding
+     the port open after the server exits */
+  fcntl( serv->listenSocket, F_SETFD, FD_CLOEXEC );
+
+  /* child exits are read from a signalfd, so they wake up the main loop
+     like any other input */
+  sigemptyset( &mask );
+  sigaddset( &mask, SIGCHLD );
+  if( sigprocmask( SIG_BLOCK, &mask, NULL ) < 0
+      || ( serv->signalFD = signalfd( -1, &mask,
+				      SFD_NONBLOCK | SFD_CLOEXEC ) ) < 0 ) {
+
+    fprintf( stderr, "BM_ERROR: could not create signalfd\n" );
+    exit( EXIT_FAILURE );
+  }
+
+  serv->epollFD = epoll_create1( EPOLL_CLOEXEC );
+  if( serv->epollFD < 0 ) {
+
+    fprintf( stderr, "BM_ERROR: could not create epoll instance\n" );
+    exit( EXIT_FAILURE );
+  }
+  watchFD( serv, serv->listenSocket, &serv->listenSocket );
+  watchFD( serv, serv->signalFD, &serv->signalFD );
+
+  init_genrand( &serv->rng, time( NULL ) );
+
+  hnm = sysconf( _SC_HOST_NAME_MAX );
+  hn = (char*)malloc( hnm );
+  assert( hn != 0 );
+  if( gethostname( hn, hnm + 1 ) < 0 ) {
+
+    fprintf( stderr, "BM_ERROR: could not get hostname\n" );
+    exit( EXIT_FAILURE );
+  }
+
+  memset( &hints, 0, sizeof( hints ) );
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  if( ( r = getaddrinfo( hn, NULL, &hints, &info ) ) != 0 ) {
+
+    fprintf( stderr,
+	     "BM_ERROR: could not get address info for host %s\n",
+	     hn );
+    exit( 1 );
+  }
+  free( hn );
+
+  /* Get an address for the server */
+  void *addr;
+
+  /* get the pointer to the address itself,
+   * different fields in IPv4 and IPv6: */
+  if ( info->ai_family == AF_INET ) {
+    /* IPv4 */
+    struct sockaddr_in *ipv4 = ( struct sockaddr_in * ) info->ai_addr;
+    addr = &( ipv4->sin_addr );
+  } else {
+    /* IPv6 */
+    struct sockaddr_in6 *ipv6 = ( struct sockaddr_in6 * ) info->ai_addr;
+    addr = &( ipv6->sin6_addr );
+  }
+
+  /* convert the IP to a string and store it:*/
+  inet_ntop( info->ai_family, addr, ipstr, sizeof( ipstr ) );
+  serv->hostname = strdup( ipstr );
+
+  freeaddrinfo( info ); /* free the linked list */
+
+  serv->devnullfd = open( "/dev/null", O_WRONLY );
+  if( serv->devnullfd < 0 ) {
+
+    fprintf( stderr, "BM_ERROR: could not open /dev/null\n" );
+    exit( EXIT_FAILURE );
+  }
+
+  startDealerWorkers( conf, serv );
+}
+
+void setProcessUsage( ProcessUsage *usage, const struct rusage *ru )
+{
+  usage->valid = 1;
+  usage->userMicros = (int64_t)ru->ru_utime.tv_sec * 1000000
+    + ru->ru_utime.tv_usec;
+  usage->sysMicros = (int64_t)ru->ru_stime.tv_sec * 1000000
+    + ru->ru_stime.tv_usec;
+  usage->maxRSSKB = ru->ru_maxrss;
+}
+
+/* forget about pid if it belongs to job, keeping what it used
+   returns 1 if pid was part of job, 0 otherwise */
+int jobChildExited( MatchJob *job, const pid_t pid, const struct rusage *ru )
+{
+  int p;
+  Match *match = (Match *)LLPoolGetItem( job->matchEntry );
+
+  if( job->dealerPID == pid ) {
+
+    job->dealerPID = 0;
+    setProcessUsage( &job->dealerUsage, ru );
+    return 1;
+  }
+
+  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+
+    if( job->botPID[ p ] == pid ) {
+
+      job->botPID[ p ] = 0;
+      setProcessUsage( &job->botUsage[ p ], ru );
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+int checkIfJobFinished( const MatchJob *job )
+{
+  int p;
+  Match *match = (Match *)LLPoolGetItem( job->matchEntry );
+
+  if( job->dealerPID || job->waitingForPorts ) {
+
+    return 0;
+  }
+
+  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+
+    if( job->botPID[ p ] ) {
+
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+void addValueTotals( ValueTotals *totals,
+		     const uint32_t numHands,
+		     const double total,
+		     const double totalSquared )
+{
+  ++totals->numRuns;
+  totals->numHands += numHands;
+  totals->total += total;
+  totals->totalSquared += totalSquared;
+}
+
+/* returns the results for the match job is a run of, which are added
+   the first time the match finishes a run */
+MatchResults *getMatchResults( ServerState *serv, const MatchJob *job )
+{
+  int p;
+  LLPoolEntry *entry;
+  MatchResults results;
+  Match *match = (Match *)LLPoolGetItem( job->matchEntry );
+
+  entry = LLPoolIndexFind( &serv->matchResultsIndex, job->tag );
+  if( entry == NULL ) {
+
+    memset( &results, 0, sizeof( results ) );
+    results.name = strdup( job->tag );
+    results.numPlayers = match->gameConf->game->numPlayers;
+    for( p = 0; p < results.numPlayers; ++p ) {
+
+      results.playerName[ p ] = strdup( matchPlayerName( match, p ) );
+    }
+    entry = LLPoolAddItem( serv->matchResults, &results );
+    LLPoolIndexAdd( &serv->matchResultsIndex, entry );
+  }
+
+  return (MatchResults *)LLPoolGetItem( entry );
+}
+
+/* returns the results for player against opponent in game, which are
+   added the first time they finish a match together */
+PairResults *getPairResults( ServerState *serv,
+			     const GameConfig *game,
+			     const char *player,
+			     const char *opponent )
+{
+  LLPoolEntry *entry;
+  PairResults results;
+  char name[ READBUF_LEN ];
+
+  snprintf( name, sizeof( name ), "%s %s %s",
+	    game->gameFile, player, opponent );
+  entry = LLPoolIndexFind( &serv->pairResultsIndex, name );
+  if( entry == NULL ) {
+
+    memset( &results, 0, sizeof( results ) );
+    results.name = strdup( name );
+    entry = LLPoolAddItem( serv->pairResults, &results );
+    LLPoolIndexAdd( &serv->pairResultsIndex, entry );
+  }
+
+  return (PairResults *)LLPoolGetItem( entry );
+}
+
+/* add the VALUES line a dealer printed for job (see dealer.c) to the
+   results of its match, and of every pair of players in the match
+   returns 0 on success, -1 on failure */
+int recordValueStats( ServerState *serv,
+		      const MatchJob *job,
+		      const char *line )
+{
+  int p, q, pos, t, numPlayers;
+  uint32_t numHands;
+  double total[ MAX_PLAYERS ], squared[ MAX_PLAYERS ];
+  MatchResults *results;
+  Match *match = (Match *)LLPoolGetItem( job->matchEntry );
+
+  numPlayers = match->gameConf->game->numPlayers;
+  if( sscanf( line, "VALUES:%"SCNu32"%n", &numHands, &pos ) < 1 ) {
+
+    return -1;
+  }
+  for( p = 0; p < numPlayers; ++p ) {
+
+    if( sscanf( &line[ pos ], p ? "|%lf%n" : ":%lf%n",
+		&total[ p ], &t ) < 1 ) {
+
+      return -1;
+    }
+    pos += t;
+  }
+  for( p = 0; p < numPlayers; ++p ) {
+
+    if( sscanf( &line[ pos ], p ? "|%lf%n" : ":%lf%n",
+		&squared[ p ], &t ) < 1 ) {
+
+      return -1;
+    }
+    pos += t;
+  }
+
+  tellSubmitter( match, "# VALUES %s %.*s\n", job->tag,
+		 (int)strcspn( line, "\r\n" ), line );
+
+  results = getMatchResults( serv, job );
+  for( p = 0; p < numPlayers && p < results->numPlayers; ++p ) {
+
+    addValueTotals( &results->seat[ p ], numHands, total[ p ], squared[ p ] );
+    for( q = 0; q < numPlayers; ++q ) {
+
+      if( q == p ) {
+	continue;
+      }
+
+      addValueTotals( &getPairResults( serv, match->gameConf,
+				       matchPlayerName( match, p ),
+				       matchPlayerName( match, q ) )->totals,
+		      numHands, total[ p ], squared[ p ] );
+    }
+  }
+
+  return 0;
+}
+
+/* look for a VALUES line in what a dealer run here printed after its
+   ports, now that it has exited */
+void readDealerValues( ServerState *serv, MatchJob *job )
+{
+  int len;
+  ssize_t r;
+  char *line;
+  char output[ READBUF_LEN ];
+
+  len = 0;
+  while( len < sizeof( output ) - 1
+	 && ( r = read( job->stdoutFD, &output[ len ],
+			sizeof( output ) - 1 - len ) ) > 0 ) {
+
+    len += r;
+  }
+  output[ len ] = 0;
+  close( job->stdoutFD );
+  job->stdoutFD = -1;
+
+  for( line = strtok( output, "\n" ); line != NULL;
+       line = strtok( NULL, "\n" ) ) {
+
+    if( !strncmp( line, "VALUES:", 7 )
+	&& recordValueStats( serv, job, line ) < 0 ) {
+
+      fprintf( stderr, "BM_ERROR: bad value stats for job %s\n", job->tag );
+    }
+  }
+}
+
+void writeProcessUsage( FILE *file,
+			const char *name,
+			const ProcessUsage *usage )
+{
+  if( !usage->valid ) {
+
+    return;
+  }
+
+  fprintf( file, "# USAGE %s user %.3f sys %.3f maxrss_kb %ld\n", name,
+	   usage->userMicros / 1000000.0, usage->sysMicros / 1000000.0,
+	   usage->maxRSSKB );
+}
+
+/* add the CPU time and peak memory of a job's dealer and each of its
+   bots to the end of the job's log, which the dealer has finished with */
+void writeJobUsage( const char *logFile,
+		    const int numPlayers,
+		    char * const *playerNames,
+		    const ProcessUsage *dealerUsage,
+		    const ProcessUsage *botUsage )
+{
+  int p;
+  FILE *file;
+
+  if( !dealerUsage->valid ) {
+    /* the dealer was never reaped, so there is nothing to add */
+
+    return;
+  }
+
+  file = fopen( logFile, "a" );
+  if( file == NULL ) {
+
+    fprintf( stderr, "BM_ERROR: could not add usage to %s\n", logFile );
+    return;
+  }
+
+  writeProcessUsage( file, "dealer", dealerUsage );
+  for( p = 0; p < numPlayers; ++p ) {
+
+    writeProcessUsage( file, playerNames[ p ], &botUsage[ p ] );
+  }
+  fclose( file );
+}
+
+void finishedJob( ServerState *serv, LLPoolEntry *jobEntry )
+{
+  int p;
+  MatchJob *job = (MatchJob *)LLPoolGetItem( jobEntry );
+  Match *match = (Match *)LLPoolGetItem( job->matchEntry );
+  char *playerNames[ MAX_PLAYERS ];
+  char logFile[ READBUF_LEN ];
+
+  if( job->stdoutFD >= 0 ) {
+
+    readDealerValues( serv, job );
+  }
+  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+
+    playerNames[ p ] = matchPlayerName( match, p );
+  }
+  snprintf( logFile, sizeof( logFile ), "%s/%s.log", BM_LOGDIR, job->tag );
+  writeJobUsage( logFile, match->gameConf->game->numPlayers, playerNames,
+		 &job->dealerUsage, job->botUsage );
+  if( match->journalId ) {
+
+    writeJournal( serv, "END %"PRIu32"\n", match->journalId );
+  }
+  tellSubmitter( match, "# FINISHED %s\n", job->tag );
+  returnJobCores( serv, job );
+  free( job->tag );
+  schedFinished( &serv->sched, &match->sched );
+  serv->runningBots -= botsInMatch( match );
+  match->isRunning = 0;
+
+  /* queue up the next run, or forget about the match */
+  if( match->numRuns > 0 ) {
+
+    queueMatch( serv, job->matchEntry );
+  } else {
+
+    removeMatch( serv, job->matchEntry );
+  }
+  LLPoolRemoveEntry( serv->jobs, jobEntry );
+}
+
+/* returns the job the worker knows as jobId, or NULL */
+LLPoolEntry *findWorkerJob( ServerState *serv,
+			    const int worker,
+			    const uint32_t jobId )
+{
+  LLPoolEntry *cur;
+
+  for( cur = LLPoolFirstEntry( serv->jobs );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    MatchJob *job = (MatchJob *)LLPoolGetItem( cur );
+
+    if( job->worker == worker && job->workerJobId == jobId ) {
+
+      return cur;
+    }
+  }
+
+  return NULL;
+}
+
+/* handle a PORTS, VALUES, or EXIT message from a dealer worker, as described in
+   dealer.c */
+void handleWorkerMessage( ServerState *serv, DealerWorker *worker )
+{
+  ssize_t len;
+  int pid, status, pos, r;
+  uint32_t jobId;
+  LLPoolEntry *jobEntry;
+  MatchJob *job;
+  ProcessUsage usage;
+  char message[ BM_WORKER_MESSAGE_LEN + 1 ];
+
+  len = read( worker->fd, message, BM_WORKER_MESSAGE_LEN );
+  if( len <= 0 ) {
+    /* jobs waiting on the worker could never finish */
+
+    fprintf( stderr, "BM_ERROR: dealer worker %d exited\n",
+	     (int)worker->pid );
+    exit( EXIT_FAILURE );
+  }
+  message[ len ] = 0;
+
+  if( sscanf( message, "PORTS %"SCNu32" %d %n", &jobId, &pid, &pos ) >= 2 ) {
+
+    jobEntry = findWorkerJob( serv, worker - serv->workers, jobId );
+    if( jobEntry == NULL ) {
+
+      fprintf( stderr, "BM_ERROR: ports for unknown worker job\n" );
+      return;
+    }
+    job = (MatchJob *)LLPoolGetItem( jobEntry );
+
+    /* the dealer is running now, so it is part of the job */
+    job->dealerPID = pid;
+    job->waitingForPorts = 0;
+    journalDealer( serv, job );
+    if( job->pinned
+	&& sched_setaffinity( pid, sizeof( job->cores ), &job->cores ) < 0 ) {
+
+      fprintf( stderr, "BM_ERROR: could not pin dealer to its cores\n" );
+    }
+    if( parsePortString( ( (Match *)LLPoolGetItem( job->matchEntry ) )
+			 ->gameConf->game->numPlayers, &message[ pos ],
+			 job->ports, job->endpoints ) < 0 ) {
+
+      fprintf( stderr, "BM_ERROR: aborting job\n" );
+      kill( job->dealerPID, SIGTERM );
+      return;
+    }
+    startJobPlayers( serv, job );
+  } else if( sscanf( message, "VALUES %"SCNu32" %n", &jobId, &pos ) >= 1 ) {
+
+    jobEntry = findWorkerJob( serv, worker - serv->workers, jobId );
+    if( jobEntry == NULL ) {
+
+      fprintf( stderr, "BM_ERROR: values for unknown worker job\n" );
+      return;
+    }
+    job = (MatchJob *)LLPoolGetItem( jobEntry );
+
+    if( recordValueStats( serv, job, &message[ pos ] ) < 0 ) {
+
+      fprintf( stderr, "BM_ERROR: bad value stats for job %s\n", job->tag );
+    }
+  } else if( ( r = sscanf( message, "EXIT %"SCNu32" %d %"SCNd64" %"SCNd64
+			    " %ld", &jobId, &status, &usage.userMicros,
+			    &usage.sysMicros, &usage.maxRSSKB ) ) >= 2 ) {
+
+    jobEntry = findWorkerJob( serv, worker - serv->workers, jobId );
+    if( jobEntry == NULL ) {
+
+      fprintf( stderr, "BM_ERROR: exit for unknown worker job\n" );
+      return;
+    }
+    job = (MatchJob *)LLPoolGetItem( jobEntry );
+
+    job->dealerPID = 0;
+    job->waitingForPorts = 0;
+    if( r == 5 ) {
+
+      usage.valid = 1;
+      job->dealerUsage = usage;
+    }
+    if( checkIfJobFinished( job ) ) {
+
+      finishedJob( serv, jobEntry );
+    }
+  } else {
+
+    fprintf( stderr, "BM_ERROR: bad message from dealer worker: %s\n",
+	     message );
+  }
+}
+
+/* turn conn into an agent, from the rest of an AGENT maxJobs [host]
+   line, with network players sent to the connection's address if the
+   agent does not give a host
+   returns 0 on success, -1 on failure */
+int startAgent( ServerState *serv, Connection *conn, const char *args )
+{
+  struct sockaddr_in addr;
+  socklen_t addrLen;
+
+  conn->agentHost[ 0 ] = 0;
+  if( conn->isAgent
+      || sscanf( args, " %d %255s", &conn->agentMaxJobs,
+		 conn->agentHost ) < 1
+      || conn->agentMaxJobs < 1 ) {
+
+    return -1;
+  }
+
+  if( conn->agentHost[ 0 ] == 0 ) {
+
+    addrLen = sizeof( addr );
+    if( getpeername( conn->connBuf->fd, (struct sockaddr *)&addr,
+		     &addrLen ) < 0
+	|| addr.sin_family != AF_INET
+	|| inet_ntop( AF_INET, &addr.sin_addr, conn->agentHost,
+		      sizeof( conn->agentHost ) ) == NULL ) {
+
+      return -1;
+    }
+  }
+
+  conn->isAgent = 1;
+  conn->agentRunningJobs = 0;
+  ++serv->numAgents;
+  fprintf( stderr, "agent %s connected, running up to %d jobs\n",
+	   conn->agentHost, conn->agentMaxJobs );
+  return 0;
+}
+
+/* returns the job the agent knows as jobId, or NULL */
+LLPoolEntry *findAgentJob( ServerState *serv,
+			   const LLPoolEntry *agent,
+			   const uint32_t jobId )
+{
+  LLPoolEntry *cur;
+
+  for( cur = LLPoolFirstEntry( serv->jobs );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    MatchJob *job = (MatchJob *)LLPoolGetItem( cur );
+
+    if( job->agent == agent && job->workerJobId == jobId ) {
+
+      return cur;
+    }
+  }
+
+  return NULL;
+}
+
+/* the dealer's logs stay on the agent, so the server keeps a line for
+   each run in logs/<tag>.results with the agent's host, the dealer's
+   exit status, and the final score if there was one */
+void writeAgentResult( const Connection *agent,
+		       const MatchJob *job,
+		       const int status,
+		       const char *score )
+{
+  FILE *file;
+  char filename[ READBUF_LEN ];
+
+  snprintf( filename, sizeof( filename ), "%s/%s.results",
+	    BM_LOGDIR, job->tag );
+  file = fopen( filename, "a" );
+  if( file == NULL ) {
+
+    fprintf( stderr, "BM_ERROR: could not open results file %s\n",
+	     filename );
+    return;
+  }
+  fprintf( file, "%s %d %s\n", agent->agentHost, status,
+	   score[ 0 ] ? score : "NO_SCORE" );
+  fclose( file );
+}
+
+/* handle a PORTS or DONE line from an agent, as described in runAgent */
+void handleAgentMessage( ServerState *serv,
+			 LLPoolEntry *connEntry,
+			 char *line )
+{
+  int pos, status;
+  uint32_t jobId;
+  LLPoolEntry *jobEntry;
+  MatchJob *job;
+  char *score;
+  Connection *conn = (Connection *)LLPoolGetItem( connEntry );
+
+  line[ strcspn( line, "\r\n" ) ] = 0;
+  if( sscanf( line, "PORTS %"SCNu32" %n", &jobId, &pos ) >= 1 ) {
+
+    jobEntry = findAgentJob( serv, connEntry, jobId );
+    if( jobEntry == NULL ) {
+
+      fprintf( stderr, "BM_ERROR: ports for unknown agent job\n" );
+      return;
+    }
+    job = (MatchJob *)LLPoolGetItem( jobEntry );
+
+    job->waitingForPorts = 0;
+    if( parsePortString( ( (Match *)LLPoolGetItem( job->matchEntry ) )
+			 ->gameConf->game->numPlayers, &line[ pos ],
+			 job->ports, job->endpoints ) < 0 ) {
+
+      abortJob( job );
+      return;
+    }
+    startJobPlayers( serv, job );
+  } else if( sscanf( line, "DONE %"SCNu32" %d %n",
+		     &jobId, &status, &pos ) >= 2 ) {
+
+    jobEntry = findAgentJob( serv, connEntry, jobId );
+    if( jobEntry == NULL ) {
+
+      fprintf( stderr, "BM_ERROR: done for unknown agent job\n" );
+      return;
+    }
+    job = (MatchJob *)LLPoolGetItem( jobEntry );
+
+    /* the score goes to the results file, and the values line
+       before it is kept with the server's other results */
+    score = strstr( &line[ pos ], "SCORE:" );
+    if( score == NULL ) {
+
+      score = "";
+    }
+    if( !strncmp( &line[ pos ], "VALUES:", 7 ) ) {
+
+      line[ pos + strcspn( &line[ pos ], " " ) ] = 0;
+      if( recordValueStats( serv, job, &line[ pos ] ) < 0 ) {
+
+	fprintf( stderr, "BM_ERROR: bad value stats for job %s\n",
+		 job->tag );
+      }
+    }
+    writeAgentResult( conn, job, status, score );
+    --conn->agentRunningJobs;
+    finishedJob( serv, jobEntry );
+  } else {
+
+    fprintf( stderr, "BM_ERROR: bad message from agent %s: %s\n",
+	     conn->agentHost, line );
+  }
+}
+
+/* finish off the jobs of an agent whose connection has closed, giving
+   their matches the lost runs back unless a network player has gone */
+void finishAgentJobs( ServerState *serv, LLPoolEntry *connEntry )
+{
+  int p, retry;
+  LLPoolEntry *cur, *next;
+
+  for( cur = LLPoolFirstEntry( serv->jobs ); cur != NULL; cur = next ) {
+    next = LLPoolNextEntry( cur );
+    MatchJob *job = (MatchJob *)LLPoolGetItem( cur );
+    Match *match = (Match *)LLPoolGetItem( job->matchEntry );
+
+    if( job->agent != connEntry ) {
+      continue;
+    }
+
+    retry = 1;
+    for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
+
+      if( match->players[ p ].isNetworkPlayer
+	  && ( (Connection *)LLPoolGetItem( match->players[ p ].entry ) )
+	  ->status == STATUS_CLOSED ) {
+
+	retry = 0;
+      }
+    }
+
+    fprintf( stderr, "BM_ERROR: lost job %s on agent %s%s\n", job->tag,
+	     ( (Connection *)LLPoolGetItem( connEntry ) )->agentHost,
+	     retry ? ", running it again" : "" );
+    if( retry ) {
+
+      ++match->numRuns;
+      if( match->journalId ) {
+
+	writeJournal( serv, "RETRY %"PRIu32"\n", match->journalId );
+      }
+    }
+    finishedJob( serv, cur );
+  }
+}
+
+/* print runs, hands, total, and mean and standard deviation per hand */
+int printValueTotals( char *line, const size_t len, const ValueTotals *totals )
+{
+  double mean, variance;
+
+  mean = totals->numHands ? totals->total / totals->numHands : 0.0;
+  variance = 0.0;
+  if( totals->numHands > 1 ) {
+
+    variance = ( totals->totalSquared - mean * totals->total )
+      / ( totals->numHands - 1 );
+  }
+
+  return snprintf( line, len, "runs %"PRIu32" hands %"PRIu64
+		   " total %.3f mean %.3f sd %.3f\n",
+		   totals->numRuns, totals->numHands, totals->total, mean,
+		   variance > 0.0 ? sqrt( variance ) : 0.0 );
+}
+
+/* write the results kept from every finished run, a line for each
+   seat of each match, and each player against each opponent */
+void writeResults( const ServerState *serv, int fd )
+{
+  int r, p;
+  LLPoolEntry *cur;
+  char line[ READBUF_LEN * 4 ];
+
+  if( serv->matchResults->numEntries == 0 ) {
+    r = write( fd, "No results\n", 11 );
+  }
+
+  for( cur = LLPoolFirstEntry( serv->matchResults );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    MatchResults *results = (MatchResults *)LLPoolGetItem( cur );
+
+    for( p = 0; p < results->numPlayers; ++p ) {
+
+      r = snprintf( line, sizeof( line ), "MATCH %s %s ",
+		    results->name, results->playerName[ p ] );
+      assert( r > 0 );
+      r += printValueTotals( &line[ r ], sizeof( line ) - r,
+			     &results->seat[ p ] );
+      r = write( fd, line, r );
+    }
+  }
+
+  for( cur = LLPoolFirstEntry( serv->pairResults );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    PairResults *results = (PairResults *)LLPoolGetItem( cur );
+
+    r = snprintf( line, sizeof( line ), "PAIR %s ", results->name );
+    assert( r > 0 );
+    r += printValueTotals( &line[ r ], sizeof( line ) - r,
+			   &results->totals );
+    r = write( fd, line, r );
+  }
+}
+
+void handleConnection( Config *conf, ServerState *serv,
+		       LLPoolEntry *connEntry )
+{
+  int r;
+  Connection *conn = (Connection *)LLPoolGetItem( connEntry );
+  char *line;
+
+  /* handle every line already read, as epoll will not report lines
+     left in the read buffer */
+  while( ( r = getLineView( conn->connBuf, &line, 0 ) ) >= 0 ) {
+
+    if( r == 0 ) {
+
+      closeConnection( serv, connEntry );
+      return;
+    }
+
+    if( conn->isAgent ) {
+
+      handleAgentMessage( serv, connEntry, line );
+      continue;
+    }
+
+    if( conn->status == STATUS_UNVALIDATED ) {
+      UserSpec *user;
+
+      user = validateLogon( conf, line );
+      if( user == NULL ) {
+	/* couldn't authenticate */
+
+	r = write( conn->connBuf->fd, "BAD LOGON\n", 10 );
+	fprintf( stderr, "BM_ERROR: connection failed to log in\n" );
+	closeConnection( serv, connEntry );
+	return;
+      }
+
+      /* send an okay message */
+      r = write( conn->connBuf->fd, "LOGON OKAY - type help for commands\n", 36 );
+
+      /* connection status is now okay */
+      conn->user = user;
+      conn->status = STATUS_OKAY;
+      continue;
+    }
+
+    if( !strncasecmp( line, "HELP", 4 ) ) {
+
+      writeHelpMessage( conn->connBuf->fd );
+    } else if( !strncasecmp( line, "GAMES", 5 ) ) {
+
+      writeGameList( conf, conn->connBuf->fd );
+    } else if( !strncasecmp( line, "QSTAT", 5 ) ) {
 
-      continue;
+      writeQueueStatus( conf, serv, conn->connBuf->fd );
+    } else if( !strncasecmp( line, "RESULTS", 7 ) ) {
+
+      writeResults( serv, conn->connBuf->fd );
+    } else if( !strncasecmp( line, "RUNMATCHES", 10 ) ) {
+      Match match;
+      LLPoolEntry *matchEntry;
+
+      if( parseMatchSpec( conf, serv, &line[ 10 ], connEntry, &match ) < 0 ) {
+
+	fprintf( stderr, "BM_ERROR: bad RUNMATCHES command: %s", line );
+	r = write( conn->connBuf->fd, "BAD RUNMATCHES COMMAND\n", 23 );
+	continue;
+      }
+      match.user = ( (Connection *)LLPoolGetItem( connEntry ) )->user;
+      match.isRunning = 0;
+      if( match.numRuns == 0 ) {
+
+	free( match.tag );
+	continue;
+      }
+      matchEntry = LLPoolAddItem( serv->matches, &match );
+      queueMatch( serv, matchEntry );
+      journalNewMatch( serv, (Match *)LLPoolGetItem( matchEntry ) );
+    } else if( !strncasecmp( line, "AGENT", 5 ) ) {
+
+      if( startAgent( serv, conn, &line[ 5 ] ) < 0 ) {
+
+	fprintf( stderr, "BM_ERROR: bad AGENT command: %s", line );
+	r = write( conn->connBuf->fd, "BAD AGENT COMMAND\n", 18 );
+	continue;
+      }
+      r = write( conn->connBuf->fd, "AGENT OKAY\n", 11 );
+    } else {
+
+      r = write( conn->connBuf->fd, "UNKNOWN\n", 8 );
     }
+  }
+}
 
-    if( curMatch->numRuns <= 0 ) {
-      /* match is finished - clean it up */
+/* reap every child which has exited, and clean up any finished jobs */
+void handleChildExits( ServerState *serv )
+{
+  int status;
+  pid_t pid;
+  struct signalfd_siginfo info;
+  struct rusage usage;
+  LLPoolEntry *cur;
 
-      free( curMatch->tag );
-      LLPoolRemoveEntry( serv->matches, cur );
-      continue;
+  /* several exits can be merged into one signal, so the signals are
+     only used as a wake up, and wait4 finds the children */
+  while( read( serv->signalFD, &info, sizeof( info ) ) == sizeof( info ) );
+
+  while( ( pid = wait4( -1, &status, WNOHANG, &usage ) ) > 0 ) {
+
+    for( cur = LLPoolFirstEntry( serv->jobs );
+	 cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+      MatchJob *job = (MatchJob *)LLPoolGetItem( cur );
+
+      if( jobChildExited( job, pid, &usage ) ) {
+
+	if( checkIfJobFinished( job ) ) {
+
+	  finishedJob( serv, cur );
+	}
+	break;
+      }
     }
+  }
+}
+
+/* start the dealer and bots for a JOB line from the server */
+void startAgentJob( AgentState *agent, char *line )
+{
+  int numFields, p, botPosition;
+  AgentJob job, *jobPtr;
+  BotSpec bot;
+  uint16_t ports[ MAX_PLAYERS ];
+  char endpoints[ MAX_PLAYERS ][ 64 ];
+  char *fields[ BM_AGENT_MAX_FIELDS + 1 ];
+  char portString[ READBUF_LEN ];
+  char msg[ READBUF_LEN + 32 ];
+
+  line[ strcspn( line, "\r\n" ) ] = 0;
+  numFields = 0;
+  while( numFields < BM_AGENT_MAX_FIELDS
+	 && ( fields[ numFields ] = strsep( &line, "\t" ) ) != NULL ) {
+
+    ++numFields;
+  }
+  fields[ numFields ] = NULL;
+  if( line != NULL || numFields < 5
+      || sscanf( fields[ 1 ], "%"SCNu32, &job.id ) < 1
+      || sscanf( fields[ 2 ], "%d", &job.numPlayers ) < 1
+      || job.numPlayers < 1 || job.numPlayers > MAX_PLAYERS
+      || numFields < 9 + 2 * job.numPlayers ) {
+
+    fprintf( stderr, "BM_ERROR: bad JOB line from server\n" );
+    return;
+  }
+
+  /* the dealer's arguments start with the match name, game, hands,
+     and seed, followed by the player names */
+  snprintf( msg, sizeof( msg ), "%s.log", fields[ 5 + job.numPlayers ] );
+  job.logFile = strdup( msg );
+  for( p = 0; p < job.numPlayers; ++p ) {
+
+    job.botPID[ p ] = 0;
+    job.botUsage[ p ].valid = 0;
+    job.playerNames[ p ] = strdup( fields[ 9 + job.numPlayers + p ] );
+  }
+  job.dealerStatus = 0;
+  job.dealerUsage.valid = 0;
+
+  job.dealerPID = forkDealer( &fields[ 4 + job.numPlayers ], fields[ 3 ],
+			      NULL, &job.stdoutFD );
+  jobPtr = (AgentJob *)LLPoolGetItem( LLPoolAddItem( agent->jobs, &job ) );
+
+  /* if the dealer never gets going, the job is done once it exits */
+  if( readPortString( jobPtr->stdoutFD, portString ) < 0
+      || parsePortString( jobPtr->numPlayers, portString,
+			  ports, endpoints ) < 0 ) {
 
-    if( curMatch->gameConf->maxRunningJobs
-	&& curMatch->gameConf->curRunningJobs
-	>= curMatch->gameConf->maxRunningJobs ) {
-      /* cur refers to a match in a game which is currently too busy */
+    fprintf( stderr, "BM_ERROR: aborting job\n" );
+    kill( jobPtr->dealerPID, SIGTERM );
+    return;
+  }
+
+  botPosition = 0;
+  for( p = 0; p < jobPtr->numPlayers; ++p ) {
 
+    if( !strcmp( fields[ 4 + p ], "-" ) ) {
       continue;
     }
 
-    if( best == 0
-	|| timeIsEarlier( &curMatch->user->waitStart,
-			  &bestMatch->user->waitStart )
-	|| ( !timeIsEarlier( &bestMatch->user->waitStart,
-			     &curMatch->user->waitStart )
-	     && timeIsEarlier( &curMatch->queueTime,
-			       &bestMatch->queueTime ) ) ) {
+    bot.name = fields[ 4 + p ];
+    bot.command = fields[ 4 + p ];
+    bot.cores = 1;
+    jobPtr->botPID[ p ] = startBot( &agent->serv, &bot,
+				    ports[ p ], endpoints[ p ],
+				    botPosition, NULL );
+    ++botPosition;
+  }
 
-      best = cur;
-      bestMatch = curMatch;
-    }
+  /* portString still has the dealer's newline */
+  p = snprintf( msg, sizeof( msg ), "PORTS %"PRIu32" %s",
+		jobPtr->id, portString );
+  if( write( agent->serverBuf->fd, msg, p ) < p ) {
+
+    fprintf( stderr, "BM_ERROR: short write to server\n" );
   }
+}
+
+/* stop the dealer and bots of the job in a KILL line from the server */
+void killAgentJob( AgentState *agent, const char *line )
+{
+  int p;
+  uint32_t id;
+  LLPoolEntry *cur;
 
-  /* return failure if we couldn't find a runnable job */
-  if( best == NULL ) {
+  if( sscanf( line, "KILL %"SCNu32, &id ) < 1 ) {
 
-    return 0;
+    fprintf( stderr, "BM_ERROR: bad KILL line from server\n" );
+    return;
   }
 
-  /* check if we have the space to run the bots */
-  if( conf->maxRunningBots
-      && botsInMatch( bestMatch ) + running > conf->maxRunningBots ) {
+  for( cur = LLPoolFirstEntry( agent->jobs );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    AgentJob *job = (AgentJob *)LLPoolGetItem( cur );
 
-    return 0;
+    if( job->id != id ) {
+      continue;
+    }
+
+    if( job->dealerPID ) {
+
+      kill( job->dealerPID, SIGTERM );
+    }
+    for( p = 0; p < job->numPlayers; ++p ) {
+
+      if( job->botPID[ p ] ) {
+
+	kill( job->botPID[ p ], SIGTERM );
+      }
+    }
+    return;
   }
+}
 
-  /* create the job */
-  job = runMatchJob( conf,
-		     serv,
-		     best,
-		     bestMatch->useRngForSeed
-		     ? genrand_int32( &bestMatch->rng )
-		     : bestMatch->rngSeed );
-  assert( job.dealerPID );
-  LLPoolAddItem( serv->jobs, &job );
+/* tell the server a job is done, with the dealer's exit status and
+   the VALUES and SCORE lines it printed at the end of the match, if it
+   got that far */
+void finishAgentJob( AgentState *agent, LLPoolEntry *jobEntry )
+{
+  int len, status, p;
+  ssize_t r;
+  AgentJob *job = (AgentJob *)LLPoolGetItem( jobEntry );
+  char *line;
+  char output[ READBUF_LEN ];
+  char msg[ READBUF_LEN + 64 ];
+
+  /* the dealer has exited, so everything it printed is in the pipe */
+  len = 0;
+  while( len < sizeof( output ) - 1
+	 && ( r = read( job->stdoutFD, &output[ len ],
+			sizeof( output ) - 1 - len ) ) > 0 ) {
+
+    len += r;
+  }
+  output[ len ] = 0;
+  close( job->stdoutFD );
 
-  /* update status about running jobs */
-  ++( bestMatch->gameConf->curRunningJobs );
-  bestMatch->isRunning = 1;
+  status = WIFEXITED( job->dealerStatus )
+    ? WEXITSTATUS( job->dealerStatus ) : 128 + WTERMSIG( job->dealerStatus );
+  len = snprintf( msg, sizeof( msg ), "DONE %"PRIu32" %d",
+		  job->id, status );
+  for( line = strtok( output, "\n" ); line != NULL;
+       line = strtok( NULL, "\n" ) ) {
 
-  /* update the user */
-  gettimeofday( &bestMatch->user->waitStart, NULL );
+    if( ( !strncmp( line, "VALUES:", 7 ) || !strncmp( line, "SCORE:", 6 ) )
+	&& len < sizeof( msg ) ) {
 
-  /* update the match */
-  --bestMatch->numRuns;
-  gettimeofday( &bestMatch->queueTime, NULL );
+      len += snprintf( &msg[ len ], sizeof( msg ) - len, " %s", line );
+    }
+  }
+  if( len >= sizeof( msg ) - 1 ) {
 
-  return 1;
+    fprintf( stderr, "BM_ERROR: results too long for server\n" );
+    len = snprintf( msg, sizeof( msg ), "DONE %"PRIu32" %d",
+		    job->id, status );
+  }
+  msg[ len ] = '\n';
+  ++len;
+  if( write( agent->serverBuf->fd, msg, len ) < len ) {
+
+    fprintf( stderr, "BM_ERROR: short write to server\n" );
+  }
+
+  writeJobUsage( job->logFile, job->numPlayers, job->playerNames,
+		 &job->dealerUsage, job->botUsage );
+  free( job->logFile );
+  for( p = 0; p < job->numPlayers; ++p ) {
+
+    free( job->playerNames[ p ] );
+  }
+  LLPoolRemoveEntry( agent->jobs, jobEntry );
 }
 
-void initServerState( const Config *conf, ServerState *serv )
+/* reap every child which has exited, and report any finished jobs */
+void handleAgentChildExits( AgentState *agent )
 {
-  struct addrinfo hints, *info;
-  uint16_t port;
-  int hnm, r;
-  char *hn;
-  char ipstr[ INET6_ADDRSTRLEN ];
+  int p, status, found;
+  pid_t pid;
+  struct signalfd_siginfo info;
+  struct rusage usage;
+  LLPoolEntry *cur;
 
-  serv->conns = newLLPool( sizeof( Connection ) );
-  serv->matches = newLLPool( sizeof( Match ) );
-  serv->jobs = newLLPool( sizeof( MatchJob ) );
+  while( read( agent->signalFD, &info, sizeof( info ) ) == sizeof( info ) );
 
-  /* create the socket clients will connect to */
-  port = conf->port;
-  serv->listenSocket = getListenSocket( &port );
-  if( serv->listenSocket < 0 ) {
+  while( ( pid = wait4( -1, &status, WNOHANG, &usage ) ) > 0 ) {
 
-    fprintf( stderr, "BM_ERROR: could not open socket for listening\n" );
-    exit( EXIT_FAILURE );
+    for( cur = LLPoolFirstEntry( agent->jobs );
+	 cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+      AgentJob *job = (AgentJob *)LLPoolGetItem( cur );
+
+      found = 0;
+      if( job->dealerPID == pid ) {
+
+	job->dealerPID = 0;
+	job->dealerStatus = status;
+	setProcessUsage( &job->dealerUsage, &usage );
+	found = 1;
+      }
+      for( p = 0; p < job->numPlayers; ++p ) {
+
+	if( job->botPID[ p ] == pid ) {
+
+	  job->botPID[ p ] = 0;
+	  setProcessUsage( &job->botUsage[ p ], &usage );
+	  found = 1;
+	}
+      }
+      if( !found ) {
+	continue;
+      }
+
+      for( p = 0; p < job->numPlayers && job->botPID[ p ] == 0; ++p );
+      if( job->dealerPID == 0 && p == job->numPlayers ) {
+
+	finishAgentJob( agent, cur );
+      }
+      break;
+    }
   }
-  printf( "starting server on port %"PRIu16"\n", conf->port );
+}
 
-  init_genrand( &serv->rng, time( NULL ) );
+/* connect to the server at serverHost:port as user, and run the jobs
+   it sends until it goes away.  Dealers and bots run in the current
+   directory, which needs the dealer, bots, and game files at the same
+   paths as on the server, and a logs directory.
+
+   After logging in, the agent sends
+     AGENT maxJobs [host]
+   and the server answers AGENT OKAY.  The server then sends
+     JOB <tab> id <tab> numPlayers <tab> stderrFile <tab> seats <tab> argv
+   with a bot command, or - for a network player, for each seat, and the
+   dealer's command line, all separated by tabs.  The agent answers
+     PORTS id ports
+   once the dealer is listening and the bots are started, and
+     DONE id status [VALUES...] [SCORE...]
+   once the dealer and bots have all exited.  The server may send
+     KILL <tab> id
+   to stop a job, which still ends with DONE */
+void runAgent( char *serverHost,
+	       const uint16_t port,
+	       const char *user,
+	       const char *passwd,
+	       const int maxJobs,
+	       const char *host )
+{
+  int sock, len;
+  ssize_t r;
+  sigset_t mask;
+  struct pollfd fds[ 2 ];
+  AgentState agent;
+  LLPoolEntry *cur;
+  char *line;
+  char msg[ READBUF_LEN ];
 
-  hnm = sysconf( _SC_HOST_NAME_MAX );
-  hn = (char*)malloc( hnm );
-  assert( hn != 0 );
-  if( gethostname( hn, hnm + 1 ) < 0 ) {
+  sock = connectTo( serverHost, port );
+  if( sock < 0 ) {
 
-    fprintf( stderr, "BM_ERROR: could not get hostname\n" );
+    fprintf( stderr, "BM_ERROR: could not connect to %s:%"PRIu16"\n",
+	     serverHost, port );
     exit( EXIT_FAILURE );
   }
+  agent.serverBuf = createReadBuf( sock );
+  if( agent.serverBuf == 0 ) {
 
-  memset( &hints, 0, sizeof( hints ) );
-  hints.ai_family = AF_INET;
-  hints.ai_socktype = SOCK_STREAM;
-  if( ( r = getaddrinfo( hn, NULL, &hints, &info ) ) != 0 ) {
-
-    fprintf( stderr,
-	     "BM_ERROR: could not get address info for host %s\n",
-	     hn );
-    exit( 1 );
+    fprintf( stderr, "BM_ERROR: could not create read buffer for socket\n" );
+    exit( EXIT_FAILURE );
   }
-  free( hn );
 
-  /* Get an address for the server */
-  void *addr;
+  len = snprintf( msg, sizeof( msg ), "%s %s\n", user, passwd );
+  if( write( sock, msg, len ) < len
+      || getLine( agent.serverBuf, sizeof( msg ), msg, -1 ) <= 0
+      || strncmp( msg, "LOGON OKAY", 10 ) ) {
 
-  /* get the pointer to the address itself,
-   * different fields in IPv4 and IPv6: */
-  if ( info->ai_family == AF_INET ) {
-    /* IPv4 */
-    struct sockaddr_in *ipv4 = ( struct sockaddr_in * ) info->ai_addr;
-    addr = &( ipv4->sin_addr );
-  } else {
-    /* IPv6 */
-    struct sockaddr_in6 *ipv6 = ( struct sockaddr_in6 * ) info->ai_addr;
-    addr = &( ipv6->sin6_addr );
+    fprintf( stderr, "BM_ERROR: could not log in to server\n" );
+    exit( EXIT_FAILURE );
   }
+  len = snprintf( msg, sizeof( msg ), "AGENT %d %s\n", maxJobs, host );
+  if( write( sock, msg, len ) < len
+      || getLine( agent.serverBuf, sizeof( msg ), msg, -1 ) <= 0
+      || strncmp( msg, "AGENT OKAY", 10 ) ) {
 
-  /* convert the IP to a string and store it:*/
-  inet_ntop( info->ai_family, addr, ipstr, sizeof( ipstr ) );
-  serv->hostname = strdup( ipstr );
+    fprintf( stderr, "BM_ERROR: server did not accept agent\n" );
+    exit( EXIT_FAILURE );
+  }
 
-  freeaddrinfo( info ); /* free the linked list */
+  sigemptyset( &mask );
+  sigaddset( &mask, SIGCHLD );
+  if( sigprocmask( SIG_BLOCK, &mask, NULL ) < 0
+      || ( agent.signalFD = signalfd( -1, &mask,
+				      SFD_NONBLOCK | SFD_CLOEXEC ) ) < 0 ) {
 
-  serv->devnullfd = open( "/dev/null", O_WRONLY );
-  if( serv->devnullfd < 0 ) {
+    fprintf( stderr, "BM_ERROR: could not create signalfd\n" );
+    exit( EXIT_FAILURE );
+  }
+
+  agent.jobs = newLLPool( sizeof( AgentJob ) );
+  agent.serv.hostname = "localhost";
+  agent.serv.devnullfd = open( "/dev/null", O_WRONLY );
+  if( agent.serv.devnullfd < 0 ) {
 
     fprintf( stderr, "BM_ERROR: could not open /dev/null\n" );
     exit( EXIT_FAILURE );
   }
-}
-
-int checkIfJobFinished( MatchJob *job )
-{
-  int status, r, p, allDone;
-  Match *match = (Match *)LLPoolGetItem( job->matchEntry );
+  printf( "agent for %s:%"PRIu16" running up to %d jobs\n",
+	  serverHost, port, maxJobs );
+  fflush( stdout );
 
-  allDone = 1;
+  while( 1 ) {
 
-  if( job->dealerPID ) {
+    fds[ 0 ].fd = sock;
+    fds[ 0 ].events = POLLIN;
+    fds[ 1 ].fd = agent.signalFD;
+    fds[ 1 ].events = POLLIN;
+    if( poll( fds, 2, -1 ) < 0 ) {
 
-    r = waitpid( job->dealerPID, &status, WNOHANG );
-    if( r < 0 ) {
+      if( errno == EINTR ) {
 
-      fprintf( stderr, "BM_ERROR: could not wait on child\n" );
+	continue;
+      }
+      fprintf( stderr, "BM_ERROR: poll failed\n" );
       exit( EXIT_FAILURE );
     }
-    if( r == job->dealerPID ) {
 
-      job->dealerPID = 0;
-    } else {
+    if( fds[ 1 ].revents ) {
 
-      allDone = 0;
+      handleAgentChildExits( &agent );
     }
-  }
 
-  for( p = 0; p < match->gameConf->game->numPlayers; ++p ) {
-    if( job->botPID[ p ] == 0 ) {
+    if( fds[ 0 ].revents == 0 ) {
       continue;
     }
+    while( ( r = getLineView( agent.serverBuf, &line, 0 ) ) >= 0 ) {
 
-    r = waitpid( job->botPID[ p ], &status, WNOHANG );
-    if( r < 0 ) {
+      if( r == 0 ) {
+	/* nobody is left to report to */
 
-      fprintf( stderr, "BM_ERROR: could not wait on child\n" );
-      exit( EXIT_FAILURE );
-    }
-    if( r == job->botPID[ p ] ) {
+	fprintf( stderr, "BM_ERROR: server closed connection\n" );
+	for( cur = LLPoolFirstEntry( agent.jobs );
+	     cur != NULL; cur = LLPoolNextEntry( cur ) ) {
 
-      job->botPID[ p ] = 0;
-    } else {
+	  snprintf( msg, sizeof( msg ), "KILL %"PRIu32,
+		    ( (AgentJob *)LLPoolGetItem( cur ) )->id );
+	  killAgentJob( &agent, msg );
+	}
+	exit( EXIT_FAILURE );
+      }
+
+      if( !strncmp( line, "JOB\t", 4 ) ) {
+
+	startAgentJob( &agent, line );
+      } else if( !strncmp( line, "KILL\t", 5 ) ) {
+
+	killAgentJob( &agent, line );
+      } else {
 
-      allDone = 0;
+	fprintf( stderr, "BM_ERROR: unknown line from server: %s", line );
+      }
     }
   }
-
-  return allDone;
 }
 
-void finishedJob( ServerState *serv, LLPoolEntry *jobEntry )
+/* report on a config which took readMicros to read, and time looking
+   up every bot and user in it */
+void checkConfig( const Config *conf, const int64_t readMicros )
 {
-  MatchJob *job = (MatchJob *)LLPoolGetItem( jobEntry );
-  Match *match = (Match *)LLPoolGetItem( job->matchEntry );
+  int numBots, numLookups;
+  int64_t start;
+  LLPoolEntry *cur, *botCur;
 
-  free( job->tag );
-  --( match->gameConf->curRunningJobs );
-  match->isRunning = 0;
-  LLPoolRemoveEntry( serv->jobs, jobEntry );
+  start = monotonicMicros();
+  numBots = 0;
+  numLookups = 0;
+  for( cur = LLPoolFirstEntry( conf->games );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+    GameConfig *game = (GameConfig *)LLPoolGetItem( cur );
+
+    for( botCur = LLPoolFirstEntry( game->bots );
+	 botCur != NULL; botCur = LLPoolNextEntry( botCur ) ) {
+
+      if( findBot( game, ( (BotSpec *)LLPoolGetItem( botCur ) )->name )
+	  != botCur ) {
+
+	fprintf( stderr, "BM_ERROR: could not find bot %s\n",
+		 ( (BotSpec *)LLPoolGetItem( botCur ) )->name );
+	exit( EXIT_FAILURE );
+      }
+      ++numBots;
+      ++numLookups;
+    }
+  }
+  for( cur = LLPoolFirstEntry( conf->users );
+       cur != NULL; cur = LLPoolNextEntry( cur ) ) {
+
+    if( findUser( conf, ( (UserSpec *)LLPoolGetItem( cur ) )->name ) != cur ) {
+
+      fprintf( stderr, "BM_ERROR: could not find user %s\n",
+	       ( (UserSpec *)LLPoolGetItem( cur ) )->name );
+      exit( EXIT_FAILURE );
+    }
+    ++numLookups;
+  }
+
+  printf( "%d games, %d bots, %d users read in %.3f ms\n",
+	  conf->games->numEntries, numBots, conf->users->numEntries,
+	  readMicros / 1000.0 );
+  printf( "%d lookups in %.3f ms\n",
+	  numLookups, ( monotonicMicros() - start ) / 1000.0 );
 }
 
 int main( int argc, char **argv )
 {
   Config conf;
   ServerState serv;
-  int maxfd;
-  fd_set readfds;
+  int i, n, check;
+  int64_t start;
   LLPoolEntry *cur, *next;
-  struct timeval tv;
+  struct epoll_event events[ BM_MAX_EVENTS ];
+
+  check = 0;
+  if( argc >= 6 && argc <= 8 && !strcmp( argv[ 1 ], "--agent" ) ) {
+    uint16_t port;
+    int maxJobs;
+
+    signal( SIGPIPE, SIG_IGN );
+    maxJobs = sysconf( _SC_NPROCESSORS_ONLN );
+    if( sscanf( argv[ 3 ], "%"SCNu16, &port ) < 1
+	|| ( argc > 6 && sscanf( argv[ 6 ], "%d", &maxJobs ) < 1 )
+	|| maxJobs < 1 ) {
 
-  if( argc < 2 ) {
+      printUsage( stderr );
+      exit( EXIT_FAILURE );
+    }
+    runAgent( argv[ 2 ], port, argv[ 4 ], argv[ 5 ], maxJobs,
+	      argc > 7 ? argv[ 7 ] : "" );
+  } else if( argc == 3 && !strcmp( argv[ 1 ], "--check" ) ) {
+
+    check = 1;
+  } else if( argc != 2 ) {
 
     printUsage( stderr );
     exit( EXIT_FAILURE );
@@ -1524,77 +4023,81 @@ int main( int argc, char **argv )
   /* Ignore SIGPIPE.  It seems that SIGPIPE can be raised when the underlying
    * IO fails with a SIGPIPE.  Unfortunately this causes the entire benchmark
    * server to crash and jobs are lost.  Ignore the signal to avoid death */
-  /* ???: May also need to catch SIGCHLD */
   signal( SIGPIPE, SIG_IGN );
 
   /* use the config file */
   setDefaults( &conf );
-  readConfig( argv[ 1 ], &conf );
+  start = monotonicMicros();
+  readConfig( argv[ argc - 1 ], &conf );
+  if( check ) {
+
+    checkConfig( &conf, monotonicMicros() - start );
+    exit( EXIT_SUCCESS );
+  }
 
   /* initialise server state */
   initServerState( &conf, &serv );
+  openJournal( &conf, &serv );
 
-  /* main I/O loop */
+  /* main I/O loop
+     everything which can change what jobs should run wakes up epoll,
+     so there is no need to time out */
   while( 1 ) {
 
-    /* clean up any finished jobs */
-    for( cur = LLPoolFirstEntry( serv.jobs ); cur != NULL; cur = next ) {
-      next = LLPoolNextEntry( cur );
-      MatchJob *job = (MatchJob *)LLPoolGetItem( cur );
-
-      if( checkIfJobFinished( job ) ) {
-
-	finishedJob( &serv, cur );
-      }
-    }
-
     /* clean up any closed connections */
     for( cur = LLPoolFirstEntry( serv.conns ); cur != NULL; cur = next ) {
       next = LLPoolNextEntry( cur );
 
       if( ( (Connection *)LLPoolGetItem( cur ) )->status == STATUS_CLOSED ) {
 
+	if( ( (Connection *)LLPoolGetItem( cur ) )->isAgent ) {
+
+	  finishAgentJobs( &serv, cur );
+	}
 	LLPoolRemoveEntry( serv.conns, cur );
       }
     }
 
     /* start jobs, up to the maximum */
     while( startMatchJob( &conf, &serv ) );
+    checkJournal( &conf, &serv );
 
     /* wait for input */
-    FD_ZERO( &readfds );
-    FD_SET( serv.listenSocket, &readfds );
-    maxfd = serv.listenSocket;
-    tv.tv_sec = BM_MAX_IOWAIT_SECS;
-    tv.tv_usec = 0;
-    for( cur = LLPoolFirstEntry( serv.conns );
-	 cur != NULL; cur = LLPoolNextEntry( cur ) ) {
-      Connection *conn = (Connection *)LLPoolGetItem( cur );
+    n = epoll_wait( serv.epollFD, events, BM_MAX_EVENTS, -1 );
+    if( n < 0 ) {
 
-      FD_SET( conn->connBuf->fd, &readfds );
-      if( conn->connBuf->fd > maxfd ) {
+      if( errno == EINTR ) {
 
-	maxfd = conn->connBuf->fd;
+	continue;
       }
-    }
-    if( select( maxfd + 1, &readfds, NULL, NULL, &tv ) < 0 ) {
-
-      fprintf( stderr, "BM_ERROR: select failed\n" );
+      fprintf( stderr, "BM_ERROR: epoll_wait failed\n" );
       exit( -1 );
     }
 
-    /* process anything that's happened */
-    if( FD_ISSET( serv.listenSocket, &readfds ) ) {
+    /* process anything that's happened
+       closed connections stay in the pool until the top of the loop,
+       so every entry in events is still valid */
+    for( i = 0; i < n; ++i ) {
 
-      handleListenSocket( &conf, &serv );
-    }
-    for( cur = LLPoolFirstEntry( serv.conns );
-	 cur != NULL; cur = LLPoolNextEntry( cur ) ) {
-      Connection *conn = (Connection *)LLPoolGetItem( cur );
+      if( events[ i ].data.ptr == &serv.listenSocket ) {
+
+	handleListenSocket( &conf, &serv );
+      } else if( events[ i ].data.ptr == &serv.signalFD ) {
 
-      if( FD_ISSET( conn->connBuf->fd, &readfds ) ) {
+	handleChildExits( &serv );
+      } else if( (DealerWorker *)events[ i ].data.ptr >= serv.workers
+		 && (DealerWorker *)events[ i ].data.ptr
+		 < serv.workers + serv.numWorkers ) {
 
-	handleConnection( &conf, &serv, cur );
+	handleWorkerMessage( &serv, (DealerWorker *)events[ i ].data.ptr );
+      } else {
+	LLPoolEntry *entry = (LLPoolEntry *)events[ i ].data.ptr;
+
+	if( ( (Connection *)LLPoolGetItem( entry ) )->status
+	    != STATUS_CLOSED ) {
+
+	  handleConnection( &conf, &serv, entry );
+	}
       }
     }
   }
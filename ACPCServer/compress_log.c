@@ -0,0 +1,133 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+/* convert dealer logs between plain text and the block compressed
+   format in match_log.h, and look inside compressed logs */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "match_log.h"
+
+
+static void printUsage( FILE *file )
+{
+  fprintf( file, "usage: compress_log log compressedLog\n" );
+  fprintf( file, "       compress_log -d log\n" );
+  fprintf( file, "       compress_log -h handId log\n" );
+  fprintf( file, "       compress_log -i log\n" );
+  fprintf( file, "  with no option, writes the text of log, which may be plain or\n" );
+  fprintf( file, "    compressed, to compressedLog as a compressed log\n" );
+  fprintf( file, "  -d prints the text of log\n" );
+  fprintf( file, "  -h prints the text of log from hand handId on\n" );
+  fprintf( file, "  -i prints the block index of log\n" );
+}
+
+int main( int argc, char **argv )
+{
+  int r, mode, c;
+  uint32_t b, handId, numHands;
+  LogReader *log;
+  LogWriter *out;
+  char line[ LOG_BLOCK_LEN ];
+
+  mode = 0;
+  handId = 0;
+  while( ( r = getopt( argc, argv, "dh:i" ) ) != -1 ) {
+
+    if( ( r != 'd' && r != 'h' && r != 'i' )
+	|| ( r == 'h' && sscanf( optarg, "%"SCNu32, &handId ) < 1 ) ) {
+
+      argc = 0;
+      break;
+    }
+    mode = r;
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
+
+  if( argc < ( mode ? 2 : 3 ) ) {
+
+    printUsage( stderr );
+    exit( EXIT_FAILURE );
+  }
+
+  log = openLogReader( argv[ 1 ] );
+  if( log == NULL ) {
+
+    fprintf( stderr, "ERROR: could not open log %s\n", argv[ 1 ] );
+    exit( EXIT_FAILURE );
+  }
+
+  if( mode == 'i' ) {
+
+    numHands = 0;
+    for( b = 0; b < log->numBlocks && log->compressed; ++b ) {
+
+      printf( "block %"PRIu32" offset %"PRIu64" hands %"PRIu32,
+	      b, log->blocks[ b ].offset, log->blocks[ b ].numHands );
+      if( log->blocks[ b ].numHands ) {
+
+	printf( " %"PRIu32"-%"PRIu32, log->blocks[ b ].firstHand,
+		log->blocks[ b ].lastHand );
+      }
+      printf( "\n" );
+      numHands += log->blocks[ b ].numHands;
+    }
+    printf( "%s log, %"PRIu32" blocks, %"PRIu32" hands\n",
+	    log->compressed ? "compressed" : "plain", log->numBlocks,
+	    numHands );
+    closeLogReader( log );
+    exit( EXIT_SUCCESS );
+  }
+
+  if( mode == 'h' && seekLogHand( log, handId ) < 0 ) {
+
+    fprintf( stderr, "ERROR: no hand %"PRIu32" in %s\n", handId, argv[ 1 ] );
+    exit( EXIT_FAILURE );
+  }
+
+  if( mode ) {
+
+    while( readLogLine( log, line, LOG_BLOCK_LEN ) ) {
+
+      fputs( line, stdout );
+    }
+    closeLogReader( log );
+    exit( EXIT_SUCCESS );
+  }
+
+  out = openLogWriter( argv[ 2 ], 0, 1 );
+  if( out == NULL ) {
+
+    fprintf( stderr, "ERROR: could not open %s\n", argv[ 2 ] );
+    exit( EXIT_FAILURE );
+  }
+  while( readLogLine( log, line, LOG_BLOCK_LEN ) ) {
+
+    /* hands are STATE lines, and everything else is just text */
+    c = -1;
+    if( strncmp( line, "STATE:", 6 )
+	|| sscanf( &line[ 6 ], "%"SCNu32"%n", &handId, &c ) < 1
+	|| line[ 6 + c ] != ':' ) {
+
+      c = -1;
+    }
+    if( writeLog( out, line, strlen( line ),
+		  c < 0 ? (int64_t)-1 : (int64_t)handId ) < 0 ) {
+
+      fprintf( stderr, "ERROR: could not write to %s\n", argv[ 2 ] );
+      exit( EXIT_FAILURE );
+    }
+  }
+  closeLogReader( log );
+  if( closeLogWriter( out ) < 0 ) {
+
+    fprintf( stderr, "ERROR: could not write to %s\n", argv[ 2 ] );
+    exit( EXIT_FAILURE );
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -9,19 +9,37 @@ Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
 #include <unistd.h>
 #include <sys/socket.h>
 #include <sys/time.h>
-#include <sys/select.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <getopt.h>
+#include <signal.h>
+#include <string.h>
+#include <stdarg.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <sys/signalfd.h>
 #include "game.h"
 #include "net.h"
+#include "histogram.h"
+#include "player_plugin.h"
+#include "trace.h"
+#include "binary_protocol.h"
+#include "match_log.h"
 
 
 /* the ports for players to connect to will be printed on standard out
    (in player order)
 
    if log file is enabled, matchName.log will contain finished states
-   and values, followed by the final total values for each player
+   and values, followed by the final total values for each player.
+   With --compress_log, the same text goes to matchName.logz in the
+   block compressed format described in match_log.h instead.  The last
+   block is held in memory, and written out on any exit, or on SIGTERM,
+   SIGINT or SIGHUP, but a dealer killed with SIGKILL loses it
 
    if transaction file is enabled, matchName.tlog will contain a list
    of actions taken and timestamps that is sufficient to recreate an
@@ -30,17 +48,56 @@ Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
    if the quiet option is not enabled, standard error will print out
    the messages sent to and receieved from the players
 
+   if a trace file is given, the messages are instead written to it in
+   the binary format described in trace.h, whether or not the quiet
+   option is enabled.  trace_decode prints the same text as standard
+   error would have had.
+
+   seats given a plugin are played in-process by the plugin, and are
+   printed with a port of 0 since no one needs to connect to them
+
    the final total values for each player will be printed to both
    standard out and standard error
 
+   with --value_stats, a line before the final values gives the number
+   of hands, and each seat's total and squared total of its per hand
+   values, so the mean and variance of each seat's value can be found
+   without reading the log
+     VALUES:hands:total1|total2...:squared1|squared2...:name1|name2...
+
+   in duplicate mode, a copy of the match is played for every rotation
+   of the players around the seats, all at the same time with the same
+   seed.  The ports for all copies are printed on the first line, copy
+   by copy, and each copy writes matchName.dupK.log (and .tlog, and
+   stats and trace files with the same suffix.)  The final values are
+   each player's average over the copies.  Plugin seats on the command
+   line follow the player, not the seat.
+
+   if a stats file is given, per-seat response latency histograms are
+   written to it as JSON every stats interval hands, at the end of the
+   match, and whenever the dealer receives SIGUSR1
+
    exit value is EXIT_SUCCESS if the match was a success,
-   or EXIT_FAILURE on any failure */
+   or EXIT_FAILURE on any failure
+
+   dealer --worker gameDefFile ... does not play a match itself, but
+   reads the games once and then plays the matches bm_server asks for
+   on standard input, each in a forked copy of itself.  See runWorker */
 
 
 #define DEFAULT_MAX_INVALID_ACTIONS UINT32_MAX
 #define DEFAULT_MAX_RESPONSE_MICROS 600000000
 #define DEFAULT_MAX_USED_HAND_MICROS 600000000
 #define DEFAULT_MAX_USED_PER_HAND_MICROS 7000000
+#define DEFAULT_STATS_INTERVAL_HANDS 1000
+
+#define MAX_WORKER_GAMES 64
+#define MAX_WORKER_MESSAGE 4096
+#define MAX_WORKER_ARGS 128
+
+/* response latencies are broken down by the number of actions already
+   made in the round, with the last bin holding everything beyond it */
+#define LATENCY_ACTION_BINS 8
 
 
 typedef struct {
@@ -54,6 +111,38 @@ typedef struct {
   uint64_t usedMatchMicros[ MAX_PLAYERS ];
 } ErrorInfo;
 
+typedef struct {
+  const char *fileName;
+  uint32_t intervalHands;
+
+  Histogram hist[ MAX_PLAYERS ][ MAX_ROUNDS ][ LATENCY_ACTION_BINS ];
+} LatencyStats;
+
+
+typedef struct {
+  void *handle; /* from dlopen, NULL for network seats */
+  const PlayerPlugin *api;
+  void *player;
+} PluginSeat;
+
+
+/* set by the SIGUSR1 handler, checked between actions */
+static volatile sig_atomic_t latencyDumpRequested = 0;
+
+/* a compressed match log holds up to a block of hands in memory, so it
+   is finished at exit(), and by the handler for terminateSignals, which
+   are blocked while the log is being written */
+static LogWriter *matchLog = NULL;
+static sigset_t terminateSignals;
+
+/* games read by a worker, and the worker's control socket and job id
+   in a match it forked, where workerFD is -1 outside of workers */
+static int numWorkerGames = 0;
+static char *workerGameFile[ MAX_WORKER_GAMES ];
+static Game *workerGame[ MAX_WORKER_GAMES ];
+static int workerFD = -1;
+static uint32_t workerJobId;
+
 
 static void printUsage( FILE *file, int verbose )
 {
@@ -61,6 +150,8 @@ static void printUsage( FILE *file, int verbose )
   fprintf( file, "  -f use fixed dealer button at table\n" );
   fprintf( file, "  -l/L disable/enable log file - enabled by default\n" );
   fprintf( file, "  -p player1_port,player2_port,... [default is random]\n" );
+  fprintf( file, "     a port may instead be a Unix domain socket unix:/path or\n" );
+  fprintf( file, "     abstract socket @name, where a lone @ picks a name\n" );
   fprintf( file, "  -q only print errors, warnings, and final value to stderr\n" );
   fprintf( file, "  -t/T disable/enable transaction file - disabled by default\n" );
   fprintf( file, "  -a append to log/transaction files - disabled by default\n" );
@@ -69,11 +160,26 @@ static void printUsage( FILE *file, int verbose )
   fprintf( file, "  --t_per_hand [milliseconds] maximum average player time for match\n" );
   fprintf( file, "  --start_timeout [milliseconds] maximum time to wait for players to connect\n" );
   fprintf( file, "    <0 [default] is no timeout\n" );
+  fprintf( file, "  --stats_file [file] write response latency histograms to file as JSON\n" );
+  fprintf( file, "  --stats_interval [hands] hands between stats file updates [default %d]\n", DEFAULT_STATS_INTERVAL_HANDS );
+  fprintf( file, "    SIGUSR1 also triggers an update\n" );
+  fprintf( file, "  --plugin [seat:plugin.so[:args]] play seat with an in-process plugin\n" );
+  fprintf( file, "  --trace [file] write player messages to a binary trace file instead of stderr\n" );
+  fprintf( file, "  --duplicate play a copy of the match for each rotation of the players at once\n" );
+  fprintf( file, "  --value_stats print the hands and each seat's total and squared value\n" );
+  fprintf( file, "  --compress_log write the log as compressed blocks to matchName.logz\n" );
+  fprintf( file, "usage: dealer --worker gameDefFile ...\n" );
+  fprintf( file, "  run matches for bm_server with the games already loaded\n" );
 }
 
-/* returns >= 0 on success, -1 on error */
-static int scanPortString( const char *string,
-			   uint16_t listenPort[ MAX_PLAYERS ] )
+/* parse a comma separated list of ports and Unix domain endpoints
+   (see net.h,) where a lone @ asks for a generated abstract name
+   modifies string to split out the endpoints, and sets
+   listenEndpoint[ p ] to point to them, or NULL for ports
+   returns >= 0 on success, -1 on error */
+static int scanPortString( char *string,
+			   uint16_t listenPort[ MAX_PLAYERS ],
+			   char *listenEndpoint[ MAX_PLAYERS ] )
 {
   int c, r, p;
 
@@ -94,14 +200,24 @@ static int scanPortString( const char *string,
 
 	return -1;
       }
+      string[ c ] = 0;
       ++c;
     }
 
+    if( isUnixEndpoint( &string[ c ] ) ) {
+
+      listenEndpoint[ p ] = &string[ c ];
+      listenPort[ p ] = 0;
+      c += strcspn( &string[ c ], "," );
+      continue;
+    }
+
     if( sscanf( &string[ c ], "%"SCNu16"%n", &listenPort[ p ], &r ) < 1 ) {
       /* couldn't get a number */
 
       return -1;
     }
+    listenEndpoint[ p ] = NULL;
     c += r;
   }
 
@@ -142,26 +258,51 @@ static int checkErrorInvalidAction( const uint8_t seat, ErrorInfo *info )
   return 0;
 }
 
-/* update the time used by seat
-   returns >= 0 if match should continue, -1 for failure */
-static int checkErrorTimes( const uint8_t seat,
-			    const struct timeval *sendTime,
-			    const struct timeval *recvTime,
-			    ErrorInfo *info )
+/* microseconds between two wall clock times, or 0 if the clock was
+   set back in between */
+static uint64_t wallClockMicros( const struct timeval *start,
+				 const struct timeval *end )
 {
-  uint64_t responseMicros;
+  int64_t micros;
 
-  /* calls to gettimeofday can return earlier times on later calls :/ */
-  if( recvTime->tv_sec < sendTime->tv_sec
-      || ( recvTime->tv_sec == sendTime->tv_sec
-	   && recvTime->tv_usec < sendTime->tv_usec ) ) {
-    return 0;
+  micros = (int64_t)( end->tv_sec - start->tv_sec ) * 1000000
+    + end->tv_usec - start->tv_usec;
+  return micros < 0 ? 0 : micros;
+}
+
+/* monotonicMicros() time at which seat runs out of time for a
+   response sent at sendMicros, whichever of the response, hand, and
+   match limits comes first
+   returns -1 if there is effectively no limit */
+static int64_t responseDeadline( const uint8_t seat, const int64_t sendMicros,
+				 const ErrorInfo *info )
+{
+  uint64_t left;
+
+  left = info->maxResponseMicros;
+  if( info->maxUsedHandMicros - info->usedHandMicros[ seat ] < left ) {
+
+    left = info->maxUsedHandMicros - info->usedHandMicros[ seat ];
+  }
+  if( info->maxUsedMatchMicros - info->usedMatchMicros[ seat ] < left ) {
+
+    left = info->maxUsedMatchMicros - info->usedMatchMicros[ seat ];
   }
 
-  /* figure out how many microseconds the response took */
-  responseMicros = ( recvTime->tv_sec - sendTime->tv_sec ) * 1000000
-    + recvTime->tv_usec - sendTime->tv_usec;
+  /* allow for the (<=) check in checkErrorTimes */
+  if( left >= INT64_MAX - sendMicros ) {
+
+    return -1;
+  }
+  return sendMicros + left + 1;
+}
 
+/* update the time used by seat, which took responseMicros to respond
+   returns >= 0 if match should continue, -1 for failure */
+static int checkErrorTimes( const uint8_t seat,
+			    const uint64_t responseMicros,
+			    ErrorInfo *info )
+{
   /* update usage counts */
   info->usedHandMicros[ seat ] += responseMicros;
   info->usedMatchMicros[ seat ] += responseMicros;
@@ -198,6 +339,215 @@ static int checkErrorNewHand( const Game *game, ErrorInfo *info )
 }
 
 
+static void handleLatencyDumpSignal( int sig )
+{
+  latencyDumpRequested = 1;
+}
+
+static void handleTerminateSignal( int sig )
+{
+  if( matchLog != NULL ) {
+
+    salvageLogWriter( matchLog );
+    matchLog = NULL;
+  }
+  signal( sig, SIG_DFL );
+  raise( sig );
+}
+
+/* close the match log, if it wasn't already
+   returns 0 on success, -1 on failure */
+static int closeMatchLog( void )
+{
+  if( matchLog == NULL ) {
+
+    return 0;
+  }
+  sigprocmask( SIG_BLOCK, &terminateSignals, NULL );
+  if( closeLogWriter( matchLog ) < 0 ) {
+
+    matchLog = NULL;
+    return -1;
+  }
+  matchLog = NULL;
+  return 0;
+}
+
+static void closeMatchLogAtExit( void )
+{
+  closeMatchLog();
+}
+
+/* keep log as the match log, making sure a compressed log is finished
+   however the dealer ends */
+static void setMatchLog( LogWriter *log )
+{
+  struct sigaction action;
+
+  matchLog = log;
+  if( !log->compressed ) {
+    /* plain logs are flushed after every line */
+
+    return;
+  }
+
+  sigemptyset( &terminateSignals );
+  sigaddset( &terminateSignals, SIGTERM );
+  sigaddset( &terminateSignals, SIGINT );
+  sigaddset( &terminateSignals, SIGHUP );
+  memset( &action, 0, sizeof( action ) );
+  action.sa_handler = handleTerminateSignal;
+  action.sa_mask = terminateSignals;
+  sigaction( SIGTERM, &action, NULL );
+  sigaction( SIGINT, &action, NULL );
+  sigaction( SIGHUP, &action, NULL );
+  atexit( closeMatchLogAtExit );
+}
+
+/* writeLog, with the termination signals held off while a compressed
+   log is being changed */
+static int writeMatchLog( LogWriter *log, const char *text, const size_t len,
+			  const int64_t handId )
+{
+  int r;
+  sigset_t oldMask;
+
+  if( !log->compressed ) {
+
+    return writeLog( log, text, len, handId );
+  }
+  sigprocmask( SIG_BLOCK, &terminateSignals, &oldMask );
+  r = writeLog( log, text, len, handId );
+  sigprocmask( SIG_SETMASK, &oldMask, NULL );
+  return r;
+}
+
+static void initLatencyStats( const Game *game, const char *fileName,
+			      const uint32_t intervalHands,
+			      LatencyStats *stats )
+{
+  int s, r, a;
+
+  stats->fileName = fileName;
+  stats->intervalHands = intervalHands;
+
+  for( s = 0; s < game->numPlayers; ++s ) {
+    for( r = 0; r < MAX_ROUNDS; ++r ) {
+      for( a = 0; a < LATENCY_ACTION_BINS; ++a ) {
+
+	initHistogram( &stats->hist[ s ][ r ][ a ] );
+      }
+    }
+  }
+}
+
+/* note how long seat took to respond to state */
+static void recordLatency( const State *state, const uint8_t seat,
+			   const uint64_t responseMicros,
+			   LatencyStats *stats )
+{
+  int actionBin;
+
+  actionBin = state->numActions[ state->round ];
+  if( actionBin >= LATENCY_ACTION_BINS ) {
+
+    actionBin = LATENCY_ACTION_BINS - 1;
+  }
+
+  histogramRecord( &stats->hist[ seat ][ state->round ][ actionBin ],
+		   responseMicros );
+}
+
+/* write string to file as a quoted JSON string */
+static void printJSONString( FILE *file, const char *string )
+{
+  const unsigned char *c;
+
+  fputc( '"', file );
+  for( c = (const unsigned char *)string; *c; ++c ) {
+
+    if( *c == '"' || *c == '\\' ) {
+
+      fputc( '\\', file );
+      fputc( *c, file );
+    } else if( *c < 0x20 || *c == 0x7f ) {
+
+      fprintf( file, "\\u%04x", *c );
+    } else {
+
+      fputc( *c, file );
+    }
+  }
+  fputc( '"', file );
+}
+
+/* write the latency histograms out to the stats file as JSON
+   the file is replaced atomically, so readers never see a partial file */
+static void writeLatencyStats( const Game *game, char *seatName[ MAX_PLAYERS ],
+			       const uint32_t numHandsPlayed,
+			       const LatencyStats *stats )
+{
+  int r, a;
+  uint8_t s;
+  FILE *file;
+  Histogram seatHist, roundHist;
+  char name[ MAX_LINE_LEN ];
+
+  latencyDumpRequested = 0;
+
+  if( snprintf( name, MAX_LINE_LEN, "%s.tmp", stats->fileName )
+      >= MAX_LINE_LEN ) {
+
+    fprintf( stderr, "WARNING: stats file name too long %s\n",
+	     stats->fileName );
+    return;
+  }
+  file = fopen( name, "w" );
+  if( file == NULL ) {
+
+    fprintf( stderr, "WARNING: could not open stats file %s\n", name );
+    return;
+  }
+
+  fprintf( file, "{\"hands\":%"PRIu32",\"seats\":[", numHandsPlayed );
+  for( s = 0; s < game->numPlayers; ++s ) {
+
+    initHistogram( &seatHist );
+    fprintf( file, "%s{\"seat\":%d,\"name\":", s ? "," : "", s + 1 );
+    printJSONString( file, seatName[ s ] );
+    fprintf( file, ",\"rounds\":[" );
+    for( r = 0; r < game->numRounds; ++r ) {
+
+      initHistogram( &roundHist );
+      fprintf( file, "%s{\"round\":%d,\"actions\":[", r ? "," : "", r );
+      for( a = 0; a < LATENCY_ACTION_BINS; ++a ) {
+
+	histogramMerge( &roundHist, &stats->hist[ s ][ r ][ a ] );
+	if( a ) {
+	  fputc( ',', file );
+	}
+	printHistogramJSON( file, &stats->hist[ s ][ r ][ a ] );
+      }
+      fprintf( file, "],\"all\":" );
+      printHistogramJSON( file, &roundHist );
+      fputc( '}', file );
+
+      histogramMerge( &seatHist, &roundHist );
+    }
+    fprintf( file, "],\"all\":" );
+    printHistogramJSON( file, &seatHist );
+    fputc( '}', file );
+  }
+  fprintf( file, "]}\n" );
+
+  if( fclose( file ) != 0 || rename( name, stats->fileName ) < 0 ) {
+
+    fprintf( stderr, "WARNING: could not write stats file %s\n",
+	     stats->fileName );
+  }
+}
+
+
 static uint8_t seatToPlayer( const Game *game, const uint8_t player0Seat,
 			     const uint8_t seat )
 {
@@ -210,29 +560,50 @@ static uint8_t playerToSeat( const Game *game, const uint8_t player0Seat,
   return ( player + player0Seat ) % game->numPlayers;
 }
 
-/* returns >= 0 if match should continue, -1 for failure */
+/* if binary is non-zero, the player gets a binary frame instead of
+   text, but the text is still what gets logged
+   returns >= 0 if match should continue, -1 for failure */
 static int sendPlayerMessage( const Game *game, const MatchState *state,
-			      const int quiet, const uint8_t seat,
-			      const int seatFD, struct timeval *sendTime )
+			      const int quiet, TraceWriter *trace,
+			      const uint8_t seat, ReadBuf *seatBuf,
+			      const int binary,
+			      struct timeval *sendTime, int64_t *sendMicros )
 {
-  int c;
+  int c, len;
   char line[ MAX_LINE_LEN ];
+  uint8_t frame[ BINARY_MAX_FRAME_LEN ];
 
   /* prepare the message */
-  c = printMatchState( game, state, MAX_LINE_LEN, line );
-  if( c < 0 || c > MAX_LINE_LEN - 3 ) {
-    /* message is too long */
+  c = 0;
+  if( !binary || trace != NULL || !quiet ) {
 
-    fprintf( stderr, "ERROR: state message too long\n" );
-    return -1;
+    c = printMatchState( game, state, MAX_LINE_LEN, line );
+    if( c < 0 || c > MAX_LINE_LEN - 3 ) {
+      /* message is too long */
+
+      fprintf( stderr, "ERROR: state message too long\n" );
+      return -1;
+    }
+    line[ c ] = '\r';
+    line[ c + 1 ] = '\n';
+    line[ c + 2 ] = 0;
+    c += 2;
+  }
+  if( binary ) {
+
+    len = makeStateFrame( game, state, frame );
+    if( len < 0 ) {
+
+      fprintf( stderr, "ERROR: state frame too long\n" );
+      return -1;
+    }
+  } else {
+
+    len = c;
   }
-  line[ c ] = '\r';
-  line[ c + 1 ] = '\n';
-  line[ c + 2 ] = 0;
-  c += 2;
 
   /* send it to the player and flush */
-  if( write( seatFD, line, c ) != c ) {
+  if( putLine( seatBuf, binary ? (const char *)frame : line, len ) != len ) {
     /* couldn't send the line */
 
     fprintf( stderr, "ERROR: could not send state to seat %"PRIu8"\n",
@@ -240,11 +611,20 @@ static int sendPlayerMessage( const Game *game, const MatchState *state,
     return -1;
   }
 
-  /* note when we sent the message */
+  /* note when we sent the message - the wall clock time is for logs,
+     the monotonic time for keeping track of time limits */
+  *sendMicros = monotonicMicros();
   gettimeofday( sendTime, NULL );
 
   /* log the message */
-  if( !quiet ) {
+  if( trace != NULL ) {
+
+    if( traceRecord( trace, trace_to, seat, sendTime, line, c ) < 0 ) {
+
+      fprintf( stderr, "ERROR: could not write to trace file\n" );
+      return -1;
+    }
+  } else if( !quiet ) {
     fprintf( stderr, "TO %d at %zu.%.06zu %s", seat + 1,
 	     sendTime->tv_sec, sendTime->tv_usec, line );
   }
@@ -252,68 +632,157 @@ static int sendPlayerMessage( const Game *game, const MatchState *state,
   return 0;
 }
 
-/* returns >= 0 if action/size has been set to a valid action
+/* print the text response which a binary response stands for
+   returns the length of the line, or -1 on failure */
+static int printBinaryResponse( const Game *game, const MatchState *state,
+				const Action *action, char *line )
+{
+  int c, r;
+
+  c = printMatchState( game, state, MAX_LINE_LEN, line );
+  if( c < 0 || c > MAX_LINE_LEN - 2 ) {
+
+    return -1;
+  }
+  line[ c ] = ':';
+  ++c;
+
+  r = printAction( game, action, MAX_LINE_LEN - c, &line[ c ] );
+  if( r < 0 || c + r > MAX_LINE_LEN - 3 ) {
+
+    return -1;
+  }
+  c += r;
+  line[ c ] = '\r';
+  line[ c + 1 ] = '\n';
+  line[ c + 2 ] = 0;
+  return c + 2;
+}
+
+/* if binary is non-zero, the player answers with binary frames
+   returns >= 0 if action/size has been set to a valid action
    returns -1 for failure (disconnect, timeout, too many bad actions, etc) */
 static int readPlayerResponse( const Game *game,
 			       const MatchState *state,
 			       const int quiet,
+			       TraceWriter *trace,
 			       const uint8_t seat,
+			       const int binary,
 			       const struct timeval *sendTime,
+			       const int64_t sendMicros,
 			       ErrorInfo *errorInfo,
+			       LatencyStats *latency,
 			       ReadBuf *readBuf,
 			       Action *action,
 			       struct timeval *recvTime )
 {
   int c, r;
+  ssize_t len;
+  int64_t deadline, recvMicros;
   MatchState tempState;
-  char line[ MAX_LINE_LEN ];
+  char *line, text[ MAX_LINE_LEN ];
+  uint8_t frame[ BINARY_MAX_FRAME_LEN ];
 
+  /* stop waiting as soon as the player runs out of any of its time
+     limits, rather than waiting out the whole response limit */
+  deadline = responseDeadline( seat, sendMicros, errorInfo );
+
+  r = 0;
   while( 1 ) {
 
-    /* read a line of input from player */
-    struct timeval start;
-    gettimeofday( &start, NULL );
-    if( getLine( readBuf, MAX_LINE_LEN, line,
-		 errorInfo->maxResponseMicros ) <= 0 ) {
+    /* read a line of input from player
+       line points into readBuf, and is only good until the next read */
+    if( binary ) {
+
+      len = getFrameDeadline( readBuf, frame, deadline );
+    } else {
+
+      len = getLineViewDeadline( readBuf, &line, deadline );
+    }
+    recvMicros = monotonicMicros();
+    if( len <= 0 ) {
       /* couldn't get any input from player */
 
-      struct timeval after;
-      gettimeofday( &after, NULL );
-      uint64_t micros_spent =
-	(uint64_t)( after.tv_sec - start.tv_sec ) * 1000000
-	+ ( after.tv_usec - start.tv_usec );
       fprintf( stderr, "ERROR: could not get action from seat %"PRIu8"\n",
 	       seat + 1 );
       // Print out how much time has passed so we can see if this was a
       // timeout as opposed to some other sort of failure (e.g., socket
       // closing).
       fprintf( stderr, "%.1f seconds spent waiting; timeout %.1f\n",
-	       micros_spent / 1000000.0,
-	       errorInfo->maxResponseMicros / 1000000.0);
+	       ( recvMicros - sendMicros ) / 1000000.0,
+	       deadline < 0 ? -1.0 : ( deadline - sendMicros ) / 1000000.0 );
       return -1;
     }
 
     /* note when the message arrived */
     gettimeofday( recvTime, NULL );
 
+    if( binary ) {
+      /* only well formed binary responses are logged, as the text
+	 response they stand for */
+
+      r = readResponseFrame( game, frame, len, state, action );
+      if( r > 0 && ( trace != NULL || !quiet ) ) {
+
+	len = printBinaryResponse( game, state, action, text );
+	if( len < 0 ) {
+
+	  fprintf( stderr, "ERROR: response too long to log\n" );
+	  return -1;
+	}
+      } else {
+
+	len = 0;
+      }
+      line = text;
+    }
+
     /* log the response */
-    if( !quiet ) {
+    if( len > 0 && trace != NULL ) {
+
+      if( traceRecord( trace, trace_from, seat, recvTime, line, len ) < 0 ) {
+
+	fprintf( stderr, "ERROR: could not write to trace file\n" );
+	return -1;
+      }
+    } else if( len > 0 && !quiet ) {
       fprintf( stderr, "FROM %d at %zu.%06zu %s", seat + 1,
 	       recvTime->tv_sec, recvTime->tv_usec, line );
     }
 
     /* ignore comments */
-    if( line[ 0 ] == '#' || line[ 0 ] == ';' ) {
+    if( !binary && ( line[ 0 ] == '#' || line[ 0 ] == ';' ) ) {
       continue;
     }
 
+    /* keep track of how long the player took */
+    if( latency != NULL ) {
+
+      recordLatency( &state->state, seat, recvMicros - sendMicros, latency );
+    }
+
     /* check for any timeout issues */
-    if( checkErrorTimes( seat, sendTime, recvTime, errorInfo ) < 0 ) {
+    if( checkErrorTimes( seat, recvMicros - sendMicros, errorInfo ) < 0 ) {
 
       fprintf( stderr, "ERROR: seat %"PRIu8" ran out of time\n", seat + 1 );
       return -1;
     }
 
+    if( binary ) {
+
+      if( r < 0 ) {
+
+	fprintf( stderr, "WARNING: bad binary response\n" );
+	continue;
+      }
+      if( r == 0 ) {
+
+	fprintf( stderr, "WARNING: ignoring un-requested response\n" );
+	continue;
+      }
+      goto checkAction;
+    }
+
     /* parse out the state */
     c = readMatchState( line, game, &tempState );
     if( c < 0 ) {
@@ -347,6 +816,7 @@ static int readPlayerResponse( const Game *game,
     }
     c += r;
 
+  checkAction:
     /* make sure the action is valid */
     if( !isValidAction( game, &state->state, 1, action ) ) {
 
@@ -397,11 +867,13 @@ static int processTransactionFile( const Game *game, const int fixedSeats,
 				   uint32_t *handId, uint8_t *player0Seat,
 				   rng_state_t *rng, ErrorInfo *errorInfo,
 				   double totalValue[ MAX_PLAYERS ],
+				   double totalSquared[ MAX_PLAYERS ],
 				   MatchState *state, FILE *file )
 {
   int c, r;
   uint32_t h;
   uint8_t s;
+  double value;
   Action action;
   struct timeval sendTime, recvTime;
   char line[ MAX_LINE_LEN ];
@@ -445,7 +917,8 @@ static int processTransactionFile( const Game *game, const int fixedSeats,
     /* check for any timeout issues */
     s = playerToSeat( game, *player0Seat,
 		      currentPlayer( game, &state->state ) );
-    if( checkErrorTimes( s, &sendTime, &recvTime, errorInfo ) < 0 ) {
+    if( checkErrorTimes( s, wallClockMicros( &sendTime, &recvTime ),
+			 errorInfo ) < 0 ) {
 
       fprintf( stderr,
 	       "ERROR: seat %"PRIu8" ran out of time in transaction file\n",
@@ -461,9 +934,10 @@ static int processTransactionFile( const Game *game, const int fixedSeats,
       /* update the total value for each player */
       for( s = 0; s < game->numPlayers; ++s ) {
 
-	totalValue[ s ]
-	  += valueOfState( game, &state->state,
-			   seatToPlayer( game, *player0Seat, s ) );
+	value = valueOfState( game, &state->state,
+			      seatToPlayer( game, *player0Seat, s ) );
+	totalValue[ s ] += value;
+	totalSquared[ s ] += value * value;
       }
 
       /* move on to next hand */
@@ -516,82 +990,254 @@ static int logTransaction( const Game *game, const State *state,
   return c;
 }
 
-/* returns >= 0 if match should continue, -1 on failure */
-static int checkVersion( const uint8_t seat,
-			 ReadBuf *readBuf )
+/* returns >= 0 if action/size has been set to a valid action
+   returns -1 for failure (timeout, too many bad actions, etc) */
+static int getPluginAction( const Game *game,
+			    const MatchState *state,
+			    const uint8_t seat,
+			    PluginSeat *plugin,
+			    ErrorInfo *errorInfo,
+			    LatencyStats *latency,
+			    Action *action,
+			    struct timeval *sendTime,
+			    struct timeval *recvTime )
 {
-  uint32_t major, minor, rev;
-  char line[ MAX_LINE_LEN ];
+  int64_t sendMicros, responseMicros;
 
+  gettimeofday( sendTime, NULL );
+  sendMicros = monotonicMicros();
+  *action = plugin->api->act( plugin->player, state );
+  responseMicros = monotonicMicros() - sendMicros;
+  gettimeofday( recvTime, NULL );
 
-  if( getLine( readBuf, MAX_LINE_LEN, line, -1 ) <= 0 ) {
+  /* keep track of how long the player took */
+  if( latency != NULL ) {
 
-    fprintf( stderr,
-	     "ERROR: could not read version string from seat %"PRIu8"\n",
-	     seat + 1 );
-    return -1;
+    recordLatency( &state->state, seat, responseMicros, latency );
   }
 
-  if( sscanf( line, "VERSION:%"SCNu32".%"SCNu32".%"SCNu32,
-	      &major, &minor, &rev ) < 3 ) {
+  /* check for any timeout issues */
+  if( checkErrorTimes( seat, responseMicros, errorInfo ) < 0 ) {
 
-    fprintf( stderr,
-	     "ERROR: invalid version string %s", line );
+    fprintf( stderr, "ERROR: seat %"PRIu8" ran out of time\n", seat + 1 );
     return -1;
   }
 
-  if( major != VERSION_MAJOR || minor > VERSION_MINOR ) {
+  /* make sure the action is valid */
+  if( !isValidAction( game, &state->state, 1, action ) ) {
 
-    fprintf( stderr, "ERROR: this server is currently using version %"SCNu32".%"SCNu32".%"SCNu32"\n", VERSION_MAJOR, VERSION_MINOR, VERSION_REVISION );
+    if( checkErrorInvalidAction( seat, errorInfo ) < 0 ) {
+
+      fprintf( stderr, "ERROR: invalid action\n" );
+      return -1;
+    }
+
+    fprintf( stderr, "WARNING: invalid action, changed to call\n" );
+    action->type = a_call;
+    action->size = 0;
   }
 
   return 0;
 }
 
-/* returns >= 0 if match should continue, -1 on failure */
-static int addToLogFile( const Game *game, const State *state,
-			 const double value[ MAX_PLAYERS ],
-			 const uint8_t player0Seat,
-			 char *seatName[ MAX_PLAYERS ], FILE *logFile )
+/* parse a seat:plugin.so[:args] specification, where seat starts at 1
+   modifies string to split out the path and arguments
+   returns >= 0 on success, -1 on error */
+static int scanPluginString( char *string,
+			     char *path[ MAX_PLAYERS ],
+			     char *args[ MAX_PLAYERS ] )
 {
-  int c, r;
-  uint8_t p;
-  char line[ MAX_LINE_LEN ];
+  int seat, r;
+  char *sep;
 
-  /* prepare the message */
-  c = printState( game, state, MAX_LINE_LEN, line );
-  if( c < 0 ) {
-    /* message is too long */
+  r = 0;
+  if( sscanf( string, "%d:%n", &seat, &r ) < 1 || r == 0
+      || seat < 1 || seat > MAX_PLAYERS ) {
 
-    fprintf( stderr, "ERROR: log state message too long\n" );
     return -1;
   }
+  --seat;
 
-  /* add the values */
-  for( p = 0; p < game->numPlayers; ++p ) {
-
-    r = snprintf( &line[ c ], MAX_LINE_LEN - c,
-		  p ? "|%.6f" : ":%.6f", value[ p ] );
-    if( r < 0 ) {
+  path[ seat ] = &string[ r ];
+  sep = strchr( path[ seat ], ':' );
+  if( sep != NULL ) {
 
-      fprintf( stderr, "ERROR: log message too long\n" );
-      return -1;
-    }
-    c += r;
+    *sep = 0;
+    args[ seat ] = sep + 1;
+  } else {
 
-    /* remove trailing zeros after decimal-point */
-    while( line[ c - 1 ] == '0' ) { --c; }
-    if( line[ c - 1 ] == '.' ) { --c; }
-    line[ c ] = 0;
+    args[ seat ] = NULL;
   }
 
-  /* add the player names */
-  for( p = 0; p < game->numPlayers; ++p ) {
+  return 0;
+}
 
-    r = snprintf( &line[ c ], MAX_LINE_LEN - c,
-		  p ? "|%s" : ":%s",
-		  seatName[ playerToSeat( game, player0Seat, p ) ] );
-    if( r < 0 ) {
+/* returns >= 0 on success, -1 on failure */
+static int loadPlugin( const Game *game, const uint8_t seat,
+		       const char *path, const char *args,
+		       PluginSeat *plugin )
+{
+  plugin->handle = dlopen( path, RTLD_NOW | RTLD_LOCAL );
+  if( plugin->handle == NULL ) {
+
+    fprintf( stderr, "ERROR: could not load plugin %s: %s\n",
+	     path, dlerror() );
+    return -1;
+  }
+
+  plugin->api
+    = (const PlayerPlugin *)dlsym( plugin->handle, PLAYER_PLUGIN_SYMBOL );
+  if( plugin->api == NULL ) {
+
+    fprintf( stderr, "ERROR: plugin %s does not define %s\n",
+	     path, PLAYER_PLUGIN_SYMBOL );
+    return -1;
+  }
+  if( plugin->api->abiVersion != PLAYER_PLUGIN_ABI_VERSION ) {
+
+    fprintf( stderr, "ERROR: plugin %s has ABI version %"PRIu32
+	     ", dealer uses %d\n",
+	     path, plugin->api->abiVersion, PLAYER_PLUGIN_ABI_VERSION );
+    return -1;
+  }
+
+  plugin->player = plugin->api->init( game, seat, args );
+  if( plugin->player == NULL ) {
+
+    fprintf( stderr, "ERROR: plugin %s failed to initialise seat %d\n",
+	     path, seat + 1 );
+    return -1;
+  }
+
+  return 0;
+}
+
+static void unloadPlugin( PluginSeat *plugin )
+{
+  if( plugin->api->destroy != NULL ) {
+
+    plugin->api->destroy( plugin->player );
+  }
+  dlclose( plugin->handle );
+  plugin->handle = NULL;
+  plugin->api = NULL;
+}
+
+/* returns 1 if the player asked for and was switched to the binary
+   protocol, 0 if it uses text, or -1 on failure */
+static int checkVersion( const uint8_t seat,
+			 ReadBuf *readBuf )
+{
+  int r, c;
+  uint32_t major, minor, rev;
+  char line[ MAX_LINE_LEN ];
+
+
+  if( getLine( readBuf, MAX_LINE_LEN, line, -1 ) <= 0 ) {
+
+    fprintf( stderr,
+	     "ERROR: could not read version string from seat %"PRIu8"\n",
+	     seat + 1 );
+    return -1;
+  }
+
+  /* local players may ask to switch to shared memory before the version */
+  r = acceptShmRequest( readBuf, line );
+  if( r < 0 ) {
+
+    fprintf( stderr,
+	     "ERROR: could not set up shared memory for seat %"PRIu8"\n",
+	     seat + 1 );
+    return -1;
+  }
+  if( r > 0 && getLine( readBuf, MAX_LINE_LEN, line, -1 ) <= 0 ) {
+
+    fprintf( stderr,
+	     "ERROR: could not read version string from seat %"PRIu8"\n",
+	     seat + 1 );
+    return -1;
+  }
+
+  c = 0;
+  if( sscanf( line, "VERSION:%"SCNu32".%"SCNu32".%"SCNu32"%n",
+	      &major, &minor, &rev, &c ) < 3 ) {
+
+    fprintf( stderr,
+	     "ERROR: invalid version string %s", line );
+    return -1;
+  }
+
+  if( major != VERSION_MAJOR || minor > VERSION_MINOR ) {
+
+    fprintf( stderr, "ERROR: this server is currently using version %"SCNu32".%"SCNu32".%"SCNu32"\n", VERSION_MAJOR, VERSION_MINOR, VERSION_REVISION );
+  }
+
+  if( strncmp( &line[ c ], BINARY_VERSION_SUFFIX,
+	       strlen( BINARY_VERSION_SUFFIX ) ) ) {
+    /* plain text protocol */
+
+    return 0;
+  }
+
+  /* let the player know it will get binary frames */
+  c = snprintf( line, MAX_LINE_LEN,
+		"VERSION:%"PRIu32".%"PRIu32".%"PRIu32 BINARY_VERSION_SUFFIX
+		"\r\n", VERSION_MAJOR, VERSION_MINOR, VERSION_REVISION );
+  if( putLine( readBuf, line, c ) != c ) {
+
+    fprintf( stderr,
+	     "ERROR: could not send version string to seat %"PRIu8"\n",
+	     seat + 1 );
+    return -1;
+  }
+
+  return 1;
+}
+
+/* returns >= 0 if match should continue, -1 on failure */
+static int addToLogFile( const Game *game, const State *state,
+			 const double value[ MAX_PLAYERS ],
+			 const uint8_t player0Seat,
+			 char *seatName[ MAX_PLAYERS ], LogWriter *logFile )
+{
+  int c, r;
+  uint8_t p;
+  char line[ MAX_LINE_LEN ];
+
+  /* prepare the message */
+  c = printState( game, state, MAX_LINE_LEN, line );
+  if( c < 0 ) {
+    /* message is too long */
+
+    fprintf( stderr, "ERROR: log state message too long\n" );
+    return -1;
+  }
+
+  /* add the values */
+  for( p = 0; p < game->numPlayers; ++p ) {
+
+    r = snprintf( &line[ c ], MAX_LINE_LEN - c,
+		  p ? "|%.6f" : ":%.6f", value[ p ] );
+    if( r < 0 ) {
+
+      fprintf( stderr, "ERROR: log message too long\n" );
+      return -1;
+    }
+    c += r;
+
+    /* remove trailing zeros after decimal-point */
+    while( line[ c - 1 ] == '0' ) { --c; }
+    if( line[ c - 1 ] == '.' ) { --c; }
+    line[ c ] = 0;
+  }
+
+  /* add the player names */
+  for( p = 0; p < game->numPlayers; ++p ) {
+
+    r = snprintf( &line[ c ], MAX_LINE_LEN - c,
+		  p ? "|%s" : ":%s",
+		  seatName[ playerToSeat( game, player0Seat, p ) ] );
+    if( r < 0 ) {
 
       fprintf( stderr, "ERROR: log message too long\n" );
       return -1;
@@ -599,13 +1245,19 @@ static int addToLogFile( const Game *game, const State *state,
     c += r;
   }
 
-  /* print the line to log and flush */
-  if( fprintf( logFile, "%s\n", line ) < 0 ) {
+  /* add the line to the log */
+  if( c + 1 >= MAX_LINE_LEN ) {
 
+    fprintf( stderr, "ERROR: log message too long\n" );
+    return -1;
+  }
+  line[ c ] = '\n';
+  if( writeMatchLog( logFile, line, c + 1, state->handId ) < 0 ) {
+
+    line[ c ] = 0;
     fprintf( stderr, "ERROR: logging failed for game %s\n", line );
     return -1;
   }
-  fflush( logFile );
 
   return 0;
 }
@@ -613,7 +1265,7 @@ static int addToLogFile( const Game *game, const State *state,
 /* returns >= 0 if match should continue, -1 on failure */
 static int printInitialMessage( const char *matchName, const char *gameName,
 				const uint32_t numHands, const uint32_t seed,
-				const ErrorInfo *info, FILE *logFile )
+				const ErrorInfo *info, LogWriter *logFile )
 {
   int c;
   char line[ MAX_LINE_LEN ];
@@ -631,18 +1283,91 @@ static int printInitialMessage( const char *matchName, const char *gameName,
   }
 
   fprintf( stderr, "%s", line );
-  if( logFile ) {
+  if( logFile && writeMatchLog( logFile, line, c, -1 ) < 0 ) {
 
-    fprintf( logFile, "%s", line );
+    fprintf( stderr, "ERROR: logging failed for initial comment\n" );
+    return -1;
+  }
+
+  return 0;
+}
+
+/* send a message to bm_server on the worker's control socket
+   returns 0 on success, -1 on failure */
+static int sendWorkerMessage( const char *format, ... )
+{
+  int len;
+  va_list ap;
+  char message[ MAX_WORKER_MESSAGE ];
+
+  va_start( ap, format );
+  len = vsnprintf( message, MAX_WORKER_MESSAGE, format, ap );
+  va_end( ap );
+  if( len < 0 || len >= MAX_WORKER_MESSAGE ) {
+
+    return -1;
+  }
+
+  return write( workerFD, message, len ) == len ? 0 : -1;
+}
+
+/* print the VALUES line for --value_stats, or hand it to the worker's
+   control socket in a match run by a worker
+   returns >= 0 on success, -1 on failure */
+static int printValueStats( const Game *game, char *seatName[ MAX_PLAYERS ],
+			    const uint32_t numHands,
+			    const double totalValue[ MAX_PLAYERS ],
+			    const double totalSquared[ MAX_PLAYERS ] )
+{
+  int c, r;
+  uint8_t s;
+  char line[ MAX_LINE_LEN ];
+
+  c = snprintf( line, MAX_LINE_LEN, "VALUES:%"PRIu32, numHands );
+  for( s = 0; s < game->numPlayers * 3 && c < MAX_LINE_LEN; ++s ) {
+
+    if( s < game->numPlayers ) {
+
+      r = snprintf( &line[ c ], MAX_LINE_LEN - c, s ? "|%.6f" : ":%.6f",
+		    totalValue[ s ] );
+    } else if( s < game->numPlayers * 2 ) {
+
+      r = snprintf( &line[ c ], MAX_LINE_LEN - c,
+		    s > game->numPlayers ? "|%.6f" : ":%.6f",
+		    totalSquared[ s - game->numPlayers ] );
+    } else {
+
+      r = snprintf( &line[ c ], MAX_LINE_LEN - c,
+		    s > game->numPlayers * 2 ? "|%s" : ":%s",
+		    seatName[ s - game->numPlayers * 2 ] );
+    }
+    c += r;
+  }
+  if( c >= MAX_LINE_LEN ) {
+
+    fprintf( stderr, "ERROR: value stats message too long\n" );
+    return -1;
+  }
+
+  if( workerFD >= 0 ) {
+
+    if( sendWorkerMessage( "VALUES\t%"PRIu32"\t%s",
+			   workerJobId, line ) < 0 ) {
+
+      fprintf( stderr, "ERROR: could not send value stats to worker\n" );
+      return -1;
+    }
+    return 0;
   }
 
+  fprintf( stdout, "%s\n", line );
   return 0;
 }
 
 /* returns >= 0 if match should continue, -1 on failure */
 static int printFinalMessage( const Game *game, char *seatName[ MAX_PLAYERS ],
 			      const double totalValue[ MAX_PLAYERS ],
-			      FILE *logFile )
+			      LogWriter *logFile )
 {
   int c, r;
   uint8_t s;
@@ -691,7 +1416,17 @@ static int printFinalMessage( const Game *game, char *seatName[ MAX_PLAYERS ],
 
   if( logFile ) {
 
-    fprintf( logFile, "%s\n", line );
+    if( c + 1 >= MAX_LINE_LEN ) {
+
+      fprintf( stderr, "ERROR: log message too long\n" );
+      return -1;
+    }
+    line[ c ] = '\n';
+    if( writeMatchLog( logFile, line, c + 1, -1 ) < 0 ) {
+
+      fprintf( stderr, "ERROR: logging failed for final values\n" );
+      return -1;
+    }
   }
 
   return 0;
@@ -702,7 +1437,11 @@ static int printFinalMessage( const Game *game, char *seatName[ MAX_PLAYERS ],
    cards are dealt using rng, error conditions like timeouts
    are controlled and stored in errorInfo
 
-   actions are read/sent to seat p on seatFD[ p ]
+   actions are read/sent to seat p on readBuf[ p ], unless plugin[ p ]
+   has been loaded, in which case the plugin is called directly
+
+   if trace is not NULL, messages to and from players are written to it
+   instead of standard error
 
    if quiet is not zero, only print out errors, warnings, and final value   
    
@@ -715,33 +1454,63 @@ static int printFinalMessage( const Game *game, char *seatName[ MAX_PLAYERS ],
    the stream when gameLoop is called, it will be processed to
    initialise the state
 
+   if latency is not NULL, player response times are recorded in it
+   and periodically written out to the stats file
+
+   if valueStats is not zero, the VALUES line is printed before the
+   final values
+
    returns >=0 if the match finished correctly, -1 on error */
 static int gameLoop( const Game *game, char *seatName[ MAX_PLAYERS ],
 		     const uint32_t numHands, const int quiet,
+		     TraceWriter *trace,
 		     const int fixedSeats, rng_state_t *rng,
-		     ErrorInfo *errorInfo, const int seatFD[ MAX_PLAYERS ],
+		     ErrorInfo *errorInfo,
 		     ReadBuf *readBuf[ MAX_PLAYERS ],
-		     FILE *logFile, FILE *transactionFile )
+		     PluginSeat plugin[ MAX_PLAYERS ],
+		     LatencyStats *latency, const int valueStats,
+		     LogWriter *logFile, FILE *transactionFile )
 {
+  int r;
   uint32_t handId;
   uint8_t seat, p, player0Seat, currentP, currentSeat;
+  int64_t tMicros, sendMicros;
   struct timeval t, sendTime, recvTime;
+  uint8_t binary[ MAX_PLAYERS ];
   Action action;
   MatchState state;
   double value[ MAX_PLAYERS ], totalValue[ MAX_PLAYERS ];
+  double totalSquared[ MAX_PLAYERS ];
 
   /* check version string for each player */
   for( seat = 0; seat < game->numPlayers; ++seat ) {
 
-    if( checkVersion( seat, readBuf[ seat ] ) < 0 ) {
+    binary[ seat ] = 0;
+    if( plugin[ seat ].api != NULL ) {
+      /* plugins don't need a handshake */
+
+      continue;
+    }
+
+    r = checkVersion( seat, readBuf[ seat ] );
+    if( r < 0 ) {
       /* error messages already handled in function */
 
       return -1;
     }
+    binary[ seat ] = r;
   }
 
   gettimeofday( &sendTime, NULL );
-  if( !quiet ) {
+  sendMicros = monotonicMicros();
+  if( trace != NULL ) {
+
+    if( traceRecord( trace, trace_started, 0, &sendTime, NULL, 0 ) < 0 ) {
+
+      fprintf( stderr, "ERROR: could not write to trace file\n" );
+      return -1;
+    }
+  } else if( !quiet ) {
     fprintf( stderr, "STARTED at %zu.%06zu\n",
 	     sendTime.tv_sec, sendTime.tv_usec );
   }
@@ -757,176 +1526,757 @@ static int gameLoop( const Game *game, char *seatName[ MAX_PLAYERS ],
   dealCards( game, rng, &state.state );
   for( seat = 0; seat < game->numPlayers; ++seat ) {
     totalValue[ seat ] = 0.0;
+    totalSquared[ seat ] = 0.0;
+  }
+
+  /* seat 0 is player 0 in first game */
+  player0Seat = 0;
+
+  /* process the transaction file */
+  if( transactionFile != NULL ) {
+
+    if( processTransactionFile( game, fixedSeats, &handId, &player0Seat,
+				rng, errorInfo, totalValue, totalSquared,
+				&state, transactionFile ) < 0 ) {
+      /* error messages already handled in function */
+
+      return -1;
+    }
+  }
+
+  if( handId >= numHands ) {
+    goto finishedGameLoop;
+  }
+
+  /* play all the (remaining) hands */
+  while( 1 ) {
+
+    /* play the hand */
+    while( !stateFinished( &state.state ) ) {
+
+      /* find the current player */
+      currentP = currentPlayer( game, &state.state );
+
+      /* send state to each player */
+      for( seat = 0; seat < game->numPlayers; ++seat ) {
+
+	if( plugin[ seat ].api != NULL ) {
+	  /* plugins are only asked for actions */
+
+	  continue;
+	}
+
+	state.viewingPlayer = seatToPlayer( game, player0Seat, seat );
+	if( sendPlayerMessage( game, &state, quiet, trace, seat,
+			       readBuf[ seat ], binary[ seat ],
+			       &t, &tMicros ) < 0 ) {
+	  /* error messages already handled in function */
+
+	  return -1;
+	}
+
+	/* remember the seat and send time if player is acting */
+	if( state.viewingPlayer == currentP ) {
+
+	  sendTime = t;
+	  sendMicros = tMicros;
+	}
+      }
+
+      /* get action from current player */
+      state.viewingPlayer = currentP;
+      currentSeat = playerToSeat( game, player0Seat, currentP );
+      if( plugin[ currentSeat ].api != NULL ) {
+
+	r = getPluginAction( game, &state, currentSeat, &plugin[ currentSeat ],
+			     errorInfo, latency, &action,
+			     &sendTime, &recvTime );
+      } else {
+
+	r = readPlayerResponse( game, &state, quiet, trace, currentSeat,
+				binary[ currentSeat ],
+				&sendTime, sendMicros, errorInfo, latency,
+				readBuf[ currentSeat ], &action, &recvTime );
+      }
+      if( r < 0 ) {
+	/* error messages already handled in function */
+
+	return -1;
+      }
+
+      /* log the transaction */
+      if( transactionFile != NULL ) {
+
+	if( logTransaction( game, &state.state, &action,
+			    &sendTime, &recvTime, transactionFile ) < 0 ) {
+	  /* error messages already handled in function */
+
+	  return -1;
+	}
+      }
+
+      /* do the action */
+      doAction( game, &action, &state.state );
+
+      if( latency != NULL && latencyDumpRequested ) {
+
+	writeLatencyStats( game, seatName, handId, latency );
+      }
+    }
+
+    /* get values */
+    for( p = 0; p < game->numPlayers; ++p ) {
+
+      value[ p ] = valueOfState( game, &state.state, p );
+      totalValue[ playerToSeat( game, player0Seat, p ) ] += value[ p ];
+      totalSquared[ playerToSeat( game, player0Seat, p ) ]
+	+= value[ p ] * value[ p ];
+    }
+
+    /* add the game to the log */
+    if( logFile != NULL ) {
+
+      if( addToLogFile( game, &state.state, value, player0Seat,
+			seatName, logFile ) < 0 ) {
+	/* error messages already handled in function */
+
+	return -1;
+      }
+    }
+
+    /* send final state to each player */
+    for( seat = 0; seat < game->numPlayers; ++seat ) {
+
+      state.viewingPlayer = seatToPlayer( game, player0Seat, seat );
+      if( plugin[ seat ].api != NULL ) {
+
+	if( plugin[ seat ].api->handOver != NULL ) {
+
+	  plugin[ seat ].api->handOver( plugin[ seat ].player, &state );
+	}
+	continue;
+      }
+      if( sendPlayerMessage( game, &state, quiet, trace, seat,
+			     readBuf[ seat ], binary[ seat ],
+			     &t, &tMicros ) < 0 ) {
+	/* error messages already handled in function */
+
+	return -1;
+      }
+    }
+
+    if( latency != NULL && ( ( handId + 1 ) % latency->intervalHands == 0
+			     || latencyDumpRequested ) ) {
+
+      writeLatencyStats( game, seatName, handId + 1, latency );
+    }
+
+    if ( !quiet ) {
+      if ( handId % 100 == 0) {
+	for( seat = 0; seat < game->numPlayers; ++seat ) {
+	  fprintf(stderr, "Seconds cumulatively spent in match for seat %i: "
+		  "%i\n", seat,
+		  (int)(errorInfo->usedMatchMicros[ seat ] / 1000000));
+	}
+      }
+    }
+
+    /* start a new hand */
+    if( setUpNewHand( game, fixedSeats, &handId, &player0Seat,
+		      rng, errorInfo, &state.state ) < 0 ) {
+      /* error messages already handled in function */
+
+      return -1;
+    }
+    if( handId >= numHands ) {
+      break;
+    }
+  }
+
+ finishedGameLoop:
+  if( latency != NULL ) {
+
+    writeLatencyStats( game, seatName, handId, latency );
+  }
+
+  /* print out the final values */
+  if( trace != NULL ) {
+
+    if( traceRecord( trace, trace_finished, 0, &sendTime, NULL, 0 ) < 0 ) {
+
+      fprintf( stderr, "ERROR: could not write to trace file\n" );
+      return -1;
+    }
+  } else if( !quiet ) {
+    gettimeofday( &t, NULL );
+    fprintf( stderr, "FINISHED at %zu.%06zu\n",
+	     sendTime.tv_sec, sendTime.tv_usec );
+  }
+  if( valueStats && printValueStats( game, seatName, handId,
+				     totalValue, totalSquared ) < 0 ) {
+    /* error messages already handled in function */
+
+    return -1;
+  }
+  if( printFinalMessage( game, seatName, totalValue, logFile ) < 0 ) {
+    /* error messages already handled in function */
+
+    return -1;
+  }
+
+  return 0;
+}
+
+/* reads the values from a SCORE line made by printFinalMessage
+   returns >= 0 on success, -1 on failure */
+static int scanFinalMessage( const Game *game, const char *line,
+			     double value[ MAX_PLAYERS ] )
+{
+  int c, r;
+  uint8_t s;
+
+  if( strncmp( line, "SCORE", 5 ) ) {
+
+    return -1;
+  }
+  c = 5;
+
+  for( s = 0; s < game->numPlayers; ++s ) {
+
+    if( line[ c ] != ( s ? '|' : ':' )
+	|| sscanf( &line[ c + 1 ], "%lf%n", &value[ s ], &r ) < 1 ) {
+
+      return -1;
+    }
+    c += r + 1;
+  }
+
+  return 0;
+}
+
+/* start a copy of the match for every rotation of the players around
+   the seats, all played at the same time with the same cards
+
+   copy k puts player p in seat ( p - k ) mod numPlayers, so in a two
+   player game copy 1 is the usual reversed duplicate match.  Listen
+   sockets for all copies are opened first, and their ports printed
+   on a single line, copy by copy, in player order.  Players with a
+   plugin get port 0.
+
+   in each child, returns the copy number after rotating seatName,
+   pluginPath, and pluginArgs, and setting listenSocket, for that copy.
+   The child's standard out is sent back to the parent.
+
+   the parent never returns.  It waits for the copies, then prints the
+   duplicate score (the average over the copies of each player's total
+   value) to standard out, standard error, and matchName.log (or .logz
+   if compressLog is non-zero) if useLogFile is non-zero, and exits */
+static int startDuplicateCopies( const Game *game, const char *matchName,
+				 const int useLogFile, const int compressLog,
+				 const int append,
+				 char *seatName[ MAX_PLAYERS ],
+				 char *pluginPath[ MAX_PLAYERS ],
+				 char *pluginArgs[ MAX_PLAYERS ],
+				 int listenSocket[ MAX_PLAYERS ] )
+{
+  int k, p, s, status, failed;
+  int copySocket[ MAX_PLAYERS ][ MAX_PLAYERS ];
+  int scorePipe[ MAX_PLAYERS ][ 2 ];
+  uint16_t port;
+  pid_t copyPID[ MAX_PLAYERS ], pid;
+  FILE *file;
+  LogWriter *logFile;
+  const char *suffix;
+  char *playerName[ MAX_PLAYERS ], *playerPluginPath[ MAX_PLAYERS ];
+  char *playerPluginArgs[ MAX_PLAYERS ];
+  double value[ MAX_PLAYERS ], dupValue[ MAX_PLAYERS ];
+  char line[ MAX_LINE_LEN ];
+
+  /* open sockets for players to connect to */
+  for( k = 0; k < game->numPlayers; ++k ) {
+
+    for( p = 0; p < game->numPlayers; ++p ) {
+
+      port = 0;
+      if( pluginPath[ p ] != NULL ) {
+
+	copySocket[ k ][ p ] = -1;
+      } else {
+
+	copySocket[ k ][ p ] = getListenSocket( &port );
+	if( copySocket[ k ][ p ] < 0 ) {
+
+	  fprintf( stderr, "ERROR: could not create listen socket for"
+		   " player %d in copy %d\n", p + 1, k );
+	  exit( EXIT_FAILURE );
+	}
+      }
+
+      printf( k || p ? " %"PRIu16 : "%"PRIu16, port );
+    }
+  }
+  printf( "\n" );
+  fflush( stdout );
+
+  /* stats updates are requested from the copies, not the parent */
+  signal( SIGUSR1, SIG_IGN );
+
+  for( p = 0; p < game->numPlayers; ++p ) {
+
+    playerName[ p ] = seatName[ p ];
+    playerPluginPath[ p ] = pluginPath[ p ];
+    playerPluginArgs[ p ] = pluginArgs[ p ];
+  }
+
+  for( k = 0; k < game->numPlayers; ++k ) {
+
+    if( pipe( scorePipe[ k ] ) < 0 ) {
+
+      fprintf( stderr, "ERROR: could not create pipe for copy %d\n", k );
+      exit( EXIT_FAILURE );
+    }
+
+    copyPID[ k ] = fork();
+    if( copyPID[ k ] < 0 ) {
+
+      fprintf( stderr, "ERROR: fork() failed\n" );
+      exit( EXIT_FAILURE );
+    }
+
+    if( copyPID[ k ] == 0 ) {
+      /* child plays copy k */
+
+      dup2( scorePipe[ k ][ 1 ], 1 );
+      close( scorePipe[ k ][ 0 ] );
+      close( scorePipe[ k ][ 1 ] );
+      for( p = 0; p < k; ++p ) {
+
+	close( scorePipe[ p ][ 0 ] );
+      }
+
+      for( s = 0; s < game->numPlayers; ++s ) {
+
+	p = ( s + k ) % game->numPlayers;
+	seatName[ s ] = playerName[ p ];
+	pluginPath[ s ] = playerPluginPath[ p ];
+	pluginArgs[ s ] = playerPluginArgs[ p ];
+	listenSocket[ s ] = copySocket[ k ][ p ];
+      }
+
+      /* close the sockets for the other copies */
+      for( p = 0; p < game->numPlayers; ++p ) {
+
+	for( s = 0; s < game->numPlayers; ++s ) {
+
+	  if( p != k && copySocket[ p ][ s ] >= 0 ) {
+
+	    close( copySocket[ p ][ s ] );
+	  }
+	}
+      }
+
+      signal( SIGUSR1, SIG_DFL );
+      return k;
+    }
+
+    close( scorePipe[ k ][ 1 ] );
+  }
+
+  for( k = 0; k < game->numPlayers; ++k ) {
+
+    for( p = 0; p < game->numPlayers; ++p ) {
+
+      if( copySocket[ k ][ p ] >= 0 ) {
+
+	close( copySocket[ k ][ p ] );
+      }
+    }
+  }
+
+  /* wait for all the copies, stopping the rest if one of them fails,
+     since the duplicate score needs all of them */
+  failed = 0;
+  for( k = 0; k < game->numPlayers; ++k ) {
+
+    pid = wait( &status );
+    if( pid < 0 ) {
+
+      fprintf( stderr, "ERROR: lost track of duplicate copies\n" );
+      exit( EXIT_FAILURE );
+    }
+
+    if( !failed && ( !WIFEXITED( status )
+		     || WEXITSTATUS( status ) != EXIT_SUCCESS ) ) {
+
+      for( p = 0; p < game->numPlayers; ++p ) {
+
+	if( copyPID[ p ] == pid ) {
+
+	  fprintf( stderr, "ERROR: duplicate copy %d failed\n", p );
+	} else {
+
+	  kill( copyPID[ p ], SIGTERM );
+	}
+      }
+      failed = 1;
+    }
+  }
+  if( failed ) {
+
+    exit( EXIT_FAILURE );
+  }
+
+  /* add up the scores, by player */
+  for( p = 0; p < game->numPlayers; ++p ) {
+
+    dupValue[ p ] = 0.0;
+  }
+  for( k = 0; k < game->numPlayers; ++k ) {
+
+    file = fdopen( scorePipe[ k ][ 0 ], "r" );
+    if( file == NULL ) {
+
+      fprintf( stderr, "ERROR: could not read score for copy %d\n", k );
+      exit( EXIT_FAILURE );
+    }
+
+    failed = 1;
+    while( fgets( line, MAX_LINE_LEN, file ) ) {
+
+      if( scanFinalMessage( game, line, value ) >= 0 ) {
+
+	failed = 0;
+      }
+    }
+    fclose( file );
+    if( failed ) {
+
+      fprintf( stderr, "ERROR: no score from copy %d\n", k );
+      exit( EXIT_FAILURE );
+    }
+
+    for( s = 0; s < game->numPlayers; ++s ) {
+
+      dupValue[ ( s + k ) % game->numPlayers ]
+	+= value[ s ] / game->numPlayers;
+    }
+  }
+
+  /* print the combined score */
+  logFile = NULL;
+  if( useLogFile ) {
+
+    suffix = compressLog ? COMPRESSED_LOG_SUFFIX : LOG_SUFFIX;
+    if( snprintf( line, MAX_LINE_LEN, "%s%s", matchName, suffix ) < 0 ) {
+
+      fprintf( stderr, "ERROR: match file name too long %s\n", matchName );
+      exit( EXIT_FAILURE );
+    }
+    logFile = openLogWriter( line, append, compressLog );
+    if( logFile == NULL ) {
+
+      fprintf( stderr, "ERROR: could not open log file %s\n", line );
+      exit( EXIT_FAILURE );
+    }
+    p = snprintf( line, MAX_LINE_LEN,
+		  "# duplicate of %d copies, logged in %s.dup*%s\n",
+		  game->numPlayers, matchName, suffix );
+    if( p < 0 || p >= MAX_LINE_LEN || writeLog( logFile, line, p, -1 ) < 0 ) {
+
+      fprintf( stderr, "ERROR: logging failed for duplicate comment\n" );
+      exit( EXIT_FAILURE );
+    }
+  }
+  if( printFinalMessage( game, playerName, dupValue, logFile ) < 0 ) {
+    /* error messages already handled in function */
+
+    exit( EXIT_FAILURE );
+  }
+  if( logFile != NULL && closeLogWriter( logFile ) < 0 ) {
+
+    fprintf( stderr, "ERROR: could not write log file\n" );
+    exit( EXIT_FAILURE );
+  }
+
+  exit( EXIT_SUCCESS );
+}
+
+/* returns the game read from gameFile, or the copy a worker already
+   read, or NULL on failure */
+static Game *loadGame( const char *gameFile )
+{
+  int i;
+  FILE *file;
+  Game *game;
+
+  for( i = 0; i < numWorkerGames; ++i ) {
+
+    if( !strcmp( workerGameFile[ i ], gameFile ) ) {
+
+      return workerGame[ i ];
+    }
+  }
+
+  file = fopen( gameFile, "r" );
+  if( file == NULL ) {
+
+    fprintf( stderr, "ERROR: could not open game definition %s\n",
+	     gameFile );
+    return NULL;
+  }
+  game = readGame( file );
+  fclose( file );
+  if( game == NULL ) {
+
+    fprintf( stderr, "ERROR: could not read game %s\n", gameFile );
+    return NULL;
   }
 
-  /* seat 0 is player 0 in first game */
-  player0Seat = 0;
+  return game;
+}
 
-  /* process the transaction file */
-  if( transactionFile != NULL ) {
+static int runMatch( int argc, char **argv );
 
-    if( processTransactionFile( game, fixedSeats, &handId, &player0Seat,
-				rng, errorInfo, totalValue,
-				&state, transactionFile ) < 0 ) {
-      /* error messages already handled in function */
+/* start the match requested by a RUN message, split into numFields
+   fields, in a forked copy of the worker
+   returns the PID of the match, or -1 on failure */
+static pid_t startWorkerMatch( const uint32_t jobId,
+			       char **field, const int numFields,
+			       const sigset_t *mask, const int sigFD )
+{
+  int fd;
+  pid_t pid;
 
-      return -1;
-    }
-  }
+  pid = fork();
+  if( pid ) {
 
-  if( handId >= numHands ) {
-    goto finishedGameLoop;
+    return pid;
   }
 
-  /* play all the (remaining) hands */
-  while( 1 ) {
+  /* the match is an ordinary dealer from here on, apart from sending
+     its ports to the worker's control socket */
+  sigprocmask( SIG_UNBLOCK, mask, NULL );
+  close( sigFD );
+  workerJobId = jobId;
 
-    /* play the hand */
-    while( !stateFinished( &state.state ) ) {
+  fd = open( field[ 2 ], O_WRONLY | O_APPEND | O_CREAT, 0644 );
+  if( fd < 0 ) {
 
-      /* find the current player */
-      currentP = currentPlayer( game, &state.state );
+    fprintf( stderr, "ERROR: could not open error log %s\n", field[ 2 ] );
+    exit( EXIT_FAILURE );
+  }
+  dup2( fd, 2 );
+  close( fd );
 
-      /* send state to each player */
-      for( seat = 0; seat < game->numPlayers; ++seat ) {
+  exit( runMatch( numFields - 3, &field[ 3 ] ) );
+}
 
-	state.viewingPlayer = seatToPlayer( game, player0Seat, seat );
-	if( sendPlayerMessage( game, &state, quiet, seat,
-			       seatFD[ seat ], &t ) < 0 ) {
-	  /* error messages already handled in function */
+/* read gameFiles, then run each match bm_server asks for
+   the control socket is standard input, which must be a SOCK_SEQPACKET
+   socket so every message arrives whole.  Messages are tab separated
+   fields, with bm_server sending
+     RUN jobId stderrFile dealerArg0 dealerArg1 ...
+   to play the match a dealer with those arguments would, and getting
+     PORTS jobId dealerPID ports
+   from the match once it is listening, with ports as a dealer prints
+   them,
+     VALUES jobId valuesLine
+   from the match as it finishes, if it was run with --value_stats, and
+     EXIT jobId status userMicros sysMicros maxRSSKB
+   once the match has exited, with status and the CPU time and peak
+   memory the match used from wait4, or just a status of -1 if it
+   could not be started
+   returns when the control socket is closed */
+static int runWorker( const int numGames, char **gameFiles )
+{
+  int i, sigFD, numJobs, maxJobs, numFields, status;
+  ssize_t len;
+  pid_t pid, *jobPID;
+  uint32_t jobId, *jobIds;
+  sigset_t mask;
+  struct pollfd fds[ 2 ];
+  struct signalfd_siginfo info;
+  struct rusage usage;
+  char *field[ MAX_WORKER_ARGS + 1 ];
+  char message[ MAX_WORKER_MESSAGE + 1 ];
+
+  if( numGames > MAX_WORKER_GAMES ) {
+
+    fprintf( stderr, "ERROR: workers can only load %d games\n",
+	     MAX_WORKER_GAMES );
+    exit( EXIT_FAILURE );
+  }
+  for( i = 0; i < numGames; ++i ) {
 
-	  return -1;
-	}
+    workerGame[ i ] = loadGame( gameFiles[ i ] );
+    if( workerGame[ i ] == NULL ) {
 
-	/* remember the seat and send time if player is acting */
-	if( state.viewingPlayer == currentP ) {
+      exit( EXIT_FAILURE );
+    }
+    workerGameFile[ i ] = gameFiles[ i ];
+  }
+  numWorkerGames = numGames;
 
-	  sendTime = t;
-	}
-      }
+  /* match exits are read from a signalfd along with the control socket */
+  sigemptyset( &mask );
+  sigaddset( &mask, SIGCHLD );
+  if( sigprocmask( SIG_BLOCK, &mask, NULL ) < 0
+      || ( sigFD = signalfd( -1, &mask, SFD_NONBLOCK ) ) < 0 ) {
 
-      /* get action from current player */
-      state.viewingPlayer = currentP;
-      currentSeat = playerToSeat( game, player0Seat, currentP );
-      if( readPlayerResponse( game, &state, quiet, currentSeat, &sendTime,
-			      errorInfo, readBuf[ currentSeat ],
-			      &action, &recvTime ) < 0 ) {
-	/* error messages already handled in function */
+    fprintf( stderr, "ERROR: could not create signalfd\n" );
+    exit( EXIT_FAILURE );
+  }
+  workerFD = 0;
 
-	return -1;
-      }
+  numJobs = 0;
+  maxJobs = 0;
+  jobPID = NULL;
+  jobIds = NULL;
+  while( 1 ) {
 
-      /* log the transaction */
-      if( transactionFile != NULL ) {
+    fds[ 0 ].fd = workerFD;
+    fds[ 0 ].events = POLLIN;
+    fds[ 1 ].fd = sigFD;
+    fds[ 1 ].events = POLLIN;
+    if( poll( fds, 2, -1 ) < 0 ) {
 
-	if( logTransaction( game, &state.state, &action,
-			    &sendTime, &recvTime, transactionFile ) < 0 ) {
-	  /* error messages already handled in function */
+      if( errno == EINTR ) {
 
-	  return -1;
-	}
+	continue;
       }
-
-      /* do the action */
-      doAction( game, &action, &state.state );
+      fprintf( stderr, "ERROR: worker poll failed\n" );
+      exit( EXIT_FAILURE );
     }
 
-    /* get values */
-    for( p = 0; p < game->numPlayers; ++p ) {
+    if( fds[ 1 ].revents ) {
+      /* report every match which has exited */
 
-      value[ p ] = valueOfState( game, &state.state, p );
-      totalValue[ playerToSeat( game, player0Seat, p ) ] += value[ p ];
-    }
+      while( read( sigFD, &info, sizeof( info ) ) == sizeof( info ) );
+      while( ( pid = wait4( -1, &status, WNOHANG, &usage ) ) > 0 ) {
 
-    /* add the game to the log */
-    if( logFile != NULL ) {
+	for( i = 0; i < numJobs; ++i ) {
 
-      if( addToLogFile( game, &state.state, value, player0Seat,
-			seatName, logFile ) < 0 ) {
-	/* error messages already handled in function */
+	  if( jobPID[ i ] == pid ) {
 
-	return -1;
+	    sendWorkerMessage( "EXIT\t%"PRIu32"\t%d\t%"PRId64"\t%"PRId64"\t%ld",
+			       jobIds[ i ], status,
+			       (int64_t)usage.ru_utime.tv_sec * 1000000
+			       + usage.ru_utime.tv_usec,
+			       (int64_t)usage.ru_stime.tv_sec * 1000000
+			       + usage.ru_stime.tv_usec,
+			       usage.ru_maxrss );
+	    --numJobs;
+	    jobPID[ i ] = jobPID[ numJobs ];
+	    jobIds[ i ] = jobIds[ numJobs ];
+	    break;
+	  }
+	}
       }
     }
 
-    /* send final state to each player */
-    for( seat = 0; seat < game->numPlayers; ++seat ) {
-
-      state.viewingPlayer = seatToPlayer( game, player0Seat, seat );
-      if( sendPlayerMessage( game, &state, quiet, seat,
-			     seatFD[ seat ], &t ) < 0 ) {
-	/* error messages already handled in function */
+    if( !fds[ 0 ].revents ) {
 
-	return -1;
-      }
+      continue;
     }
+    len = read( workerFD, message, MAX_WORKER_MESSAGE );
+    if( len <= 0 ) {
+      /* bm_server has gone, and any running matches carry on alone */
 
-    if ( !quiet ) {
-      if ( handId % 100 == 0) {
-	for( seat = 0; seat < game->numPlayers; ++seat ) {
-	  fprintf(stderr, "Seconds cumulatively spent in match for seat %i: "
-		  "%i\n", seat,
-		  (int)(errorInfo->usedMatchMicros[ seat ] / 1000000));
-	}
-      }
+      break;
     }
+    message[ len ] = 0;
 
-    /* start a new hand */
-    if( setUpNewHand( game, fixedSeats, &handId, &player0Seat,
-		      rng, errorInfo, &state.state ) < 0 ) {
-      /* error messages already handled in function */
+    /* split the message into fields */
+    numFields = 0;
+    field[ 0 ] = strtok( message, "\t" );
+    while( field[ numFields ] != NULL && numFields < MAX_WORKER_ARGS ) {
 
-      return -1;
+      ++numFields;
+      field[ numFields ] = strtok( NULL, "\t" );
     }
-    if( handId >= numHands ) {
-      break;
+    field[ numFields ] = NULL;
+    if( numFields < 4 || strcmp( field[ 0 ], "RUN" )
+	|| sscanf( field[ 1 ], "%"SCNu32, &jobId ) < 1 ) {
+
+      fprintf( stderr, "ERROR: bad worker request %s\n", message );
+      continue;
     }
-  }
 
- finishedGameLoop:
-  /* print out the final values */
-  if( !quiet ) {
-    gettimeofday( &t, NULL );
-    fprintf( stderr, "FINISHED at %zu.%06zu\n",
-	     sendTime.tv_sec, sendTime.tv_usec );
-  }
-  if( printFinalMessage( game, seatName, totalValue, logFile ) < 0 ) {
-    /* error messages already handled in function */
+    pid = startWorkerMatch( jobId, field, numFields, &mask, sigFD );
+    if( pid < 0 ) {
 
-    return -1;
+      fprintf( stderr, "ERROR: could not fork match\n" );
+      sendWorkerMessage( "EXIT\t%"PRIu32"\t-1", jobId );
+      continue;
+    }
+
+    if( numJobs == maxJobs ) {
+
+      maxJobs = maxJobs ? maxJobs * 2 : 16;
+      jobPID = (pid_t *)realloc( jobPID, sizeof( pid_t ) * maxJobs );
+      jobIds = (uint32_t *)realloc( jobIds, sizeof( uint32_t ) * maxJobs );
+      if( jobPID == NULL || jobIds == NULL ) {
+
+	fprintf( stderr, "ERROR: could not allocate worker jobs\n" );
+	exit( EXIT_FAILURE );
+      }
+    }
+    jobPID[ numJobs ] = pid;
+    jobIds[ numJobs ] = jobId;
+    ++numJobs;
   }
 
-  return 0;
+  return EXIT_SUCCESS;
 }
 
-int main( int argc, char **argv )
+static int runMatch( int argc, char **argv )
 {
-  int i, listenSocket[ MAX_PLAYERS ], v, longOpt;
-  int fixedSeats, quiet, append;
+  int i, listenSocket[ MAX_PLAYERS ], v, longOpt, pos;
+  int fixedSeats, quiet, append, duplicate, portsGiven, copy, valueStats;
   int seatFD[ MAX_PLAYERS ];
-  FILE *file, *logFile, *transactionFile;
+  LogWriter *logFile;
+  FILE *transactionFile;
   ReadBuf *readBuf[ MAX_PLAYERS ];
+  PluginSeat plugin[ MAX_PLAYERS ];
+  char *pluginPath[ MAX_PLAYERS ], *pluginArgs[ MAX_PLAYERS ];
   Game *game;
   rng_state_t rng;
   ErrorInfo errorInfo;
+  LatencyStats *latency;
+  TraceWriter *trace;
   struct sockaddr_in addr;
   socklen_t addrLen;
   char *seatName[ MAX_PLAYERS ];
 
-  int useLogFile, useTransactionFile;
+  int useLogFile, compressLog, useTransactionFile;
   uint64_t maxResponseMicros, maxUsedHandMicros, maxUsedPerHandMicros;
   int64_t startTimeoutMicros;
   uint32_t numHands, seed, maxInvalidActions;
   uint16_t listenPort[ MAX_PLAYERS ];
-
-  struct timeval startTime, tv;
-
-  char name[ MAX_LINE_LEN ];
+  char *listenEndpoint[ MAX_PLAYERS ];
+  char *statsFileName;
+  uint32_t statsIntervalHands;
+  char *traceFileName;
+  char *matchName;
+
+  int64_t startDeadline;
+
+  char name[ MAX_LINE_LEN ], copyMatchName[ MAX_LINE_LEN ];
+  char copyStatsFileName[ MAX_LINE_LEN ], copyTraceFileName[ MAX_LINE_LEN ];
+  char autoEndpoint[ MAX_PLAYERS ][ 64 ];
+  char portLine[ MAX_LINE_LEN ];
   static struct option longOptions[] = {
     { "t_response", 1, 0, 0 },
     { "t_hand", 1, 0, 0 },
     { "t_per_hand", 1, 0, 0 },
     { "start_timeout", 1, 0, 0 },
+    { "stats_file", 1, 0, 0 },
+    { "stats_interval", 1, 0, 0 },
+    { "plugin", 1, 0, 0 },
+    { "trace", 1, 0, 0 },
+    { "duplicate", 0, 0, 0 },
+    { "value_stats", 0, 0, 0 },
+    { "compress_log", 0, 0, 0 },
     { 0, 0, 0, 0 }
   };
 
@@ -938,10 +2288,14 @@ int main( int argc, char **argv )
   maxUsedHandMicros = DEFAULT_MAX_USED_HAND_MICROS;
   maxUsedPerHandMicros = DEFAULT_MAX_USED_PER_HAND_MICROS;
 
-  /* use random ports */
+  /* use random ports, and network players in every seat */
   for( i = 0; i < MAX_PLAYERS; ++i ) {
 
     listenPort[ i ] = 0;
+    listenEndpoint[ i ] = NULL;
+    pluginPath[ i ] = NULL;
+    plugin[ i ].handle = NULL;
+    plugin[ i ].api = NULL;
   }
 
   /* use log file, don't use transaction file */
@@ -960,6 +2314,23 @@ int main( int argc, char **argv )
   /* no timeout on startup */
   startTimeoutMicros = -1;
 
+  /* no latency stats */
+  statsFileName = NULL;
+  statsIntervalHands = DEFAULT_STATS_INTERVAL_HANDS;
+
+  /* no binary trace */
+  traceFileName = NULL;
+
+  /* play a single match */
+  duplicate = 0;
+  portsGiven = 0;
+
+  /* only the final values */
+  valueStats = 0;
+
+  /* plain text log */
+  compressLog = 0;
+
   /* parse options */
   while( 1 ) {
 
@@ -1032,6 +2403,57 @@ int main( int argc, char **argv )
 	}
 	break;
 
+      case 4:
+	/* stats_file */
+
+	statsFileName = optarg;
+	break;
+
+      case 5:
+	/* stats_interval */
+
+	if( sscanf( optarg, "%"SCNu32, &statsIntervalHands ) < 1
+	    || statsIntervalHands == 0 ) {
+
+	  fprintf( stderr, "ERROR: could not get stats interval from %s\n",
+		   optarg );
+	  exit( EXIT_FAILURE );
+	}
+	break;
+
+      case 6:
+	/* plugin */
+
+	if( scanPluginString( optarg, pluginPath, pluginArgs ) < 0 ) {
+
+	  fprintf( stderr, "ERROR: bad plugin string %s\n", optarg );
+	  exit( EXIT_FAILURE );
+	}
+	break;
+
+      case 7:
+	/* trace */
+
+	traceFileName = optarg;
+	break;
+
+      case 8:
+	/* duplicate */
+
+	duplicate = 1;
+	break;
+
+      case 9:
+	/* value_stats */
+
+	valueStats = 1;
+	break;
+
+      case 10:
+	/* compress_log */
+
+	compressLog = 1;
+	break;
       }
       break;
 
@@ -1056,11 +2478,12 @@ int main( int argc, char **argv )
     case 'p':
       /* port specification */
 
-      if( scanPortString( optarg, listenPort ) < 0 ) {
+      if( scanPortString( optarg, listenPort, listenEndpoint ) < 0 ) {
 
 	fprintf( stderr, "ERROR: bad port string %s\n", optarg );
 	exit( EXIT_FAILURE );
       }
+      portsGiven = 1;
 
       break;
 
@@ -1100,20 +2523,12 @@ int main( int argc, char **argv )
   }
 
   /* get the game definition */
-  file = fopen( argv[ optind + 1 ], "r" );
-  if( file == NULL ) {
-
-    fprintf( stderr, "ERROR: could not open game definition %s\n",
-	     argv[ optind + 1 ] );
-    exit( EXIT_FAILURE );
-  }
-  game = readGame( file );
+  game = loadGame( argv[ optind + 1 ] );
   if( game == NULL ) {
+    /* error messages already handled in function */
 
-    fprintf( stderr, "ERROR: could not read game %s\n", argv[ optind + 1 ] );
     exit( EXIT_FAILURE );
   }
-  fclose( file );
 
   /* save the seat names */
   if( optind + 4 + game->numPlayers > argc ) {
@@ -1145,23 +2560,63 @@ int main( int argc, char **argv )
   init_genrand( &rng, seed );
   srandom( seed ); /* used for random port selection */
 
+  matchName = argv[ optind ];
+  if( duplicate ) {
+    /* split into one process per copy of the match, each continuing
+       below with its own names */
+
+    if( portsGiven ) {
+
+      fprintf( stderr, "ERROR: ports can not be given for duplicate matches\n" );
+      exit( EXIT_FAILURE );
+    }
+    if( valueStats ) {
+
+      fprintf( stderr, "ERROR: value stats can not be given for duplicate matches\n" );
+      exit( EXIT_FAILURE );
+    }
+
+    copy = startDuplicateCopies( game, matchName, useLogFile, compressLog,
+				 append,
+				 seatName, pluginPath, pluginArgs,
+				 listenSocket );
+
+    if( snprintf( copyMatchName, MAX_LINE_LEN, "%s.dup%d",
+		  matchName, copy ) >= MAX_LINE_LEN
+	|| ( statsFileName != NULL
+	     && snprintf( copyStatsFileName, MAX_LINE_LEN, "%s.dup%d",
+			  statsFileName, copy ) >= MAX_LINE_LEN )
+	|| ( traceFileName != NULL
+	     && snprintf( copyTraceFileName, MAX_LINE_LEN, "%s.dup%d",
+			  traceFileName, copy ) >= MAX_LINE_LEN ) ) {
+
+      fprintf( stderr, "ERROR: match file name too long %s\n", matchName );
+      exit( EXIT_FAILURE );
+    }
+    matchName = copyMatchName;
+    if( statsFileName != NULL ) {
+      statsFileName = copyStatsFileName;
+    }
+    if( traceFileName != NULL ) {
+      traceFileName = copyTraceFileName;
+    }
+  }
+
   if( useLogFile ) {
     /* create/open the log */
-    if( snprintf( name, MAX_LINE_LEN, "%s.log", argv[ optind ] ) < 0 ) {
+    if( snprintf( name, MAX_LINE_LEN, "%s%s", matchName,
+		  compressLog ? COMPRESSED_LOG_SUFFIX : LOG_SUFFIX ) < 0 ) {
 
-      fprintf( stderr, "ERROR: match file name too long %s\n", argv[ optind ] );
+      fprintf( stderr, "ERROR: match file name too long %s\n", matchName );
       exit( EXIT_FAILURE );
     }
-    if (append) {
-      logFile = fopen( name, "a+" );
-    } else {
-      logFile = fopen( name, "w" );
-    }
+    logFile = openLogWriter( name, append, compressLog );
     if( logFile == NULL ) {
 
       fprintf( stderr, "ERROR: could not open log file %s\n", name );
       exit( EXIT_FAILURE );
     }
+    setMatchLog( logFile );
   } else {
     /* no log file */
 
@@ -1171,9 +2626,9 @@ int main( int argc, char **argv )
   if( useTransactionFile ) {
     /* create/open the transaction log */
 
-    if( snprintf( name, MAX_LINE_LEN, "%s.tlog", argv[ optind ] ) < 0 ) {
+    if( snprintf( name, MAX_LINE_LEN, "%s.tlog", matchName ) < 0 ) {
 
-      fprintf( stderr, "ERROR: match file name too long %s\n", argv[ optind ] );
+      fprintf( stderr, "ERROR: match file name too long %s\n", matchName );
       exit( EXIT_FAILURE );
     }
     if (append) {
@@ -1192,57 +2647,145 @@ int main( int argc, char **argv )
     transactionFile = NULL;
   }
 
+  if( traceFileName != NULL ) {
+    /* create/open the binary trace */
+
+    trace = openTrace( traceFileName, append );
+    if( trace == NULL ) {
+
+      fprintf( stderr, "ERROR: could not open trace file %s\n",
+	       traceFileName );
+      exit( EXIT_FAILURE );
+    }
+  } else {
+
+    trace = NULL;
+  }
+
   /* set up the error info */
   initErrorInfo( maxInvalidActions, maxResponseMicros, maxUsedHandMicros,
 		 maxUsedPerHandMicros * numHands, &errorInfo );
 
-  /* open sockets for players to connect to */
-  for( i = 0; i < game->numPlayers; ++i ) {
+  /* set up the latency stats */
+  if( statsFileName != NULL ) {
 
-    listenSocket[ i ] = getListenSocket( &listenPort[ i ] );
-    if( listenSocket[ i ] < 0 ) {
+    latency = (LatencyStats*)malloc( sizeof( LatencyStats ) );
+    if( latency == NULL ) {
 
-      fprintf( stderr, "ERROR: could not create listen socket for player %d\n",
-	       i + 1 );
+      fprintf( stderr, "ERROR: could not allocate latency stats\n" );
       exit( EXIT_FAILURE );
     }
+    initLatencyStats( game, statsFileName, statsIntervalHands, latency );
+    signal( SIGUSR1, handleLatencyDumpSignal );
+  } else {
+
+    latency = NULL;
   }
 
-  /* print out the final port assignments */
+  /* load any plugins */
   for( i = 0; i < game->numPlayers; ++i ) {
 
-    printf( i ? " %"PRIu16 : "%"PRIu16, listenPort[ i ] );
+    if( pluginPath[ i ] != NULL ) {
+
+      if( loadPlugin( game, i, pluginPath[ i ], pluginArgs[ i ],
+		      &plugin[ i ] ) < 0 ) {
+	/* error messages already handled in function */
+
+	exit( EXIT_FAILURE );
+      }
+      listenPort[ i ] = 0;
+      listenEndpoint[ i ] = NULL;
+    }
+  }
+
+  if( !duplicate ) {
+    /* duplicate copies already have sockets from startDuplicateCopies */
+
+    /* open sockets for players to connect to */
+    for( i = 0; i < game->numPlayers; ++i ) {
+
+      if( plugin[ i ].api != NULL ) {
+
+	listenSocket[ i ] = -1;
+	continue;
+      }
+
+      if( listenEndpoint[ i ] == NULL ) {
+
+	listenSocket[ i ] = getListenSocket( &listenPort[ i ] );
+      } else {
+
+	if( !strcmp( listenEndpoint[ i ], "@" ) ) {
+	  /* pick an abstract name no other dealer will be using */
+
+	  snprintf( autoEndpoint[ i ], sizeof( autoEndpoint[ i ] ),
+		    "@acpc.%d.%d", (int)getpid(), i + 1 );
+	  listenEndpoint[ i ] = autoEndpoint[ i ];
+	}
+	listenSocket[ i ] = getUnixListenSocket( listenEndpoint[ i ] );
+      }
+      if( listenSocket[ i ] < 0 ) {
+
+	fprintf( stderr, "ERROR: could not create listen socket for player %d\n",
+		 i + 1 );
+	exit( EXIT_FAILURE );
+      }
+    }
+
+    /* print out the final port assignments, or hand them to the
+       worker's control socket */
+    pos = 0;
+    for( i = 0; i < game->numPlayers; ++i ) {
+
+      if( listenEndpoint[ i ] != NULL ) {
+
+	pos += snprintf( &portLine[ pos ], MAX_LINE_LEN - pos,
+			 i ? " %s" : "%s", listenEndpoint[ i ] );
+      } else {
+
+	pos += snprintf( &portLine[ pos ], MAX_LINE_LEN - pos,
+			 i ? " %"PRIu16 : "%"PRIu16, listenPort[ i ] );
+      }
+    }
+    if( workerFD >= 0 ) {
+
+      if( sendWorkerMessage( "PORTS\t%"PRIu32"\t%d\t%s", workerJobId,
+			     (int)getpid(), portLine ) < 0 ) {
+
+	fprintf( stderr, "ERROR: could not send ports to worker\n" );
+	exit( EXIT_FAILURE );
+      }
+      if( !valueStats ) {
+
+	close( workerFD );
+	workerFD = -1;
+      }
+    } else {
+
+      printf( "%s\n", portLine );
+      fflush( stdout );
+    }
   }
-  printf( "\n" );
-  fflush( stdout );
 
   /* print out usage information */
-  printInitialMessage( argv[ optind ], argv[ optind + 1 ],
+  printInitialMessage( matchName, argv[ optind + 1 ],
 		       numHands, seed, &errorInfo, logFile );
 
   /* wait for each player to connect */
-  gettimeofday( &startTime, NULL );
+  startDeadline = monotonicMicros() + startTimeoutMicros;
   for( i = 0; i < game->numPlayers; ++i ) {
 
-    if( startTimeoutMicros >= 0 ) {
-      uint64_t startTimeLeft;
-      fd_set fds;
+    if( plugin[ i ].api != NULL ) {
 
-      gettimeofday( &tv, NULL );
-      startTimeLeft = startTimeoutMicros
-	- (uint64_t)( tv.tv_sec - startTime.tv_sec ) * 1000000
-	- ( tv.tv_usec - startTime.tv_usec );
-      if( startTimeLeft < 0 ) {
+      seatFD[ i ] = -1;
+      readBuf[ i ] = NULL;
+      continue;
+    }
 
-	startTimeLeft = 0;
-      }
-      tv.tv_sec = startTimeLeft / 1000000;
-      tv.tv_usec = startTimeLeft % 1000000;
+    if( startTimeoutMicros >= 0 ) {
 
-      FD_ZERO( &fds );
-      FD_SET( listenSocket[ i ], &fds );
-      if( select( listenSocket[ i ] + 1, &fds, NULL, NULL, &tv ) < 1 ) {
-	/* no input ready within time, or an actual error */
+      if( waitReadable( listenSocket[ i ], startDeadline ) < 0 ) {
+	/* no connection within time, or an actual error */
 
 	fprintf( stderr, "ERROR: timed out waiting for seat %d to connect\n",
 		 i + 1 );
@@ -1259,6 +2802,11 @@ int main( int argc, char **argv )
       exit( EXIT_FAILURE );
     }
     close( listenSocket[ i ] );
+    if( listenEndpoint[ i ] != NULL ) {
+      /* nobody else can connect, so clear the name from the file system */
+
+      removeUnixEndpoint( listenEndpoint[ i ] );
+    }
 
     v = 1;
     setsockopt( seatFD[ i ], IPPROTO_TCP, TCP_NODELAY,
@@ -1268,22 +2816,53 @@ int main( int argc, char **argv )
   }
 
   /* play the match */
-  if( gameLoop( game, seatName, numHands, quiet, fixedSeats, &rng, &errorInfo,
-		seatFD, readBuf, logFile, transactionFile ) < 0 ) {
+  if( gameLoop( game, seatName, numHands, quiet, trace, fixedSeats,
+		&rng, &errorInfo, readBuf, plugin, latency, valueStats,
+		logFile, transactionFile ) < 0 ) {
     /* should have already printed an error message */
 
+    /* keep the trace and log leading up to the failure */
+    if( trace != NULL ) {
+      closeTrace( trace );
+    }
+    closeMatchLog();
     exit( EXIT_FAILURE );
   }
 
   fflush( stderr );
   fflush( stdout );
+  if( trace != NULL && closeTrace( trace ) < 0 ) {
+
+    fprintf( stderr, "ERROR: could not write to trace file\n" );
+    exit( EXIT_FAILURE );
+  }
   if( transactionFile != NULL ) {
     fclose( transactionFile );
   }
-  if( logFile != NULL ) {
-    fclose( logFile );
+  if( closeMatchLog() < 0 ) {
+
+    fprintf( stderr, "ERROR: could not write log file\n" );
+    exit( EXIT_FAILURE );
+  }
+  for( i = 0; i < game->numPlayers; ++i ) {
+
+    if( plugin[ i ].api != NULL ) {
+
+      unloadPlugin( &plugin[ i ] );
+    }
   }
+  free( latency );
   free( game );
 
   return EXIT_SUCCESS;
 }
+
+int main( int argc, char **argv )
+{
+  if( argc > 1 && !strcmp( argv[ 1 ], "--worker" ) ) {
+
+    return runWorker( argc - 2, &argv[ 2 ] );
+  }
+
+  return runMatch( argc, argv );
+}
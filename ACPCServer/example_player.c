@@ -6,39 +6,425 @@ Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
 #include <stdio.h>
 #include <assert.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
 #include <netdb.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/epoll.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <getopt.h>
 #include "game.h"
 #include "rng.h"
 #include "net.h"
+#include "binary_protocol.h"
 
-int main( int argc, char **argv )
+
+#define MAX_EPOLL_EVENTS 64
+
+
+/* one connection to a dealer, when playing several at once */
+typedef struct {
+  ReadBuf *fromServer; /* NULL once the match is over */
+  char *port;
+  int binary;
+  int negotiating; /* waiting for the answer to a binary request */
+  MatchState state;
+  rng_state_t rng; /* each connection has its own stream */
+} PlayerConn;
+
+
+/* choose one of the valid actions in state at random, with the
+   probabilities in probs scaled up to make up for invalid actions */
+static void chooseAction( const Game *game, const State *state,
+			  const double probs[ NUM_ACTION_TYPES ],
+			  rng_state_t *rng, Action *action )
 {
-  int sock, len, r, a;
+  int a;
   int32_t min, max;
-  uint16_t port;
   double p;
+  double actionProbs[ NUM_ACTION_TYPES ];
+
+  /* build the set of valid actions */
+  p = 0;
+  for( a = 0; a < NUM_ACTION_TYPES; ++a ) {
+
+    actionProbs[ a ] = 0.0;
+  }
+
+  /* consider fold */
+  action->type = a_fold;
+  action->size = 0;
+  if( isValidAction( game, state, 0, action ) ) {
+
+    actionProbs[ a_fold ] = probs[ a_fold ];
+    p += probs[ a_fold ];
+  }
+
+  /* consider call */
+  action->type = a_call;
+  action->size = 0;
+  actionProbs[ a_call ] = probs[ a_call ];
+  p += probs[ a_call ];
+
+  /* consider raise */
+  if( raiseIsValid( game, state, &min, &max ) ) {
+
+    actionProbs[ a_raise ] = probs[ a_raise ];
+    p += probs[ a_raise ];
+  }
+
+  /* normalise the probabilities  */
+  assert( p > 0.0 );
+  for( a = 0; a < NUM_ACTION_TYPES; ++a ) {
+
+    actionProbs[ a ] /= p;
+  }
+
+  /* choose one of the valid actions at random */
+  p = genrand_real2( rng );
+  for( a = 0; a < NUM_ACTION_TYPES - 1; ++a ) {
+
+    if( p <= actionProbs[ a ] ) {
+
+      break;
+    }
+    p -= actionProbs[ a ];
+  }
+  action->type = (enum ActionType)a;
+  if( a == a_raise ) {
+
+    action->size = min + genrand_int32( rng ) % ( max - min + 1 );
+  }
+}
+
+/* send action in response to state, which came in as the text line of
+   length len unless we are using the binary protocol
+   returns 0 on success, -1 on failure */
+static int sendAction( const Game *game, ReadBuf *fromServer,
+		       const int binary, const MatchState *state,
+		       const char *line, int len, const Action *action )
+{
+  int r;
+  char response[ MAX_LINE_LEN ];
+
+  if( binary ) {
+
+    if( putBinaryAction( fromServer, state, action ) < 0 ) {
+
+      fprintf( stderr, "ERROR: could not get send response to server\n" );
+      return -1;
+    }
+    return 0;
+  }
+
+  /* copy the state and add a colon, leaving room for an action */
+  if( len + 3 >= MAX_LINE_LEN ) {
+
+    fprintf( stderr, "ERROR: state too long for response %s", line );
+    return -1;
+  }
+  memcpy( response, line, len );
+  response[ len ] = ':';
+  ++len;
+
+  r = printAction( game, action, MAX_LINE_LEN - len - 2,
+		   &response[ len ] );
+  if( r < 0 ) {
+
+    fprintf( stderr, "ERROR: line too long after printing action\n" );
+    return -1;
+  }
+  len += r;
+  response[ len ] = '\r';
+  ++len;
+  response[ len ] = '\n';
+  ++len;
+
+  if( putLine( fromServer, response, len ) != len ) {
+
+    fprintf( stderr, "ERROR: could not get send response to server\n" );
+    return -1;
+  }
+  return 0;
+}
+
+/* send the text version string to the dealer
+   returns 0 on success, -1 on failure */
+static int sendVersion( ReadBuf *fromServer )
+{
+  int len;
+  char version[ MAX_LINE_LEN ];
+
+  len = snprintf( version, MAX_LINE_LEN,
+		  "VERSION:%"PRIu32".%"PRIu32".%"PRIu32"\n",
+		  VERSION_MAJOR, VERSION_MINOR, VERSION_REVISION );
+  if( len != 14 || putLine( fromServer, version, len ) != len ) {
+
+    fprintf( stderr, "ERROR: could not get send version to server\n" );
+    return -1;
+  }
+  return 0;
+}
+
+/* read everything which has arrived on conn, answering each state
+   where it is our turn
+   returns 1 if the match goes on, 0 if it is over, or -1 on failure */
+static int readConn( const Game *game, const double probs[ NUM_ACTION_TYPES ],
+		     PlayerConn *conn )
+{
+  int len, first;
+  ssize_t r;
+  char *line;
+  Action action;
+
+  /* the socket was readable, so the first read doesn't wait, and after
+     that we only carry on while there is data left in the buffer */
+  line = NULL;
+  for( first = 1;
+       first || conn->fromServer->bufStart < conn->fromServer->bufEnd;
+       first = 0 ) {
+
+    len = 0;
+    if( conn->binary ) {
+
+      r = getBinaryStateNow( conn->fromServer, game, &conn->state );
+      if( r == BINARY_INCOMPLETE ) {
+	/* no whole frame yet */
+
+	return 1;
+      }
+      if( r < 0 ) {
+
+	fprintf( stderr, "ERROR: could not read binary state\n" );
+      }
+      if( r <= 0 ) {
+
+	return r;
+      }
+    } else {
+
+      r = getLineView( conn->fromServer, &line, 0 );
+      if( r == 0 ) {
+
+	return 0;
+      }
+      if( r < 0 ) {
+	/* no whole line yet */
+
+	return 1;
+      }
+
+      if( conn->negotiating ) {
+
+	conn->negotiating = 0;
+	if( binaryProtocolAnswer( line ) ) {
+
+	  conn->binary = 1;
+	  continue;
+	}
+      }
+
+      /* ignore comments */
+      if( line[ 0 ] == '#' || line[ 0 ] == ';' ) {
+	continue;
+      }
+
+      len = readMatchState( line, game, &conn->state );
+      if( len < 0 ) {
+
+	fprintf( stderr, "ERROR: could not read state %s", line );
+	return -1;
+      }
+    }
+
+    if( stateFinished( &conn->state.state )
+	|| currentPlayer( game, &conn->state.state )
+	!= conn->state.viewingPlayer ) {
+      /* game over, or we're not acting */
+
+      continue;
+    }
+
+    chooseAction( game, &conn->state.state, probs, &conn->rng, &action );
+    assert( isValidAction( game, &conn->state.state, 0, &action ) );
+    if( sendAction( game, conn->fromServer, conn->binary, &conn->state,
+		    line, len, &action ) < 0 ) {
+
+      return -1;
+    }
+  }
+
+  return 1;
+}
+
+/* play a seat at each of numPorts ports from one process, waiting on
+   all of the connections at once with epoll
+   a port may be a Unix domain endpoint, which is used in place of server
+   returns the number of connections which failed */
+static int playMany( const Game *game, const double probs[ NUM_ACTION_TYPES ],
+		     char *server, const int numPorts, char **ports,
+		     const int binary, rng_state_t *rng )
+{
+  int i, n, e, r, sock, epfd, numOpen, numFailed;
+  uint16_t port;
+  char *host;
+  PlayerConn *conns, *conn;
+  struct epoll_event event, events[ MAX_EPOLL_EVENTS ];
+
+  epfd = epoll_create1( 0 );
+  if( epfd < 0 ) {
+
+    fprintf( stderr, "ERROR: could not create epoll instance\n" );
+    exit( EXIT_FAILURE );
+  }
+  conns = (PlayerConn *)calloc( numPorts, sizeof( PlayerConn ) );
+  if( conns == NULL ) {
+
+    fprintf( stderr, "ERROR: could not allocate connections\n" );
+    exit( EXIT_FAILURE );
+  }
+
+  /* connect to every dealer before reading from any of them, since we
+     may be several of the players in one match */
+  for( i = 0; i < numPorts; ++i ) {
+
+    conn = &conns[ i ];
+    conn->port = ports[ i ];
+    host = server;
+    port = 0;
+    if( isUnixEndpoint( ports[ i ] ) ) {
+
+      host = ports[ i ];
+    } else if( sscanf( ports[ i ], "%"SCNu16, &port ) < 1 ) {
+
+      fprintf( stderr, "ERROR: invalid port %s\n", ports[ i ] );
+      exit( EXIT_FAILURE );
+    }
+    sock = connectTo( host, port );
+    if( sock < 0 ) {
+
+      exit( EXIT_FAILURE );
+    }
+    conn->fromServer = createReadBuf( sock );
+    if( conn->fromServer == NULL ) {
+
+      fprintf( stderr, "ERROR: could not create socket buffer\n" );
+      exit( EXIT_FAILURE );
+    }
+    init_genrand( &conn->rng, genrand_int32( rng ) );
+
+    /* ask for binary without waiting for the answer, which is read
+       along with everything else */
+    if( binary ) {
+
+      if( requestBinaryProtocol( conn->fromServer ) < 0 ) {
+
+	fprintf( stderr, "ERROR: could not start binary protocol\n" );
+	exit( EXIT_FAILURE );
+      }
+      conn->negotiating = 1;
+    } else if( sendVersion( conn->fromServer ) < 0 ) {
+
+      exit( EXIT_FAILURE );
+    }
+
+    event.events = EPOLLIN;
+    event.data.u32 = i;
+    if( epoll_ctl( epfd, EPOLL_CTL_ADD, sock, &event ) < 0 ) {
+
+      fprintf( stderr, "ERROR: could not add socket to epoll\n" );
+      exit( EXIT_FAILURE );
+    }
+  }
+
+  /* play the games! */
+  numOpen = numPorts;
+  numFailed = 0;
+  while( numOpen > 0 ) {
+
+    n = epoll_wait( epfd, events, MAX_EPOLL_EVENTS, -1 );
+    if( n < 0 ) {
+
+      if( errno == EINTR ) {
+	continue;
+      }
+      fprintf( stderr, "ERROR: epoll_wait failed\n" );
+      exit( EXIT_FAILURE );
+    }
+
+    for( e = 0; e < n; ++e ) {
+
+      conn = &conns[ events[ e ].data.u32 ];
+      r = events[ e ].events & EPOLLERR ? -1
+	: readConn( game, probs, conn );
+      if( r > 0 ) {
+	continue;
+      }
+
+      /* closing the socket also takes it out of the epoll set */
+      if( r < 0 ) {
+
+	fprintf( stderr, "ERROR: gave up on port %s\n", conn->port );
+	++numFailed;
+      }
+      destroyReadBuf( conn->fromServer );
+      conn->fromServer = NULL;
+      --numOpen;
+    }
+  }
+
+  close( epfd );
+  free( conns );
+  return numFailed;
+}
+
+int main( int argc, char **argv )
+{
+  int sock, len, r, binary, shm, pending;
+  uint16_t port;
   Game *game;
   MatchState state;
   Action action;
-  FILE *file, *toServer, *fromServer;
+  FILE *file;
+  ReadBuf *fromServer;
   struct timeval tv;
   double probs[ NUM_ACTION_TYPES ];
-  double actionProbs[ NUM_ACTION_TYPES ];
   rng_state_t rng;
-  char line[ MAX_LINE_LEN ];
+  char *line, first[ MAX_LINE_LEN ];
 
   /* we make some assumptions about the actions - check them here */
   assert( NUM_ACTION_TYPES == 3 );
 
+  binary = 0;
+  shm = 0;
+  while( ( r = getopt( argc, argv, "bs" ) ) != -1 ) {
+
+    if( r == 'b' ) {
+
+      binary = 1;
+    } else if( r == 's' ) {
+
+      shm = 1;
+    } else {
+
+      argc = 0;
+      break;
+    }
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
+
   if( argc < 4 ) {
 
-    fprintf( stderr, "usage: player game server port\n" );
+    fprintf( stderr, "usage: player [-b] [-s] game server port [port ...]\n" );
+    fprintf( stderr, "  server may be a Unix domain socket unix:/path or @name, with port 0\n" );
+    fprintf( stderr, "  with more than one port, plays a seat at each from this process,\n" );
+    fprintf( stderr, "  where a port may also be a Unix domain socket\n" );
+    fprintf( stderr, "  -b asks the dealer for the binary protocol\n" );
+    fprintf( stderr, "  -s talks to a dealer on the same host through shared memory rings,\n" );
+    fprintf( stderr, "    with a single port\n" );
     exit( EXIT_FAILURE );
   }
 
@@ -66,138 +452,133 @@ int main( int argc, char **argv )
   }
   fclose( file );
 
-  /* connect to the dealer */
-  if( sscanf( argv[ 3 ], "%"SCNu16, &port ) < 1 ) {
+  if( argc > 4 ) {
+    /* the rings can't be waited on with epoll */
 
-    fprintf( stderr, "ERROR: invalid port %s\n", argv[ 3 ] );
-    exit( EXIT_FAILURE );
-  }
-  sock = connectTo( argv[ 2 ], port );
-  if( sock < 0 ) {
+    if( shm ) {
 
-    exit( EXIT_FAILURE );
-  }
-  toServer = fdopen( sock, "w" );
-  fromServer = fdopen( sock, "r" );
-  if( toServer == NULL || fromServer == NULL ) {
-
-    fprintf( stderr, "ERROR: could not get socket streams\n" );
-    exit( EXIT_FAILURE );
+      fprintf( stderr, "ERROR: -s only works with a single port\n" );
+      exit( EXIT_FAILURE );
+    }
+    r = playMany( game, probs, argv[ 2 ], argc - 3, &argv[ 3 ], binary, &rng );
+    free( game );
+    return r ? EXIT_FAILURE : EXIT_SUCCESS;
   }
 
-  /* send version string to dealer */
-  if( fprintf( toServer, "VERSION:%"PRIu32".%"PRIu32".%"PRIu32"\n",
-	       VERSION_MAJOR, VERSION_MINOR, VERSION_REVISION ) != 14 ) {
+  /* connect to the dealer */
+  if( sscanf( argv[ 3 ], "%"SCNu16, &port ) < 1 ) {
 
-    fprintf( stderr, "ERROR: could not get send version to server\n" );
+    fprintf( stderr, "ERROR: invalid port %s\n", argv[ 3 ] );
     exit( EXIT_FAILURE );
   }
-  fflush( toServer );
+  if( shm ) {
+    /* the request goes before the version, so the dealer switches
+       to the rings before anything else is sent */
 
-  /* play the game! */
-  while( fgets( line, MAX_LINE_LEN, fromServer ) ) {
+    fromServer = connectToShm( argv[ 2 ], port );
+    if( fromServer == NULL ) {
 
-    /* ignore comments */
-    if( line[ 0 ] == '#' || line[ 0 ] == ';' ) {
-      continue;
+      fprintf( stderr, "ERROR: could not connect through shared memory\n" );
+      exit( EXIT_FAILURE );
     }
+  } else {
 
-    len = readMatchState( line, game, &state );
-    if( len < 0 ) {
+    sock = connectTo( argv[ 2 ], port );
+    if( sock < 0 ) {
 
-      fprintf( stderr, "ERROR: could not read state %s", line );
       exit( EXIT_FAILURE );
     }
+    fromServer = createReadBuf( sock );
+    if( fromServer == NULL ) {
 
-    if( stateFinished( &state.state ) ) {
-      /* ignore the game over message */
-
-      continue;
+      fprintf( stderr, "ERROR: could not create socket buffer\n" );
+      exit( EXIT_FAILURE );
     }
+  }
 
-    if( currentPlayer( game, &state.state ) != state.viewingPlayer ) {
-      /* we're not acting */
+  /* send version string to dealer */
+  pending = 0;
+  if( binary ) {
+    /* a dealer which doesn't do binary just starts sending text */
 
-      continue;
-    }
+    r = startBinaryProtocol( fromServer, first, MAX_LINE_LEN );
+    if( r < 0 ) {
 
-    /* add a colon (guaranteed to fit because we read a new-line in fgets) */
-    line[ len ] = ':';
-    ++len;
+      fprintf( stderr, "ERROR: could not start binary protocol\n" );
+      exit( EXIT_FAILURE );
+    }
+    binary = r;
+    pending = !r;
+  } else if( sendVersion( fromServer ) < 0 ) {
 
-    /* build the set of valid actions */
-    p = 0;
-    for( a = 0; a < NUM_ACTION_TYPES; ++a ) {
+    exit( EXIT_FAILURE );
+  }
 
-      actionProbs[ a ] = 0.0;
-    }
+  /* play the game!
+     line points into fromServer's buffer, so sendAction builds the
+     response in a separate buffer */
+  len = 0;
+  line = NULL;
+  while( 1 ) {
 
-    /* consider fold */
-    action.type = a_fold;
-    action.size = 0;
-    if( isValidAction( game, &state.state, 0, &action ) ) {
+    if( binary ) {
+      /* state is updated in place from each frame */
 
-      actionProbs[ a_fold ] = probs[ a_fold ];
-      p += probs[ a_fold ];
-    }
+      r = getBinaryState( fromServer, game, &state, -1 );
+      if( r < 0 ) {
 
-    /* consider call */
-    action.type = a_call;
-    action.size = 0;
-    actionProbs[ a_call ] = probs[ a_call ];
-    p += probs[ a_call ];
+	fprintf( stderr, "ERROR: could not read binary state\n" );
+	exit( EXIT_FAILURE );
+      }
+      if( r == 0 ) {
 
-    /* consider raise */
-    if( raiseIsValid( game, &state.state, &min, &max ) ) {
+	break;
+      }
+    } else {
 
-      actionProbs[ a_raise ] = probs[ a_raise ];
-      p += probs[ a_raise ];
-    }
+      if( pending ) {
 
-    /* normalise the probabilities  */
-    assert( p > 0.0 );
-    for( a = 0; a < NUM_ACTION_TYPES; ++a ) {
+	line = first;
+	pending = 0;
+      } else if( getLineView( fromServer, &line, -1 ) <= 0 ) {
 
-      actionProbs[ a ] /= p;
-    }
+	break;
+      }
 
-    /* choose one of the valid actions at random */
-    p = genrand_real2( &rng );
-    for( a = 0; a < NUM_ACTION_TYPES - 1; ++a ) {
+      /* ignore comments */
+      if( line[ 0 ] == '#' || line[ 0 ] == ';' ) {
+	continue;
+      }
 
-      if( p <= actionProbs[ a ] ) {
+      len = readMatchState( line, game, &state );
+      if( len < 0 ) {
 
-        break;
+	fprintf( stderr, "ERROR: could not read state %s", line );
+	exit( EXIT_FAILURE );
       }
-      p -= actionProbs[ a ];
     }
-    action.type = (enum ActionType)a;
-    if( a == a_raise ) {
 
-      action.size = min + genrand_int32( &rng ) % ( max - min + 1 );
+    if( stateFinished( &state.state ) ) {
+      /* ignore the game over message */
+
+      continue;
     }
 
-    /* do the action! */
-    assert( isValidAction( game, &state.state, 0, &action ) );
-    r = printAction( game, &action, MAX_LINE_LEN - len - 2,
-		     &line[ len ] );
-    if( r < 0 ) {
+    if( currentPlayer( game, &state.state ) != state.viewingPlayer ) {
+      /* we're not acting */
 
-      fprintf( stderr, "ERROR: line too long after printing action\n" );
-      exit( EXIT_FAILURE );
+      continue;
     }
-    len += r;
-    line[ len ] = '\r';
-    ++len;
-    line[ len ] = '\n';
-    ++len;
 
-    if( fwrite( line, 1, len, toServer ) != len ) {
+    chooseAction( game, &state.state, probs, &rng, &action );
+
+    /* do the action! */
+    assert( isValidAction( game, &state.state, 0, &action ) );
+    if( sendAction( game, fromServer, binary, &state, line, len,
+		    &action ) < 0 ) {
 
-      fprintf( stderr, "ERROR: could not get send response to server\n" );
       exit( EXIT_FAILURE );
     }
-    fflush( toServer );
   }
 
   return EXIT_SUCCESS;
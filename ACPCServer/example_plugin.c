@@ -0,0 +1,134 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+/* example_player as an in-process dealer plugin
+
+   the optional plugin argument is the random number seed, otherwise
+   the time is used */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <sys/time.h>
+#include "game.h"
+#include "rng.h"
+#include "player_plugin.h"
+
+
+typedef struct {
+  const Game *game;
+  double probs[ NUM_ACTION_TYPES ];
+  rng_state_t rng;
+} ExamplePlayer;
+
+
+static void *exampleInit( const Game *game, const uint8_t seat,
+			  const char *args )
+{
+  uint32_t seed;
+  struct timeval tv;
+  ExamplePlayer *player;
+
+  /* we make some assumptions about the actions - check them here */
+  assert( NUM_ACTION_TYPES == 3 );
+
+  player = (ExamplePlayer*)malloc( sizeof( ExamplePlayer ) );
+  if( player == NULL ) {
+
+    return NULL;
+  }
+  player->game = game;
+
+  /* Define the probabilities of actions for the player */
+  player->probs[ a_fold ] = 0.06;
+  player->probs[ a_call ] = ( 1.0 - player->probs[ a_fold ] ) * 0.5;
+  player->probs[ a_raise ] = ( 1.0 - player->probs[ a_fold ] ) * 0.5;
+
+  /* Initialize the player's random number state */
+  if( args == NULL || sscanf( args, "%"SCNu32, &seed ) < 1 ) {
+
+    gettimeofday( &tv, NULL );
+    seed = tv.tv_usec + seat;
+  }
+  init_genrand( &player->rng, seed );
+
+  return player;
+}
+
+static Action exampleAct( void *data, const MatchState *state )
+{
+  int a;
+  int32_t min, max;
+  double p;
+  Action action;
+  double actionProbs[ NUM_ACTION_TYPES ];
+  ExamplePlayer *player = (ExamplePlayer*)data;
+
+  /* build the set of valid actions */
+  p = 0;
+  for( a = 0; a < NUM_ACTION_TYPES; ++a ) {
+
+    actionProbs[ a ] = 0.0;
+  }
+
+  /* consider fold */
+  action.type = a_fold;
+  action.size = 0;
+  if( isValidAction( player->game, &state->state, 0, &action ) ) {
+
+    actionProbs[ a_fold ] = player->probs[ a_fold ];
+    p += player->probs[ a_fold ];
+  }
+
+  /* consider call */
+  actionProbs[ a_call ] = player->probs[ a_call ];
+  p += player->probs[ a_call ];
+
+  /* consider raise */
+  if( raiseIsValid( player->game, &state->state, &min, &max ) ) {
+
+    actionProbs[ a_raise ] = player->probs[ a_raise ];
+    p += player->probs[ a_raise ];
+  }
+
+  /* normalise the probabilities  */
+  assert( p > 0.0 );
+  for( a = 0; a < NUM_ACTION_TYPES; ++a ) {
+
+    actionProbs[ a ] /= p;
+  }
+
+  /* choose one of the valid actions at random */
+  p = genrand_real2( &player->rng );
+  for( a = 0; a < NUM_ACTION_TYPES - 1; ++a ) {
+
+    if( p <= actionProbs[ a ] ) {
+
+      break;
+    }
+    p -= actionProbs[ a ];
+  }
+  action.type = (enum ActionType)a;
+  action.size = 0;
+  if( a == a_raise ) {
+
+    action.size = min + genrand_int32( &player->rng ) % ( max - min + 1 );
+  }
+
+  return action;
+}
+
+static void exampleDestroy( void *player )
+{
+  free( player );
+}
+
+
+const PlayerPlugin acpcPlayerPlugin = {
+  PLAYER_PLUGIN_ABI_VERSION,
+  exampleInit,
+  exampleAct,
+  NULL,
+  exampleDestroy
+};
@@ -0,0 +1,903 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "hand_history.h"
+
+
+static const uint8_t columnElementLen[ HH_NUM_COLUMNS ]
+= { sizeof( uint32_t ), sizeof( uint16_t ), sizeof( float ), 1,
+    sizeof( uint64_t ), 1, 1 };
+
+static const char actionChars[ a_invalid + 1 ] = "fcr";
+
+
+static int writeVarint( uint32_t value, uint8_t *bytes )
+{
+  int len;
+
+  for( len = 0; value >= 128; ++len ) {
+
+    bytes[ len ] = ( value & 127 ) | 128;
+    value >>= 7;
+  }
+  bytes[ len ] = value;
+  return len + 1;
+}
+
+/* returns the number of bytes read, or 0 if the varint runs past len */
+static int readVarint( const uint8_t *bytes, const uint32_t len,
+		       uint32_t *value )
+{
+  int i;
+
+  *value = 0;
+  for( i = 0; i < len && i < 5; ++i ) {
+
+    *value |= (uint32_t)( bytes[ i ] & 127 ) << ( 7 * i );
+    if( !( bytes[ i ] & 128 ) ) {
+
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+/* returns the number of bytes taken by the action at the start of
+   bytes, or 0 if it is cut off */
+static int actionLen( const HandHistory *hh, const uint8_t *bytes,
+		      const uint32_t len )
+{
+  uint32_t size;
+  int c;
+
+  if( len == 0 ) {
+
+    return 0;
+  }
+  if( bytes[ 0 ] != a_raise || hh->header->bettingType != noLimitBetting ) {
+
+    return 1;
+  }
+  c = readVarint( &bytes[ 1 ], len - 1, &size );
+  return c ? c + 1 : 0;
+}
+
+static int writeColumn( HandHistoryWriter *writer,
+			const enum HandHistoryColumn column,
+			const void *data, const size_t len )
+{
+  if( fwrite( data, 1, len, writer->column[ column ] ) != len ) {
+
+    fprintf( stderr, "ERROR: could not write hand history column\n" );
+    return -1;
+  }
+  writer->header.columnLen[ column ] += len;
+  return 0;
+}
+
+static int32_t findName( HandHistoryWriter *writer, const int position,
+			 const char *name )
+{
+  uint32_t i;
+  char **names;
+
+  /* players usually keep their positions, or swap them around, so
+     check last hand's names before looking through all of them */
+  if( writer->header.numNames
+      && !strcmp( writer->names[ writer->lastName[ position ] ], name ) ) {
+
+    return writer->lastName[ position ];
+  }
+  for( i = 0; i < writer->header.numNames; ++i ) {
+
+    if( !strcmp( writer->names[ i ], name ) ) {
+
+      writer->lastName[ position ] = i;
+      return i;
+    }
+  }
+
+  if( writer->header.numNames == HH_MAX_NAMES ) {
+
+    fprintf( stderr, "ERROR: more than %d players in hand history\n",
+	     HH_MAX_NAMES );
+    return -1;
+  }
+  if( writer->header.numNames == writer->maxNames ) {
+
+    i = writer->maxNames ? writer->maxNames * 2 : 16;
+    names = realloc( writer->names, sizeof( names[ 0 ] ) * i );
+    if( names == NULL ) {
+
+      fprintf( stderr, "ERROR: could not allocate hand history names\n" );
+      return -1;
+    }
+    writer->names = names;
+    writer->maxNames = i;
+  }
+  i = writer->header.numNames;
+  writer->names[ i ] = strdup( name );
+  if( writer->names[ i ] == NULL
+      || writeColumn( writer, hh_names, name, strlen( name ) + 1 ) < 0 ) {
+
+    return -1;
+  }
+  ++writer->header.numNames;
+  writer->lastName[ position ] = i;
+  return i;
+}
+
+static void freeWriter( HandHistoryWriter *writer )
+{
+  int i;
+
+  for( i = 0; i < HH_NUM_COLUMNS; ++i ) {
+
+    if( writer->column[ i ] ) {
+
+      fclose( writer->column[ i ] );
+    }
+  }
+  if( writer->file ) {
+
+    fclose( writer->file );
+  }
+  for( i = 0; i < writer->header.numNames; ++i ) {
+
+    free( writer->names[ i ] );
+  }
+  free( writer->names );
+  free( writer );
+}
+
+HandHistoryWriter *openHandHistoryWriter( const char *fileName,
+					  const Game *game )
+{
+  int i;
+  HandHistoryWriter *writer;
+
+  writer = calloc( 1, sizeof( *writer ) );
+  if( writer == NULL ) {
+
+    fprintf( stderr, "ERROR: could not allocate hand history writer\n" );
+    return NULL;
+  }
+  memcpy( writer->header.magic, HH_MAGIC, sizeof( writer->header.magic ) );
+  writer->header.byteOrder = HH_BYTE_ORDER_MARK;
+  writer->header.numPlayers = game->numPlayers;
+  writer->header.numRounds = game->numRounds;
+  writer->header.numHoleCards = game->numHoleCards;
+  writer->header.numBoardCards = sumBoardCards( game, game->numRounds - 1 );
+  writer->header.bettingType = game->bettingType;
+  writer->header.cardsPerHand = game->numPlayers * game->numHoleCards
+    + writer->header.numBoardCards;
+
+  /* each column goes to its own file until the number of hands is
+     known, so logs of any length can be converted in one pass */
+  writer->file = fopen( fileName, "wb" );
+  if( writer->file == NULL ) {
+
+    fprintf( stderr, "ERROR: could not open hand history %s\n", fileName );
+    freeWriter( writer );
+    return NULL;
+  }
+  for( i = 0; i < HH_NUM_COLUMNS; ++i ) {
+
+    writer->column[ i ] = tmpfile();
+    if( writer->column[ i ] == NULL ) {
+
+      fprintf( stderr, "ERROR: could not open hand history column\n" );
+      freeWriter( writer );
+      return NULL;
+    }
+  }
+
+  return writer;
+}
+
+int addHandHistoryLine( HandHistoryWriter *writer, const Game *game,
+			const char *line )
+{
+  int c, r, a, p, n, len;
+  int32_t nameId;
+  uint32_t handId;
+  uint16_t nameIds[ MAX_PLAYERS ];
+  float values[ MAX_PLAYERS ];
+  uint8_t cards[ MAX_PLAYERS * MAX_HOLE_CARDS + MAX_BOARD_CARDS ];
+  uint8_t actions[ HH_MAX_ACTION_BYTES ];
+  uint64_t offset;
+  double value;
+  State state;
+  char name[ MAX_LINE_LEN ];
+
+  c = readState( line, game, &state );
+  if( c < 0 ) {
+
+    return 0;
+  }
+
+  /* STATE:handId:betting:cards:values:names */
+  for( p = 0; p < game->numPlayers; ++p ) {
+
+    if( line[ c ] != ( p ? '|' : ':' )
+	|| sscanf( &line[ c + 1 ], "%lf%n", &value, &r ) < 1 ) {
+
+      fprintf( stderr, "ERROR: could not read values of hand %"PRIu32"\n",
+	       state.handId );
+      return -1;
+    }
+    values[ p ] = value;
+    c += r + 1;
+  }
+  for( p = 0; p < game->numPlayers; ++p ) {
+
+    if( line[ c ] != ( p ? '|' : ':' ) ) {
+
+      fprintf( stderr, "ERROR: could not read names of hand %"PRIu32"\n",
+	       state.handId );
+      return -1;
+    }
+    ++c;
+    for( n = 0; line[ c ] && line[ c ] != '|' && line[ c ] != '\n'
+	   && line[ c ] != '\r'; ++n, ++c ) {
+
+      name[ n ] = line[ c ];
+    }
+    name[ n ] = 0;
+    nameId = findName( writer, p, name );
+    if( nameId < 0 ) {
+
+      return -1;
+    }
+    nameIds[ p ] = nameId;
+  }
+
+  /* the dealer always shows everyone's hole cards in its log, but
+     only the board cards of the rounds which were played */
+  n = 0;
+  for( p = 0; p < game->numPlayers; ++p ) {
+
+    for( c = 0; c < game->numHoleCards; ++c ) {
+
+      cards[ n ] = state.holeCards[ p ][ c ];
+      ++n;
+    }
+  }
+  r = sumBoardCards( game, state.round );
+  for( c = 0; c < writer->header.numBoardCards; ++c ) {
+
+    cards[ n ] = c < r ? state.boardCards[ c ] : HH_NO_CARD;
+    ++n;
+  }
+
+  len = 0;
+  for( r = 0; r <= state.round; ++r ) {
+
+    if( r ) {
+
+      actions[ len ] = HH_ROUND_END;
+      ++len;
+    }
+    for( a = 0; a < state.numActions[ r ]; ++a ) {
+
+      actions[ len ] = state.action[ r ][ a ].type;
+      ++len;
+      if( game->bettingType == noLimitBetting
+	  && state.action[ r ][ a ].type == a_raise ) {
+
+	len += writeVarint( state.action[ r ][ a ].size, &actions[ len ] );
+      }
+    }
+  }
+
+  offset = writer->numActionBytes;
+  handId = state.handId;
+  if( writeColumn( writer, hh_hand_id, &handId, sizeof( handId ) ) < 0
+      || writeColumn( writer, hh_name_ids, nameIds,
+		      sizeof( nameIds[ 0 ] ) * game->numPlayers ) < 0
+      || writeColumn( writer, hh_values, values,
+		      sizeof( values[ 0 ] ) * game->numPlayers ) < 0
+      || writeColumn( writer, hh_cards, cards, n ) < 0
+      || writeColumn( writer, hh_action_offsets, &offset,
+		      sizeof( offset ) ) < 0
+      || writeColumn( writer, hh_actions, actions, len ) < 0 ) {
+
+    return -1;
+  }
+  writer->numActionBytes += len;
+  ++writer->header.numHands;
+
+  return 1;
+}
+
+int closeHandHistoryWriter( HandHistoryWriter *writer )
+{
+  int i, r;
+  uint64_t offset;
+  size_t len;
+  char buf[ 65536 ];
+
+  /* finish the offsets with the end of the last hand */
+  if( writeColumn( writer, hh_action_offsets, &writer->numActionBytes,
+		   sizeof( writer->numActionBytes ) ) < 0 ) {
+
+    freeWriter( writer );
+    return -1;
+  }
+
+  offset = sizeof( writer->header );
+  for( i = 0; i < HH_NUM_COLUMNS; ++i ) {
+
+    offset = ( offset + HH_COLUMN_ALIGN - 1 )
+      / HH_COLUMN_ALIGN * HH_COLUMN_ALIGN;
+    writer->header.columnOffset[ i ] = offset;
+    offset += writer->header.columnLen[ i ];
+  }
+
+  r = 0;
+  if( fwrite( &writer->header, sizeof( writer->header ), 1, writer->file )
+      != 1 ) {
+
+    r = -1;
+  }
+  for( i = 0; i < HH_NUM_COLUMNS && r == 0; ++i ) {
+
+    if( fseek( writer->file, writer->header.columnOffset[ i ], SEEK_SET ) < 0
+	|| fflush( writer->column[ i ] ) || fseek( writer->column[ i ], 0,
+						     SEEK_SET ) < 0 ) {
+
+      r = -1;
+      break;
+    }
+    while( ( len = fread( buf, 1, sizeof( buf ), writer->column[ i ] ) ) ) {
+
+      if( fwrite( buf, 1, len, writer->file ) != len ) {
+
+	r = -1;
+	break;
+      }
+    }
+    if( ferror( writer->column[ i ] ) ) {
+
+      r = -1;
+    }
+  }
+  if( fclose( writer->file ) ) {
+
+    r = -1;
+  }
+  writer->file = NULL;
+  if( r < 0 ) {
+
+    fprintf( stderr, "ERROR: could not write hand history\n" );
+  }
+
+  freeWriter( writer );
+  return r;
+}
+
+int openHandHistory( const char *fileName, HandHistory *hh )
+{
+  int fd, i;
+  uint64_t n;
+  struct stat st;
+  const HandHistoryHeader *header;
+  const char *names;
+
+  memset( hh, 0, sizeof( *hh ) );
+  fd = open( fileName, O_RDONLY );
+  if( fd < 0 || fstat( fd, &st ) < 0 ) {
+
+    fprintf( stderr, "ERROR: could not open hand history %s\n", fileName );
+    if( fd >= 0 ) {
+
+      close( fd );
+    }
+    return -1;
+  }
+  if( st.st_size < sizeof( HandHistoryHeader ) ) {
+
+    fprintf( stderr, "ERROR: %s is not a hand history\n", fileName );
+    close( fd );
+    return -1;
+  }
+
+  /* queries go through the columns they use from start to end */
+  hh->mapLen = st.st_size;
+  hh->map = mmap( NULL, hh->mapLen, PROT_READ, MAP_SHARED, fd, 0 );
+  close( fd );
+  if( hh->map == MAP_FAILED ) {
+
+    fprintf( stderr, "ERROR: could not map hand history %s\n", fileName );
+    hh->map = NULL;
+    return -1;
+  }
+  madvise( hh->map, hh->mapLen, MADV_SEQUENTIAL );
+
+  header = (const HandHistoryHeader *)hh->map;
+  hh->header = header;
+  if( memcmp( header->magic, HH_MAGIC, sizeof( header->magic ) ) ) {
+
+    fprintf( stderr, "ERROR: %s is not a hand history\n", fileName );
+    closeHandHistory( hh );
+    return -1;
+  }
+  if( header->byteOrder != HH_BYTE_ORDER_MARK ) {
+
+    fprintf( stderr, "ERROR: %s was written on a machine with a different byte order\n", fileName );
+    closeHandHistory( hh );
+    return -1;
+  }
+
+  /* every column must be in the file, aligned, and as long as the
+     number of hands says */
+  n = header->numHands;
+  if( header->numPlayers == 0 || header->numPlayers > MAX_PLAYERS
+      || header->numRounds == 0 || header->numRounds > MAX_ROUNDS
+      || header->cardsPerHand != header->numPlayers * header->numHoleCards
+      + header->numBoardCards
+      || header->cardsPerHand > MAX_PLAYERS * MAX_HOLE_CARDS + MAX_BOARD_CARDS
+      || header->columnLen[ hh_hand_id ] != n * sizeof( uint32_t )
+      || header->columnLen[ hh_name_ids ]
+      != n * header->numPlayers * sizeof( uint16_t )
+      || header->columnLen[ hh_values ]
+      != n * header->numPlayers * sizeof( float )
+      || header->columnLen[ hh_cards ] != n * header->cardsPerHand
+      || header->columnLen[ hh_action_offsets ]
+      != ( n + 1 ) * sizeof( uint64_t ) ) {
+
+    fprintf( stderr, "ERROR: %s is not a valid hand history\n", fileName );
+    closeHandHistory( hh );
+    return -1;
+  }
+  for( i = 0; i < HH_NUM_COLUMNS; ++i ) {
+
+    if( header->columnOffset[ i ] % columnElementLen[ i ]
+	|| header->columnOffset[ i ] > hh->mapLen
+	|| header->columnLen[ i ] > hh->mapLen - header->columnOffset[ i ] ) {
+
+      fprintf( stderr, "ERROR: %s is not a valid hand history\n", fileName );
+      closeHandHistory( hh );
+      return -1;
+    }
+  }
+
+  hh->numHands = n;
+  hh->numPlayers = header->numPlayers;
+  hh->handId = (const uint32_t *)
+    ( (const char *)hh->map + header->columnOffset[ hh_hand_id ] );
+  hh->nameIds = (const uint16_t *)
+    ( (const char *)hh->map + header->columnOffset[ hh_name_ids ] );
+  hh->values = (const float *)
+    ( (const char *)hh->map + header->columnOffset[ hh_values ] );
+  hh->cards = (const uint8_t *)hh->map + header->columnOffset[ hh_cards ];
+  hh->actionOffset = (const uint64_t *)
+    ( (const char *)hh->map + header->columnOffset[ hh_action_offsets ] );
+  hh->actions = (const uint8_t *)hh->map + header->columnOffset[ hh_actions ];
+  if( hh->actionOffset[ n ] != header->columnLen[ hh_actions ] ) {
+
+    fprintf( stderr, "ERROR: %s is not a valid hand history\n", fileName );
+    closeHandHistory( hh );
+    return -1;
+  }
+
+  /* point at each name, checking the column ends with one */
+  names = (const char *)hh->map + header->columnOffset[ hh_names ];
+  if( header->numNames > HH_MAX_NAMES
+      || ( header->columnLen[ hh_names ]
+	   && names[ header->columnLen[ hh_names ] - 1 ] ) ) {
+
+    fprintf( stderr, "ERROR: %s is not a valid hand history\n", fileName );
+    closeHandHistory( hh );
+    return -1;
+  }
+  hh->names = malloc( sizeof( hh->names[ 0 ] )
+		      * ( header->numNames ? header->numNames : 1 ) );
+  if( hh->names == NULL ) {
+
+    fprintf( stderr, "ERROR: could not allocate hand history names\n" );
+    closeHandHistory( hh );
+    return -1;
+  }
+  n = 0;
+  for( i = 0; i < header->numNames; ++i ) {
+
+    if( n >= header->columnLen[ hh_names ] ) {
+
+      fprintf( stderr, "ERROR: %s is not a valid hand history\n", fileName );
+      closeHandHistory( hh );
+      return -1;
+    }
+    hh->names[ i ] = &names[ n ];
+    n += strlen( &names[ n ] ) + 1;
+  }
+
+  return 0;
+}
+
+void closeHandHistory( HandHistory *hh )
+{
+  if( hh->map ) {
+
+    munmap( hh->map, hh->mapLen );
+  }
+  free( hh->names );
+  memset( hh, 0, sizeof( *hh ) );
+}
+
+int32_t handHistoryNameId( const HandHistory *hh, const char *name )
+{
+  int32_t i;
+
+  for( i = 0; i < hh->header->numNames; ++i ) {
+
+    if( !strcmp( hh->names[ i ], name ) ) {
+
+      return i;
+    }
+  }
+  return -1;
+}
+
+void initHandFilter( const HandHistory *hh, HandFilter *filter )
+{
+  filter->firstHand = 0;
+  filter->endHand = hh->numHands;
+  filter->nameId = -1;
+  filter->actionPrefixLen = 0;
+}
+
+int encodeBetting( const HandHistory *hh, const char *betting,
+		   uint8_t *bytes, const int maxLen )
+{
+  int c, len, r;
+  uint32_t size;
+
+  len = 0;
+  for( c = 0; betting[ c ]; ++c ) {
+
+    if( len + 6 > maxLen ) {
+
+      return -1;
+    }
+    if( betting[ c ] == '/' ) {
+
+      bytes[ len ] = HH_ROUND_END;
+      ++len;
+      continue;
+    }
+    for( r = 0; r < a_invalid; ++r ) {
+
+      if( betting[ c ] == actionChars[ r ] ) {
+
+	break;
+      }
+    }
+    if( r == a_invalid ) {
+
+      return -1;
+    }
+    bytes[ len ] = r;
+    ++len;
+
+    /* no-limit raises are followed by their size, which may be left
+       off the last action to match a raise of any size */
+    if( r == a_raise && betting[ c + 1 ] >= '0' && betting[ c + 1 ] <= '9' ) {
+
+      if( hh->header->bettingType != noLimitBetting
+	  || sscanf( &betting[ c + 1 ], "%"SCNu32"%n", &size, &r ) < 1 ) {
+
+	return -1;
+      }
+      len += writeVarint( size, &bytes[ len ] );
+      c += r;
+    }
+  }
+
+  return len;
+}
+
+int printBetting( const HandHistory *hh, const uint8_t *actions,
+		  const uint32_t len, const int ignoreSizes, const int maxLen,
+		  char *string )
+{
+  int c, r, a;
+  uint32_t i, size;
+
+  c = 0;
+  for( i = 0; i < len; ) {
+
+    if( c + 1 >= maxLen ) {
+
+      return -1;
+    }
+    if( actions[ i ] == HH_ROUND_END ) {
+
+      string[ c ] = '/';
+      ++c;
+      ++i;
+      continue;
+    }
+    if( actions[ i ] >= a_invalid ) {
+
+      return -1;
+    }
+    string[ c ] = actionChars[ actions[ i ] ];
+    ++c;
+
+    r = actionLen( hh, &actions[ i ], len - i );
+    if( r == 0 ) {
+
+      return -1;
+    }
+    if( r > 1 && !ignoreSizes ) {
+
+      readVarint( &actions[ i + 1 ], r - 1, &size );
+      a = snprintf( &string[ c ], maxLen - c, "%"PRIu32, size );
+      if( a < 0 || a >= maxLen - c ) {
+
+	return -1;
+      }
+      c += a;
+    }
+    i += r;
+  }
+  string[ c ] = 0;
+
+  return c;
+}
+
+void valueByPosition( const HandHistory *hh, const HandFilter *filter,
+		      ValueTotal total[ MAX_PLAYERS ] )
+{
+  uint64_t h, end;
+  uint32_t p;
+  const uint32_t numPlayers = hh->numPlayers;
+  const float *values;
+  double v;
+
+  memset( total, 0, sizeof( total[ 0 ] ) * MAX_PLAYERS );
+  end = filter->endHand < hh->numHands ? filter->endHand : hh->numHands;
+
+  if( filter->nameId < 0 && filter->actionPrefixLen == 0 ) {
+    /* every hand counts, so this is just a pass over the values */
+
+    for( h = filter->firstHand; h < end; ++h ) {
+
+      values = &hh->values[ h * numPlayers ];
+      for( p = 0; p < numPlayers; ++p ) {
+
+	v = values[ p ];
+	total[ p ].total += v;
+	total[ p ].totalSquared += v * v;
+      }
+    }
+    for( p = 0; p < numPlayers; ++p ) {
+
+      total[ p ].hands = end > filter->firstHand ? end - filter->firstHand : 0;
+    }
+    return;
+  }
+
+  for( h = filter->firstHand; h < end; ++h ) {
+
+    if( !handMatches( hh, filter, h ) ) {
+
+      continue;
+    }
+    for( p = 0; p < numPlayers; ++p ) {
+
+      if( filter->nameId >= 0
+	  && hh->nameIds[ h * numPlayers + p ] != filter->nameId ) {
+
+	continue;
+      }
+      v = hh->values[ h * numPlayers + p ];
+      ++total[ p ].hands;
+      total[ p ].total += v;
+      total[ p ].totalSquared += v * v;
+    }
+  }
+}
+
+/* FNV-1a */
+static uint64_t hashActions( const uint8_t *actions, const uint32_t len )
+{
+  uint64_t hash;
+  uint32_t i;
+
+  hash = 14695981039346656037ULL;
+  for( i = 0; i < len; ++i ) {
+
+    hash ^= actions[ i ];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/* point *key at what len bytes of actions are grouped on, which is the
+   actions themselves, or with ignoreSizes, just their types copied
+   into buf
+   returns the length of the key */
+static uint32_t actionKey( const HandHistory *hh, const uint8_t *actions,
+			   const uint32_t len, const int ignoreSizes,
+			   uint8_t *buf, const uint8_t **key )
+{
+  uint32_t i, keyLen;
+  int r;
+
+  if( !ignoreSizes || hh->header->bettingType != noLimitBetting ) {
+
+    *key = actions;
+    return len;
+  }
+
+  keyLen = 0;
+  for( i = 0; i < len; i += r ) {
+
+    buf[ keyLen ] = actions[ i ];
+    ++keyLen;
+    r = actions[ i ] == HH_ROUND_END
+      ? 1 : actionLen( hh, &actions[ i ], len - i );
+    if( r == 0 ) {
+
+      break;
+    }
+  }
+  *key = buf;
+  return keyLen;
+}
+
+int64_t valueByActions( const HandHistory *hh, const HandFilter *filter,
+			const int numActions, const int ignoreSizes,
+			ActionGroup **groups )
+{
+  uint64_t h, end, hash, mask, tableSize, numGroups, maxGroups, i;
+  uint32_t p, len, handLen, c, keyLen, exampleKeyLen;
+  int a, r;
+  const uint8_t *actions, *key, *exampleKey;
+  uint8_t keyBuf[ HH_MAX_ACTION_BYTES ], exampleKeyBuf[ HH_MAX_ACTION_BYTES ];
+  int64_t *table, *newTable;
+  ActionGroup *g, *newGroups;
+  double v;
+
+  tableSize = 1024;
+  table = malloc( sizeof( table[ 0 ] ) * tableSize );
+  maxGroups = 256;
+  *groups = malloc( sizeof( ( *groups )[ 0 ] ) * maxGroups );
+  if( table == NULL || *groups == NULL ) {
+
+    fprintf( stderr, "ERROR: could not allocate action groups\n" );
+    free( table );
+    free( *groups );
+    *groups = NULL;
+    return -1;
+  }
+  memset( table, -1, sizeof( table[ 0 ] ) * tableSize );
+  mask = tableSize - 1;
+  numGroups = 0;
+
+  end = filter->endHand < hh->numHands ? filter->endHand : hh->numHands;
+  for( h = filter->firstHand; h < end; ++h ) {
+
+    if( !handMatches( hh, filter, h ) ) {
+
+      continue;
+    }
+
+    /* the key is the bytes of the first numActions actions, along with
+       the ends of the rounds between them */
+    actions = &hh->actions[ hh->actionOffset[ h ] ];
+    handLen = hh->actionOffset[ h + 1 ] - hh->actionOffset[ h ];
+    len = 0;
+    for( a = 0; a < numActions && len < handLen; ) {
+
+      if( actions[ len ] == HH_ROUND_END ) {
+
+	++len;
+	continue;
+      }
+      r = actionLen( hh, &actions[ len ], handLen - len );
+      if( r == 0 ) {
+
+	break;
+      }
+      len += r;
+      ++a;
+    }
+
+    keyLen = actionKey( hh, actions, len, ignoreSizes, keyBuf, &key );
+    hash = hashActions( key, keyLen );
+    for( i = hash & mask; table[ i ] >= 0; i = ( i + 1 ) & mask ) {
+
+      g = &( *groups )[ table[ i ] ];
+      exampleKeyLen
+	= actionKey( hh, &hh->actions[ hh->actionOffset[ g->exampleHand ] ],
+		     g->actionLen, ignoreSizes, exampleKeyBuf, &exampleKey );
+      if( exampleKeyLen == keyLen && !memcmp( exampleKey, key, keyLen ) ) {
+
+	break;
+      }
+    }
+
+    if( table[ i ] < 0 ) {
+      /* a new action sequence */
+
+      if( numGroups == maxGroups ) {
+
+	maxGroups *= 2;
+	newGroups = realloc( *groups, sizeof( newGroups[ 0 ] ) * maxGroups );
+	if( newGroups == NULL ) {
+
+	  fprintf( stderr, "ERROR: could not allocate action groups\n" );
+	  free( table );
+	  free( *groups );
+	  *groups = NULL;
+	  return -1;
+	}
+	*groups = newGroups;
+      }
+      g = &( *groups )[ numGroups ];
+      memset( g, 0, sizeof( *g ) );
+      g->exampleHand = h;
+      g->actionLen = len;
+      table[ i ] = numGroups;
+      ++numGroups;
+
+      /* keep the table at most half full */
+      if( numGroups * 2 > tableSize ) {
+
+	newTable = malloc( sizeof( newTable[ 0 ] ) * tableSize * 2 );
+	if( newTable == NULL ) {
+
+	  fprintf( stderr, "ERROR: could not allocate action groups\n" );
+	  free( table );
+	  free( *groups );
+	  *groups = NULL;
+	  return -1;
+	}
+	memset( newTable, -1, sizeof( newTable[ 0 ] ) * tableSize * 2 );
+	tableSize *= 2;
+	mask = tableSize - 1;
+	for( c = 0; c < numGroups; ++c ) {
+
+	  g = &( *groups )[ c ];
+	  exampleKeyLen
+	    = actionKey( hh, &hh->actions[ hh->actionOffset[ g->exampleHand ] ],
+			 g->actionLen, ignoreSizes, exampleKeyBuf, &exampleKey );
+	  hash = hashActions( exampleKey, exampleKeyLen );
+	  for( i = hash & mask; newTable[ i ] >= 0; i = ( i + 1 ) & mask ) {
+	  }
+	  newTable[ i ] = c;
+	}
+	g = &( *groups )[ numGroups - 1 ];
+	free( table );
+	table = newTable;
+      }
+    }
+
+    for( p = 0; p < hh->numPlayers; ++p ) {
+
+      if( filter->nameId >= 0
+	  && hh->nameIds[ h * hh->numPlayers + p ] != filter->nameId ) {
+
+	continue;
+      }
+      v = hh->values[ h * hh->numPlayers + p ];
+      ++g->value[ p ].hands;
+      g->value[ p ].total += v;
+      g->value[ p ].totalSquared += v * v;
+    }
+  }
+
+  free( table );
+  return numGroups;
+}
@@ -0,0 +1,207 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#ifndef _HAND_HISTORY_H
+#define _HAND_HISTORY_H
+
+#include <stdio.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <string.h>
+#include "game.h"
+
+
+/* columnar hand histories, for queries over many hands
+
+   a hand history file has a HandHistoryHeader, followed by one array
+   per column, each starting on a HH_COLUMN_ALIGN byte boundary, so the
+   file can be memory mapped and each column scanned on its own.  For
+   hand h (counting from 0 in the file, which is not its handId) and
+   position p (the player numbering of the game, not the seat the
+   player connected to):
+     hh_hand_id: uint32 handId[ h ]
+     hh_name_ids: uint16 nameIds[ h * numPlayers + p ], the name of the
+       player in position p, as an index into the names column, so
+       these also give the permutation of players around the table
+     hh_values: float values[ h * numPlayers + p ], the value to
+       position p, exact for whole chip values under 2^24
+     hh_cards: uint8 cards[ h * cardsPerHand + i ], every player's hole
+       cards in position order, then the board cards, with HH_NO_CARD
+       for board cards not dealt before the hand ended
+     hh_action_offsets: uint64 actionOffset[ h ], with one extra entry
+       at the end, giving where each hand's actions start
+     hh_actions: a byte per action, HH_ROUND_END between rounds, and
+       the size of a no-limit raise following its action as a varint
+       (7 bits a byte, lowest first)
+     hh_names: the players' names, each with a terminating 0
+   numbers are in the byte order of the machine which wrote the file,
+   which is checked when it is opened.
+
+   hands can be filtered by range, by a player taking part, and by the
+   start of their action sequence, and the values of the matching hands
+   totalled by position or grouped by action sequence.  Each query is
+   a pass over a few columns, so several processes can each take a
+   range of hands of one mapped file. */
+
+#define HH_MAGIC "ACPCHH01"
+#define HH_BYTE_ORDER_MARK 0x01020304
+#define HH_COLUMN_ALIGN 64
+#define HH_NO_CARD 255
+#define HH_ROUND_END 3 /* after the action types */
+#define HH_MAX_ACTION_BYTES ( MAX_ROUNDS * ( MAX_NUM_ACTIONS * 6 + 1 ) )
+#define HH_MAX_NAMES 65536
+
+enum HandHistoryColumn { hh_hand_id, hh_name_ids, hh_values, hh_cards,
+			 hh_action_offsets, hh_actions, hh_names,
+			 HH_NUM_COLUMNS };
+
+typedef struct {
+  char magic[ 8 ];
+  uint32_t byteOrder;
+  uint32_t numPlayers;
+  uint32_t numRounds;
+  uint32_t numHoleCards;
+  uint32_t numBoardCards; /* in all rounds together */
+  uint32_t bettingType;
+  uint32_t numNames;
+  uint32_t cardsPerHand;
+  uint64_t numHands;
+  uint64_t columnOffset[ HH_NUM_COLUMNS ];
+  uint64_t columnLen[ HH_NUM_COLUMNS ]; /* in bytes */
+} HandHistoryHeader;
+
+/* a mapped hand history file */
+typedef struct {
+  void *map;
+  size_t mapLen;
+  const HandHistoryHeader *header;
+  uint64_t numHands;
+  uint32_t numPlayers;
+  const uint32_t *handId;
+  const uint16_t *nameIds;
+  const float *values;
+  const uint8_t *cards;
+  const uint64_t *actionOffset;
+  const uint8_t *actions;
+  const char **names; /* numNames pointers into the names column */
+} HandHistory;
+
+/* builds a hand history file, a column at a time in temporary files */
+typedef struct {
+  HandHistoryHeader header;
+  FILE *file;
+  FILE *column[ HH_NUM_COLUMNS ];
+  uint64_t numActionBytes;
+  uint32_t maxNames;
+  char **names;
+  uint32_t lastName[ MAX_PLAYERS ]; /* guesses for the next hand */
+} HandHistoryWriter;
+
+/* which hands a query looks at */
+typedef struct {
+  uint64_t firstHand; /* range of hands in the file */
+  uint64_t endHand;
+  int32_t nameId; /* only hands this player is in, or -1 for any */
+  uint8_t actionPrefix[ HH_MAX_ACTION_BYTES ]; /* only hands whose */
+  uint32_t actionPrefixLen; /* actions start with this */
+} HandFilter;
+
+typedef struct {
+  uint64_t hands;
+  double total;
+  double totalSquared;
+} ValueTotal;
+
+typedef struct {
+  uint64_t exampleHand; /* the first hand with this action sequence */
+  uint32_t actionLen; /* bytes of the sequence */
+  ValueTotal value[ MAX_PLAYERS ]; /* by position */
+} ActionGroup;
+
+
+/* start writing a hand history file for game
+   returns NULL on failure */
+HandHistoryWriter *openHandHistoryWriter( const char *fileName,
+					  const Game *game );
+
+/* add a line from a dealer log
+   returns 1 if the line was a hand, 0 if it was something else, or -1
+   on failure */
+int addHandHistoryLine( HandHistoryWriter *writer, const Game *game,
+			const char *line );
+
+/* put the columns together into the file, and free the writer
+   returns 0 on success, -1 on failure */
+int closeHandHistoryWriter( HandHistoryWriter *writer );
+
+/* map a hand history file
+   returns 0 on success, -1 on failure */
+int openHandHistory( const char *fileName, HandHistory *hh );
+
+void closeHandHistory( HandHistory *hh );
+
+/* returns the id of name, or -1 if no hand has that player */
+int32_t handHistoryNameId( const HandHistory *hh, const char *name );
+
+/* set filter to take every hand */
+void initHandFilter( const HandHistory *hh, HandFilter *filter );
+
+/* encode a betting string, like the one in a STATE line, into the
+   actions column's bytes
+   returns the number of bytes, or -1 if betting is not valid */
+int encodeBetting( const HandHistory *hh, const char *betting,
+		   uint8_t *bytes, const int maxLen );
+
+/* print len bytes of actions as a betting string, leaving out the raise
+   sizes if ignoreSizes is set
+   returns the number of characters printed, or -1 if it did not fit */
+int printBetting( const HandHistory *hh, const uint8_t *actions,
+		  const uint32_t len, const int ignoreSizes, const int maxLen,
+		  char *string );
+
+static inline int handMatches( const HandHistory *hh,
+			       const HandFilter *filter, const uint64_t h )
+{
+  uint32_t p;
+
+  if( filter->actionPrefixLen
+      && ( hh->actionOffset[ h + 1 ] - hh->actionOffset[ h ]
+	   < filter->actionPrefixLen
+	   || memcmp( &hh->actions[ hh->actionOffset[ h ] ],
+		      filter->actionPrefix, filter->actionPrefixLen ) ) ) {
+
+    return 0;
+  }
+  if( filter->nameId < 0 ) {
+
+    return 1;
+  }
+  for( p = 0; p < hh->numPlayers; ++p ) {
+
+    if( hh->nameIds[ h * hh->numPlayers + p ] == filter->nameId ) {
+
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* total the value of each position over the hands matching filter,
+   only counting the positions filter->nameId played if it is set */
+void valueByPosition( const HandHistory *hh, const HandFilter *filter,
+		      ValueTotal total[ MAX_PLAYERS ] );
+
+/* group the hands matching filter by their first numActions actions,
+   or all of them for hands with fewer, and total each position's
+   value in each group, where positions are only counted for
+   filter->nameId if it is set
+   with ignoreSizes, no-limit raises of different sizes are grouped
+   together, so a group's exampleHand only gives its action types
+   *groups is allocated, and must be freed by the caller
+   returns the number of groups, or -1 on failure */
+int64_t valueByActions( const HandHistory *hh, const HandFilter *filter,
+			const int numActions, const int ignoreSizes,
+			ActionGroup **groups );
+
+#endif
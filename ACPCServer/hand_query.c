@@ -0,0 +1,308 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+/* convert dealer logs to the columnar hand histories of hand_history.h,
+   and total the values of the hands in them */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+#include "game.h"
+#include "match_log.h"
+#include "hand_history.h"
+
+
+static void printUsage( FILE *file )
+{
+  fprintf( file, "usage: hand_query convert game handHistory log ...\n" );
+  fprintf( file, "       hand_query info handHistory\n" );
+  fprintf( file, "       hand_query position [options] handHistory\n" );
+  fprintf( file, "       hand_query actions [options] handHistory numActions\n" );
+  fprintf( file, "  convert writes the hands of the logs, which may be plain or\n" );
+  fprintf( file, "    compressed, to handHistory\n" );
+  fprintf( file, "  info prints the size of handHistory and the players in it\n" );
+  fprintf( file, "  position prints the hands and average value of each position\n" );
+  fprintf( file, "  actions prints the same for each sequence of the first\n" );
+  fprintf( file, "    numActions actions of the hands\n" );
+  fprintf( file, "options:\n" );
+  fprintf( file, "  --player=name only count hands name played, from name's seats\n" );
+  fprintf( file, "  --betting=prefix only count hands whose betting starts with\n" );
+  fprintf( file, "    prefix, like r/c or r300c\n" );
+  fprintf( file, "  --hands=first:end only count hands first up to end in the file\n" );
+  fprintf( file, "  --no_sizes group actions by type, so no-limit raises of any\n" );
+  fprintf( file, "    size count as the same action\n" );
+}
+
+static int convert( int argc, char **argv )
+{
+  int i, r;
+  uint64_t numHands;
+  FILE *file;
+  Game *game;
+  LogReader *log;
+  HandHistoryWriter *writer;
+  char line[ MAX_LINE_LEN ];
+
+  if( argc < 4 ) {
+
+    printUsage( stderr );
+    return EXIT_FAILURE;
+  }
+
+  file = fopen( argv[ 1 ], "r" );
+  if( file == NULL ) {
+
+    fprintf( stderr, "ERROR: could not open game %s\n", argv[ 1 ] );
+    return EXIT_FAILURE;
+  }
+  game = readGame( file );
+  if( game == NULL ) {
+
+    fprintf( stderr, "ERROR: could not read game %s\n", argv[ 1 ] );
+    return EXIT_FAILURE;
+  }
+  fclose( file );
+
+  writer = openHandHistoryWriter( argv[ 2 ], game );
+  if( writer == NULL ) {
+
+    return EXIT_FAILURE;
+  }
+  numHands = 0;
+  for( i = 3; i < argc; ++i ) {
+
+    log = openLogReader( argv[ i ] );
+    if( log == NULL ) {
+
+      fprintf( stderr, "ERROR: could not open log %s\n", argv[ i ] );
+      return EXIT_FAILURE;
+    }
+    while( readLogLine( log, line, MAX_LINE_LEN ) ) {
+
+      r = addHandHistoryLine( writer, game, line );
+      if( r < 0 ) {
+
+	fprintf( stderr, "ERROR: could not convert %s\n", argv[ i ] );
+	return EXIT_FAILURE;
+      }
+      numHands += r;
+    }
+    closeLogReader( log );
+  }
+  if( closeHandHistoryWriter( writer ) < 0 ) {
+
+    return EXIT_FAILURE;
+  }
+  fprintf( stderr, "%"PRIu64" hands\n", numHands );
+
+  free( game );
+  return EXIT_SUCCESS;
+}
+
+static void printValue( const ValueTotal *total )
+{
+  double mean, sd;
+
+  mean = total->hands ? total->total / total->hands : 0.0;
+  sd = total->hands > 1
+    ? sqrt( ( total->totalSquared - total->total * mean )
+	    / ( total->hands - 1 ) ) : 0.0;
+  printf( " %"PRIu64" %f %f", total->hands, mean,
+	  total->hands ? sd / sqrt( total->hands ) : 0.0 );
+}
+
+int main( int argc, char **argv )
+{
+  int i, p, longOpt, numActions, ignoreSizes;
+  int64_t numGroups, g;
+  HandHistory hh;
+  HandFilter filter;
+  ValueTotal total[ MAX_PLAYERS ];
+  ActionGroup *groups;
+  const char *command, *player, *betting;
+  uint64_t firstHand, endHand;
+  char string[ MAX_LINE_LEN ];
+  struct option longOptions[] = {
+    { "player", 1, 0, 0 },
+    { "betting", 1, 0, 0 },
+    { "hands", 1, 0, 0 },
+    { "no_sizes", 0, 0, 0 },
+    { 0, 0, 0, 0 }
+  };
+
+  if( argc < 2 ) {
+
+    printUsage( stderr );
+    exit( EXIT_FAILURE );
+  }
+  if( !strcmp( argv[ 1 ], "convert" ) ) {
+
+    exit( convert( argc - 1, argv + 1 ) );
+  }
+  if( strcmp( argv[ 1 ], "info" ) && strcmp( argv[ 1 ], "position" )
+      && strcmp( argv[ 1 ], "actions" ) ) {
+
+    printUsage( stderr );
+    exit( EXIT_FAILURE );
+  }
+
+  /* options follow the command */
+  command = argv[ 1 ];
+  --argc;
+  ++argv;
+  player = NULL;
+  betting = NULL;
+  firstHand = 0;
+  endHand = UINT64_MAX;
+  ignoreSizes = 0;
+  while( 1 ) {
+
+    i = getopt_long( argc, argv, "", longOptions, &longOpt );
+    if( i < 0 ) {
+
+      break;
+    }
+    if( i != 0 ) {
+
+      printUsage( stderr );
+      exit( EXIT_FAILURE );
+    }
+
+    switch( longOpt ) {
+    case 0:
+      /* player */
+
+      player = optarg;
+      break;
+
+    case 1:
+      /* betting */
+
+      betting = optarg;
+      break;
+
+    case 2:
+      /* hands */
+
+      if( sscanf( optarg, "%"SCNu64":%"SCNu64, &firstHand, &endHand ) < 2 ) {
+
+	fprintf( stderr, "ERROR: could not read hand range %s\n", optarg );
+	exit( EXIT_FAILURE );
+      }
+      break;
+
+    case 3:
+      /* no_sizes */
+
+      ignoreSizes = 1;
+      break;
+
+    default:
+
+      printUsage( stderr );
+      exit( EXIT_FAILURE );
+    }
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
+  numActions = 0;
+  if( argc < ( strcmp( command, "actions" ) ? 2 : 3 )
+      || ( argc > 2 && sscanf( argv[ 2 ], "%d", &numActions ) < 1 ) ) {
+
+    printUsage( stderr );
+    exit( EXIT_FAILURE );
+  }
+
+  if( openHandHistory( argv[ 1 ], &hh ) < 0 ) {
+
+    exit( EXIT_FAILURE );
+  }
+
+  if( !strcmp( command, "info" ) ) {
+
+    printf( "%"PRIu64" hands, %"PRIu32" players, %s betting, %"PRIu64
+	    " action bytes\n", hh.numHands, hh.numPlayers,
+	    hh.header->bettingType == noLimitBetting ? "no-limit" : "limit",
+	    hh.header->columnLen[ hh_actions ] );
+    for( i = 0; i < hh.header->numNames; ++i ) {
+
+      printf( "%d %s\n", i, hh.names[ i ] );
+    }
+    closeHandHistory( &hh );
+    exit( EXIT_SUCCESS );
+  }
+
+  initHandFilter( &hh, &filter );
+  filter.firstHand = firstHand;
+  if( endHand < filter.endHand ) {
+
+    filter.endHand = endHand;
+  }
+  if( player ) {
+
+    filter.nameId = handHistoryNameId( &hh, player );
+    if( filter.nameId < 0 ) {
+
+      fprintf( stderr, "ERROR: no player %s in %s\n", player, argv[ 1 ] );
+      exit( EXIT_FAILURE );
+    }
+  }
+  if( betting ) {
+
+    i = encodeBetting( &hh, betting, filter.actionPrefix,
+		       HH_MAX_ACTION_BYTES );
+    if( i < 0 ) {
+
+      fprintf( stderr, "ERROR: could not read betting %s\n", betting );
+      exit( EXIT_FAILURE );
+    }
+    filter.actionPrefixLen = i;
+  }
+
+  /* each line has the hands, mean value, and standard error of the
+     mean for each position */
+  if( !strcmp( command, "position" ) ) {
+
+    valueByPosition( &hh, &filter, total );
+    for( p = 0; p < hh.numPlayers; ++p ) {
+
+      printf( "%d", p );
+      printValue( &total[ p ] );
+      printf( "\n" );
+    }
+    closeHandHistory( &hh );
+    exit( EXIT_SUCCESS );
+  }
+
+  numGroups = valueByActions( &hh, &filter, numActions, ignoreSizes,
+			      &groups );
+  if( numGroups < 0 ) {
+
+    exit( EXIT_FAILURE );
+  }
+  for( g = 0; g < numGroups; ++g ) {
+
+    if( printBetting( &hh,
+		      &hh.actions[ hh.actionOffset[ groups[ g ].exampleHand ] ],
+		      groups[ g ].actionLen, ignoreSizes, MAX_LINE_LEN,
+		      string ) < 0 ) {
+
+      fprintf( stderr, "ERROR: bad actions in hand %"PRIu64"\n",
+	       groups[ g ].exampleHand );
+      exit( EXIT_FAILURE );
+    }
+    printf( "%s", string[ 0 ] ? string : "-" );
+    for( p = 0; p < hh.numPlayers; ++p ) {
+
+      printValue( &groups[ g ].value[ p ] );
+    }
+    printf( "\n" );
+  }
+  free( groups );
+  closeHandHistory( &hh );
+
+  return EXIT_SUCCESS;
+}
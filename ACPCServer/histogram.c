@@ -0,0 +1,138 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#define __STDC_LIMIT_MACROS
+#include <stdint.h>
+#include "histogram.h"
+
+
+void initHistogram( Histogram *hist )
+{
+  memset( hist, 0, sizeof( *hist ) );
+  hist->min = UINT64_MAX;
+}
+
+void histogramMerge( Histogram *dest, const Histogram *src )
+{
+  int i;
+
+  if( src->count == 0 ) {
+
+    return;
+  }
+
+  for( i = 0; i < HISTOGRAM_NUM_BUCKETS; ++i ) {
+
+    dest->buckets[ i ] += src->buckets[ i ];
+  }
+  dest->count += src->count;
+  dest->sum += src->sum;
+  if( src->min < dest->min ) {
+
+    dest->min = src->min;
+  }
+  if( src->max > dest->max ) {
+
+    dest->max = src->max;
+  }
+}
+
+uint64_t histogramBucketLow( const int bucket )
+{
+  int m;
+
+  if( bucket < 2 * HISTOGRAM_SUB_BUCKETS ) {
+
+    return bucket;
+  }
+
+  m = ( bucket >> HISTOGRAM_PRECISION_BITS ) - 1;
+  return (uint64_t)( bucket - ( m << HISTOGRAM_PRECISION_BITS ) ) << m;
+}
+
+uint64_t histogramBucketHigh( const int bucket )
+{
+  int m;
+
+  if( bucket < 2 * HISTOGRAM_SUB_BUCKETS ) {
+
+    return bucket;
+  }
+
+  m = ( bucket >> HISTOGRAM_PRECISION_BITS ) - 1;
+  return histogramBucketLow( bucket ) + ( (uint64_t)1 << m ) - 1;
+}
+
+uint64_t histogramValueAtPercentile( const Histogram *hist,
+				     const double percentile )
+{
+  int i;
+  uint64_t target, seen;
+
+  if( hist->count == 0 ) {
+
+    return 0;
+  }
+
+  /* number of values which must be at or below the returned value */
+  target = (uint64_t)( percentile / 100.0 * hist->count + 0.5 );
+  if( target < 1 ) {
+
+    target = 1;
+  } else if( target > hist->count ) {
+
+    target = hist->count;
+  }
+
+  seen = 0;
+  for( i = 0; i < HISTOGRAM_NUM_BUCKETS; ++i ) {
+
+    seen += hist->buckets[ i ];
+    if( seen >= target ) {
+
+      /* never report more than the largest value actually seen */
+      return histogramBucketHigh( i ) < hist->max
+	? histogramBucketHigh( i ) : hist->max;
+    }
+  }
+
+  return hist->max;
+}
+
+void printHistogramJSON( FILE *file, const Histogram *hist )
+{
+  int i, first;
+
+  fprintf( file,
+	   "{\"count\":%"PRIu64",\"min\":%"PRIu64",\"max\":%"PRIu64
+	   ",\"mean\":%.1f",
+	   hist->count,
+	   hist->count ? hist->min : 0,
+	   hist->max,
+	   hist->count ? (double)hist->sum / hist->count : 0.0 );
+  fprintf( file,
+	   ",\"p50\":%"PRIu64",\"p90\":%"PRIu64",\"p99\":%"PRIu64
+	   ",\"p999\":%"PRIu64,
+	   histogramValueAtPercentile( hist, 50.0 ),
+	   histogramValueAtPercentile( hist, 90.0 ),
+	   histogramValueAtPercentile( hist, 99.0 ),
+	   histogramValueAtPercentile( hist, 99.9 ) );
+
+  fprintf( file, ",\"buckets\":[" );
+  first = 1;
+  for( i = 0; i < HISTOGRAM_NUM_BUCKETS; ++i ) {
+
+    if( hist->buckets[ i ] == 0 ) {
+      continue;
+    }
+
+    fprintf( file, first ? "[%"PRIu64",%"PRIu64"]" : ",[%"PRIu64",%"PRIu64"]",
+	     histogramBucketHigh( i ), hist->buckets[ i ] );
+    first = 0;
+  }
+  fprintf( file, "]}" );
+}
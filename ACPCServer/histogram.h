@@ -0,0 +1,96 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#ifndef _HISTOGRAM_H
+#define _HISTOGRAM_H
+
+#include <stdio.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+
+
+/* log-linear (HDR style) histogram of non-negative integer values
+
+   values below 2*HISTOGRAM_SUB_BUCKETS are counted exactly, larger
+   values are counted in buckets whose width doubles every
+   HISTOGRAM_SUB_BUCKETS buckets, so the relative error of any
+   reported value is at most 1/HISTOGRAM_SUB_BUCKETS
+
+   values larger than HISTOGRAM_MAX_VALUE are counted as
+   HISTOGRAM_MAX_VALUE, which is about 12 days in microseconds */
+#define HISTOGRAM_PRECISION_BITS 5
+#define HISTOGRAM_SUB_BUCKETS ( 1 << HISTOGRAM_PRECISION_BITS )
+#define HISTOGRAM_MAX_BITS 40
+#define HISTOGRAM_MAX_VALUE ( ( (uint64_t)1 << HISTOGRAM_MAX_BITS ) - 1 )
+#define HISTOGRAM_NUM_BUCKETS \
+  ( ( HISTOGRAM_MAX_BITS - HISTOGRAM_PRECISION_BITS + 1 ) \
+    * HISTOGRAM_SUB_BUCKETS )
+
+typedef struct {
+  uint64_t count;
+  uint64_t sum;
+  uint64_t min;
+  uint64_t max;
+  uint64_t buckets[ HISTOGRAM_NUM_BUCKETS ];
+} Histogram;
+
+
+/* index of the bucket which counts value */
+static inline int histogramBucket( uint64_t value )
+{
+  int m;
+
+  if( value < 2 * HISTOGRAM_SUB_BUCKETS ) {
+
+    return (int)value;
+  }
+  if( value > HISTOGRAM_MAX_VALUE ) {
+
+    value = HISTOGRAM_MAX_VALUE;
+  }
+
+  m = 63 - __builtin_clzll( value ) - HISTOGRAM_PRECISION_BITS;
+  return ( m << HISTOGRAM_PRECISION_BITS ) + (int)( value >> m );
+}
+
+/* add a single value to the histogram
+   this is on the dealer's per-action path, so it is kept branch-light
+   and allocation free */
+static inline void histogramRecord( Histogram *hist, uint64_t value )
+{
+  ++hist->buckets[ histogramBucket( value ) ];
+  ++hist->count;
+  hist->sum += value;
+  if( value < hist->min ) {
+
+    hist->min = value;
+  }
+  if( value > hist->max ) {
+
+    hist->max = value;
+  }
+}
+
+/* set a histogram to be empty */
+void initHistogram( Histogram *hist );
+
+/* add all the counts in src into dest */
+void histogramMerge( Histogram *dest, const Histogram *src );
+
+/* smallest and largest values counted by bucket */
+uint64_t histogramBucketLow( const int bucket );
+uint64_t histogramBucketHigh( const int bucket );
+
+/* value at or below which percentile percent of the values lie,
+   reported as the largest value equivalent to the bucket it is in
+   returns 0 for an empty histogram */
+uint64_t histogramValueAtPercentile( const Histogram *hist,
+				     const double percentile );
+
+/* print the histogram as a JSON object with summary statistics,
+   common percentiles, and the non-empty buckets as
+   [ highest equivalent value, count ] pairs */
+void printHistogramJSON( FILE *file, const Histogram *hist );
+
+#endif
@@ -0,0 +1,906 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+/* run a batch of local matches, several at a time
+
+   each line of the manifest holds the arguments play_match.pl would
+   take for one match:
+
+     matchName gameDefFile #Hands rngSeed player1name player1exe ...
+       [dealer options]
+
+   and blank lines or lines starting with '#' are skipped.  Matches
+   start in manifest order while they fit in the core budget, counting
+   a core for every player the dealer waits on (one per seat, or one
+   per seat per copy with --duplicate), though a match which needs
+   more than the whole budget still runs on its own.  As with
+   play_match.pl, the dealer logs to matchName.log and matchName.err,
+   and each player's output goes to matchName.playerP.std and .err.
+
+   a match whose dealer fails or never prints a SCORE line is run
+   again with the same arguments, and so the same seed, up to
+   --retries times.  Once every match is done, a summary with each
+   match's SCORE line and each player's total and mean over the
+   matches is printed.
+
+   with --cache dir, finished matches are kept in a result cache (see
+   result_cache.h), and a match already in the cache has its logs and
+   SCORE line copied out of it instead of being played.  --cache_max_mb
+   limits the cache's size, and running with --cache but no manifest
+   just prints the cache's size */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <getopt.h>
+#include <sys/wait.h>
+#include <sys/signalfd.h>
+#include <fcntl.h>
+#include "game.h"
+#include "net.h"
+#include "result_cache.h"
+
+
+#define DEFAULT_RETRIES 2
+#define DEFAULT_DEALER "./dealer"
+#define MAX_DEALER_ARGS 64
+#define MAX_BOTS ( MAX_PLAYERS * MAX_PLAYERS )
+#define BOT_HOST "localhost"
+
+
+typedef struct {
+  char *line; /* manifest line, split up in place */
+  int numArgs;
+  char *dealerArgs[ MAX_DEALER_ARGS + 2 ];
+  char *name;
+  int numPlayers;
+  char *playerName[ MAX_PLAYERS ];
+  char *playerExe[ MAX_PLAYERS ];
+  int cores;
+  int attempts;
+  int ok;
+  int cacheChecked; /* looked up once, while waiting to start */
+  int cached;
+  char cacheKey[ CACHE_KEY_LEN + 1 ]; /* empty if the match can't be cached */
+  char score[ READBUF_LEN ];
+} FarmMatch;
+
+typedef struct {
+  FarmMatch *match;
+  pid_t dealerPID;
+  int dealerStatus;
+  ReadBuf *fromDealer; /* NULL once the dealer's output is closed */
+  int gotPorts;
+  int numBots;
+  pid_t botPID[ MAX_BOTS ]; /* 0 once the bot has exited */
+  int botsRunning;
+} FarmJob;
+
+
+static void printUsage( FILE *file )
+{
+  fprintf( file, "usage: match_farm [options] manifest\n" );
+  fprintf( file, "  --cores n   core budget [default: online processors]\n" );
+  fprintf( file, "  --retries n times to rerun a failed match [default: %d]\n",
+	   DEFAULT_RETRIES );
+  fprintf( file, "  --dealer p  dealer to run [default: %s]\n",
+	   DEFAULT_DEALER );
+  fprintf( file, "  --summary f write the summary to f [default: stdout]\n" );
+  fprintf( file, "  --cache d   keep finished matches in directory d\n" );
+  fprintf( file, "  --cache_max_mb n  evict old matches past n MB "
+	   "[default: no limit]\n" );
+}
+
+/* split a manifest line into the dealer's arguments and the players
+   returns 1 for a match, 0 for a line to skip, -1 on failure */
+static int parseManifestLine( char *line, FarmMatch *match )
+{
+  int i, numTokens, copies;
+  char *token[ MAX_DEALER_ARGS + MAX_PLAYERS ];
+  FILE *file;
+  Game *game;
+
+  numTokens = 0;
+  for( token[ 0 ] = strtok( line, " \t\r\n" ); token[ numTokens ] != NULL;
+       token[ numTokens ] = strtok( NULL, " \t\r\n" ) ) {
+
+    ++numTokens;
+    if( numTokens == MAX_DEALER_ARGS + MAX_PLAYERS ) {
+
+      fprintf( stderr, "ERROR: too many arguments\n" );
+      return -1;
+    }
+  }
+  if( numTokens == 0 || token[ 0 ][ 0 ] == '#' ) {
+
+    return 0;
+  }
+  if( numTokens < 4 ) {
+
+    fprintf( stderr, "ERROR: too few arguments\n" );
+    return -1;
+  }
+
+  /* the number of players comes from the game */
+  file = fopen( token[ 1 ], "r" );
+  if( file == NULL ) {
+
+    fprintf( stderr, "ERROR: could not open game %s\n", token[ 1 ] );
+    return -1;
+  }
+  game = readGame( file );
+  fclose( file );
+  if( game == NULL ) {
+
+    fprintf( stderr, "ERROR: could not read game %s\n", token[ 1 ] );
+    return -1;
+  }
+  match->numPlayers = game->numPlayers;
+  free( game );
+  if( numTokens < 4 + match->numPlayers * 2 ) {
+
+    fprintf( stderr, "ERROR: too few players\n" );
+    return -1;
+  }
+
+  /* dealer name gameDef hands seed names... options... */
+  match->name = token[ 0 ];
+  match->numArgs = 0;
+  match->dealerArgs[ match->numArgs++ ] = "dealer";
+  for( i = 0; i < 4; ++i ) {
+
+    match->dealerArgs[ match->numArgs++ ] = token[ i ];
+  }
+  for( i = 0; i < match->numPlayers; ++i ) {
+
+    match->playerName[ i ] = token[ 4 + i * 2 ];
+    match->playerExe[ i ] = token[ 5 + i * 2 ];
+    match->dealerArgs[ match->numArgs++ ] = match->playerName[ i ];
+  }
+  copies = 1;
+  for( i = 4 + match->numPlayers * 2; i < numTokens; ++i ) {
+
+    if( match->numArgs == MAX_DEALER_ARGS ) {
+
+      fprintf( stderr, "ERROR: too many dealer options\n" );
+      return -1;
+    }
+    if( !strcmp( token[ i ], "--duplicate" ) ) {
+
+      copies = match->numPlayers;
+    }
+    match->dealerArgs[ match->numArgs++ ] = token[ i ];
+  }
+  match->dealerArgs[ match->numArgs ] = NULL;
+
+  match->cores = match->numPlayers * copies;
+  match->attempts = 0;
+  match->ok = 0;
+  match->cacheChecked = 0;
+  match->cached = 0;
+  match->cacheKey[ 0 ] = 0;
+  match->score[ 0 ] = 0;
+  return 1;
+}
+
+/* key match by the dealer, game, and players' executables, and by its
+   hands, seed, player names, and options */
+static void setCacheKey( const char *dealerPath, FarmMatch *match )
+{
+  int i;
+  char *files[ MAX_PLAYERS + 2 ];
+
+  files[ 0 ] = (char *)dealerPath;
+  files[ 1 ] = match->dealerArgs[ 2 ];
+  for( i = 0; i < match->numPlayers; ++i ) {
+
+    files[ 2 + i ] = match->playerExe[ i ];
+  }
+  if( makeCacheKey( match->cacheKey, match->numPlayers + 2, files,
+		    match->numArgs - 3, &match->dealerArgs[ 3 ] ) < 0 ) {
+
+    fprintf( stderr, "ERROR: %s: not using the cache\n", match->name );
+    match->cacheKey[ 0 ] = 0;
+  }
+}
+
+/* read every match from the manifest file
+   returns the number of matches, or -1 on failure */
+static int readManifest( const char *fileName, FarmMatch **matches )
+{
+  int r, num, size, lineNum;
+  FILE *file;
+  char line[ READBUF_LEN ];
+
+  file = fopen( fileName, "r" );
+  if( file == NULL ) {
+
+    fprintf( stderr, "ERROR: could not open manifest %s\n", fileName );
+    return -1;
+  }
+
+  num = 0;
+  size = 0;
+  *matches = NULL;
+  lineNum = 0;
+  while( fgets( line, READBUF_LEN, file ) ) {
+
+    ++lineNum;
+    if( num == size ) {
+
+      size = size ? size * 2 : 64;
+      *matches = (FarmMatch *)realloc( *matches, sizeof( FarmMatch ) * size );
+      if( *matches == NULL ) {
+
+	fprintf( stderr, "ERROR: could not allocate matches\n" );
+	exit( EXIT_FAILURE );
+      }
+    }
+
+    ( *matches )[ num ].line = strdup( line );
+    r = parseManifestLine( ( *matches )[ num ].line, &( *matches )[ num ] );
+    if( r < 0 ) {
+
+      fprintf( stderr, "ERROR: bad match on line %d of %s\n",
+	       lineNum, fileName );
+      fclose( file );
+      return -1;
+    }
+    if( r == 0 ) {
+
+      free( ( *matches )[ num ].line );
+      continue;
+    }
+    ++num;
+  }
+
+  fclose( file );
+  return num;
+}
+
+/* the farm blocks SIGCHLD to read it from a signalfd, and children
+   should start with it unblocked */
+static void unblockChildSignal()
+{
+  sigset_t mask;
+
+  sigemptyset( &mask );
+  sigaddset( &mask, SIGCHLD );
+  sigprocmask( SIG_UNBLOCK, &mask, NULL );
+}
+
+/* send standard out and standard error of a child to files */
+static void redirectOutput( const char *outName, const char *errName,
+			    const int append )
+{
+  int fd, flags;
+
+  flags = O_WRONLY | O_CREAT | ( append ? O_APPEND : O_TRUNC );
+  if( outName != NULL ) {
+
+    fd = open( outName, flags, 0644 );
+    if( fd < 0 || dup2( fd, 1 ) < 0 ) {
+
+      fprintf( stderr, "ERROR: could not open %s\n", outName );
+      exit( EXIT_FAILURE );
+    }
+    close( fd );
+  }
+  fd = open( errName, flags, 0644 );
+  if( fd < 0 || dup2( fd, 2 ) < 0 ) {
+
+    fprintf( stderr, "ERROR: could not open %s\n", errName );
+    exit( EXIT_FAILURE );
+  }
+  close( fd );
+}
+
+/* fork the dealer for job's match, reading its standard out
+   returns 0 on success, -1 on failure */
+static int startDealer( const char *dealerPath, FarmJob *job )
+{
+  int stdoutPipe[ 2 ];
+  char errName[ READBUF_LEN ];
+
+  if( pipe( stdoutPipe ) < 0 ) {
+
+    fprintf( stderr, "ERROR: could not create dealer pipe\n" );
+    return -1;
+  }
+  snprintf( errName, READBUF_LEN, "%s.err", job->match->name );
+
+  job->dealerPID = fork();
+  if( job->dealerPID < 0 ) {
+
+    fprintf( stderr, "ERROR: fork() failed\n" );
+    close( stdoutPipe[ 0 ] );
+    close( stdoutPipe[ 1 ] );
+    return -1;
+  }
+  if( job->dealerPID == 0 ) {
+    /* child runs the dealer */
+
+    unblockChildSignal();
+    close( stdoutPipe[ 0 ] );
+    if( dup2( stdoutPipe[ 1 ], 1 ) < 0 ) {
+
+      exit( EXIT_FAILURE );
+    }
+    close( stdoutPipe[ 1 ] );
+    redirectOutput( NULL, errName, 1 );
+    execv( dealerPath, job->match->dealerArgs );
+    fprintf( stderr, "ERROR: could not run %s\n", dealerPath );
+    exit( EXIT_FAILURE );
+  }
+
+  close( stdoutPipe[ 1 ] );
+  job->fromDealer = createReadBuf( stdoutPipe[ 0 ] );
+  if( job->fromDealer == NULL ) {
+
+    fprintf( stderr, "ERROR: could not create dealer read buffer\n" );
+    close( stdoutPipe[ 0 ] );
+    kill( job->dealerPID, SIGKILL );
+    return -1;
+  }
+  job->dealerStatus = -1;
+  job->gotPorts = 0;
+  job->numBots = 0;
+  job->botsRunning = 0;
+  return 0;
+}
+
+/* start a player for each port on the dealer's first line, which lists
+   every copy's ports in turn with duplicate matches
+   returns 0 on success, -1 on failure */
+static int startBots( FarmJob *job, char *portLine )
+{
+  int i, p, copy, numCopies, numPorts;
+  const FarmMatch *match = job->match;
+  char *port[ MAX_BOTS ], *host;
+  char outName[ READBUF_LEN ], errName[ READBUF_LEN ];
+
+  numPorts = 0;
+  for( port[ 0 ] = strtok( portLine, " \t\r\n" );
+       port[ numPorts ] != NULL && numPorts < MAX_BOTS;
+       port[ numPorts ] = strtok( NULL, " \t\r\n" ) ) {
+
+    ++numPorts;
+  }
+  numCopies = numPorts / match->numPlayers;
+  if( numCopies < 1 ) {
+
+    fprintf( stderr, "ERROR: %s: could not get ports from dealer\n",
+	     match->name );
+    return -1;
+  }
+
+  for( i = 0; i < numCopies * match->numPlayers; ++i ) {
+
+    /* port 0 is a seat the dealer plays with an in-process plugin */
+    if( !strcmp( port[ i ], "0" ) ) {
+      continue;
+    }
+
+    /* Unix domain endpoints take the place of the host, with no port */
+    if( isUnixEndpoint( port[ i ] ) ) {
+
+      host = port[ i ];
+      port[ i ] = "0";
+    } else {
+
+      host = BOT_HOST;
+    }
+
+    p = i % match->numPlayers;
+    copy = i / match->numPlayers;
+    if( numCopies > 1 ) {
+
+      snprintf( outName, READBUF_LEN, "%s.dup%d.player%d.std",
+		match->name, copy, p );
+      snprintf( errName, READBUF_LEN, "%s.dup%d.player%d.err",
+		match->name, copy, p );
+    } else {
+
+      snprintf( outName, READBUF_LEN, "%s.player%d.std", match->name, p );
+      snprintf( errName, READBUF_LEN, "%s.player%d.err", match->name, p );
+    }
+
+    job->botPID[ job->numBots ] = fork();
+    if( job->botPID[ job->numBots ] < 0 ) {
+
+      fprintf( stderr, "ERROR: fork() failed\n" );
+      return -1;
+    }
+    if( job->botPID[ job->numBots ] == 0 ) {
+      /* child runs the player */
+
+      unblockChildSignal();
+      redirectOutput( outName, errName, 0 );
+      execl( match->playerExe[ p ], match->playerExe[ p ], host, port[ i ],
+	     NULL );
+      fprintf( stderr, "ERROR: could not run %s\n", match->playerExe[ p ] );
+      exit( EXIT_FAILURE );
+    }
+    ++job->numBots;
+    ++job->botsRunning;
+  }
+
+  return 0;
+}
+
+/* stop everything job still has running, after a failure */
+static void killJob( FarmJob *job )
+{
+  int i;
+
+  if( job->dealerStatus < 0 ) {
+
+    kill( job->dealerPID, SIGKILL );
+  }
+  for( i = 0; i < job->numBots; ++i ) {
+
+    if( job->botPID[ i ] ) {
+
+      kill( job->botPID[ i ], SIGKILL );
+    }
+  }
+}
+
+/* read what the dealer has printed: the ports, then the SCORE line */
+static void readDealer( FarmJob *job )
+{
+  ssize_t r;
+  char line[ READBUF_LEN ];
+
+  while( ( r = getLine( job->fromDealer, READBUF_LEN, line, 0 ) ) > 0 ) {
+
+    if( !job->gotPorts ) {
+
+      job->gotPorts = 1;
+      if( startBots( job, line ) < 0 ) {
+
+	killJob( job );
+      }
+    } else if( !strncmp( line, "SCORE", 5 ) ) {
+
+      line[ strcspn( line, "\r\n" ) ] = 0;
+      snprintf( job->match->score, READBUF_LEN, "%s", line );
+    }
+  }
+  if( r == 0 ) {
+
+    destroyReadBuf( job->fromDealer );
+    job->fromDealer = NULL;
+  }
+}
+
+/* note the exit of pid, if it belongs to job
+   returns 1 if it did, 0 otherwise */
+static int jobChildExited( FarmJob *job, const pid_t pid, const int status )
+{
+  int i;
+
+  if( pid == job->dealerPID ) {
+
+    job->dealerStatus = status;
+    if( !WIFEXITED( status ) || WEXITSTATUS( status ) ) {
+
+      /* players may still be waiting for a dealer which is gone */
+      killJob( job );
+    }
+    return 1;
+  }
+  for( i = 0; i < job->numBots; ++i ) {
+
+    if( pid == job->botPID[ i ] ) {
+
+      job->botPID[ i ] = 0;
+      --job->botsRunning;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int jobFinished( const FarmJob *job )
+{
+  return job->dealerStatus >= 0 && job->fromDealer == NULL
+    && job->botsRunning == 0;
+}
+
+/* sum up each player's score over the matches and print everything */
+static void printSummary( FILE *file, const FarmMatch *matches,
+			  const int numMatches )
+{
+  int m, p, c, r, n, numNames, numFailed;
+  double value;
+  char *names[ MAX_PLAYERS ];
+  char *name, nameBuf[ READBUF_LEN ];
+  struct {
+    char *name;
+    int matches;
+    double total;
+  } *players;
+
+  players = calloc( numMatches * MAX_PLAYERS, sizeof( *players ) );
+  if( players == NULL ) {
+
+    fprintf( stderr, "ERROR: could not allocate summary\n" );
+    exit( EXIT_FAILURE );
+  }
+
+  numNames = 0;
+  numFailed = 0;
+  for( m = 0; m < numMatches; ++m ) {
+
+    if( !matches[ m ].ok ) {
+
+      fprintf( file, "%s FAILED attempts %d\n",
+	       matches[ m ].name, matches[ m ].attempts );
+      ++numFailed;
+      continue;
+    }
+    fprintf( file, "%s %s attempts %d %s\n", matches[ m ].name,
+	     matches[ m ].cached ? "cached" : "ok",
+	     matches[ m ].attempts, matches[ m ].score );
+
+    /* SCORE:v1|v2...:name1|name2... */
+    snprintf( nameBuf, READBUF_LEN, "%s",
+	      strchr( &matches[ m ].score[ 6 ], ':' ) + 1 );
+    names[ 0 ] = strtok( nameBuf, "|" );
+    for( p = 1; p < matches[ m ].numPlayers; ++p ) {
+
+      names[ p ] = strtok( NULL, "|" );
+    }
+    c = 5;
+    for( p = 0; p < matches[ m ].numPlayers; ++p ) {
+
+      sscanf( &matches[ m ].score[ c + 1 ], "%lf%n", &value, &r );
+      c += r + 1;
+      name = names[ p ];
+      for( n = 0; n < numNames; ++n ) {
+
+	if( !strcmp( players[ n ].name, name ) ) {
+	  break;
+	}
+      }
+      if( n == numNames ) {
+
+	players[ n ].name = strdup( name );
+	++numNames;
+      }
+      ++players[ n ].matches;
+      players[ n ].total += value;
+    }
+  }
+
+  for( n = 0; n < numNames; ++n ) {
+
+    fprintf( file, "PLAYER %s matches %d total %.6f mean %.6f\n",
+	     players[ n ].name, players[ n ].matches, players[ n ].total,
+	     players[ n ].total / players[ n ].matches );
+    free( players[ n ].name );
+  }
+  fprintf( file, "%d matches, %d failed\n", numMatches, numFailed );
+  free( players );
+}
+
+int main( int argc, char **argv )
+{
+  int i, r, j, numMatches, cores, usedCores, retries, numJobs;
+  int *pending, numPending, pendingStart, pendingSize, longOpt;
+  char *dealerPath, *summaryName, *cacheDir;
+  uint64_t cacheMaxMB;
+  ResultCache cache;
+  sigset_t mask;
+  int signalFD, status;
+  pid_t pid;
+  struct signalfd_siginfo info;
+  struct pollfd *fds;
+  FarmMatch *matches, *match;
+  FarmJob *jobs;
+  FILE *summary;
+  static struct option longOptions[] = {
+    { "cores", 1, 0, 0 },
+    { "retries", 1, 0, 0 },
+    { "dealer", 1, 0, 0 },
+    { "summary", 1, 0, 0 },
+    { "cache", 1, 0, 0 },
+    { "cache_max_mb", 1, 0, 0 },
+    { 0, 0, 0, 0 }
+  };
+
+  cores = sysconf( _SC_NPROCESSORS_ONLN );
+  retries = DEFAULT_RETRIES;
+  dealerPath = DEFAULT_DEALER;
+  summaryName = NULL;
+  cacheDir = NULL;
+  cacheMaxMB = 0;
+  while( ( i = getopt_long( argc, argv, "", longOptions, &longOpt ) ) >= 0 ) {
+
+    if( i != 0 ) {
+
+      printUsage( stderr );
+      exit( EXIT_FAILURE );
+    }
+    switch( longOpt ) {
+    case 0:
+
+      if( sscanf( optarg, "%d", &cores ) < 1 || cores < 1 ) {
+
+	fprintf( stderr, "ERROR: bad core budget %s\n", optarg );
+	exit( EXIT_FAILURE );
+      }
+      break;
+
+    case 1:
+
+      if( sscanf( optarg, "%d", &retries ) < 1 || retries < 0 ) {
+
+	fprintf( stderr, "ERROR: bad number of retries %s\n", optarg );
+	exit( EXIT_FAILURE );
+      }
+      break;
+
+    case 2:
+
+      dealerPath = optarg;
+      break;
+
+    case 3:
+
+      summaryName = optarg;
+      break;
+
+    case 4:
+
+      cacheDir = optarg;
+      break;
+
+    case 5:
+
+      if( sscanf( optarg, "%"SCNu64, &cacheMaxMB ) < 1 ) {
+
+	fprintf( stderr, "ERROR: bad cache size %s\n", optarg );
+	exit( EXIT_FAILURE );
+      }
+      break;
+    }
+  }
+  if( optind + 1 != argc && !( cacheDir && optind == argc ) ) {
+
+    printUsage( stderr );
+    exit( EXIT_FAILURE );
+  }
+
+  if( cacheDir != NULL ) {
+
+    if( openResultCache( &cache, cacheDir, cacheMaxMB << 20 ) < 0 ) {
+
+      exit( EXIT_FAILURE );
+    }
+    if( optind == argc ) {
+
+      exit( printCacheStats( &cache, stdout ) < 0
+	    ? EXIT_FAILURE : EXIT_SUCCESS );
+    }
+  }
+
+  numMatches = readManifest( argv[ optind ], &matches );
+  if( numMatches < 0 ) {
+
+    exit( EXIT_FAILURE );
+  }
+  if( numMatches == 0 ) {
+
+    fprintf( stderr, "ERROR: no matches in %s\n", argv[ optind ] );
+    exit( EXIT_FAILURE );
+  }
+
+  if( cacheDir != NULL ) {
+
+    for( i = 0; i < numMatches; ++i ) {
+
+      setCacheKey( dealerPath, &matches[ i ] );
+    }
+  }
+
+  /* every start of a match, retries included, goes through pending */
+  pendingSize = numMatches * ( retries + 1 );
+  pending = (int *)malloc( sizeof( int ) * pendingSize );
+  jobs = (FarmJob *)malloc( sizeof( FarmJob ) * numMatches );
+  fds = (struct pollfd *)malloc( sizeof( struct pollfd )
+				 * ( numMatches + 1 ) );
+  if( pending == NULL || jobs == NULL || fds == NULL ) {
+
+    fprintf( stderr, "ERROR: could not allocate jobs\n" );
+    exit( EXIT_FAILURE );
+  }
+  for( i = 0; i < numMatches; ++i ) {
+
+    pending[ i ] = i;
+  }
+  pendingStart = 0;
+  numPending = numMatches;
+
+  /* children exits are read from a signalfd, like bm_server */
+  sigemptyset( &mask );
+  sigaddset( &mask, SIGCHLD );
+  if( sigprocmask( SIG_BLOCK, &mask, NULL ) < 0
+      || ( signalFD = signalfd( -1, &mask,
+				SFD_NONBLOCK | SFD_CLOEXEC ) ) < 0 ) {
+
+    fprintf( stderr, "ERROR: could not set up child signals\n" );
+    exit( EXIT_FAILURE );
+  }
+  signal( SIGPIPE, SIG_IGN );
+
+  numJobs = 0;
+  usedCores = 0;
+  while( 1 ) {
+
+    /* start matches while they fit, letting anything run alone */
+    while( pendingStart < numPending ) {
+
+      match = &matches[ pending[ pendingStart ] ];
+
+      /* a match in the cache is done without using any cores, and a
+	 match waiting for cores is only looked up the first time */
+      if( cacheDir != NULL && !match->cacheChecked
+	  && match->cacheKey[ 0 ] ) {
+
+	match->cacheChecked = 1;
+	r = cacheLookup( &cache, match->cacheKey, match->name,
+			 match->score, READBUF_LEN );
+	if( r > 0 ) {
+
+	  ++pendingStart;
+	  match->ok = 1;
+	  match->cached = 1;
+	  printf( "cached %s: %s\n", match->name, match->score );
+	  fflush( stdout );
+	  continue;
+	}
+      }
+
+      if( usedCores && usedCores + match->cores > cores ) {
+	break;
+      }
+
+      ++pendingStart;
+      ++match->attempts;
+      jobs[ numJobs ].match = match;
+      if( startDealer( dealerPath, &jobs[ numJobs ] ) < 0 ) {
+
+	fprintf( stderr, "ERROR: %s: could not start dealer\n", match->name );
+	if( match->attempts <= retries ) {
+
+	  pending[ numPending++ ] = match - matches;
+	}
+	continue;
+      }
+      printf( "starting %s, attempt %d\n", match->name, match->attempts );
+      fflush( stdout );
+      usedCores += match->cores;
+      ++numJobs;
+    }
+    if( numJobs == 0 ) {
+      break;
+    }
+
+    /* wait for dealer output or children exiting */
+    fds[ 0 ].fd = signalFD;
+    fds[ 0 ].events = POLLIN;
+    for( i = 0; i < numJobs; ++i ) {
+
+      fds[ i + 1 ].fd = jobs[ i ].fromDealer
+	? jobs[ i ].fromDealer->fd : -1;
+      fds[ i + 1 ].events = POLLIN;
+    }
+    if( poll( fds, numJobs + 1, -1 ) < 0 ) {
+
+      continue;
+    }
+
+    for( i = 0; i < numJobs; ++i ) {
+
+      if( jobs[ i ].fromDealer && fds[ i + 1 ].revents ) {
+
+	readDealer( &jobs[ i ] );
+      }
+    }
+
+    /* several exits can be merged into one signal, so the signals are
+       only used as a wake up, and waitpid finds the children */
+    while( read( signalFD, &info, sizeof( info ) ) == sizeof( info ) );
+    while( ( pid = waitpid( -1, &status, WNOHANG ) ) > 0 ) {
+
+      for( i = 0; i < numJobs; ++i ) {
+
+	if( jobChildExited( &jobs[ i ], pid, status ) ) {
+	  break;
+	}
+      }
+    }
+
+    /* retire finished jobs, queueing failures to run again */
+    for( i = 0; i < numJobs; ) {
+
+      if( !jobFinished( &jobs[ i ] ) ) {
+
+	++i;
+	continue;
+      }
+
+      match = jobs[ i ].match;
+      r = WIFEXITED( jobs[ i ].dealerStatus )
+	? WEXITSTATUS( jobs[ i ].dealerStatus ) : -1;
+      if( r == 0 && match->score[ 0 ] ) {
+
+	match->ok = 1;
+	printf( "finished %s: %s\n", match->name, match->score );
+	if( cacheDir != NULL && match->cacheKey[ 0 ] ) {
+
+	  cacheStore( &cache, match->cacheKey, match->name, match->score );
+	}
+      } else {
+
+	printf( "%s failed on attempt %d%s\n", match->name, match->attempts,
+		match->attempts <= retries ? ", trying again" : "" );
+	match->score[ 0 ] = 0;
+	if( match->attempts <= retries ) {
+
+	  pending[ numPending++ ] = match - matches;
+	}
+      }
+      fflush( stdout );
+
+      usedCores -= match->cores;
+      --numJobs;
+      jobs[ i ] = jobs[ numJobs ];
+    }
+  }
+
+  if( summaryName != NULL ) {
+
+    summary = fopen( summaryName, "w" );
+    if( summary == NULL ) {
+
+      fprintf( stderr, "ERROR: could not open summary %s\n", summaryName );
+      exit( EXIT_FAILURE );
+    }
+  } else {
+
+    summary = stdout;
+  }
+  printSummary( summary, matches, numMatches );
+  if( cacheDir != NULL ) {
+
+    printCacheStats( &cache, summary );
+    closeResultCache( &cache );
+  }
+  if( summary != stdout ) {
+
+    fclose( summary );
+  }
+
+  r = EXIT_SUCCESS;
+  for( j = 0; j < numMatches; ++j ) {
+
+    if( !matches[ j ].ok ) {
+
+      r = EXIT_FAILURE;
+    }
+    free( matches[ j ].line );
+  }
+  free( matches );
+  free( pending );
+  free( jobs );
+  free( fds );
+  return r;
+}
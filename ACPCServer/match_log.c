@@ -0,0 +1,810 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#define _FILE_OFFSET_BITS 64
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "match_log.h"
+
+
+#define LOG_BLOCK_HEADER_LEN 21
+#define LOG_INDEX_HEADER_LEN 5
+#define LOG_INDEX_ENTRY_LEN 20
+#define LOG_TRAILER_LEN ( 8 + LOG_MAGIC_LEN )
+#define HAND_PREFIX_LEN 18 /* "STATE:", up to 10 digits, and ':' */
+
+
+static void put32( unsigned char *buf, const uint32_t value )
+{
+  buf[ 0 ] = value & 255;
+  buf[ 1 ] = ( value >> 8 ) & 255;
+  buf[ 2 ] = ( value >> 16 ) & 255;
+  buf[ 3 ] = value >> 24;
+}
+
+static void put64( unsigned char *buf, const uint64_t value )
+{
+  put32( buf, (uint32_t)value );
+  put32( &buf[ 4 ], (uint32_t)( value >> 32 ) );
+}
+
+static uint32_t get32( const unsigned char *buf )
+{
+  return (uint32_t)buf[ 0 ] | ( (uint32_t)buf[ 1 ] << 8 )
+    | ( (uint32_t)buf[ 2 ] << 16 ) | ( (uint32_t)buf[ 3 ] << 24 );
+}
+
+static uint64_t get64( const unsigned char *buf )
+{
+  return (uint64_t)get32( buf ) | ( (uint64_t)get32( &buf[ 4 ] ) << 32 );
+}
+
+/* returns 0 on success, -1 on failure */
+static int addBlockEntry( LogBlockEntry **blocks, uint32_t *numBlocks,
+			  uint32_t *maxBlocks, const LogBlockEntry *entry )
+{
+  LogBlockEntry *grown;
+
+  if( *numBlocks == *maxBlocks ) {
+
+    *maxBlocks = *maxBlocks ? *maxBlocks * 2 : 64;
+    grown = (LogBlockEntry *)realloc( *blocks,
+				      *maxBlocks * sizeof( LogBlockEntry ) );
+    if( grown == NULL ) {
+
+      fprintf( stderr, "ERROR: could not allocate log index\n" );
+      return -1;
+    }
+    *blocks = grown;
+  }
+
+  (*blocks)[ *numBlocks ] = *entry;
+  ++*numBlocks;
+  return 0;
+}
+
+/* walk the records of a compressed log from the start, adding an
+   entry for each block, and setting *end to the end of the last whole
+   record
+   returns 0 on success, -1 on failure */
+static int scanLog( FILE *file, LogBlockEntry **blocks, uint32_t *numBlocks,
+		    uint32_t *maxBlocks, off_t *end )
+{
+  off_t pos, size;
+  uint64_t len;
+  struct stat st;
+  LogBlockEntry entry;
+  unsigned char header[ LOG_BLOCK_HEADER_LEN ];
+
+  if( fstat( fileno( file ), &st ) < 0 ) {
+
+    fprintf( stderr, "ERROR: could not get size of log\n" );
+    return -1;
+  }
+  size = st.st_size;
+
+  pos = 0;
+  while( pos < size ) {
+
+    if( fseeko( file, pos, SEEK_SET ) < 0 ) {
+
+      fprintf( stderr, "ERROR: could not seek in log\n" );
+      return -1;
+    }
+    len = size - pos < LOG_BLOCK_HEADER_LEN ? size - pos
+      : LOG_BLOCK_HEADER_LEN;
+    if( fread( header, 1, len, file ) != len ) {
+
+      fprintf( stderr, "ERROR: could not read log\n" );
+      return -1;
+    }
+
+    if( header[ 0 ] == LOG_MAGIC[ 0 ] ) {
+      /* start of a session */
+
+      if( len < LOG_MAGIC_LEN || memcmp( header, LOG_MAGIC, LOG_MAGIC_LEN ) ) {
+	break;
+      }
+      len = LOG_MAGIC_LEN;
+    } else if( header[ 0 ] == log_block ) {
+
+      if( len < LOG_BLOCK_HEADER_LEN ) {
+	break;
+      }
+      entry.offset = pos;
+      entry.numHands = get32( &header[ 9 ] );
+      entry.firstHand = get32( &header[ 13 ] );
+      entry.lastHand = get32( &header[ 17 ] );
+      len = LOG_BLOCK_HEADER_LEN + (uint64_t)get32( &header[ 5 ] );
+      if( pos + len > size ) {
+	break;
+      }
+      if( addBlockEntry( blocks, numBlocks, maxBlocks, &entry ) < 0 ) {
+
+	return -1;
+      }
+    } else if( header[ 0 ] == log_index ) {
+      /* an earlier session's index */
+
+      if( len < LOG_INDEX_HEADER_LEN ) {
+	break;
+      }
+      len = LOG_INDEX_HEADER_LEN
+	+ (uint64_t)get32( &header[ 1 ] ) * LOG_INDEX_ENTRY_LEN
+	+ LOG_TRAILER_LEN;
+      if( pos + len > size ) {
+	break;
+      }
+    } else {
+      /* not a record, so the log was cut short */
+
+      break;
+    }
+
+    pos += len;
+  }
+
+  *end = pos;
+  return 0;
+}
+
+LogWriter *openLogWriter( const char *fileName, const int append,
+			  const int compressed )
+{
+  off_t end;
+  LogWriter *log;
+
+  log = (LogWriter *)calloc( 1, sizeof( LogWriter ) );
+  if( log == NULL ) {
+
+    return NULL;
+  }
+  log->compressed = compressed;
+
+  if( !compressed ) {
+
+    log->file = fopen( fileName, append ? "a+" : "w" );
+    if( log->file == NULL ) {
+
+      free( log );
+      return NULL;
+    }
+    return log;
+  }
+
+  log->text = (char *)malloc( LOG_BLOCK_LEN );
+  log->maxDataLen = compressBound( LOG_BLOCK_LEN );
+  log->data = (unsigned char *)malloc( log->maxDataLen );
+  if( log->text == NULL || log->data == NULL ) {
+
+    goto fail;
+  }
+
+  log->file = append ? fopen( fileName, "r+" ) : NULL;
+  if( log->file != NULL ) {
+    /* pick up the blocks already in the log, and drop anything after
+       the last whole record */
+
+    if( scanLog( log->file, &log->blocks, &log->numBlocks, &log->maxBlocks,
+		 &end ) < 0 ) {
+
+      goto fail;
+    }
+    if( ftruncate( fileno( log->file ), end ) < 0
+	|| fseeko( log->file, end, SEEK_SET ) < 0 ) {
+
+      fprintf( stderr, "ERROR: could not truncate log %s\n", fileName );
+      goto fail;
+    }
+  } else {
+
+    log->file = fopen( fileName, "w" );
+    if( log->file == NULL ) {
+
+      goto fail;
+    }
+  }
+
+  if( fwrite( LOG_MAGIC, 1, LOG_MAGIC_LEN, log->file ) != LOG_MAGIC_LEN
+      || fflush( log->file ) != 0 ) {
+
+    goto fail;
+  }
+  return log;
+
+ fail:
+  if( log->file != NULL ) {
+    fclose( log->file );
+  }
+  free( log->blocks );
+  free( log->text );
+  free( log->data );
+  free( log );
+  return NULL;
+}
+
+/* compress and write out the current block
+   returns 0 on success, -1 on failure */
+static int flushLogBlock( LogWriter *log )
+{
+  off_t offset;
+  uLongf dataLen;
+  LogBlockEntry entry;
+  unsigned char header[ LOG_BLOCK_HEADER_LEN ];
+
+  if( log->fill == 0 ) {
+
+    return 0;
+  }
+
+  dataLen = log->maxDataLen;
+  if( compress2( log->data, &dataLen, (const Bytef *)log->text, log->fill,
+		 Z_DEFAULT_COMPRESSION ) != Z_OK ) {
+
+    fprintf( stderr, "ERROR: could not compress log block\n" );
+    return -1;
+  }
+
+  offset = ftello( log->file );
+  if( offset < 0 ) {
+
+    return -1;
+  }
+  header[ 0 ] = log_block;
+  put32( &header[ 1 ], log->fill );
+  put32( &header[ 5 ], dataLen );
+  put32( &header[ 9 ], log->numHands );
+  put32( &header[ 13 ], log->firstHand );
+  put32( &header[ 17 ], log->lastHand );
+  if( fwrite( header, 1, LOG_BLOCK_HEADER_LEN, log->file )
+      != LOG_BLOCK_HEADER_LEN
+      || fwrite( log->data, 1, dataLen, log->file ) != dataLen ) {
+
+    return -1;
+  }
+
+  entry.offset = offset;
+  entry.numHands = log->numHands;
+  entry.firstHand = log->firstHand;
+  entry.lastHand = log->lastHand;
+  if( addBlockEntry( &log->blocks, &log->numBlocks, &log->maxBlocks,
+		     &entry ) < 0 ) {
+
+    return -1;
+  }
+
+  log->fill = 0;
+  log->numHands = 0;
+  log->firstHand = 0;
+  log->lastHand = 0;
+
+  /* nothing is left in the stdio buffer between blocks, so a block is
+     safe once it is written, and salvageLogWriter can use the fd */
+  if( fflush( log->file ) != 0 ) {
+
+    return -1;
+  }
+  return 0;
+}
+
+/* write all of len bytes to fd, using nothing but write()
+   returns 0 on success, -1 on failure */
+static int writeAll( const int fd, const unsigned char *buf, size_t len )
+{
+  ssize_t r;
+
+  while( len ) {
+
+    r = write( fd, buf, len );
+    if( r <= 0 ) {
+
+      return -1;
+    }
+    buf += r;
+    len -= r;
+  }
+  return 0;
+}
+
+int salvageLogWriter( LogWriter *log )
+{
+  int fd;
+  uint32_t i, b, a1, a2, len, dataLen = 0;
+  off_t offset, indexOffset;
+  unsigned char buf[ LOG_BLOCK_HEADER_LEN + 2 ];
+
+  if( !log->compressed ) {
+    /* plain logs are flushed after every write */
+
+    return 0;
+  }
+  fd = fileno( log->file );
+
+  /* the current block is written as a zlib stream of stored deflate
+     blocks, which needs no allocation: a 2 byte header, then for
+     each piece of up to 65535 bytes a final flag, its length, and the
+     length's complement, and an adler32 check at the end */
+  offset = lseek( fd, 0, SEEK_CUR );
+  if( offset < 0 ) {
+
+    return -1;
+  }
+  if( log->fill ) {
+
+    dataLen = 2 + log->fill + 5 * ( ( log->fill + 65534 ) / 65535 ) + 4;
+    buf[ 0 ] = log_block;
+    put32( &buf[ 1 ], log->fill );
+    put32( &buf[ 5 ], dataLen );
+    put32( &buf[ 9 ], log->numHands );
+    put32( &buf[ 13 ], log->firstHand );
+    put32( &buf[ 17 ], log->lastHand );
+    buf[ LOG_BLOCK_HEADER_LEN ] = 0x78;
+    buf[ LOG_BLOCK_HEADER_LEN + 1 ] = 0x01;
+    if( writeAll( fd, buf, LOG_BLOCK_HEADER_LEN + 2 ) < 0 ) {
+
+      return -1;
+    }
+    a1 = 1;
+    a2 = 0;
+    for( i = 0; i < log->fill; i += len ) {
+
+      len = log->fill - i > 65535 ? 65535 : log->fill - i;
+      buf[ 0 ] = i + len == log->fill;
+      buf[ 1 ] = len & 255;
+      buf[ 2 ] = len >> 8;
+      buf[ 3 ] = ~len & 255;
+      buf[ 4 ] = ( ~len >> 8 ) & 255;
+      if( writeAll( fd, buf, 5 ) < 0
+	  || writeAll( fd, (unsigned char *)&log->text[ i ], len ) < 0 ) {
+
+	return -1;
+      }
+    }
+    for( i = 0; i < log->fill; ++i ) {
+
+      a1 = ( a1 + (unsigned char)log->text[ i ] ) % 65521;
+      a2 = ( a2 + a1 ) % 65521;
+    }
+    a1 |= a2 << 16;
+    buf[ 0 ] = a1 >> 24;
+    buf[ 1 ] = ( a1 >> 16 ) & 255;
+    buf[ 2 ] = ( a1 >> 8 ) & 255;
+    buf[ 3 ] = a1 & 255;
+    if( writeAll( fd, buf, 4 ) < 0 ) {
+
+      return -1;
+    }
+  }
+
+  /* then the index, with the new block as its last entry */
+  indexOffset = offset + ( log->fill ? LOG_BLOCK_HEADER_LEN + dataLen : 0 );
+  b = log->numBlocks + ( log->fill ? 1 : 0 );
+  buf[ 0 ] = log_index;
+  put32( &buf[ 1 ], b );
+  if( writeAll( fd, buf, LOG_INDEX_HEADER_LEN ) < 0 ) {
+
+    return -1;
+  }
+  for( b = 0; b < log->numBlocks; ++b ) {
+
+    put64( buf, log->blocks[ b ].offset );
+    put32( &buf[ 8 ], log->blocks[ b ].numHands );
+    put32( &buf[ 12 ], log->blocks[ b ].firstHand );
+    put32( &buf[ 16 ], log->blocks[ b ].lastHand );
+    if( writeAll( fd, buf, LOG_INDEX_ENTRY_LEN ) < 0 ) {
+
+      return -1;
+    }
+  }
+  if( log->fill ) {
+
+    put64( buf, offset );
+    put32( &buf[ 8 ], log->numHands );
+    put32( &buf[ 12 ], log->firstHand );
+    put32( &buf[ 16 ], log->lastHand );
+    if( writeAll( fd, buf, LOG_INDEX_ENTRY_LEN ) < 0 ) {
+
+      return -1;
+    }
+  }
+  put64( buf, indexOffset );
+  memcpy( &buf[ 8 ], LOG_INDEX_MAGIC, LOG_MAGIC_LEN );
+  return writeAll( fd, buf, LOG_TRAILER_LEN );
+}
+
+int writeLog( LogWriter *log, const char *text, const size_t len,
+	      const int64_t handId )
+{
+  if( !log->compressed ) {
+
+    if( fwrite( text, 1, len, log->file ) != len ) {
+
+      return -1;
+    }
+    fflush( log->file );
+    return 0;
+  }
+
+  if( len > LOG_BLOCK_LEN ) {
+
+    fprintf( stderr, "ERROR: log text too long for a block\n" );
+    return -1;
+  }
+  if( log->fill + len > LOG_BLOCK_LEN && flushLogBlock( log ) < 0 ) {
+
+    return -1;
+  }
+
+  memcpy( &log->text[ log->fill ], text, len );
+  log->fill += len;
+  if( handId >= 0 ) {
+
+    if( log->numHands == 0 ) {
+
+      log->firstHand = handId;
+    }
+    log->lastHand = handId;
+    ++log->numHands;
+  }
+  return 0;
+}
+
+int closeLogWriter( LogWriter *log )
+{
+  int r;
+  uint32_t b;
+  off_t indexOffset;
+  unsigned char buf[ LOG_TRAILER_LEN + LOG_INDEX_ENTRY_LEN ];
+
+  r = 0;
+  if( log->compressed ) {
+
+    if( flushLogBlock( log ) < 0 ) {
+
+      r = -1;
+    }
+
+    /* the index covers every block in the file, and ends it */
+    indexOffset = ftello( log->file );
+    buf[ 0 ] = log_index;
+    put32( &buf[ 1 ], log->numBlocks );
+    if( indexOffset < 0
+	|| fwrite( buf, 1, LOG_INDEX_HEADER_LEN, log->file )
+	!= LOG_INDEX_HEADER_LEN ) {
+
+      r = -1;
+    }
+    for( b = 0; b < log->numBlocks; ++b ) {
+
+      put64( buf, log->blocks[ b ].offset );
+      put32( &buf[ 8 ], log->blocks[ b ].numHands );
+      put32( &buf[ 12 ], log->blocks[ b ].firstHand );
+      put32( &buf[ 16 ], log->blocks[ b ].lastHand );
+      if( fwrite( buf, 1, LOG_INDEX_ENTRY_LEN, log->file )
+	  != LOG_INDEX_ENTRY_LEN ) {
+
+	r = -1;
+      }
+    }
+    put64( buf, indexOffset );
+    memcpy( &buf[ 8 ], LOG_INDEX_MAGIC, LOG_MAGIC_LEN );
+    if( fwrite( buf, 1, LOG_TRAILER_LEN, log->file ) != LOG_TRAILER_LEN ) {
+
+      r = -1;
+    }
+  }
+
+  if( fclose( log->file ) != 0 ) {
+
+    r = -1;
+  }
+  free( log->blocks );
+  free( log->text );
+  free( log->data );
+  free( log );
+  return r;
+}
+
+/* read the index at the end of a compressed log
+   returns 0 on success, -1 if there is no index */
+static int readLogIndex( LogReader *log )
+{
+  off_t size, indexOffset;
+  uint32_t b, numBlocks;
+  struct stat st;
+  unsigned char buf[ LOG_TRAILER_LEN + LOG_INDEX_ENTRY_LEN ];
+
+  if( fstat( fileno( log->file ), &st ) < 0 ) {
+
+    return -1;
+  }
+  size = st.st_size;
+  if( size < LOG_MAGIC_LEN + LOG_INDEX_HEADER_LEN + LOG_TRAILER_LEN
+      || fseeko( log->file, size - LOG_TRAILER_LEN, SEEK_SET ) < 0
+      || fread( buf, 1, LOG_TRAILER_LEN, log->file ) != LOG_TRAILER_LEN
+      || memcmp( &buf[ 8 ], LOG_INDEX_MAGIC, LOG_MAGIC_LEN ) ) {
+
+    return -1;
+  }
+
+  indexOffset = get64( buf );
+  if( indexOffset < LOG_MAGIC_LEN
+      || indexOffset > size - LOG_INDEX_HEADER_LEN - LOG_TRAILER_LEN
+      || fseeko( log->file, indexOffset, SEEK_SET ) < 0
+      || fread( buf, 1, LOG_INDEX_HEADER_LEN, log->file )
+      != LOG_INDEX_HEADER_LEN
+      || buf[ 0 ] != log_index ) {
+
+    return -1;
+  }
+  numBlocks = get32( &buf[ 1 ] );
+  if( indexOffset + LOG_INDEX_HEADER_LEN
+      + (off_t)numBlocks * LOG_INDEX_ENTRY_LEN + LOG_TRAILER_LEN != size ) {
+
+    return -1;
+  }
+
+  log->blocks = (LogBlockEntry *)malloc( ( numBlocks ? numBlocks : 1 )
+					 * sizeof( LogBlockEntry ) );
+  if( log->blocks == NULL ) {
+
+    return -1;
+  }
+  for( b = 0; b < numBlocks; ++b ) {
+
+    if( fread( buf, 1, LOG_INDEX_ENTRY_LEN, log->file )
+	!= LOG_INDEX_ENTRY_LEN ) {
+
+      return -1;
+    }
+    log->blocks[ b ].offset = get64( buf );
+    log->blocks[ b ].numHands = get32( &buf[ 8 ] );
+    log->blocks[ b ].firstHand = get32( &buf[ 12 ] );
+    log->blocks[ b ].lastHand = get32( &buf[ 16 ] );
+  }
+  log->numBlocks = numBlocks;
+  return 0;
+}
+
+LogReader *openLogReader( const char *fileName )
+{
+  off_t end;
+  uint32_t maxBlocks;
+  LogReader *log;
+  char magic[ LOG_MAGIC_LEN ];
+
+  log = (LogReader *)calloc( 1, sizeof( LogReader ) );
+  if( log == NULL ) {
+
+    return NULL;
+  }
+  log->file = fopen( fileName, "r" );
+  if( log->file == NULL ) {
+
+    free( log );
+    return NULL;
+  }
+
+  if( fread( magic, 1, LOG_MAGIC_LEN, log->file ) != LOG_MAGIC_LEN
+      || memcmp( magic, LOG_MAGIC, LOG_MAGIC_LEN ) ) {
+    /* a plain log is one big block */
+
+    rewind( log->file );
+    log->numBlocks = 1;
+    log->endBlock = 1;
+    return log;
+  }
+
+  log->compressed = 1;
+  if( readLogIndex( log ) < 0 ) {
+    /* the writer never finished, so find the blocks the slow way */
+
+    free( log->blocks );
+    log->blocks = NULL;
+    log->numBlocks = 0;
+    maxBlocks = 0;
+    if( scanLog( log->file, &log->blocks, &log->numBlocks, &maxBlocks,
+		 &end ) < 0 ) {
+
+      closeLogReader( log );
+      return NULL;
+    }
+  }
+  log->endBlock = log->numBlocks;
+
+  log->text = (char *)malloc( LOG_BLOCK_LEN );
+  log->maxDataLen = compressBound( LOG_BLOCK_LEN );
+  log->data = (unsigned char *)malloc( log->maxDataLen );
+  if( log->text == NULL || log->data == NULL ) {
+
+    closeLogReader( log );
+    return NULL;
+  }
+  return log;
+}
+
+void closeLogReader( LogReader *log )
+{
+  fclose( log->file );
+  free( log->blocks );
+  free( log->text );
+  free( log->data );
+  free( log );
+}
+
+/* read and decompress block b of a compressed log
+   returns 0 on success, -1 on failure */
+static int loadLogBlock( LogReader *log, const uint32_t b )
+{
+  uint32_t dataLen;
+  uLongf textLen;
+  unsigned char header[ LOG_BLOCK_HEADER_LEN ];
+
+  log->textLen = 0;
+  log->textPos = 0;
+  if( fseeko( log->file, log->blocks[ b ].offset, SEEK_SET ) < 0
+      || fread( header, 1, LOG_BLOCK_HEADER_LEN, log->file )
+      != LOG_BLOCK_HEADER_LEN
+      || header[ 0 ] != log_block ) {
+
+    fprintf( stderr, "ERROR: could not read log block %"PRIu32"\n", b );
+    return -1;
+  }
+
+  textLen = get32( &header[ 1 ] );
+  dataLen = get32( &header[ 5 ] );
+  if( textLen > LOG_BLOCK_LEN || dataLen > log->maxDataLen
+      || fread( log->data, 1, dataLen, log->file ) != dataLen
+      || uncompress( (Bytef *)log->text, &textLen, log->data,
+		     dataLen ) != Z_OK
+      || textLen != get32( &header[ 1 ] ) ) {
+
+    fprintf( stderr, "ERROR: bad log block %"PRIu32"\n", b );
+    return -1;
+  }
+
+  log->textLen = textLen;
+  return 0;
+}
+
+char *readLogLine( LogReader *log, char *line, const int maxLen )
+{
+  int len;
+  char *newline;
+
+  if( !log->compressed ) {
+
+    if( log->nextBlock >= log->endBlock ) {
+
+      return NULL;
+    }
+    return fgets( line, maxLen, log->file );
+  }
+
+  while( log->textPos >= log->textLen ) {
+
+    if( log->nextBlock >= log->endBlock
+	|| loadLogBlock( log, log->nextBlock ) < 0 ) {
+
+      return NULL;
+    }
+    ++log->nextBlock;
+  }
+
+  /* copy out up to and including the newline, if it fits */
+  len = log->textLen - log->textPos;
+  if( len > maxLen - 1 ) {
+
+    len = maxLen - 1;
+  }
+  newline = memchr( &log->text[ log->textPos ], '\n', len );
+  if( newline != NULL ) {
+
+    len = newline - &log->text[ log->textPos ] + 1;
+  }
+  memcpy( line, &log->text[ log->textPos ], len );
+  line[ len ] = 0;
+  log->textPos += len;
+  return line;
+}
+
+int setLogBlockRange( LogReader *log, const uint32_t first,
+		      const uint32_t end )
+{
+  if( first > end || end > log->numBlocks ) {
+
+    return -1;
+  }
+
+  log->nextBlock = first;
+  log->endBlock = end;
+  log->textLen = 0;
+  log->textPos = 0;
+  if( !log->compressed && fseeko( log->file, 0, SEEK_SET ) < 0 ) {
+
+    return -1;
+  }
+  return 0;
+}
+
+/* returns non-zero if text starts a STATE line for handId */
+static int isHandLine( const char *text, const uint32_t handId )
+{
+  uint32_t id;
+  int c;
+
+  return !strncmp( text, "STATE:", 6 )
+    && sscanf( &text[ 6 ], "%"SCNu32"%n", &id, &c ) >= 1
+    && id == handId && text[ 6 + c ] == ':';
+}
+
+int seekLogHand( LogReader *log, const uint32_t handId )
+{
+  uint32_t b, pos, len;
+  off_t start;
+  char line[ LOG_BLOCK_LEN ];
+
+  if( !log->compressed ) {
+    /* no index, so read through until we find it */
+
+    if( setLogBlockRange( log, 0, 1 ) < 0 ) {
+
+      return -1;
+    }
+    while( 1 ) {
+
+      start = ftello( log->file );
+      if( fgets( line, LOG_BLOCK_LEN, log->file ) == NULL ) {
+
+	return -1;
+      }
+      if( isHandLine( line, handId ) ) {
+
+	return fseeko( log->file, start, SEEK_SET ) < 0 ? -1 : 0;
+      }
+    }
+  }
+
+  for( b = 0; b < log->numBlocks; ++b ) {
+
+    if( log->blocks[ b ].numHands == 0
+	|| handId < log->blocks[ b ].firstHand
+	|| handId > log->blocks[ b ].lastHand ) {
+      continue;
+    }
+
+    if( loadLogBlock( log, b ) < 0 ) {
+
+      return -1;
+    }
+    log->nextBlock = b + 1;
+    log->endBlock = log->numBlocks;
+
+    /* the text is not terminated, so the start of each line, which
+       is enough for "STATE:" and a handId, is copied out to check */
+    for( pos = 0; pos < log->textLen; ) {
+
+      len = log->textLen - pos < HAND_PREFIX_LEN ? log->textLen - pos
+	: HAND_PREFIX_LEN;
+      memcpy( line, &log->text[ pos ], len );
+      line[ len ] = 0;
+      if( isHandLine( line, handId ) ) {
+
+	log->textPos = pos;
+	return 0;
+      }
+      while( pos < log->textLen && log->text[ pos ] != '\n' ) {
+	++pos;
+      }
+      ++pos;
+    }
+  }
+
+  return -1;
+}
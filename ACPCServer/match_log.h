@@ -0,0 +1,144 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#ifndef _MATCH_LOG_H
+#define _MATCH_LOG_H
+
+#include <stdio.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+
+
+/* dealer logs, as plain text or as independently compressed blocks
+
+   a compressed log holds exactly the text of the plain log, cut at
+   line boundaries into blocks of up to LOG_BLOCK_LEN bytes which are
+   each deflated on their own with zlib, so any block can be read
+   without the ones before it.  Every time a compressed log is opened
+   for writing it writes the LOG_MAGIC bytes, followed by records of
+     block: kind (1 byte), text length, compressed length, number of
+       hands, first handId, last handId (4 bytes each), compressed text
+     index: kind (1 byte), number of blocks (4 bytes), and for each
+       block in the file, its offset (8 bytes), number of hands, first
+       handId, last handId (4 bytes each), then the offset of the index
+       record (8 bytes) and the LOG_INDEX_MAGIC bytes
+   where the hands of a block are its STATE lines.  The index is only
+   written when the log is closed, and is always last in the file, so
+   readers look for it at the end, and fall back to walking the block
+   headers if the dealer died before writing it.  Appending to a log
+   drops any partial record at its end, and the new index covers the
+   whole file.  Kinds never match the first byte of LOG_MAGIC, and all
+   numbers are little endian.
+
+   a LogReader reads either kind of log a line at a time, like fgets,
+   and can be limited to a range of blocks, so several processes can
+   each scan part of one log, or started at a given hand.  A plain log
+   counts as a single block. */
+
+#define LOG_MAGIC "ACPCLGZ1"
+#define LOG_INDEX_MAGIC "ACPCLGZI"
+#define LOG_MAGIC_LEN 8
+#define LOG_BLOCK_LEN 65536
+#define LOG_SUFFIX ".log"
+#define COMPRESSED_LOG_SUFFIX ".logz"
+
+enum LogRecordKind { log_block = 1, log_index = 2 };
+
+typedef struct {
+  uint64_t offset; /* of the block's record */
+  uint32_t numHands; /* 0 if the block only has other lines */
+  uint32_t firstHand;
+  uint32_t lastHand;
+} LogBlockEntry;
+
+typedef struct {
+  FILE *file;
+  int compressed;
+
+  /* compressed logs only */
+  uint32_t numBlocks;
+  uint32_t maxBlocks;
+  LogBlockEntry *blocks;
+  uint32_t fill; /* text waiting in the current block */
+  uint32_t numHands;
+  uint32_t firstHand;
+  uint32_t lastHand;
+  char *text;
+  unsigned char *data;
+  unsigned long maxDataLen;
+} LogWriter;
+
+typedef struct {
+  FILE *file;
+  int compressed;
+
+  /* the blocks of the log, of which nextBlock up to endBlock are left
+     to read */
+  uint32_t numBlocks;
+  LogBlockEntry *blocks;
+  uint32_t nextBlock;
+  uint32_t endBlock;
+
+  /* text of the current block */
+  uint32_t textLen;
+  uint32_t textPos;
+  char *text;
+  unsigned char *data;
+  unsigned long maxDataLen;
+} LogReader;
+
+
+/* open fileName for writing a log, compressed if compressed is
+   non-zero, appending to it if append is non-zero and it already
+   exists
+   returns NULL on failure */
+LogWriter *openLogWriter( const char *fileName, const int append,
+			  const int compressed );
+
+/* add len bytes of text, made of whole lines, to the log, where
+   handId is the hand of a STATE line, or -1 for anything else
+   a plain log is flushed at once, but a compressed log is only
+   written out a block at a time
+   returns 0 on success, -1 on failure */
+int writeLog( LogWriter *log, const char *text, const size_t len,
+	      const int64_t handId );
+
+/* write out anything buffered and the index, close the log, and free
+   the writer
+   returns 0 on success, -1 on failure */
+int closeLogWriter( LogWriter *log );
+
+/* finish a compressed log from a signal handler, writing the current
+   block uncompressed and the index with nothing but write(), so the
+   hands still in memory aren't lost when the writer is killed
+   the writer must not be in the middle of any other call on log, so
+   callers block the signal around them, and the writer can't be used
+   afterwards
+   returns 0 on success, -1 on failure */
+int salvageLogWriter( LogWriter *log );
+
+/* open fileName, which may be a plain or a compressed log
+   returns NULL on failure */
+LogReader *openLogReader( const char *fileName );
+
+void closeLogReader( LogReader *log );
+
+/* read the next line of the log into line, which holds maxLen
+   characters including the terminating 0, with the same results as
+   fgets: lines longer than that come back in pieces
+   returns line, or NULL at the end of the log or on failure */
+char *readLogLine( LogReader *log, char *line, const int maxLen );
+
+/* only read blocks first up to (but not including) end, starting from
+   the beginning of block first
+   returns 0 on success, -1 on failure */
+int setLogBlockRange( LogReader *log, const uint32_t first,
+		      const uint32_t end );
+
+/* make the next line read the STATE line for handId, reading to the
+   end of the log from there
+   returns 0 on success, -1 if there is no such hand */
+int seekLogHand( LogReader *log, const uint32_t handId );
+
+#endif
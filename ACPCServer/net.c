@@ -5,13 +5,401 @@ Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
 #include <unistd.h>
 #include <netdb.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <stddef.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
 #include "net.h"
 
 
+/* shared memory transport
+
+   the client creates a shared memory object holding two single
+   producer, single consumer byte rings, one in each direction, and
+   sends its name over the TCP connection.  The server maps it and
+   acknowledges, after which all traffic goes through the rings.
+
+   head and tail are free running byte counts, so head - tail is the
+   number of bytes in the ring.  A side which has to wait increments
+   the waiters count and sleeps on a futex sequence number, which the
+   other side bumps (and only wakes if there are waiters) after it
+   changes head or tail.  Waits are done in slices, so that the TCP
+   connection can be polled to notice if the other process died. */
+
+#define SHM_RING_BYTES 65536
+#define SHM_RING_MAGIC 0x41435052
+#define SHM_REQUEST "SHMRING:"
+#define SHM_REPLY "SHMRING:OK\n"
+#define SHM_REPLY_TIMEOUT_MICROS 10000000
+#define SHM_LIVENESS_MICROS 100000
+
+typedef struct {
+  /* only written by the producer */
+  uint32_t head __attribute__(( aligned( 64 ) ));
+  uint32_t dataSeq;
+  uint32_t closed;
+
+  /* only written by the consumer */
+  uint32_t tail __attribute__(( aligned( 64 ) ));
+  uint32_t spaceSeq;
+
+  uint32_t dataWaiters __attribute__(( aligned( 64 ) ));
+  uint32_t spaceWaiters;
+
+  char data[ SHM_RING_BYTES ] __attribute__(( aligned( 64 ) ));
+} ShmPipe;
+
+typedef struct {
+  uint32_t magic;
+  ShmPipe toServer;
+  ShmPipe toClient;
+} ShmSegment;
+
+struct ShmRing_struct {
+  ShmSegment *seg;
+  ShmPipe *in;
+  ShmPipe *out;
+};
+
+
+int64_t monotonicMicros()
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+#ifdef __linux__
+static void futexWait( uint32_t *addr, uint32_t val, int64_t micros )
+{
+  struct timespec ts;
+
+  ts.tv_sec = micros / 1000000;
+  ts.tv_nsec = ( micros % 1000000 ) * 1000;
+  syscall( SYS_futex, addr, FUTEX_WAIT, val, &ts, NULL, 0 );
+}
+
+static void futexWake( uint32_t *addr )
+{
+  syscall( SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0 );
+}
+#endif
+
+/* bump seq, and wake up anyone waiting on it */
+static void shmSignal( uint32_t *seq, uint32_t *waiters )
+{
+  __atomic_add_fetch( seq, 1, __ATOMIC_SEQ_CST );
+#ifdef __linux__
+  if( __atomic_load_n( waiters, __ATOMIC_SEQ_CST ) ) {
+
+    futexWake( seq );
+  }
+#endif
+}
+
+/* wait until the value at *watch is not equal to old, or the other
+   side closes the ring, for at most maxMicros
+   returns 0 if we should check again, -1 if the other side is gone */
+static int shmWait( ReadBuf *readBuf, uint32_t *watch, const uint32_t old,
+		    uint32_t *seq, uint32_t *waiters, int64_t maxMicros )
+{
+  uint32_t s;
+  struct pollfd pfd;
+
+  if( maxMicros > SHM_LIVENESS_MICROS || maxMicros < 0 ) {
+
+    maxMicros = SHM_LIVENESS_MICROS;
+  }
+
+  __atomic_add_fetch( waiters, 1, __ATOMIC_SEQ_CST );
+  s = __atomic_load_n( seq, __ATOMIC_SEQ_CST );
+  if( __atomic_load_n( watch, __ATOMIC_SEQ_CST ) == old
+      && !__atomic_load_n( &readBuf->ring->in->closed, __ATOMIC_SEQ_CST ) ) {
+
+#ifdef __linux__
+    futexWait( seq, s, maxMicros );
+#else
+    usleep( maxMicros );
+#endif
+  }
+  __atomic_sub_fetch( waiters, 1, __ATOMIC_SEQ_CST );
+
+  /* nothing is sent over the socket once the rings are in use,
+     so if it's readable the other side has gone away */
+  pfd.fd = readBuf->fd;
+  pfd.events = POLLIN;
+  if( poll( &pfd, 1, 0 ) != 0 ) {
+
+    return -1;
+  }
+
+  return 0;
+}
+
+/* read up to maxLen bytes from the ring into buf
+   if deadlineMicros is non-negative, give up waiting for data when
+   monotonicMicros() reaches it
+   returns number of bytes read, 0 on end of file, -1 on timeout */
+static ssize_t shmRead( ReadBuf *readBuf, char *buf, size_t maxLen,
+			int64_t deadlineMicros )
+{
+  uint32_t head, tail, pos, n, first;
+  int64_t left;
+  ShmPipe *pipe = readBuf->ring->in;
+
+  tail = pipe->tail;
+  while( 1 ) {
+
+    head = __atomic_load_n( &pipe->head, __ATOMIC_SEQ_CST );
+    if( head != tail ) {
+
+      break;
+    }
+    if( __atomic_load_n( &pipe->closed, __ATOMIC_SEQ_CST ) ) {
+
+      return 0;
+    }
+
+    left = -1;
+    if( deadlineMicros >= 0 ) {
+
+      left = deadlineMicros - monotonicMicros();
+      if( left <= 0 ) {
+
+	return -1;
+      }
+    }
+    if( shmWait( readBuf, &pipe->head, tail,
+		 &pipe->dataSeq, &pipe->dataWaiters, left ) < 0 ) {
+
+      return 0;
+    }
+  }
+
+  /* copy out as much as we can, in at most two pieces */
+  n = head - tail;
+  if( n > maxLen ) {
+
+    n = maxLen;
+  }
+  pos = tail & ( SHM_RING_BYTES - 1 );
+  first = SHM_RING_BYTES - pos;
+  if( first > n ) {
+
+    first = n;
+  }
+  memcpy( buf, &pipe->data[ pos ], first );
+  memcpy( &buf[ first ], pipe->data, n - first );
+
+  __atomic_store_n( &pipe->tail, tail + n, __ATOMIC_SEQ_CST );
+  shmSignal( &pipe->spaceSeq, &pipe->spaceWaiters );
+
+  return n;
+}
+
+/* returns len on success, -1 if the other side has gone away */
+static ssize_t shmWrite( ReadBuf *readBuf, const char *buf, size_t len )
+{
+  uint32_t head, tail, pos, n, first;
+  size_t done;
+  ShmPipe *pipe = readBuf->ring->out;
+
+  head = pipe->head;
+  done = 0;
+  while( done < len ) {
+
+    tail = __atomic_load_n( &pipe->tail, __ATOMIC_SEQ_CST );
+    n = SHM_RING_BYTES - ( head - tail );
+    if( n == 0 ) {
+      /* ring is full */
+
+      if( shmWait( readBuf, &pipe->tail, tail,
+		   &pipe->spaceSeq, &pipe->spaceWaiters, -1 ) < 0 ) {
+
+	return -1;
+      }
+      continue;
+    }
+
+    if( n > len - done ) {
+
+      n = len - done;
+    }
+    pos = head & ( SHM_RING_BYTES - 1 );
+    first = SHM_RING_BYTES - pos;
+    if( first > n ) {
+
+      first = n;
+    }
+    memcpy( &pipe->data[ pos ], &buf[ done ], first );
+    memcpy( pipe->data, &buf[ done + first ], n - first );
+
+    head += n;
+    done += n;
+    __atomic_store_n( &pipe->head, head, __ATOMIC_SEQ_CST );
+    shmSignal( &pipe->dataSeq, &pipe->dataWaiters );
+  }
+
+  return len;
+}
+
+static ShmRing *mapShmRing( int shmfd, const int isServer )
+{
+  ShmRing *ring;
+  void *seg;
+
+  seg = mmap( NULL, sizeof( ShmSegment ), PROT_READ | PROT_WRITE,
+	      MAP_SHARED, shmfd, 0 );
+  if( seg == MAP_FAILED ) {
+
+    return NULL;
+  }
+
+  ring = (ShmRing*)malloc( sizeof( ShmRing ) );
+  if( ring == NULL ) {
+
+    munmap( seg, sizeof( ShmSegment ) );
+    return NULL;
+  }
+  ring->seg = (ShmSegment*)seg;
+  ring->in = isServer ? &ring->seg->toServer : &ring->seg->toClient;
+  ring->out = isServer ? &ring->seg->toClient : &ring->seg->toServer;
+
+  return ring;
+}
+
+static void unmapShmRing( ShmRing *ring )
+{
+  munmap( ring->seg, sizeof( ShmSegment ) );
+  free( ring );
+}
+
+ReadBuf *connectToShm( char *hostname, uint16_t port )
+{
+  int sock, shmfd, len;
+  ReadBuf *readBuf;
+  ShmRing *ring;
+  static int count = 0;
+  char name[ 64 ], line[ READBUF_LEN ];
+
+  sock = connectTo( hostname, port );
+  if( sock < 0 ) {
+
+    return NULL;
+  }
+  readBuf = createReadBuf( sock );
+  if( readBuf == NULL ) {
+
+    close( sock );
+    return NULL;
+  }
+
+  /* create the rings - ftruncate fills them with zeros */
+  snprintf( name, sizeof( name ), "/acpc.%d.%d", (int)getpid(), count++ );
+  shmfd = shm_open( name, O_RDWR | O_CREAT | O_EXCL, 0600 );
+  if( shmfd < 0 ) {
+
+    fprintf( stderr, "ERROR: could not create shared memory %s\n", name );
+    destroyReadBuf( readBuf );
+    return NULL;
+  }
+  ring = NULL;
+  if( ftruncate( shmfd, sizeof( ShmSegment ) ) < 0
+      || ( ring = mapShmRing( shmfd, 0 ) ) == NULL ) {
+
+    fprintf( stderr, "ERROR: could not map shared memory %s\n", name );
+    close( shmfd );
+    shm_unlink( name );
+    destroyReadBuf( readBuf );
+    return NULL;
+  }
+  close( shmfd );
+  ring->seg->magic = SHM_RING_MAGIC;
+
+  /* ask the other side to switch, and wait for the acknowledgement
+     over the socket before using the rings */
+  len = snprintf( line, sizeof( line ), SHM_REQUEST"%s\n", name );
+  if( write( sock, line, len ) != len ) {
+
+    fprintf( stderr, "ERROR: could not send shared memory request\n" );
+    len = -1;
+  } else {
+
+    len = getLine( readBuf, sizeof( line ), line, SHM_REPLY_TIMEOUT_MICROS );
+  }
+  shm_unlink( name );
+  if( len <= 0 || strcmp( line, SHM_REPLY ) ) {
+
+    fprintf( stderr, "ERROR: shared memory transport refused\n" );
+    unmapShmRing( ring );
+    destroyReadBuf( readBuf );
+    return NULL;
+  }
+
+  readBuf->ring = ring;
+  return readBuf;
+}
+
+int acceptShmRequest( ReadBuf *readBuf, const char *line )
+{
+  int shmfd, len;
+  char name[ READBUF_LEN ];
+
+  if( strncmp( line, SHM_REQUEST, strlen( SHM_REQUEST ) ) ) {
+
+    return 0;
+  }
+  if( readBuf->ring != NULL
+      || sscanf( &line[ strlen( SHM_REQUEST ) ], "%s", name ) < 1 ) {
+
+    return -1;
+  }
+
+  shmfd = shm_open( name, O_RDWR, 0 );
+  if( shmfd < 0 ) {
+
+    fprintf( stderr, "ERROR: could not open shared memory %s\n", name );
+    return -1;
+  }
+  readBuf->ring = mapShmRing( shmfd, 1 );
+  close( shmfd );
+  if( readBuf->ring == NULL ) {
+
+    fprintf( stderr, "ERROR: could not map shared memory %s\n", name );
+    return -1;
+  }
+  if( readBuf->ring->seg->magic != SHM_RING_MAGIC ) {
+
+    fprintf( stderr, "ERROR: bad shared memory segment %s\n", name );
+    unmapShmRing( readBuf->ring );
+    readBuf->ring = NULL;
+    return -1;
+  }
+
+  len = strlen( SHM_REPLY );
+  if( write( readBuf->fd, SHM_REPLY, len ) != len ) {
+
+    return -1;
+  }
+
+  return 1;
+}
+
+
 ReadBuf *createReadBuf( int fd )
 {
   ReadBuf *readBuf = (ReadBuf*)malloc( sizeof( ReadBuf ) );
@@ -23,31 +411,143 @@ ReadBuf *createReadBuf( int fd )
   readBuf->fd = fd;
   readBuf->bufStart = 0;
   readBuf->bufEnd = 0;
+  readBuf->viewEnd = -1;
+  readBuf->ring = NULL;
 
   return readBuf;
 }
 
 void destroyReadBuf( ReadBuf *readBuf )
 {
+  if( readBuf->ring != NULL ) {
+    /* let the other side know we're done */
+    ShmPipe *out = readBuf->ring->out;
+
+    __atomic_store_n( &out->closed, 1, __ATOMIC_SEQ_CST );
+    shmSignal( &out->dataSeq, &out->dataWaiters );
+    unmapShmRing( readBuf->ring );
+  }
   close( readBuf->fd );
   free( readBuf );
 }
 
-/* get a newline terminated line and place it as a string in 'line'
-   terminates the string with a 0 character
-   if timeoutMicros is non-negative, do not spend more than
-   that number of microseconds waiting to read data
-   return number of characters read (including newline, excluding 0)
-   0 on end of file, or -1 on error or timeout */
+ssize_t putLine( ReadBuf *readBuf, const char *line, size_t len )
+{
+  if( readBuf->ring != NULL ) {
+
+    return shmWrite( readBuf, line, len );
+  }
+
+  if( write( readBuf->fd, line, len ) != len ) {
+
+    return -1;
+  }
+  return len;
+}
+
+/* put back the character that getLineView replaced with a 0 */
+static void restoreLineView( ReadBuf *readBuf )
+{
+  if( readBuf->viewEnd >= 0 ) {
+
+    readBuf->buf[ readBuf->viewEnd ] = readBuf->viewSaved;
+    readBuf->viewEnd = -1;
+  }
+}
+
+int waitReadable( int fd, int64_t deadlineMicros )
+{
+  int r;
+  int64_t left;
+  struct pollfd pfd;
+
+  if( deadlineMicros < 0 ) {
+
+    return 0;
+  }
+
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  while( 1 ) {
+
+    /* round up, so we never wake up before the deadline */
+    left = deadlineMicros - monotonicMicros();
+    if( left < 0 ) {
+
+      left = 0;
+    }
+    left = ( left + 999 ) / 1000;
+    if( left > INT_MAX ) {
+
+      left = INT_MAX;
+    }
+
+    r = poll( &pfd, 1, (int)left );
+    if( r > 0 ) {
+
+      return 0;
+    }
+    if( r == 0 ) {
+      /* poll may have been cut short by a very long deadline */
+
+      if( monotonicMicros() >= deadlineMicros ) {
+
+	return -1;
+      }
+    } else if( errno != EINTR ) {
+
+      return -1;
+    }
+  }
+}
+
+/* read more data into the free space at the end of readBuf's buffer
+   if deadlineMicros is non-negative, give up waiting for data when
+   monotonicMicros() reaches it
+   returns number of bytes read, 0 on end of file, or -1 on error or timeout */
+static ssize_t fillReadBuf( ReadBuf *readBuf, int64_t deadlineMicros )
+{
+  ssize_t r;
+
+  /* try reading as much data as will fit */
+  if( readBuf->ring != NULL ) {
+
+    r = shmRead( readBuf, &readBuf->buf[ readBuf->bufEnd ],
+		 READBUF_LEN - readBuf->bufEnd, deadlineMicros );
+  } else {
+
+    if( waitReadable( readBuf->fd, deadlineMicros ) < 0 ) {
+      /* no input ready within time, or an actual error */
+
+      return -1;
+    }
+
+    r = read( readBuf->fd, &readBuf->buf[ readBuf->bufEnd ],
+	      READBUF_LEN - readBuf->bufEnd );
+  }
+  if( r > 0 ) {
+
+    readBuf->bufEnd += r;
+  }
+  return r < 0 ? -1 : r;
+}
+
 ssize_t getLine( ReadBuf *readBuf,
 		 size_t maxLen,
 		 char *line,
 		 int64_t timeoutMicros )
 {
-  int haveStartTime, c;
-  ssize_t len;
-  fd_set fds;
-  struct timeval start, tv;
+  return getLineDeadline( readBuf, maxLen, line, timeoutMicros < 0 ? -1
+			  : monotonicMicros() + timeoutMicros );
+}
+
+ssize_t getLineDeadline( ReadBuf *readBuf,
+			 size_t maxLen,
+			 char *line,
+			 int64_t deadlineMicros )
+{
+  int c;
+  ssize_t len, r;
 
   /* reserve space for string terminator */
   --maxLen;
@@ -55,57 +555,25 @@ ssize_t getLine( ReadBuf *readBuf,
     return -1;
   }
 
+  restoreLineView( readBuf );
+
   /* read the line */
-  haveStartTime = 0;
   len = 0;
   while( len < maxLen ) {
 
     if( readBuf->bufStart >= readBuf->bufEnd ) {
       /* buffer is empty */
 
-      if( timeoutMicros >= 0 ) {
-	/* figure out how much time is left for reading */
-	uint64_t timeLeft;
-
-	timeLeft = timeoutMicros;
-	if( haveStartTime ) {
-
-	  gettimeofday( &tv, NULL );
-	  timeLeft -= (uint64_t)( tv.tv_sec - start.tv_sec ) * 1000000
-	    + ( tv.tv_usec - start.tv_usec );
-	  if( timeLeft < 0 ) {
-
-	    timeLeft = 0;
-	  }
-	} else {
-
-	  haveStartTime = 1;
-	  gettimeofday( &start, NULL );
-	}
-	tv.tv_sec = timeLeft / 1000000;
-	tv.tv_usec = timeLeft % 1000000;
-
-	/* wait for file descriptor to be ready */
-	FD_ZERO( &fds );
-	FD_SET( readBuf->fd, &fds );
-	if( select( readBuf->fd + 1, &fds, NULL, NULL, &tv ) < 1 ) {
-	  /* no input ready within time, or an actual error */
-	
-	  return -1;
-	}
-      }
-
-      /* try reading a buffer full of data */
       readBuf->bufStart = 0;
-      readBuf->bufEnd = read( readBuf->fd, readBuf->buf, READBUF_LEN );
-      if( readBuf->bufEnd == 0 ) {
+      readBuf->bufEnd = 0;
+      r = fillReadBuf( readBuf, deadlineMicros );
+      if( r == 0 ) {
 	/* end of input */
 
 	break;
-      } else if( readBuf->bufEnd < 0 ) {
+      } else if( r < 0 ) {
 	/* error condition */
 
-	readBuf->bufEnd = 0;
 	return -1;
       }
     }
@@ -126,6 +594,252 @@ ssize_t getLine( ReadBuf *readBuf,
   return len;
 }
 
+ssize_t getLineView( ReadBuf *readBuf,
+		     char **line,
+		     int64_t timeoutMicros )
+{
+  return getLineViewDeadline( readBuf, line, timeoutMicros < 0 ? -1
+			      : monotonicMicros() + timeoutMicros );
+}
+
+ssize_t getLineViewDeadline( ReadBuf *readBuf,
+			     char **line,
+			     int64_t deadlineMicros )
+{
+  int scanned, end;
+  ssize_t r;
+  char *newline;
+
+  restoreLineView( readBuf );
+
+  scanned = readBuf->bufStart;
+  while( 1 ) {
+
+    /* only look at data we haven't already searched */
+    newline = (char *)memchr( &readBuf->buf[ scanned ], '\n',
+			      readBuf->bufEnd - scanned );
+    if( newline != NULL ) {
+
+      end = newline - readBuf->buf + 1;
+      break;
+    }
+    scanned = readBuf->bufEnd;
+
+    if( readBuf->bufEnd - readBuf->bufStart >= READBUF_LEN ) {
+      /* line doesn't fit in the buffer, so return the part that does */
+
+      end = readBuf->bufEnd;
+      break;
+    }
+
+    /* make room for more data, only moving the partial line if it
+       is up against the end of the buffer */
+    if( readBuf->bufStart == readBuf->bufEnd ) {
+
+      readBuf->bufStart = 0;
+      readBuf->bufEnd = 0;
+      scanned = 0;
+    } else if( readBuf->bufEnd == READBUF_LEN ) {
+
+      memmove( readBuf->buf, &readBuf->buf[ readBuf->bufStart ],
+	       readBuf->bufEnd - readBuf->bufStart );
+      readBuf->bufEnd -= readBuf->bufStart;
+      readBuf->bufStart = 0;
+      scanned = readBuf->bufEnd;
+    }
+
+    r = fillReadBuf( readBuf, deadlineMicros );
+    if( r == 0 ) {
+      /* end of input, so return any partial line */
+
+      if( readBuf->bufStart == readBuf->bufEnd ) {
+
+	return 0;
+      }
+      end = readBuf->bufEnd;
+      break;
+    } else if( r < 0 ) {
+      /* error condition - leave any partial line for the next call */
+
+      return -1;
+    }
+  }
+
+  /* terminate the line in place, remembering the character we replaced */
+  readBuf->viewEnd = end;
+  readBuf->viewSaved = readBuf->buf[ end ];
+  readBuf->buf[ end ] = 0;
+
+  *line = &readBuf->buf[ readBuf->bufStart ];
+  r = end - readBuf->bufStart;
+  readBuf->bufStart = end;
+  return r;
+}
+
+ssize_t bufferBytes( ReadBuf *readBuf, size_t len )
+{
+  ssize_t r;
+
+  restoreLineView( readBuf );
+
+  while( readBuf->bufEnd - readBuf->bufStart < len ) {
+
+    /* make room for the rest after the unread bytes */
+    if( readBuf->bufStart + len > READBUF_LEN ) {
+
+      memmove( readBuf->buf, &readBuf->buf[ readBuf->bufStart ],
+	       readBuf->bufEnd - readBuf->bufStart );
+      readBuf->bufEnd -= readBuf->bufStart;
+      readBuf->bufStart = 0;
+    }
+
+    if( readBuf->ring != NULL ) {
+
+      r = shmRead( readBuf, &readBuf->buf[ readBuf->bufEnd ],
+		   READBUF_LEN - readBuf->bufEnd, monotonicMicros() );
+      if( r < 0 ) {
+	/* nothing in the ring yet */
+
+	break;
+      }
+    } else {
+
+      if( waitReadable( readBuf->fd, monotonicMicros() ) < 0 ) {
+	/* nothing ready yet */
+
+	break;
+      }
+      r = read( readBuf->fd, &readBuf->buf[ readBuf->bufEnd ],
+		READBUF_LEN - readBuf->bufEnd );
+      if( r < 0 ) {
+
+	return -1;
+      }
+    }
+    if( r == 0 ) {
+      /* end of input */
+
+      return readBuf->bufEnd > readBuf->bufStart ? -1 : BUFFER_EOF;
+    }
+    readBuf->bufEnd += r;
+  }
+
+  return readBuf->bufEnd - readBuf->bufStart;
+}
+
+ssize_t getBytesDeadline( ReadBuf *readBuf,
+			  size_t len,
+			  void *bytes,
+			  int64_t deadlineMicros )
+{
+  size_t done, n;
+  ssize_t r;
+
+  restoreLineView( readBuf );
+
+  done = 0;
+  while( done < len ) {
+
+    if( readBuf->bufStart >= readBuf->bufEnd ) {
+      /* buffer is empty */
+
+      readBuf->bufStart = 0;
+      readBuf->bufEnd = 0;
+      r = fillReadBuf( readBuf, deadlineMicros );
+      if( r == 0 ) {
+	/* end of input */
+
+	return done ? -1 : 0;
+      } else if( r < 0 ) {
+	/* error condition */
+
+	return -1;
+      }
+    }
+
+    n = readBuf->bufEnd - readBuf->bufStart;
+    if( n > len - done ) {
+
+      n = len - done;
+    }
+    memcpy( (char *)bytes + done, &readBuf->buf[ readBuf->bufStart ], n );
+    readBuf->bufStart += n;
+    done += n;
+  }
+
+  return len;
+}
+
+
+int isUnixEndpoint( const char *endpoint )
+{
+  return endpoint[ 0 ] == '@'
+    || !strncmp( endpoint, UNIX_ENDPOINT_PREFIX,
+		 strlen( UNIX_ENDPOINT_PREFIX ) );
+}
+
+/* fill in addr for a Unix domain endpoint
+   returns the length of the address, or 0 if endpoint is bad */
+static socklen_t makeUnixAddress( const char *endpoint,
+				  struct sockaddr_un *addr )
+{
+  size_t len;
+  const char *name;
+
+  memset( addr, 0, sizeof( *addr ) );
+  addr->sun_family = AF_UNIX;
+
+  if( endpoint[ 0 ] == '@' ) {
+    /* abstract names start with a 0 byte, and are not 0 terminated */
+
+    name = &endpoint[ 1 ];
+    len = strlen( name );
+    if( len == 0 || len + 1 > sizeof( addr->sun_path ) ) {
+
+      return 0;
+    }
+    memcpy( &addr->sun_path[ 1 ], name, len );
+    return offsetof( struct sockaddr_un, sun_path ) + 1 + len;
+  }
+
+  name = &endpoint[ strlen( UNIX_ENDPOINT_PREFIX ) ];
+  len = strlen( name );
+  if( len == 0 || len + 1 > sizeof( addr->sun_path ) ) {
+
+    return 0;
+  }
+  memcpy( addr->sun_path, name, len + 1 );
+  return offsetof( struct sockaddr_un, sun_path ) + len + 1;
+}
+
+static int connectToUnix( const char *endpoint )
+{
+  int sock;
+  socklen_t addrLen;
+  struct sockaddr_un addr;
+
+  addrLen = makeUnixAddress( endpoint, &addr );
+  if( addrLen == 0 ) {
+
+    fprintf( stderr, "ERROR: bad socket name %s\n", endpoint );
+    return -1;
+  }
+
+  if( ( sock = socket( AF_UNIX, SOCK_STREAM, 0 ) ) < 0 ) {
+
+    fprintf( stderr, "ERROR: could not open socket\n" );
+    return -1;
+  }
+
+  if( connect( sock, (struct sockaddr *)&addr, addrLen ) < 0 ) {
+
+    fprintf( stderr, "ERROR: could not connect to %s\n", endpoint );
+    close( sock );
+    return -1;
+  }
+
+  return sock;
+}
 
 int connectTo( char *hostname, uint16_t port )
 {
@@ -133,6 +847,11 @@ int connectTo( char *hostname, uint16_t port )
   struct hostent *hostent;
   struct sockaddr_in addr;
 
+  if( isUnixEndpoint( hostname ) ) {
+
+    return connectToUnix( hostname );
+  }
+
   hostent = gethostbyname( hostname );
   if( hostent == NULL ) {
 
@@ -216,3 +935,74 @@ int getListenSocket( uint16_t *desiredPort )
 
   return sock;
 }
+
+int getUnixListenSocket( const char *endpoint )
+{
+  int sock;
+  socklen_t addrLen;
+  struct sockaddr_un addr;
+  struct stat st;
+
+  addrLen = makeUnixAddress( endpoint, &addr );
+  if( addrLen == 0 ) {
+
+    return -1;
+  }
+
+  if( ( sock = socket( AF_UNIX, SOCK_STREAM, 0 ) ) < 0 ) {
+
+    return -1;
+  }
+
+  /* a socket file left behind by an earlier run would stop us binding,
+     but only remove it if nothing is listening on it any more */
+  if( addr.sun_path[ 0 ] != 0 && lstat( addr.sun_path, &st ) == 0 ) {
+
+    if( !S_ISSOCK( st.st_mode ) ) {
+
+      fprintf( stderr, "ERROR: %s is not a socket\n", addr.sun_path );
+      close( sock );
+      return -1;
+    }
+    if( connect( sock, (struct sockaddr *)&addr, addrLen ) == 0 ) {
+
+      fprintf( stderr, "ERROR: something is already listening on %s\n",
+	       addr.sun_path );
+      close( sock );
+      return -1;
+    }
+    if( errno != ECONNREFUSED ) {
+
+      fprintf( stderr, "ERROR: could not check %s: %s\n",
+	       addr.sun_path, strerror( errno ) );
+      close( sock );
+      return -1;
+    }
+    unlink( addr.sun_path );
+
+    /* the failed connect leaves the socket unusable for bind */
+    close( sock );
+    if( ( sock = socket( AF_UNIX, SOCK_STREAM, 0 ) ) < 0 ) {
+
+      return -1;
+    }
+  }
+
+  if( bind( sock, (struct sockaddr *)&addr, addrLen ) < 0
+      || listen( sock, 8 ) < 0 ) {
+
+    close( sock );
+    return -1;
+  }
+
+  return sock;
+}
+
+void removeUnixEndpoint( const char *endpoint )
+{
+  if( !strncmp( endpoint, UNIX_ENDPOINT_PREFIX,
+		strlen( UNIX_ENDPOINT_PREFIX ) ) ) {
+
+    unlink( &endpoint[ strlen( UNIX_ENDPOINT_PREFIX ) ] );
+  }
+}
@@ -13,23 +13,57 @@ Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
 
 
 #define READBUF_LEN 4096
+#define BUFFER_EOF -2 /* from bufferBytes */
 #define NUM_PORT_CREATION_ATTEMPTS 10
 
+/* Unix domain sockets are named by endpoints of the form
+   unix:/path/to/socket - a socket in the file system
+   @name - a socket in the (Linux only) abstract namespace, which
+   needs no file, and goes away with the process that made it */
+#define UNIX_ENDPOINT_PREFIX "unix:"
+
+
+/* shared memory transport between a dealer and a bot on the same host
+   see connectToShm and acceptShmRequest */
+typedef struct ShmRing_struct ShmRing;
 
 /* buffered I/O on file descriptors
 
    Yes... this is basically re-implementing bits of a standard FILE.
    Unfortunately, trying to mix timeouts and FILE streams either
-   a) doesn't work, or b) is fairly system specific */
+   a) doesn't work, or b) is fairly system specific
+
+   if ring is not NULL, data is read from and written to the shared
+   memory rings instead of fd, and fd is only used to notice when the
+   other side goes away */
 typedef struct {
   int fd;
   int bufStart;
   int bufEnd;
-  char buf[ READBUF_LEN ];
+  int viewEnd; /* where getLineView put a 0, or -1 */
+  char viewSaved; /* character that was at viewEnd */
+  ShmRing *ring;
+  char buf[ READBUF_LEN + 1 ]; /* room to terminate a full buffer */
 } ReadBuf;
 
 
+/* current time in microseconds from some fixed point, which is not
+   affected by changes to the system clock
+   all deadlines are in these units */
+int64_t monotonicMicros();
+
+/* wait until fd is readable, or monotonicMicros() reaches
+   deadlineMicros, unless deadlineMicros is negative
+   uses poll, so works for any file descriptor
+   returns 0 if fd is readable (or there is no deadline),
+   -1 on timeout or error */
+int waitReadable( int fd, int64_t deadlineMicros );
+
+/* returns non-zero if endpoint names a Unix domain socket */
+int isUnixEndpoint( const char *endpoint );
+
 /* open a socket to hostname/port
+   if hostname is a Unix domain endpoint, connect to it and ignore port
    returns file descriptor on success, <0 on failure */
 int connectTo( char *hostname, uint16_t port );
 
@@ -39,6 +73,29 @@ int connectTo( char *hostname, uint16_t port );
    returns file descriptor for socket, or -1 on failure */
 int getListenSocket( uint16_t *desiredPort );
 
+/* open a Unix domain socket for endpoint to listen on, replacing any
+   stale socket file already there, but failing if something is still
+   listening on it
+   returns file descriptor for socket, or -1 on failure */
+int getUnixListenSocket( const char *endpoint );
+
+/* remove the file for a unix: endpoint, once nothing else needs to
+   connect to it.  Does nothing for other endpoints */
+void removeUnixEndpoint( const char *endpoint );
+
+/* connect to hostname/port like connectTo, then ask the other side to
+   switch to a pair of shared memory rings for the rest of the
+   connection.  Only useful when both sides are on the same host, and
+   the other side must call acceptShmRequest on the first line it reads
+   returns a read buffer on success, or NULL on failure */
+ReadBuf *connectToShm( char *hostname, uint16_t port );
+
+/* check if line (the first line read from readBuf) is a request from
+   connectToShm, and if so, switch readBuf to the shared memory rings
+   returns 1 if readBuf was switched, 0 if line was not a request,
+   or -1 on failure */
+int acceptShmRequest( ReadBuf *readBuf, const char *line );
+
 
 /* create a read buffer structure
    returns 0 on failure */
@@ -58,5 +115,56 @@ ssize_t getLine( ReadBuf *readBuf,
 		 char *line,
 		 int64_t timeoutMicros );
 
+/* getLine, but giving up when monotonicMicros() reaches deadlineMicros
+   instead of after a timeout, unless deadlineMicros is negative
+   a deadline can be shared by several calls without recomputing it */
+ssize_t getLineDeadline( ReadBuf *readBuf,
+			 size_t maxLen,
+			 char *line,
+			 int64_t deadlineMicros );
+
+/* get a newline terminated line without copying it out of readBuf
+   sets *line to point to the line in readBuf's buffer, terminated by a
+   0 character.  The line is only valid until the next call on readBuf.
+   Lines longer than READBUF_LEN are returned in READBUF_LEN pieces
+   if timeoutMicros is non-negative, do not spend more than
+   that number of microseconds waiting to read data, and on a timeout,
+   any partial line is kept for the next call
+   return number of characters in the line (including newline, excluding 0)
+   0 on end of file, or -1 on error or timeout */
+ssize_t getLineView( ReadBuf *readBuf,
+		     char **line,
+		     int64_t timeoutMicros );
+
+/* getLineView with a deadline, as for getLineDeadline */
+ssize_t getLineViewDeadline( ReadBuf *readBuf,
+			     char **line,
+			     int64_t deadlineMicros );
+
+/* read exactly len bytes into bytes, for binary messages
+   gives up when monotonicMicros() reaches deadlineMicros, unless
+   deadlineMicros is negative, and on a timeout any bytes already
+   read are lost
+   return len, 0 on end of file before any bytes,
+   or -1 on error, timeout, or end of file part way through */
+ssize_t getBytesDeadline( ReadBuf *readBuf,
+			  size_t len,
+			  void *bytes,
+			  int64_t deadlineMicros );
+
+/* read whatever is ready, without waiting, until at least len unread
+   bytes are in readBuf's buffer, without taking any of them, so
+   callers waiting on many connections can leave a partial message
+   until the rest arrives
+   len must be at most READBUF_LEN
+   returns the number of unread bytes, which is less than len, and may
+   be 0, if the rest haven't arrived, BUFFER_EOF on end of file with
+   nothing unread, or -1 on error or end of file part way through */
+ssize_t bufferBytes( ReadBuf *readBuf, size_t len );
+
+/* write len bytes from line to the other side of readBuf's connection
+   returns len on success, or -1 on failure */
+ssize_t putLine( ReadBuf *readBuf, const char *line, size_t len );
+
 
 #endif
@@ -0,0 +1,449 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+/* round trip latency benchmark for the dealer/player transports
+
+   the parent plays the part of the dealer, sending a typical state
+   message and waiting for the response, and a forked child plays the
+   part of a player, echoing every line straight back */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "net.h"
+#include "histogram.h"
+#include "game.h"
+#include "rng.h"
+#include "binary_protocol.h"
+
+
+#define DEFAULT_ROUND_TRIPS 100000
+#define DEFAULT_HANDS 100000
+#define BENCH_MESSAGE "MATCHSTATE:0:30:cr/cc/r:9s8h|/Kd5c2h/3s\r\n"
+
+
+static void printUsage( FILE *file )
+{
+  fprintf( file, "usage: net_bench transport [#round trips]\n" );
+  fprintf( file, "       net_bench lines [#lines]\n" );
+  fprintf( file, "       net_bench protocol gameDefFile [#hands]\n" );
+  fprintf( file, "  transport is one of\n" );
+  fprintf( file, "    tcp - TCP over the loopback interface\n" );
+  fprintf( file, "    unix - abstract Unix domain socket\n" );
+  fprintf( file, "    shm - shared memory rings, negotiated over TCP\n" );
+  fprintf( file, "  lines compares reading lines with getLine and getLineView\n" );
+  fprintf( file, "  protocol compares the cost of the text and binary protocols\n" );
+}
+
+static uint64_t nowNanos()
+{
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* child side: connect and echo lines until the connection closes */
+static void runEchoPlayer( const char *transport, uint16_t port,
+			   char *endpoint )
+{
+  ssize_t len;
+  ReadBuf *readBuf;
+  char line[ READBUF_LEN ];
+
+  if( !strcmp( transport, "shm" ) ) {
+
+    readBuf = connectToShm( "localhost", port );
+  } else {
+    int sock, v;
+
+    sock = connectTo( endpoint != NULL ? endpoint : "localhost", port );
+    if( sock < 0 ) {
+
+      exit( EXIT_FAILURE );
+    }
+    v = 1;
+    setsockopt( sock, IPPROTO_TCP, TCP_NODELAY, (char *)&v, sizeof( int ) );
+    readBuf = createReadBuf( sock );
+  }
+  if( readBuf == NULL ) {
+
+    exit( EXIT_FAILURE );
+  }
+
+  while( ( len = getLine( readBuf, READBUF_LEN, line, -1 ) ) > 0 ) {
+
+    if( putLine( readBuf, line, len ) != len ) {
+
+      break;
+    }
+  }
+
+  destroyReadBuf( readBuf );
+  exit( EXIT_SUCCESS );
+}
+
+/* returns a connected read buffer for the parent side, exits on failure */
+static ReadBuf *startEchoPlayer( const char *transport, pid_t *childPID )
+{
+  int listenSocket, sock, v;
+  uint16_t port;
+  ReadBuf *readBuf;
+  char *endpoint;
+  char line[ READBUF_LEN ], name[ 64 ];
+
+  port = 0;
+  endpoint = NULL;
+  if( !strcmp( transport, "unix" ) ) {
+
+    snprintf( name, sizeof( name ), "@net_bench.%d", (int)getpid() );
+    endpoint = name;
+    listenSocket = getUnixListenSocket( endpoint );
+  } else {
+
+    listenSocket = getListenSocket( &port );
+  }
+  if( listenSocket < 0 ) {
+
+    fprintf( stderr, "ERROR: could not create listen socket\n" );
+    exit( EXIT_FAILURE );
+  }
+
+  *childPID = fork();
+  if( *childPID < 0 ) {
+
+    fprintf( stderr, "ERROR: fork() failed\n" );
+    exit( EXIT_FAILURE );
+  }
+  if( *childPID == 0 ) {
+
+    close( listenSocket );
+    runEchoPlayer( transport, port, endpoint );
+  }
+
+  sock = accept( listenSocket, NULL, NULL );
+  if( sock < 0 ) {
+
+    fprintf( stderr, "ERROR: player could not connect\n" );
+    exit( EXIT_FAILURE );
+  }
+  close( listenSocket );
+  v = 1;
+  setsockopt( sock, IPPROTO_TCP, TCP_NODELAY, (char *)&v, sizeof( int ) );
+  readBuf = createReadBuf( sock );
+
+  if( !strcmp( transport, "shm" ) ) {
+
+    if( getLine( readBuf, READBUF_LEN, line, -1 ) <= 0
+	|| acceptShmRequest( readBuf, line ) <= 0 ) {
+
+      fprintf( stderr, "ERROR: could not set up shared memory transport\n" );
+      exit( EXIT_FAILURE );
+    }
+  }
+
+  return readBuf;
+}
+
+static void benchRoundTrips( const char *transport, const int numTrips )
+{
+  int i, len;
+  pid_t childPID;
+  uint64_t start, end;
+  ReadBuf *readBuf;
+  Histogram hist;
+  char line[ READBUF_LEN ];
+
+  readBuf = startEchoPlayer( transport, &childPID );
+  initHistogram( &hist );
+  len = strlen( BENCH_MESSAGE );
+
+  for( i = 0; i < numTrips; ++i ) {
+
+    start = nowNanos();
+    if( putLine( readBuf, BENCH_MESSAGE, len ) != len
+	|| getLine( readBuf, READBUF_LEN, line, -1 ) != len ) {
+
+      fprintf( stderr, "ERROR: round trip %d failed\n", i );
+      exit( EXIT_FAILURE );
+    }
+    end = nowNanos();
+    histogramRecord( &hist, end - start );
+  }
+
+  destroyReadBuf( readBuf );
+  waitpid( childPID, NULL, 0 );
+
+  printf( "%s: %d round trips, mean %.2f us, p50 %.2f us, p99 %.2f us, "
+	  "max %.2f us\n",
+	  transport, numTrips,
+	  (double)hist.sum / hist.count / 1000.0,
+	  histogramValueAtPercentile( &hist, 50.0 ) / 1000.0,
+	  histogramValueAtPercentile( &hist, 99.0 ) / 1000.0,
+	  hist.max / 1000.0 );
+}
+
+/* time reading numLines lines from a file with getLine, copying each
+   line out as the callers used to, and with getLineView */
+static void benchLineReaders( const int numLines )
+{
+  int fd, i, pass;
+  ssize_t len;
+  uint64_t start, total;
+  ReadBuf *readBuf;
+  FILE *file;
+  char *view;
+  char fileName[] = "/tmp/net_bench.XXXXXX";
+  char line[ READBUF_LEN ];
+
+  /* write out lines of different lengths, like a dealer's responses */
+  fd = mkstemp( fileName );
+  if( fd < 0 || ( file = fdopen( fd, "w" ) ) == NULL ) {
+
+    fprintf( stderr, "ERROR: could not create temporary file\n" );
+    exit( EXIT_FAILURE );
+  }
+  unlink( fileName );
+  for( i = 0; i < numLines; ++i ) {
+
+    fprintf( file, "MATCHSTATE:%d:%d:%.*s:9s8h|/Kd5c2h/3s:r%d\r\n",
+	     i & 1, i, 1 + i % 24, "cr/cc/r20000c/cr300r600c", i % 20000 );
+  }
+  fflush( file );
+
+  for( pass = 0; pass < 2; ++pass ) {
+
+    lseek( fd, 0, SEEK_SET );
+    readBuf = createReadBuf( dup( fd ) );
+    total = 0;
+    start = nowNanos();
+    if( pass == 0 ) {
+
+      while( ( len = getLine( readBuf, READBUF_LEN, line, -1 ) ) > 0 ) {
+
+	total += len + line[ 0 ];
+      }
+    } else {
+
+      while( ( len = getLineView( readBuf, &view, -1 ) ) > 0 ) {
+
+	total += len + view[ 0 ];
+      }
+    }
+    start = nowNanos() - start;
+    destroyReadBuf( readBuf );
+
+    printf( "%s: %d lines, %.2f ns/line (checksum %"PRIu64")\n",
+	    pass == 0 ? "getLine" : "getLineView", numLines,
+	    (double)start / numLines, total );
+  }
+
+  fclose( file );
+}
+
+/* pick a random valid action, weighted towards calling */
+static void randomAction( const Game *game, const State *state,
+			  rng_state_t *rng, Action *action )
+{
+  int32_t min, max;
+  uint32_t r;
+
+  r = genrand_int32( rng ) % 16;
+  action->size = 0;
+  action->type = a_fold;
+  if( r == 0 && isValidAction( game, state, 0, action ) ) {
+
+    return;
+  }
+  if( r < 6 && raiseIsValid( game, state, &min, &max ) ) {
+
+    action->type = a_raise;
+    if( game->bettingType == noLimitBetting ) {
+
+      action->size = min + genrand_int32( rng ) % ( max - min + 1 );
+    }
+    return;
+  }
+  action->type = a_call;
+}
+
+/* play numHands random hands, sending every state message and response
+   both as text and as binary frames, timing what the dealer and player
+   each have to do, and checking both protocols agree on every state */
+static void benchProtocols( const char *gameFile, const int numHands )
+{
+  int h, len, c;
+  uint8_t p;
+  uint64_t start, textNanos, binaryNanos, textBytes, binaryBytes, messages;
+  FILE *file;
+  Game *game;
+  rng_state_t rng;
+  State state;
+  Action action, textAction;
+  MatchState view, textState[ MAX_PLAYERS ], binaryState[ MAX_PLAYERS ];
+  uint8_t frame[ BINARY_MAX_FRAME_LEN ];
+  char line[ MAX_LINE_LEN ], check[ MAX_LINE_LEN ];
+
+  file = fopen( gameFile, "r" );
+  if( file == NULL || ( game = readGame( file ) ) == NULL ) {
+
+    fprintf( stderr, "ERROR: could not read game %s\n", gameFile );
+    exit( EXIT_FAILURE );
+  }
+  fclose( file );
+
+  init_genrand( &rng, 0 );
+  textNanos = 0;
+  binaryNanos = 0;
+  textBytes = 0;
+  binaryBytes = 0;
+  messages = 0;
+  for( h = 0; h < numHands; ++h ) {
+
+    initState( game, h, &state );
+    dealCards( game, &rng, &state );
+
+    while( 1 ) {
+
+      /* dealer sends the state to each player, who reads it */
+      view.state = state;
+      for( p = 0; p < game->numPlayers; ++p ) {
+
+	view.viewingPlayer = p;
+
+	start = nowNanos();
+	len = printMatchState( game, &view, MAX_LINE_LEN - 2, line );
+	line[ len ] = '\r';
+	line[ len + 1 ] = '\n';
+	line[ len + 2 ] = 0;
+	readMatchState( line, game, &textState[ p ] );
+	textNanos += nowNanos() - start;
+	textBytes += len + 2;
+
+	start = nowNanos();
+	c = makeStateFrame( game, &view, frame );
+	if( applyStateFrame( game, frame, c, &binaryState[ p ] ) < 0 ) {
+
+	  fprintf( stderr, "ERROR: could not apply frame in hand %d\n", h );
+	  exit( EXIT_FAILURE );
+	}
+	binaryNanos += nowNanos() - start;
+	binaryBytes += c;
+	++messages;
+
+	printMatchState( game, &binaryState[ p ], MAX_LINE_LEN, check );
+	if( strncmp( line, check, len ) || check[ len ] ) {
+
+	  fprintf( stderr, "ERROR: binary state %s does not match %s",
+		   check, line );
+	  exit( EXIT_FAILURE );
+	}
+      }
+
+      if( stateFinished( &state ) ) {
+
+	break;
+      }
+
+      /* acting player responds, and dealer reads the response */
+      p = currentPlayer( game, &state );
+      randomAction( game, &state, &rng, &action );
+
+      start = nowNanos();
+      len = printMatchState( game, &textState[ p ], MAX_LINE_LEN - 32, line );
+      line[ len ] = ':';
+      ++len;
+      len += printAction( game, &action, MAX_LINE_LEN - len - 2, &line[ len ] );
+      line[ len ] = '\r';
+      line[ len + 1 ] = '\n';
+      line[ len + 2 ] = 0;
+      c = readMatchState( line, game, &view );
+      if( c < 0 || !matchStatesEqual( game, &view, &textState[ p ] )
+	  || readAction( &line[ c + 1 ], game, &textAction ) < 0 ) {
+
+	fprintf( stderr, "ERROR: bad text response %s", line );
+	exit( EXIT_FAILURE );
+      }
+      textNanos += nowNanos() - start;
+      textBytes += len + 2;
+
+      start = nowNanos();
+      c = makeResponseFrame( &binaryState[ p ], &action, frame );
+      view.state = state;
+      view.viewingPlayer = p;
+      if( readResponseFrame( game, frame, c, &view, &textAction ) <= 0 ) {
+
+	fprintf( stderr, "ERROR: bad binary response in hand %d\n", h );
+	exit( EXIT_FAILURE );
+      }
+      binaryNanos += nowNanos() - start;
+      binaryBytes += c;
+      ++messages;
+
+      doAction( game, &action, &state );
+    }
+  }
+
+  printf( "text: %"PRIu64" messages, %.1f ns/message, %.1f bytes/message\n",
+	  messages, (double)textNanos / messages,
+	  (double)textBytes / messages );
+  printf( "binary: %"PRIu64" messages, %.1f ns/message, %.1f bytes/message\n",
+	  messages, (double)binaryNanos / messages,
+	  (double)binaryBytes / messages );
+  free( game );
+}
+
+int main( int argc, char **argv )
+{
+  int numTrips;
+
+  if( argc < 2 ) {
+
+    printUsage( stderr );
+    exit( EXIT_FAILURE );
+  }
+
+  if( !strcmp( argv[ 1 ], "protocol" ) ) {
+
+    numTrips = DEFAULT_HANDS;
+    if( argc < 3 || ( argc > 3 && ( sscanf( argv[ 3 ], "%d", &numTrips ) < 1
+				    || numTrips <= 0 ) ) ) {
+
+      printUsage( stderr );
+      exit( EXIT_FAILURE );
+    }
+
+    benchProtocols( argv[ 2 ], numTrips );
+    return EXIT_SUCCESS;
+  }
+
+  numTrips = DEFAULT_ROUND_TRIPS;
+  if( argc > 2 && ( sscanf( argv[ 2 ], "%d", &numTrips ) < 1
+		    || numTrips <= 0 ) ) {
+
+    fprintf( stderr, "ERROR: invalid number of round trips %s\n", argv[ 2 ] );
+    exit( EXIT_FAILURE );
+  }
+
+  if( !strcmp( argv[ 1 ], "tcp" ) || !strcmp( argv[ 1 ], "unix" )
+      || !strcmp( argv[ 1 ], "shm" ) ) {
+
+    benchRoundTrips( argv[ 1 ], numTrips );
+  } else if( !strcmp( argv[ 1 ], "lines" ) ) {
+
+    benchLineReaders( numTrips );
+  } else {
+
+    printUsage( stderr );
+    exit( EXIT_FAILURE );
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -65,29 +65,44 @@ $_ = <STDOUTREADPIPE> or die "couldn't read port description from dealer";
 @_ = split;
 $#_ + 1 >= $numPlayers or die "couldn't get enough ports from $_";
 
-for( $p = 0; $p < $numPlayers; ++$p ) {
+# duplicate matches list the ports for each copy in turn, and each
+# player is started once per copy
+$numCopies = int( ( $#_ + 1 ) / $numPlayers );
 
-    $playerPID[ $p ] = fork();
+for( $i = 0; $i < $numCopies * $numPlayers; ++$i ) {
 
-    if( $playerPID[ $p ] == 0 ) {
+    # port 0 is a seat the dealer plays with an in-process plugin
+    $_[ $i ] ne '0' or next;
+
+    # Unix domain endpoints take the place of the host, with no port
+    ( $host, $port ) = $_[ $i ] =~ /^(unix:|@)/ ? ( $_[ $i ], 0 )
+	: ( $hostip, $_[ $i ] );
+
+    $p = $i % $numPlayers;
+    $c = int( $i / $numPlayers );
+    $logName = $numCopies > 1 ? "$ARGV[ 0 ].dup$c.player$p" : "$ARGV[ 0 ].player$p";
+
+    $playerPID[ $i ] = fork();
+
+    if( $playerPID[ $i ] == 0 ) {
 	# we're the child
 
 	# log standard out and standard error
-	open STDOUT, ">$ARGV[ 0 ].player$p.std"
+	open STDOUT, ">$logName.std"
 	    or die "can't dup player $p STDOUT";
-	open STDERR, ">$ARGV[ 0 ].player$p.err"
+	open STDERR, ">$logName.err"
 	    or die "can't dup player $p STDERR";
 
 	exec { $ARGV[ 4 + $p * 2 + 1 ] } ( $ARGV[ 4 + $p * 2 + 1 ],
-					   $hostip, $_[ $p ] )
+					   $host, $port )
 	    or die "couldn't run $ARGV[ 4 + $p * 2 + 1 ] for player $p";
     }
 }
 
 $_ = <STDOUTREADPIPE>;
 
-for( $p = 0; $p < $numPlayers; ++$p ) {
-    waitpid( $playerPID[ $p ], 0 );
+for( $i = 0; $i < $numCopies * $numPlayers; ++$i ) {
+    defined $playerPID[ $i ] and waitpid( $playerPID[ $i ], 0 );
 }
 
 waitpid( $dealerPID, 0 );
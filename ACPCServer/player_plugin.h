@@ -0,0 +1,53 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#ifndef _PLAYER_PLUGIN_H
+#define _PLAYER_PLUGIN_H
+
+#include "game.h"
+
+
+/* in-process players for the dealer
+
+   a plugin is a shared object which exports a PlayerPlugin structure
+   named by PLAYER_PLUGIN_SYMBOL.  The dealer loads it with dlopen and
+   calls it directly for the seats it is given, instead of sending
+   states and reading actions over a socket.
+
+   the dealer owns the Game and MatchState structures.  The Game given
+   to init stays valid until destroy is called, so a player may keep a
+   pointer to it, but a MatchState is only valid for the duration of
+   the call it is passed to */
+
+
+#define PLAYER_PLUGIN_ABI_VERSION 1
+#define PLAYER_PLUGIN_SYMBOL "acpcPlayerPlugin"
+
+
+typedef struct {
+  /* must be PLAYER_PLUGIN_ABI_VERSION */
+  uint32_t abiVersion;
+
+  /* create a player for (zero based) seat at the table
+     args is the optional argument string from the dealer command line,
+     or NULL if none was given
+     returns an opaque player pointer passed to the other functions,
+     or NULL on failure */
+  void *(*init)( const Game *game, const uint8_t seat, const char *args );
+
+  /* return the action to make in state, where it is
+     state->viewingPlayer's turn to act
+     invalid actions are treated as they are for network players */
+  Action (*act)( void *player, const MatchState *state );
+
+  /* observe the final state of a hand, as viewed by the player
+     may be NULL if the plugin doesn't need it */
+  void (*handOver)( void *player, const MatchState *state );
+
+  /* free the player at the end of the match
+     may be NULL */
+  void (*destroy)( void *player );
+} PlayerPlugin;
+
+#endif
@@ -0,0 +1,508 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include "result_cache.h"
+#include "match_log.h"
+
+
+#define CACHE_MAX_LOGS 16 /* enough for duplicate copies of any game */
+#define CACHE_PATH_LEN 4096
+#define CACHE_LINE_LEN 4096
+#define CACHE_SUFFIX_LEN 32
+#define COPY_BUF_LEN 65536
+
+typedef unsigned __int128 uint128_t;
+
+typedef struct {
+  char key[ CACHE_KEY_LEN + 1 ];
+  struct timespec used;
+  uint64_t bytes;
+} CacheEntry;
+
+
+/* FNV-1a, 128 bit version */
+static const uint128_t fnvPrime = ( (uint128_t)1 << 88 ) + ( 1 << 8 ) + 0x3b;
+static const uint128_t fnvOffset =
+  ( (uint128_t)0x6c62272e07bb0142ull << 64 ) + 0x62b821756295c58dull;
+
+static uint128_t fnvBytes( uint128_t hash, const unsigned char *bytes,
+			   const size_t len )
+{
+  size_t i;
+
+  for( i = 0; i < len; ++i ) {
+
+    hash = ( hash ^ bytes[ i ] ) * fnvPrime;
+  }
+  return hash;
+}
+
+/* hash the length of a file and then its contents
+   returns 0 on success, -1 on failure */
+static int fnvFile( uint128_t *hash, const char *fileName )
+{
+  int fd;
+  ssize_t r;
+  uint64_t len;
+  struct stat st;
+  unsigned char buf[ COPY_BUF_LEN ];
+
+  fd = open( fileName, O_RDONLY );
+  if( fd < 0 || fstat( fd, &st ) < 0 ) {
+
+    fprintf( stderr, "ERROR: could not read %s for cache key\n", fileName );
+    if( fd >= 0 ) {
+
+      close( fd );
+    }
+    return -1;
+  }
+  len = st.st_size;
+  *hash = fnvBytes( *hash, (unsigned char *)&len, sizeof( len ) );
+
+  while( ( r = read( fd, buf, COPY_BUF_LEN ) ) > 0 ) {
+
+    *hash = fnvBytes( *hash, buf, r );
+  }
+  close( fd );
+  return r < 0 ? -1 : 0;
+}
+
+/* copy a file, replacing dest
+   returns 0 on success, -1 on failure */
+static int copyFile( const char *src, const char *dest )
+{
+  int in, out;
+  ssize_t r, w, done;
+  char buf[ COPY_BUF_LEN ];
+
+  in = open( src, O_RDONLY );
+  if( in < 0 ) {
+
+    return -1;
+  }
+  out = open( dest, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+  if( out < 0 ) {
+
+    close( in );
+    return -1;
+  }
+
+  while( ( r = read( in, buf, COPY_BUF_LEN ) ) > 0 ) {
+
+    for( done = 0; done < r; done += w ) {
+
+      w = write( out, &buf[ done ], r - done );
+      if( w < 0 ) {
+
+	close( in );
+	close( out );
+	return -1;
+      }
+    }
+  }
+  close( in );
+  if( close( out ) < 0 || r < 0 ) {
+
+    return -1;
+  }
+  return 0;
+}
+
+static void entryPath( const ResultCache *cache, const char *key,
+		       const char *suffix, char path[ CACHE_PATH_LEN ] )
+{
+  snprintf( path, CACHE_PATH_LEN, "%s/%s%s", cache->dir, key, suffix );
+}
+
+static int compareKeys( const void *a, const void *b )
+{
+  return strncmp( ( (const CacheEntry *)a )->key,
+		  ( (const CacheEntry *)b )->key, CACHE_KEY_LEN );
+}
+
+static int compareUsed( const void *a, const void *b )
+{
+  const CacheEntry *x = a, *y = b;
+
+  if( x->used.tv_sec != y->used.tv_sec ) {
+
+    return x->used.tv_sec < y->used.tv_sec ? -1 : 1;
+  }
+  if( x->used.tv_nsec != y->used.tv_nsec ) {
+
+    return x->used.tv_nsec < y->used.tv_nsec ? -1 : 1;
+  }
+  return 0;
+}
+
+/* list every entry in the cache, with the bytes used by the entry and
+   its logs, sorted by key
+   returns the number of entries, or -1 on failure */
+static int scanCache( const ResultCache *cache, CacheEntry **entries,
+		      uint64_t *totalBytes )
+{
+  int num, size, pass;
+  DIR *dir;
+  struct dirent *ent;
+  struct stat st;
+  CacheEntry *entry, probe;
+  char path[ CACHE_PATH_LEN ];
+
+  num = 0;
+  size = 0;
+  *entries = NULL;
+  *totalBytes = 0;
+
+  /* first the entries themselves, then the logs which belong to them */
+  for( pass = 0; pass < 2; ++pass ) {
+
+    dir = opendir( cache->dir );
+    if( dir == NULL ) {
+
+      fprintf( stderr, "ERROR: could not read cache %s\n", cache->dir );
+      free( *entries );
+      return -1;
+    }
+
+    while( ( ent = readdir( dir ) ) != NULL ) {
+
+      /* names start with a key, and only entries are just the key */
+      if( strspn( ent->d_name, "0123456789abcdef" ) < CACHE_KEY_LEN
+	  || ( pass == 0 ) != ( ent->d_name[ CACHE_KEY_LEN ] == 0 ) ) {
+	continue;
+      }
+      snprintf( path, CACHE_PATH_LEN, "%s/%s", cache->dir, ent->d_name );
+      if( stat( path, &st ) < 0 ) {
+	continue;
+      }
+
+      if( pass == 0 ) {
+
+	if( num == size ) {
+
+	  size = size ? size * 2 : 64;
+	  *entries = realloc( *entries, sizeof( CacheEntry ) * size );
+	  if( *entries == NULL ) {
+
+	    fprintf( stderr, "ERROR: could not allocate cache entries\n" );
+	    exit( EXIT_FAILURE );
+	  }
+	}
+	memcpy( ( *entries )[ num ].key, ent->d_name, CACHE_KEY_LEN + 1 );
+	( *entries )[ num ].used = st.st_mtim;
+	( *entries )[ num ].bytes = st.st_size;
+	*totalBytes += st.st_size;
+	++num;
+	continue;
+      }
+
+      /* logs left without an entry by an interrupted store are ignored */
+      memcpy( probe.key, ent->d_name, CACHE_KEY_LEN );
+      entry = num ? bsearch( &probe, *entries, num, sizeof( CacheEntry ),
+			     compareKeys ) : NULL;
+      if( entry != NULL ) {
+
+	entry->bytes += st.st_size;
+	*totalBytes += st.st_size;
+      }
+    }
+    closedir( dir );
+
+    if( pass == 0 && num ) {
+
+      qsort( *entries, num, sizeof( CacheEntry ), compareKeys );
+    }
+  }
+
+  return num;
+}
+
+/* read an entry's SCORE line and log suffixes
+   returns the number of logs, or -1 on failure */
+static int readEntry( const ResultCache *cache, const char *key,
+		      char *score, const size_t scoreLen,
+		      char suffixes[ CACHE_MAX_LOGS ][ CACHE_SUFFIX_LEN ] )
+{
+  int num;
+  FILE *file;
+  char path[ CACHE_PATH_LEN ], line[ CACHE_LINE_LEN ];
+
+  entryPath( cache, key, "", path );
+  file = fopen( path, "r" );
+  if( file == NULL ) {
+
+    return -1;
+  }
+  if( fgets( line, CACHE_LINE_LEN, file ) == NULL
+      || strncmp( line, "SCORE", 5 ) ) {
+
+    fclose( file );
+    return -1;
+  }
+  line[ strcspn( line, "\r\n" ) ] = 0;
+  if( score != NULL ) {
+
+    snprintf( score, scoreLen, "%s", line );
+  }
+
+  num = 0;
+  while( num < CACHE_MAX_LOGS && fgets( suffixes[ num ], CACHE_SUFFIX_LEN,
+					file ) ) {
+
+    suffixes[ num ][ strcspn( suffixes[ num ], "\r\n" ) ] = 0;
+    ++num;
+  }
+  fclose( file );
+  return num;
+}
+
+static void removeEntry( const ResultCache *cache, const char *key )
+{
+  int i, num;
+  char path[ CACHE_PATH_LEN ];
+  char suffixes[ CACHE_MAX_LOGS ][ CACHE_SUFFIX_LEN ];
+
+  num = readEntry( cache, key, NULL, 0, suffixes );
+  entryPath( cache, key, "", path );
+  unlink( path );
+  for( i = 0; i < num; ++i ) {
+
+    entryPath( cache, key, suffixes[ i ], path );
+    unlink( path );
+  }
+}
+
+/* remove the least recently used entries until the cache fits, always
+   keeping the newest */
+static int evictEntries( ResultCache *cache )
+{
+  int i, num;
+  uint64_t totalBytes;
+  CacheEntry *entries;
+
+  if( cache->maxBytes == 0 ) {
+
+    return 0;
+  }
+  num = scanCache( cache, &entries, &totalBytes );
+  if( num < 0 ) {
+
+    return -1;
+  }
+
+  qsort( entries, num, sizeof( CacheEntry ), compareUsed );
+  for( i = 0; i + 1 < num && totalBytes > cache->maxBytes; ++i ) {
+
+    removeEntry( cache, entries[ i ].key );
+    totalBytes -= entries[ i ].bytes;
+    ++cache->evictions;
+  }
+
+  free( entries );
+  return 0;
+}
+
+
+int openResultCache( ResultCache *cache, const char *dir,
+		     const uint64_t maxBytes )
+{
+  struct stat st;
+
+  if( mkdir( dir, 0755 ) < 0 && errno != EEXIST ) {
+
+    fprintf( stderr, "ERROR: could not create cache %s\n", dir );
+    return -1;
+  }
+  if( stat( dir, &st ) < 0 || !S_ISDIR( st.st_mode ) ) {
+
+    fprintf( stderr, "ERROR: cache %s is not a directory\n", dir );
+    return -1;
+  }
+
+  cache->dir = strdup( dir );
+  cache->maxBytes = maxBytes;
+  cache->hits = 0;
+  cache->misses = 0;
+  cache->stores = 0;
+  cache->evictions = 0;
+  return 0;
+}
+
+void closeResultCache( ResultCache *cache )
+{
+  free( cache->dir );
+  cache->dir = NULL;
+}
+
+int makeCacheKey( char key[ CACHE_KEY_LEN + 1 ],
+		  const int numFiles, char **files,
+		  const int numArgs, char **args )
+{
+  int i;
+  uint128_t hash;
+
+  hash = fnvOffset;
+  for( i = 0; i < numFiles; ++i ) {
+
+    if( fnvFile( &hash, files[ i ] ) < 0 ) {
+
+      return -1;
+    }
+  }
+  for( i = 0; i < numArgs; ++i ) {
+
+    /* include the terminating 0, so arguments can't run together */
+    hash = fnvBytes( hash, (const unsigned char *)args[ i ],
+		     strlen( args[ i ] ) + 1 );
+  }
+
+  snprintf( key, CACHE_KEY_LEN + 1, "%016"PRIx64"%016"PRIx64,
+	    (uint64_t)( hash >> 64 ), (uint64_t)hash );
+  return 0;
+}
+
+int cacheLookup( ResultCache *cache, const char *key,
+		 const char *matchName, char *score, const size_t scoreLen )
+{
+  int i, num;
+  char path[ CACHE_PATH_LEN ], logName[ CACHE_PATH_LEN ];
+  char suffixes[ CACHE_MAX_LOGS ][ CACHE_SUFFIX_LEN ];
+
+  num = readEntry( cache, key, score, scoreLen, suffixes );
+  if( num < 0 ) {
+
+    ++cache->misses;
+    return 0;
+  }
+
+  for( i = 0; i < num; ++i ) {
+
+    entryPath( cache, key, suffixes[ i ], path );
+    snprintf( logName, CACHE_PATH_LEN, "%s%s", matchName, suffixes[ i ] );
+    if( copyFile( path, logName ) < 0 ) {
+
+      fprintf( stderr, "ERROR: could not copy %s to %s\n", path, logName );
+      return -1;
+    }
+  }
+
+  /* the entry's modification time is when it was last used */
+  entryPath( cache, key, "", path );
+  utimes( path, NULL );
+  ++cache->hits;
+  return 1;
+}
+
+int cacheStore( ResultCache *cache, const char *key,
+		const char *matchName, const char *score )
+{
+  int i, k, num, found;
+  FILE *file;
+  char path[ CACHE_PATH_LEN ], logName[ CACHE_PATH_LEN ];
+  char tmpPath[ CACHE_PATH_LEN ];
+  char suffixes[ CACHE_MAX_LOGS ][ CACHE_SUFFIX_LEN ];
+  static const char *logSuffixes[ 2 ] = { LOG_SUFFIX, COMPRESSED_LOG_SUFFIX };
+
+  /* the match's own log, and one for each duplicate copy, each of
+     which may be plain or compressed */
+  num = 0;
+  for( k = 0; k < 2 && num < CACHE_MAX_LOGS; ++k ) {
+
+    snprintf( suffixes[ num ], CACHE_SUFFIX_LEN, "%s", logSuffixes[ k ] );
+    snprintf( logName, CACHE_PATH_LEN, "%s%s", matchName, suffixes[ num ] );
+    if( access( logName, R_OK ) == 0 ) {
+
+      ++num;
+    }
+  }
+  for( i = 0; num < CACHE_MAX_LOGS; ++i ) {
+
+    found = 0;
+    for( k = 0; k < 2 && num < CACHE_MAX_LOGS; ++k ) {
+
+      snprintf( suffixes[ num ], CACHE_SUFFIX_LEN, ".dup%d%s",
+		i, logSuffixes[ k ] );
+      snprintf( logName, CACHE_PATH_LEN, "%s%s", matchName, suffixes[ num ] );
+      if( access( logName, R_OK ) == 0 ) {
+
+	++num;
+	found = 1;
+      }
+    }
+    if( !found ) {
+      break;
+    }
+  }
+
+  for( i = 0; i < num; ++i ) {
+
+    snprintf( logName, CACHE_PATH_LEN, "%s%s", matchName, suffixes[ i ] );
+    entryPath( cache, key, suffixes[ i ], path );
+    if( copyFile( logName, path ) < 0 ) {
+
+      fprintf( stderr, "ERROR: could not copy %s to %s\n", logName, path );
+      return -1;
+    }
+  }
+
+  /* the entry goes in last, so it only exists once its logs do */
+  entryPath( cache, key, ".tmp", tmpPath );
+  file = fopen( tmpPath, "w" );
+  if( file == NULL ) {
+
+    fprintf( stderr, "ERROR: could not write %s\n", tmpPath );
+    return -1;
+  }
+  fprintf( file, "%s\n", score );
+  for( i = 0; i < num; ++i ) {
+
+    fprintf( file, "%s\n", suffixes[ i ] );
+  }
+  entryPath( cache, key, "", path );
+  if( fclose( file ) < 0 || rename( tmpPath, path ) < 0 ) {
+
+    fprintf( stderr, "ERROR: could not write %s\n", path );
+    unlink( tmpPath );
+    return -1;
+  }
+  ++cache->stores;
+
+  return evictEntries( cache );
+}
+
+int printCacheStats( ResultCache *cache, FILE *file )
+{
+  int num;
+  uint64_t totalBytes;
+  CacheEntry *entries;
+
+  num = scanCache( cache, &entries, &totalBytes );
+  if( num < 0 ) {
+
+    return -1;
+  }
+  free( entries );
+
+  fprintf( file, "CACHE %s entries %d kb %"PRIu64, cache->dir, num,
+	   ( totalBytes + 1023 ) / 1024 );
+  if( cache->maxBytes ) {
+
+    fprintf( file, " limit_kb %"PRIu64, cache->maxBytes / 1024 );
+  }
+  fprintf( file, " hits %"PRIu64" misses %"PRIu64" stored %"PRIu64
+	   " evicted %"PRIu64"\n", cache->hits, cache->misses, cache->stores,
+	   cache->evictions );
+  return 0;
+}
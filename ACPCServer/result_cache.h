@@ -0,0 +1,75 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#ifndef _RESULT_CACHE_H
+#define _RESULT_CACHE_H
+
+#include <stdio.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+
+
+/* content addressed cache of finished matches
+
+   a match's key is a 128 bit FNV-1a hash over the contents of the
+   files which decide how it plays (the dealer, the game definition,
+   and each player's executable) and its remaining arguments (hands,
+   seed, player names, and dealer options), so a match with
+   deterministic players comes out the same every time it has the same
+   key.  A player started through a script is only keyed on the
+   script, so anything the script runs should be named on its command
+   line or the script changed along with it.
+
+   each entry is a file named by the key in hex, holding the SCORE line
+   and the names of the logs saved with it, which are kept in files
+   named by the key and the log's suffix (".log", or ".dupK.log" for
+   each copy of a duplicate match).  Looking up an entry marks it as
+   used, and storing one removes the least recently used entries until
+   the cache fits in its size limit */
+
+#define CACHE_KEY_LEN 32 /* hex digits */
+
+typedef struct {
+  char *dir;
+  uint64_t maxBytes; /* 0 for no limit */
+
+  /* counts since the cache was opened */
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t stores;
+  uint64_t evictions;
+} ResultCache;
+
+
+/* use dir, which is created if needed, as a cache
+   returns 0 on success, -1 on failure */
+int openResultCache( ResultCache *cache, const char *dir,
+		     const uint64_t maxBytes );
+
+void closeResultCache( ResultCache *cache );
+
+/* fill key with the key for a match, from the contents of numFiles
+   files and the text of numArgs arguments
+   returns 0 on success, -1 if a file could not be read */
+int makeCacheKey( char key[ CACHE_KEY_LEN + 1 ],
+		  const int numFiles, char **files,
+		  const int numArgs, char **args );
+
+/* look for key in the cache, and on a hit copy its logs to
+   matchName<suffix> and its SCORE line to score
+   returns 1 on a hit, 0 on a miss, -1 on failure */
+int cacheLookup( ResultCache *cache, const char *key,
+		 const char *matchName, char *score, const size_t scoreLen );
+
+/* save the logs of matchName and its SCORE line under key, then evict
+   entries as needed
+   returns 0 on success, -1 on failure */
+int cacheStore( ResultCache *cache, const char *key,
+		const char *matchName, const char *score );
+
+/* print the counts and the size of the cache
+   returns 0 on success, -1 on failure */
+int printCacheStats( ResultCache *cache, FILE *file );
+
+#endif
@@ -0,0 +1,447 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "strategy.h"
+
+
+#define TREE_START_SIZE 1024
+
+
+/* add the node for state, and everything below it
+   returns the node's index */
+static int32_t addBettingNode( const Game *game, BettingTree *tree,
+			       uint32_t *size, const State *state )
+{
+  int a;
+  int32_t id, child;
+  Action action;
+  State next;
+
+  if( tree->numNodes == *size ) {
+
+    *size *= 2;
+    tree->nodes = (BettingNode *)realloc( tree->nodes,
+					  sizeof( BettingNode ) * *size );
+    if( tree->nodes == NULL ) {
+
+      fprintf( stderr, "ERROR: could not grow betting tree\n" );
+      exit( EXIT_FAILURE );
+    }
+  }
+  id = tree->numNodes;
+  ++tree->numNodes;
+  tree->nodes[ id ].round = state->round;
+  tree->nodes[ id ].player = currentPlayer( game, state );
+  tree->nodes[ id ].index = tree->roundNodes[ state->round ];
+  ++tree->roundNodes[ state->round ];
+  tree->nodes[ id ].validActions = 0;
+
+  /* the array may move while children are added, so only ever index it */
+  for( a = 0; a < STRATEGY_NUM_ACTIONS; ++a ) {
+
+    tree->nodes[ id ].child[ a ] = -1;
+    action.type = (enum ActionType)a;
+    action.size = 0;
+    if( !isValidAction( game, state, 0, &action ) ) {
+      continue;
+    }
+    tree->nodes[ id ].validActions |= 1 << a;
+
+    next = *state;
+    doAction( game, &action, &next );
+    child = stateFinished( &next ) ? -1
+      : addBettingNode( game, tree, size, &next );
+    tree->nodes[ id ].child[ a ] = child;
+  }
+
+  return id;
+}
+
+int buildBettingTree( const Game *game, BettingTree *tree )
+{
+  uint32_t size;
+  State state;
+
+  if( game->bettingType != limitBetting ) {
+
+    fprintf( stderr, "ERROR: strategies are only for limit games\n" );
+    return -1;
+  }
+
+  size = TREE_START_SIZE;
+  tree->nodes = (BettingNode *)malloc( sizeof( BettingNode ) * size );
+  if( tree->nodes == NULL ) {
+
+    fprintf( stderr, "ERROR: could not allocate betting tree\n" );
+    return -1;
+  }
+  tree->numNodes = 0;
+  tree->numRounds = game->numRounds;
+  memset( tree->roundNodes, 0, sizeof( tree->roundNodes ) );
+
+  initState( game, 0, &state );
+  addBettingNode( game, tree, &size, &state );
+  return 0;
+}
+
+void freeBettingTree( BettingTree *tree )
+{
+  free( tree->nodes );
+  tree->nodes = NULL;
+  tree->numNodes = 0;
+}
+
+int32_t bettingNode( const BettingTree *tree, const State *state )
+{
+  int r, i;
+  int32_t node;
+
+  node = 0;
+  for( r = 0; r <= state->round; ++r ) {
+
+    for( i = 0; i < state->numActions[ r ]; ++i ) {
+
+      node = tree->nodes[ node ].child[ state->action[ r ][ i ].type ];
+      if( node < 0 || node >= tree->numNodes ) {
+
+	return -1;
+      }
+    }
+  }
+
+  /* a tree read from a file might not be sound */
+  if( tree->nodes[ node ].round != state->round
+      || tree->nodes[ node ].index >= tree->roundNodes[ state->round ] ) {
+
+    return -1;
+  }
+  return node;
+}
+
+
+/* fraction of the hole cards an opponent could hold which player's
+   hand beats with the board so far, counting ties as half */
+static double handStrength( const Game *game, const State *state,
+			    const uint8_t player )
+{
+  int i, c, numCards, numHands, ourRank, rank;
+  int idx[ MAX_HOLE_CARDS ];
+  uint8_t opp, used[ MAX_SUITS * MAX_RANKS ];
+  uint8_t deck[ MAX_SUITS * MAX_RANKS ];
+  double wins;
+  State s;
+
+  s = *state;
+  opp = ( player + 1 ) % game->numPlayers;
+
+  /* cards nobody but the opponent could have */
+  memset( used, 0, sizeof( used ) );
+  for( i = 0; i < game->numHoleCards; ++i ) {
+
+    used[ s.holeCards[ player ][ i ] ] = 1;
+  }
+  for( i = 0; i < sumBoardCards( game, s.round ); ++i ) {
+
+    used[ s.boardCards[ i ] ] = 1;
+  }
+  numCards = 0;
+  for( c = 0; c < game->numSuits * game->numRanks; ++c ) {
+
+    i = makeCard( c / game->numSuits, c % game->numSuits );
+    if( !used[ i ] ) {
+
+      deck[ numCards ] = i;
+      ++numCards;
+    }
+  }
+  if( numCards < game->numHoleCards ) {
+
+    return 0.5;
+  }
+
+  /* every combination of numHoleCards cards from the deck */
+  ourRank = rankHand( game, &s, player );
+  for( i = 0; i < game->numHoleCards; ++i ) {
+
+    idx[ i ] = i;
+  }
+  wins = 0.0;
+  numHands = 0;
+  while( 1 ) {
+
+    for( i = 0; i < game->numHoleCards; ++i ) {
+
+      s.holeCards[ opp ][ i ] = deck[ idx[ i ] ];
+    }
+    rank = rankHand( game, &s, opp );
+    wins += ourRank > rank ? 1.0 : ourRank == rank ? 0.5 : 0.0;
+    ++numHands;
+
+    for( i = game->numHoleCards - 1;
+	 i >= 0 && idx[ i ] == numCards - game->numHoleCards + i; --i );
+    if( i < 0 ) {
+      break;
+    }
+    ++idx[ i ];
+    for( ++i; i < game->numHoleCards; ++i ) {
+
+      idx[ i ] = idx[ i - 1 ] + 1;
+    }
+  }
+
+  return wins / numHands;
+}
+
+uint32_t numCardBuckets( const Game *game, const uint8_t round,
+			 const uint32_t strengthBuckets )
+{
+  if( round == 0 && game->numHoleCards == 1 ) {
+
+    return game->numRanks;
+  }
+  if( round == 0 && game->numHoleCards == 2 ) {
+
+    return game->numRanks * game->numRanks;
+  }
+  return strengthBuckets;
+}
+
+uint32_t cardBucket( const Game *game, const State *state,
+		     const uint8_t player, const uint32_t numBuckets )
+{
+  uint8_t hi, lo;
+  uint32_t bucket;
+
+  if( state->round == 0 && game->numHoleCards == 1 ) {
+
+    return rankOfCard( state->holeCards[ player ][ 0 ] );
+  }
+
+  if( state->round == 0 && game->numHoleCards == 2 ) {
+    /* suited hands above the diagonal, others on or below it */
+
+    hi = rankOfCard( state->holeCards[ player ][ 0 ] );
+    lo = rankOfCard( state->holeCards[ player ][ 1 ] );
+    if( hi < lo ) {
+
+      hi = lo;
+      lo = rankOfCard( state->holeCards[ player ][ 0 ] );
+    }
+    if( suitOfCard( state->holeCards[ player ][ 0 ] )
+	== suitOfCard( state->holeCards[ player ][ 1 ] ) ) {
+
+      return hi * game->numRanks + lo;
+    }
+    return lo * game->numRanks + hi;
+  }
+
+  bucket = handStrength( game, state, player ) * numBuckets;
+  return bucket < numBuckets ? bucket : numBuckets - 1;
+}
+
+
+static uint64_t tableBytes( const uint32_t numNodes, const uint32_t numBuckets )
+{
+  return (uint64_t)numNodes * numBuckets * STRATEGY_NUM_ACTIONS
+    * sizeof( uint16_t );
+}
+
+int openStrategy( const char *fileName, const Game *game,
+		  Strategy *strategy )
+{
+  int fd, r;
+  struct stat st;
+  State state;
+  const StrategyHeader *header;
+
+  fd = open( fileName, O_RDONLY );
+  if( fd < 0 || fstat( fd, &st ) < 0 ) {
+
+    fprintf( stderr, "ERROR: could not open strategy %s\n", fileName );
+    if( fd >= 0 ) {
+
+      close( fd );
+    }
+    return -1;
+  }
+  if( st.st_size < sizeof( StrategyHeader ) ) {
+
+    fprintf( stderr, "ERROR: %s is not a strategy\n", fileName );
+    close( fd );
+    return -1;
+  }
+
+  /* pages are read as the strategy is used, in no particular order */
+  strategy->mapLen = st.st_size;
+  strategy->map = mmap( NULL, strategy->mapLen, PROT_READ, MAP_SHARED,
+			fd, 0 );
+  close( fd );
+  if( strategy->map == MAP_FAILED ) {
+
+    fprintf( stderr, "ERROR: could not map strategy %s\n", fileName );
+    return -1;
+  }
+  madvise( strategy->map, strategy->mapLen, MADV_RANDOM );
+
+  /* the tree isn't rebuilt, so only its size and first node are
+     checked against the game */
+  header = (const StrategyHeader *)strategy->map;
+  strategy->header = header;
+  initState( game, 0, &state );
+  if( memcmp( header->magic, STRATEGY_MAGIC, sizeof( header->magic ) )
+      || game->bettingType != limitBetting
+      || header->numRounds != game->numRounds
+      || header->numNodes == 0
+      || header->nodeOffset % sizeof( uint32_t )
+      || header->nodeOffset > strategy->mapLen
+      || (uint64_t)header->numNodes * sizeof( BettingNode )
+      > strategy->mapLen - header->nodeOffset ) {
+
+    fprintf( stderr, "ERROR: %s is not a strategy for this game\n",
+	     fileName );
+    closeStrategy( strategy );
+    return -1;
+  }
+  strategy->tree.nodes = (BettingNode *)
+    ( (char *)strategy->map + header->nodeOffset );
+  strategy->tree.numNodes = header->numNodes;
+  strategy->tree.numRounds = header->numRounds;
+  if( strategy->tree.nodes[ 0 ].round != 0
+      || strategy->tree.nodes[ 0 ].player != currentPlayer( game, &state ) ) {
+
+    fprintf( stderr, "ERROR: %s is not a strategy for this game\n",
+	     fileName );
+    closeStrategy( strategy );
+    return -1;
+  }
+
+  for( r = 0; r < game->numRounds; ++r ) {
+
+    strategy->tree.roundNodes[ r ] = header->roundNodes[ r ];
+    if( header->numBuckets[ r ] == 0
+	|| header->tableOffset[ r ] % sizeof( uint16_t )
+	|| header->tableOffset[ r ] > strategy->mapLen
+	|| tableBytes( header->roundNodes[ r ], header->numBuckets[ r ] )
+	> strategy->mapLen - header->tableOffset[ r ] ) {
+
+      fprintf( stderr, "ERROR: round %d of %s does not fit the game\n",
+	       r + 1, fileName );
+      closeStrategy( strategy );
+      return -1;
+    }
+    strategy->table[ r ] = (const uint16_t *)
+      ( (const char *)strategy->map + header->tableOffset[ r ] );
+  }
+
+  return 0;
+}
+
+void closeStrategy( Strategy *strategy )
+{
+  munmap( strategy->map, strategy->mapLen );
+  strategy->map = NULL;
+}
+
+int writeStrategy( const char *fileName, const Game *game,
+		   const BettingTree *tree,
+		   const uint32_t numBuckets[ MAX_ROUNDS ],
+		   void (*fill)( const Game *game, const BettingNode *node,
+				 const uint32_t bucket, void *arg,
+				 double weights[ STRATEGY_NUM_ACTIONS ] ),
+		   void *arg )
+{
+  int r, a, best;
+  uint32_t n, b, left;
+  uint64_t offset;
+  double total, weights[ STRATEGY_NUM_ACTIONS ];
+  uint16_t entry[ STRATEGY_NUM_ACTIONS ];
+  StrategyHeader header;
+  FILE *file;
+
+  memset( &header, 0, sizeof( header ) );
+  memcpy( header.magic, STRATEGY_MAGIC, sizeof( header.magic ) );
+  header.numRounds = tree->numRounds;
+  header.numNodes = tree->numNodes;
+  header.nodeOffset = sizeof( header );
+  offset = header.nodeOffset + (uint64_t)tree->numNodes * sizeof( BettingNode );
+  for( r = 0; r < tree->numRounds; ++r ) {
+
+    header.roundNodes[ r ] = tree->roundNodes[ r ];
+    header.numBuckets[ r ] = numBuckets[ r ];
+    header.tableOffset[ r ] = offset;
+    offset += tableBytes( tree->roundNodes[ r ], numBuckets[ r ] );
+  }
+
+  file = fopen( fileName, "w" );
+  if( file == NULL ) {
+
+    fprintf( stderr, "ERROR: could not open %s\n", fileName );
+    return -1;
+  }
+  fwrite( &header, sizeof( header ), 1, file );
+  fwrite( tree->nodes, sizeof( BettingNode ), tree->numNodes, file );
+
+  /* nodes of a round are numbered in the same order as the tree */
+  for( r = 0; r < tree->numRounds; ++r ) {
+
+    for( n = 0; n < tree->numNodes; ++n ) {
+
+      if( tree->nodes[ n ].round != r ) {
+	continue;
+      }
+
+      for( b = 0; b < numBuckets[ r ]; ++b ) {
+
+	fill( game, &tree->nodes[ n ], b, arg, weights );
+
+	/* scale the valid actions to add up exactly, putting any
+	   rounding left over on the most likely action */
+	total = 0.0;
+	best = a_call;
+	for( a = 0; a < STRATEGY_NUM_ACTIONS; ++a ) {
+
+	  if( !( tree->nodes[ n ].validActions & ( 1 << a ) )
+	      || weights[ a ] < 0.0 ) {
+
+	    weights[ a ] = 0.0;
+	  }
+	  total += weights[ a ];
+	  if( weights[ a ] > weights[ best ] ) {
+
+	    best = a;
+	  }
+	}
+	if( total <= 0.0 ) {
+
+	  weights[ a_call ] = 1.0;
+	  total = 1.0;
+	  best = a_call;
+	}
+	left = STRATEGY_WEIGHT_TOTAL;
+	for( a = 0; a < STRATEGY_NUM_ACTIONS; ++a ) {
+
+	  entry[ a ] = weights[ a ] / total * STRATEGY_WEIGHT_TOTAL;
+	  left -= entry[ a ];
+	}
+	entry[ best ] += left;
+
+	fwrite( entry, sizeof( entry ), 1, file );
+      }
+    }
+  }
+
+  if( ferror( file ) | fclose( file ) ) {
+
+    fprintf( stderr, "ERROR: could not write %s\n", fileName );
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,121 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#ifndef _STRATEGY_H
+#define _STRATEGY_H
+
+#include <stdio.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include "game.h"
+
+
+/* strategy tables for limit games, indexed by betting node and card
+   bucket
+
+   the betting tree has a node for every sequence of actions where a
+   player still has to act, numbered in depth first order within each
+   round, so a node's index only depends on the game.  The bucket of a
+   player's cards is their suit isomorphic index in the first round
+   (one bucket per rank, or per pair of ranks and suitedness with two
+   hole cards), and afterwards the fraction of the opponents' possible
+   hole cards the player's hand beats right now, cut into a number of
+   equal width buckets.
+
+   a strategy file has a StrategyHeader, the betting tree's nodes, and
+   then a table for each round with STRATEGY_NUM_ACTIONS 16 bit weights
+   for every bucket of every node, one node after another.  The weights
+   of an entry add up to STRATEGY_WEIGHT_TOTAL, and invalid actions have
+   weight 0.  The file is memory mapped, tree and all, so it is ready
+   to play at once however large it is, and players running from the
+   same file share one copy of it. */
+
+#define STRATEGY_MAGIC "ACPCSTR1"
+#define STRATEGY_NUM_ACTIONS NUM_ACTION_TYPES /* fold, call, raise */
+#define STRATEGY_WEIGHT_TOTAL 65535
+
+typedef struct {
+  char magic[ 8 ];
+  uint32_t numRounds;
+  uint32_t numNodes;
+  uint32_t roundNodes[ MAX_ROUNDS ];
+  uint32_t numBuckets[ MAX_ROUNDS ];
+  uint64_t nodeOffset; /* from the start of the file */
+  uint64_t tableOffset[ MAX_ROUNDS ];
+} StrategyHeader;
+
+typedef struct {
+  int32_t child[ STRATEGY_NUM_ACTIONS ]; /* node after action, or -1 */
+  uint32_t index; /* within the node's round */
+  uint8_t round;
+  uint8_t player;
+  uint8_t validActions; /* bit a is set if action a is valid */
+} BettingNode;
+
+typedef struct {
+  BettingNode *nodes; /* node 0 is the start of a hand */
+  uint32_t numNodes;
+  uint8_t numRounds;
+  uint32_t roundNodes[ MAX_ROUNDS ];
+} BettingTree;
+
+typedef struct {
+  void *map;
+  size_t mapLen;
+  const StrategyHeader *header;
+  BettingTree tree; /* nodes are in the map */
+  const uint16_t *table[ MAX_ROUNDS ];
+} Strategy;
+
+
+/* build the betting tree of a limit game
+   returns 0 on success, -1 on failure */
+int buildBettingTree( const Game *game, BettingTree *tree );
+
+void freeBettingTree( BettingTree *tree );
+
+/* returns the node for the player to act in state, or -1 if state
+   doesn't follow the tree */
+int32_t bettingNode( const BettingTree *tree, const State *state );
+
+/* number of card buckets in round, where rounds after the first have
+   strengthBuckets buckets */
+uint32_t numCardBuckets( const Game *game, const uint8_t round,
+			 const uint32_t strengthBuckets );
+
+/* bucket of player's cards in state's round, out of numBuckets */
+uint32_t cardBucket( const Game *game, const State *state,
+		     const uint8_t player, const uint32_t numBuckets );
+
+/* map a strategy file for game
+   returns 0 on success, -1 on failure */
+int openStrategy( const char *fileName, const Game *game,
+		  Strategy *strategy );
+
+void closeStrategy( Strategy *strategy );
+
+/* the STRATEGY_NUM_ACTIONS weights for a node and bucket */
+static inline const uint16_t *strategyWeights( const Strategy *strategy,
+					       const BettingNode *node,
+					       const uint32_t bucket )
+{
+  return &strategy->table[ node->round ]
+    [ ( (uint64_t)node->index
+	* strategy->header->numBuckets[ node->round ] + bucket )
+      * STRATEGY_NUM_ACTIONS ];
+}
+
+/* write a strategy file for tree, with numBuckets buckets in each
+   round, calling fill to get the weights for each node and bucket,
+   which are scaled to add up to STRATEGY_WEIGHT_TOTAL
+   returns 0 on success, -1 on failure */
+int writeStrategy( const char *fileName, const Game *game,
+		   const BettingTree *tree,
+		   const uint32_t numBuckets[ MAX_ROUNDS ],
+		   void (*fill)( const Game *game, const BettingNode *node,
+				 const uint32_t bucket, void *arg,
+				 double weights[ STRATEGY_NUM_ACTIONS ] ),
+		   void *arg );
+
+#endif
@@ -0,0 +1,380 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+/* player for limit games which looks up its actions in a strategy
+   file (see strategy.h), or writes a simple strategy file to play
+
+   each action costs a walk down the betting tree over the actions of
+   the hand so far, the card bucket (worked out once a round), and one
+   lookup in the memory mapped table */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <getopt.h>
+#include "game.h"
+#include "rng.h"
+#include "net.h"
+#include "binary_protocol.h"
+#include "strategy.h"
+
+
+static void printUsage( FILE *file )
+{
+  fprintf( file, "usage: strategy_player [-b] game strategy server port\n" );
+  fprintf( file, "       strategy_player -w buckets game strategy\n" );
+  fprintf( file, "  -b asks the dealer for the binary protocol\n" );
+  fprintf( file, "  -w writes a strategy which bets strong hands and folds weak ones,\n" );
+  fprintf( file, "     with that many hand strength buckets after the first round\n" );
+}
+
+/* rough strength of a bucket in [0,1]: how high the ranks are in the
+   first round, and the bucket's hand strength after that */
+static double bucketStrength( const Game *game, const uint8_t round,
+			      const uint32_t bucket,
+			      const uint32_t numBuckets[ MAX_ROUNDS ] )
+{
+  uint32_t hi, lo;
+  double strength;
+
+  if( round == 0 && game->numHoleCards == 1 ) {
+
+    return (double)bucket / ( game->numRanks - 1 );
+  }
+  if( round == 0 && game->numHoleCards == 2 ) {
+
+    hi = bucket / game->numRanks;
+    lo = bucket % game->numRanks;
+    strength = 0.0;
+    if( hi > lo ) {
+      /* suited */
+
+      strength = 0.05;
+    } else {
+
+      hi = lo;
+      lo = bucket / game->numRanks;
+    }
+    if( hi == lo ) {
+
+      return 0.5 + 0.5 * hi / ( game->numRanks - 1 );
+    }
+    strength += 0.45 * ( hi + lo ) / ( game->numRanks - 1 );
+    return strength < 1.0 ? strength : 1.0;
+  }
+
+  return ( bucket + 0.5 ) / numBuckets[ round ];
+}
+
+/* raise more often with stronger hands, and fold weak ones to a bet */
+static void fillSimpleStrategy( const Game *game, const BettingNode *node,
+				const uint32_t bucket, void *arg,
+				double weights[ STRATEGY_NUM_ACTIONS ] )
+{
+  double strength;
+
+  strength = bucketStrength( game, node->round, bucket, (uint32_t *)arg );
+  weights[ a_raise ] = strength * strength;
+  weights[ a_fold ] = 0.0;
+  if( node->validActions & ( 1 << a_fold ) && strength < 0.5 ) {
+
+    weights[ a_fold ] = 0.5 - strength;
+  }
+  weights[ a_call ] = 1.0 - weights[ a_raise ] - weights[ a_fold ];
+}
+
+int main( int argc, char **argv )
+{
+  int sock, len, r, a, binary, pending;
+  int32_t node;
+  uint32_t writeBuckets, bucket, bucketHand, total, pick;
+  uint8_t bucketRound;
+  uint32_t numBuckets[ MAX_ROUNDS ];
+  uint16_t port;
+  Game *game;
+  BettingTree tree;
+  Strategy strategy;
+  const uint16_t *weights;
+  uint16_t validWeights[ STRATEGY_NUM_ACTIONS ];
+  MatchState state;
+  Action action;
+  FILE *file;
+  ReadBuf *fromServer;
+  struct timeval tv;
+  rng_state_t rng;
+  char *line, response[ MAX_LINE_LEN ], first[ MAX_LINE_LEN ];
+
+  binary = 0;
+  writeBuckets = 0;
+  while( ( r = getopt( argc, argv, "bw:" ) ) != -1 ) {
+
+    if( r == 'b' ) {
+
+      binary = 1;
+    } else if( r != 'w' || sscanf( optarg, "%"SCNu32, &writeBuckets ) < 1
+	       || writeBuckets == 0 ) {
+
+      argc = 0;
+      break;
+    }
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
+
+  if( argc < ( writeBuckets ? 3 : 5 ) ) {
+
+    printUsage( stderr );
+    exit( EXIT_FAILURE );
+  }
+
+  /* get the game */
+  file = fopen( argv[ 1 ], "r" );
+  if( file == NULL ) {
+
+    fprintf( stderr, "ERROR: could not open game %s\n", argv[ 1 ] );
+    exit( EXIT_FAILURE );
+  }
+  game = readGame( file );
+  if( game == NULL ) {
+
+    fprintf( stderr, "ERROR: could not read game %s\n", argv[ 1 ] );
+    exit( EXIT_FAILURE );
+  }
+  fclose( file );
+
+  if( writeBuckets ) {
+
+    if( buildBettingTree( game, &tree ) < 0 ) {
+
+      exit( EXIT_FAILURE );
+    }
+    for( r = 0; r < game->numRounds; ++r ) {
+
+      numBuckets[ r ] = numCardBuckets( game, r, writeBuckets );
+    }
+    if( writeStrategy( argv[ 2 ], game, &tree, numBuckets,
+		       fillSimpleStrategy, numBuckets ) < 0 ) {
+
+      exit( EXIT_FAILURE );
+    }
+    printf( "wrote %s: %"PRIu32" betting nodes\n", argv[ 2 ], tree.numNodes );
+    freeBettingTree( &tree );
+    exit( EXIT_SUCCESS );
+  }
+
+  if( openStrategy( argv[ 2 ], game, &strategy ) < 0 ) {
+
+    exit( EXIT_FAILURE );
+  }
+  for( r = 0; r < game->numRounds; ++r ) {
+
+    numBuckets[ r ] = strategy.header->numBuckets[ r ];
+    if( numBuckets[ r ] != numCardBuckets( game, r, numBuckets[ r ] ) ) {
+
+      fprintf( stderr, "ERROR: %s has the wrong buckets for round %d\n",
+	       argv[ 2 ], r + 1 );
+      exit( EXIT_FAILURE );
+    }
+  }
+
+  /* Initialize the player's random number state using time */
+  gettimeofday( &tv, NULL );
+  init_genrand( &rng, tv.tv_usec );
+
+  /* connect to the dealer */
+  if( sscanf( argv[ 4 ], "%"SCNu16, &port ) < 1 ) {
+
+    fprintf( stderr, "ERROR: invalid port %s\n", argv[ 4 ] );
+    exit( EXIT_FAILURE );
+  }
+  sock = connectTo( argv[ 3 ], port );
+  if( sock < 0 ) {
+
+    exit( EXIT_FAILURE );
+  }
+  fromServer = createReadBuf( sock );
+  if( fromServer == NULL ) {
+
+    fprintf( stderr, "ERROR: could not create socket buffer\n" );
+    exit( EXIT_FAILURE );
+  }
+
+  /* send version string to dealer */
+  pending = 0;
+  if( binary ) {
+    /* a dealer which doesn't do binary just starts sending text */
+
+    r = startBinaryProtocol( fromServer, first, MAX_LINE_LEN );
+    if( r < 0 ) {
+
+      fprintf( stderr, "ERROR: could not start binary protocol\n" );
+      exit( EXIT_FAILURE );
+    }
+    binary = r;
+    pending = !r;
+  } else {
+
+    len = snprintf( response, MAX_LINE_LEN,
+		    "VERSION:%"PRIu32".%"PRIu32".%"PRIu32"\n",
+		    VERSION_MAJOR, VERSION_MINOR, VERSION_REVISION );
+    if( len != 14 || putLine( fromServer, response, len ) != len ) {
+
+      fprintf( stderr, "ERROR: could not get send version to server\n" );
+      exit( EXIT_FAILURE );
+    }
+  }
+
+  /* play the game!
+     line points into fromServer's buffer, so the response is built
+     in a separate buffer */
+  len = 0;
+  line = NULL;
+  bucket = 0;
+  bucketHand = UINT32_MAX;
+  bucketRound = 0;
+  while( 1 ) {
+
+    if( binary ) {
+      /* state is updated in place from each frame */
+
+      r = getBinaryState( fromServer, game, &state, -1 );
+      if( r < 0 ) {
+
+	fprintf( stderr, "ERROR: could not read binary state\n" );
+	exit( EXIT_FAILURE );
+      }
+      if( r == 0 ) {
+
+	break;
+      }
+    } else {
+
+      if( pending ) {
+
+	line = first;
+	pending = 0;
+      } else if( getLineView( fromServer, &line, -1 ) <= 0 ) {
+
+	break;
+      }
+
+      /* ignore comments */
+      if( line[ 0 ] == '#' || line[ 0 ] == ';' ) {
+	continue;
+      }
+
+      len = readMatchState( line, game, &state );
+      if( len < 0 ) {
+
+	fprintf( stderr, "ERROR: could not read state %s", line );
+	exit( EXIT_FAILURE );
+      }
+    }
+
+    if( stateFinished( &state.state ) ) {
+      /* ignore the game over message */
+
+      continue;
+    }
+
+    if( currentPlayer( game, &state.state ) != state.viewingPlayer ) {
+      /* we're not acting */
+
+      continue;
+    }
+
+    node = bettingNode( &strategy.tree, &state.state );
+    if( node < 0 ) {
+
+      fprintf( stderr, "ERROR: state is not in the betting tree\n" );
+      exit( EXIT_FAILURE );
+    }
+
+    /* the cards only change between rounds */
+    if( state.state.handId != bucketHand
+	|| state.state.round != bucketRound ) {
+
+      bucket = cardBucket( game, &state.state, state.viewingPlayer,
+			   numBuckets[ state.state.round ] );
+      bucketHand = state.state.handId;
+      bucketRound = state.state.round;
+    }
+
+    /* sample an action, skipping any which aren't valid here */
+    weights = strategyWeights( &strategy, &strategy.tree.nodes[ node ],
+			       bucket );
+    total = 0;
+    for( a = 0; a < STRATEGY_NUM_ACTIONS; ++a ) {
+
+      action.type = (enum ActionType)a;
+      action.size = 0;
+      validWeights[ a ] = isValidAction( game, &state.state, 0, &action )
+	? weights[ a ] : 0;
+      total += validWeights[ a ];
+    }
+    if( total == 0 ) {
+
+      validWeights[ a_call ] = 1;
+      total = 1;
+    }
+    pick = genrand_int32( &rng ) % total;
+    for( a = 0; a < STRATEGY_NUM_ACTIONS - 1; ++a ) {
+
+      if( pick < validWeights[ a ] ) {
+
+	break;
+      }
+      pick -= validWeights[ a ];
+    }
+    action.type = (enum ActionType)a;
+    action.size = 0;
+
+    /* do the action! */
+    assert( isValidAction( game, &state.state, 0, &action ) );
+    if( binary ) {
+
+      if( putBinaryAction( fromServer, &state, &action ) < 0 ) {
+
+	fprintf( stderr, "ERROR: could not get send response to server\n" );
+	exit( EXIT_FAILURE );
+      }
+      continue;
+    }
+
+    /* copy the state and add a colon, leaving room for an action */
+    if( len + 3 >= MAX_LINE_LEN ) {
+
+      fprintf( stderr, "ERROR: state too long for response %s", line );
+      exit( EXIT_FAILURE );
+    }
+    memcpy( response, line, len );
+    response[ len ] = ':';
+    ++len;
+
+    r = printAction( game, &action, MAX_LINE_LEN - len - 2,
+		     &response[ len ] );
+    if( r < 0 ) {
+
+      fprintf( stderr, "ERROR: line too long after printing action\n" );
+      exit( EXIT_FAILURE );
+    }
+    len += r;
+    response[ len ] = '\r';
+    ++len;
+    response[ len ] = '\n';
+    ++len;
+
+    if( putLine( fromServer, response, len ) != len ) {
+
+      fprintf( stderr, "ERROR: could not get send response to server\n" );
+      exit( EXIT_FAILURE );
+    }
+  }
+
+  closeStrategy( &strategy );
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,266 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "trace.h"
+
+
+/* largest encoded record header: kind, seat, and two 10 byte varints */
+#define TRACE_MAX_HEADER_LEN 22
+
+
+static int writeAll( const int fd, const unsigned char *buf, size_t len )
+{
+  ssize_t r;
+
+  while( len > 0 ) {
+
+    r = write( fd, buf, len );
+    if( r < 0 ) {
+
+      if( errno == EINTR ) {
+
+	continue;
+      }
+      return -1;
+    }
+    buf += r;
+    len -= r;
+  }
+
+  return 0;
+}
+
+static size_t putVarint( unsigned char *buf, uint64_t value )
+{
+  size_t c;
+
+  c = 0;
+  while( value >= 0x80 ) {
+
+    buf[ c++ ] = ( value & 0x7F ) | 0x80;
+    value >>= 7;
+  }
+  buf[ c++ ] = value;
+
+  return c;
+}
+
+/* returns 0 on success, -1 on end of file or a bad varint */
+static int getVarint( FILE *file, uint64_t *value )
+{
+  int c, shift;
+
+  *value = 0;
+  for( shift = 0; shift < 64; shift += 7 ) {
+
+    c = getc( file );
+    if( c == EOF ) {
+
+      return -1;
+    }
+    *value |= (uint64_t)( c & 0x7F ) << shift;
+    if( !( c & 0x80 ) ) {
+
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+TraceWriter *openTrace( const char *fileName, const int append )
+{
+  TraceWriter *trace;
+
+  trace = (TraceWriter*)malloc( sizeof( TraceWriter ) );
+  if( trace == NULL ) {
+
+    return NULL;
+  }
+
+  trace->fd = open( fileName,
+		    O_WRONLY | O_CREAT | ( append ? O_APPEND : O_TRUNC ),
+		    0644 );
+  if( trace->fd < 0 ) {
+
+    free( trace );
+    return NULL;
+  }
+
+  /* start a new session */
+  memcpy( trace->buf, TRACE_MAGIC, TRACE_MAGIC_LEN );
+  trace->fill = TRACE_MAGIC_LEN;
+  trace->lastMicros = 0;
+
+  return trace;
+}
+
+int traceRecord( TraceWriter *trace, const enum TraceKind kind,
+		 const uint8_t seat, const struct timeval *time,
+		 const char *message, const size_t len )
+{
+  int64_t micros, delta;
+
+  if( len > TRACE_MAX_MESSAGE_LEN ) {
+
+    return -1;
+  }
+
+  /* make sure the whole record fits in the buffer, writing the
+     message directly if it is too large to ever fit */
+  if( trace->fill + TRACE_MAX_HEADER_LEN + len > TRACE_BUF_LEN ) {
+
+    if( flushTrace( trace ) < 0 ) {
+
+      return -1;
+    }
+  }
+
+  micros = (int64_t)time->tv_sec * 1000000 + time->tv_usec;
+  delta = micros - trace->lastMicros;
+  trace->lastMicros = micros;
+
+  trace->buf[ trace->fill++ ] = kind;
+  trace->buf[ trace->fill++ ] = seat;
+  trace->fill += putVarint( &trace->buf[ trace->fill ],
+			    ( (uint64_t)delta << 1 ) ^ (uint64_t)( delta >> 63 ) );
+  trace->fill += putVarint( &trace->buf[ trace->fill ], len );
+
+  if( trace->fill + len > TRACE_BUF_LEN ) {
+
+    if( flushTrace( trace ) < 0
+	|| writeAll( trace->fd, (const unsigned char *)message, len ) < 0 ) {
+
+      return -1;
+    }
+    return 0;
+  }
+  memcpy( &trace->buf[ trace->fill ], message, len );
+  trace->fill += len;
+
+  return 0;
+}
+
+int flushTrace( TraceWriter *trace )
+{
+  if( writeAll( trace->fd, trace->buf, trace->fill ) < 0 ) {
+
+    return -1;
+  }
+  trace->fill = 0;
+
+  return 0;
+}
+
+int closeTrace( TraceWriter *trace )
+{
+  int r;
+
+  r = flushTrace( trace );
+  if( close( trace->fd ) < 0 ) {
+
+    r = -1;
+  }
+  free( trace );
+
+  return r;
+}
+
+int readTraceHeader( FILE *file )
+{
+  char magic[ TRACE_MAGIC_LEN ];
+
+  if( fread( magic, 1, TRACE_MAGIC_LEN, file ) != TRACE_MAGIC_LEN
+      || memcmp( magic, TRACE_MAGIC, TRACE_MAGIC_LEN ) ) {
+
+    return -1;
+  }
+
+  return 0;
+}
+
+int readTraceRecord( FILE *file, int64_t *lastMicros, TraceRecord *record )
+{
+  int c;
+  uint64_t v;
+
+  while( ( c = getc( file ) ) == TRACE_MAGIC[ 0 ] ) {
+    /* start of a new session */
+
+    ungetc( c, file );
+    if( readTraceHeader( file ) < 0 ) {
+
+      return -1;
+    }
+    *lastMicros = 0;
+  }
+  if( c == EOF ) {
+
+    return 0;
+  }
+  if( c < trace_to || c > trace_finished ) {
+
+    return -1;
+  }
+  record->kind = (enum TraceKind)c;
+
+  c = getc( file );
+  if( c == EOF ) {
+
+    return -1;
+  }
+  record->seat = c;
+
+  if( getVarint( file, &v ) < 0 ) {
+
+    return -1;
+  }
+  *lastMicros += (int64_t)( v >> 1 ) ^ -(int64_t)( v & 1 );
+  record->time.tv_sec = *lastMicros / 1000000;
+  record->time.tv_usec = *lastMicros % 1000000;
+
+  if( getVarint( file, &v ) < 0 || v > TRACE_MAX_MESSAGE_LEN ) {
+
+    return -1;
+  }
+  record->len = v;
+  if( fread( record->message, 1, record->len, file ) != record->len ) {
+
+    return -1;
+  }
+  record->message[ record->len ] = 0;
+
+  return 1;
+}
+
+int printTraceRecord( FILE *file, const TraceRecord *record )
+{
+  switch( record->kind ) {
+  case trace_to:
+    return fprintf( file, "TO %d at %zu.%.06zu %s", record->seat + 1,
+		    record->time.tv_sec, record->time.tv_usec,
+		    record->message );
+
+  case trace_from:
+    return fprintf( file, "FROM %d at %zu.%06zu %s", record->seat + 1,
+		    record->time.tv_sec, record->time.tv_usec,
+		    record->message );
+
+  case trace_started:
+    return fprintf( file, "STARTED at %zu.%06zu\n",
+		    record->time.tv_sec, record->time.tv_usec );
+
+  case trace_finished:
+    return fprintf( file, "FINISHED at %zu.%06zu\n",
+		    record->time.tv_sec, record->time.tv_usec );
+  }
+
+  return -1;
+}
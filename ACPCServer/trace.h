@@ -0,0 +1,86 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdio.h>
+#include <sys/time.h>
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+
+
+/* binary trace of the messages the dealer exchanges with players
+
+   every time a trace is opened it writes the TRACE_MAGIC bytes, so an
+   appended file holds several sessions, each followed by records of
+     kind (1 byte), seat (1 byte, zero based),
+     time change in microseconds from the previous record (zigzag varint),
+     message length (varint), message bytes
+   where the first record of a session has a time change from 0, so it
+   is absolute.  Kinds never match the first byte of TRACE_MAGIC.
+
+   trace_decode prints exactly the text the dealer would otherwise have
+   printed to standard error for the same records */
+
+#define TRACE_MAGIC "ACPCTRC1"
+#define TRACE_MAGIC_LEN 8
+#define TRACE_BUF_LEN 65536
+#define TRACE_MAX_MESSAGE_LEN 65536
+
+enum TraceKind { trace_to = 1, trace_from = 2,
+		 trace_started = 3, trace_finished = 4 };
+
+typedef struct {
+  int fd;
+  int64_t lastMicros;
+  size_t fill;
+  unsigned char buf[ TRACE_BUF_LEN ];
+} TraceWriter;
+
+typedef struct {
+  enum TraceKind kind;
+  uint8_t seat;
+  struct timeval time;
+  size_t len;
+  char message[ TRACE_MAX_MESSAGE_LEN + 1 ];
+} TraceRecord;
+
+
+/* open fileName for writing a trace, appending to it if append is
+   non-zero and it already exists
+   returns NULL on failure */
+TraceWriter *openTrace( const char *fileName, const int append );
+
+/* add a record to the trace
+   message may be NULL for records without a message
+   returns 0 on success, -1 on failure */
+int traceRecord( TraceWriter *trace, const enum TraceKind kind,
+		 const uint8_t seat, const struct timeval *time,
+		 const char *message, const size_t len );
+
+/* write any buffered records to the file
+   returns 0 on success, -1 on failure */
+int flushTrace( TraceWriter *trace );
+
+/* flush and close the trace, and free the writer
+   returns 0 on success, -1 if the final flush failed */
+int closeTrace( TraceWriter *trace );
+
+/* check for and skip the header at the start of a trace file
+   returns 0 on success, -1 if file is not a trace */
+int readTraceHeader( FILE *file );
+
+/* read the next record, where lastMicros is the time of the previous
+   record and is updated, and should start as 0
+   any session headers in the way are skipped
+   message is NUL terminated
+   returns 1 on success, 0 at the end of the file, -1 on a bad record */
+int readTraceRecord( FILE *file, int64_t *lastMicros, TraceRecord *record );
+
+/* print record in the dealer's text format
+   returns the number of characters printed, or -1 on failure */
+int printTraceRecord( FILE *file, const TraceRecord *record );
+
+#endif
@@ -0,0 +1,65 @@
+/*
+Copyright (C) 2011 by the Computer Poker Research Group, University of Alberta
+*/
+
+/* print a dealer trace file (see trace.h) as the text the dealer
+   would have printed to standard error */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "trace.h"
+
+
+int main( int argc, char **argv )
+{
+  int r;
+  int64_t lastMicros;
+  FILE *file;
+  TraceRecord *record;
+
+  if( argc < 2 ) {
+
+    fprintf( stderr, "usage: trace_decode trace_file\n" );
+    exit( EXIT_FAILURE );
+  }
+
+  file = fopen( argv[ 1 ], "r" );
+  if( file == NULL ) {
+
+    fprintf( stderr, "ERROR: could not open trace file %s\n", argv[ 1 ] );
+    exit( EXIT_FAILURE );
+  }
+  if( readTraceHeader( file ) < 0 ) {
+
+    fprintf( stderr, "ERROR: %s is not a trace file\n", argv[ 1 ] );
+    exit( EXIT_FAILURE );
+  }
+
+  record = (TraceRecord*)malloc( sizeof( TraceRecord ) );
+  if( record == NULL ) {
+
+    fprintf( stderr, "ERROR: could not allocate trace record\n" );
+    exit( EXIT_FAILURE );
+  }
+
+  lastMicros = 0;
+  while( ( r = readTraceRecord( file, &lastMicros, record ) ) > 0 ) {
+
+    if( printTraceRecord( stdout, record ) < 0 ) {
+
+      fprintf( stderr, "ERROR: could not print trace record\n" );
+      exit( EXIT_FAILURE );
+    }
+  }
+  if( r < 0 ) {
+    /* a truncated final record is expected if the dealer was killed */
+
+    fprintf( stderr, "ERROR: bad or truncated record in %s\n", argv[ 1 ] );
+    exit( EXIT_FAILURE );
+  }
+
+  fclose( file );
+  free( record );
+
+  return EXIT_SUCCESS;
+}
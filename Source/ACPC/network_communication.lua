@@ -15,13 +15,22 @@ end
 --- Connects over a network socket.
 -- 
 -- @param server the server that sends states to DeepStack, and to which
--- DeepStack sends actions
--- @param port the port to connect on
+-- DeepStack sends actions, or a `unix:/path` Unix domain socket of a local
+-- dealer
+-- @param port the port to connect on, ignored for Unix domain sockets
 function ACPCNetworkCommunication:connect(server, port)
   server = server or arguments.acpc_server
   port = port or arguments.acpc_server_port
 
-  self.connection = assert(socket.connect(server, port))
+  if server:sub(1, 5) == "unix:" then
+    local unix = require "socket.unix"
+    self.connection = assert(unix())
+    assert(self.connection:connect(server:sub(6)))
+  else
+    assert(server:sub(1, 1) ~= "@",
+      "luasocket cannot connect to abstract sockets, use unix:/path")
+    self.connection = assert(socket.connect(server, port))
+  end
 
   self:_handshake()
 end